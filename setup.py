@@ -20,7 +20,10 @@ macros = dict(
     STARRY_REFINE_J_AT=25,
     STARRY_USE_INCOMPLETE_INTEGRALS=0,
     STARRY_QUAD_POINTS=100,
+    STARRY_QUAD_TOL=1.0e-10,
+    STARRY_QUAD_MAX_LEVEL=8,
     STARRY_EL2_MAX_ITER=100,
+    STARRY_KEPLER_MAX_ITER=100,
 )
 
 # Override with user values
@@ -48,7 +51,11 @@ if debug:
 # Numerical override at high l?
 if bool(int(os.getenv("STARRY_KL_NUMERICAL", 0))):
     macros["STARRY_KL_NUMERICAL"] = 1
-    
+
+# Count heap allocations in the solvers?
+if bool(int(os.getenv("STARRY_COUNT_ALLOCATIONS", 0))):
+    macros["STARRY_COUNT_ALLOCATIONS"] = 1
+
 # Compute the Oren-Nayar (1994) expansion if the user requests it
 deg = os.getenv("STARRY_OREN_NAYAR_DEG", None)
 Nb = os.getenv("STARRY_OREN_NAYAR_NB", None)
@@ -169,6 +176,9 @@ class BuildExt(build_ext):
                 '-DVERSION_INFO="%s"' % self.distribution.get_version()
             )
             opts.append(cpp_flag(self.compiler))
+            if has_flag(self.compiler, "-pthread"):
+                opts.append("-pthread")
+                link_opts.append("-pthread")
             if has_flag(self.compiler, "-fcolor-diagnostics"):
                 opts.append("-fcolor-diagnostics")
         elif ct == "msvc":
@@ -215,7 +225,6 @@ setup(
         "theano>=1.0.4",
         "ipython",
         "pillow",
-        "exoplanet>=0.2.0",
         "packaging"
         # TODO? "healpy>=1.12.8;platform_system!='Windows'",
     ],
@@ -1,5 +1,6 @@
 # -*- coding: utf-8 -*-
 import logging
+from collections import OrderedDict
 
 rootLogger = logging.getLogger("starry")
 rootLogger.addHandler(logging.StreamHandler())
@@ -42,6 +43,42 @@ class ConfigType(type):
         """Enable function profiling in lazy mode."""
         return cls._profile
 
+    @property
+    def cache_size(cls):
+        """Memory budget (in MB) for memoized design matrices.
+
+        In greedy mode, design matrices are cached and keyed on a hash
+        of the non-linear inputs (the orbital geometry, the map
+        orientation, the limb darkening and filter coefficients, etc.),
+        so repeated calls to ``flux`` in which only the spherical harmonic
+        coefficients change reduce to a single matrix-vector product.
+        The least recently used matrices are evicted once the budget is
+        exceeded. Set this to zero to disable (and clear) the cache.
+        """
+        return cls._cache_size
+
+    @property
+    def nthreads(cls):
+        """Number of threads used to compute reflected light occultations.
+
+        Occultations in reflected light are by far the most expensive
+        part of a light curve, so their timesteps may be distributed
+        among several threads. Set this to zero to use all available
+        hardware threads. The default is one, since parallelizing at a
+        higher level (e.g., when running several sampler chains at once)
+        is usually more efficient.
+        """
+        return cls._nthreads
+
+    @nthreads.setter
+    def nthreads(cls, value):
+        cls._nthreads = max(0, int(value))
+
+    @cache_size.setter
+    def cache_size(cls, value):
+        cls._cache_size = max(0, value)
+        cls._memo.resize(int(cls._cache_size * 1024 ** 2))
+
     @quiet.setter
     def quiet(cls, value):
         cls._quiet = value
@@ -74,8 +111,61 @@ class ConfigType(type):
         cls._allow_changes = False
 
 
+class MemoCache(object):
+    """A least-recently-used cache with a memory budget in bytes."""
+
+    def __init__(self, budget):
+        self.budget = budget
+        self.nbytes = 0
+        self.hits = 0
+        self.misses = 0
+        self._data = OrderedDict()
+
+    def __len__(self):
+        return len(self._data)
+
+    def __contains__(self, key):
+        return key in self._data
+
+    def __getitem__(self, key):
+        self._data.move_to_end(key)
+        return self._data[key]
+
+    def get(self, key, default=None):
+        """Look up `key`, counting cache hits and misses."""
+        if key in self._data:
+            self.hits += 1
+            return self[key]
+        self.misses += 1
+        return default
+
+    def __setitem__(self, key, value):
+        nbytes = getattr(value, "nbytes", 0)
+        if nbytes > self.budget:
+            return
+        if key in self._data:
+            self.nbytes -= getattr(self._data.pop(key), "nbytes", 0)
+        self._data[key] = value
+        self.nbytes += nbytes
+        self.resize(self.budget)
+
+    def resize(self, budget):
+        """Set the budget, evicting the oldest entries as needed."""
+        self.budget = budget
+        while self.nbytes > self.budget:
+            _, value = self._data.popitem(last=False)
+            self.nbytes -= getattr(value, "nbytes", 0)
+
+    def clear(self):
+        self._data.clear()
+        self.nbytes = 0
+
+
 class config(metaclass=ConfigType):
     _allow_changes = True
     _lazy = True
     _quiet = False
     _profile = False
+    _cache_size = 256
+    _nthreads = 1
+    _memo = MemoCache(_cache_size * 1024 ** 2)
@@ -6,21 +6,27 @@ from .ops import (
     sTOp,
     rTReflectedOp,
     sTReflectedOp,
+    sTReflectedExtendedOp,
     dotROp,
     tensordotRzOp,
     tensordotDzOp,
     FOp,
+    FdotOp,
     spotYlmOp,
     pTOp,
     minimizeOp,
+    positivityOp,
     LDPhysicalOp,
     LimbDarkOp,
     GetClOp,
     RaiseValueErrorOp,
     RaiseValueErrorIfOp,
     OrenNayarOp,
+    OccultationsOp,
+    KeplerOp,
+    SystemXOp,
 )
-from .utils import logger, autocompile, is_theano
+from .utils import logger, autocompile, memoize, is_theano
 from .math import lazy_math as math
 import theano
 import theano.tensor as tt
@@ -29,17 +35,6 @@ from theano.ifelse import ifelse
 import numpy as np
 from astropy import units
 
-try:  # pragma: no cover
-    from packaging import version
-    import exoplanet
-
-    if version.parse(exoplanet.__version__) < version.parse(
-        STARRY_EXOPLANET_MIN_VERSION
-    ):
-        exoplanet = None
-except ModuleNotFoundError:  # pragma: no cover
-    exoplanet = None
-
 
 __all__ = ["OpsYlm", "OpsLD", "OpsReflected", "OpsRV", "OpsSystem"]
 
@@ -88,30 +83,28 @@ class OpsYlm(object):
         self._tensordotDz = tensordotDzOp(self._c_ops.tensordotDz)
         self._dotR = dotROp(self._c_ops.dotR)
 
-        # Filter
-        # TODO: Make the filter operator sparse
+        # Filter (sparse)
         self._F = FOp(self._c_ops.F, self._c_ops.N, self._c_ops.Ny)
+        self._Fdot = FdotOp(self._c_ops.Fdot, self._c_ops.N)
 
         # Misc
         self._spotYlm = spotYlmOp(self._c_ops.spotYlm, self.ydeg, self.nw)
         self._pT = pTOp(self._c_ops.pT, self.deg)
         if self.nw is None:
             if self._reflected:
-                self._minimize = minimizeOp(
-                    self.unweighted_intensity,
-                    self.P,
-                    self.ydeg,
-                    self.udeg,
-                    self.fdeg,
+                # See the note in `unweighted_intensity`
+                self._minimize = minimizeOp(self._c_ops.minimize, norm=np.pi)
+                self._positivity = positivityOp(
+                    self._c_ops.positivity, norm=np.pi
                 )
             else:
-                self._minimize = minimizeOp(
-                    self.intensity, self.P, self.ydeg, self.udeg, self.fdeg
-                )
+                self._minimize = minimizeOp(self._c_ops.minimize)
+                self._positivity = positivityOp(self._c_ops.positivity)
         else:
             # TODO: Implement minimization for spectral maps?
             self._minimize = None
-        self._LimbDarkIsPhysical = LDPhysicalOp(_c_ops.nroots)
+            self._positivity = None
+        self._LimbDarkIsPhysical = LDPhysicalOp(_c_ops.limbdark_is_physical)
 
     @property
     def rT(self):
@@ -165,6 +158,10 @@ class OpsYlm(object):
     def F(self, u, f):
         return self._F(u, f)
 
+    @autocompile
+    def Fdot(self, u, f, M):
+        return self._Fdot(u, f, M)
+
     @autocompile
     def spotYlm(self, amp, sigma, lat, lon):
         return self._spotYlm(amp, sigma, lat, lon)
@@ -175,7 +172,11 @@ class OpsYlm(object):
 
     @autocompile
     def limbdark_is_physical(self, u):
-        """Return True if the limb darkening profile is physical."""
+        """Return True if the limb darkening profile is physical.
+
+        If `u` is a matrix, each row is checked separately and
+        the result is a mask.
+        """
         return self._LimbDarkIsPhysical(u)
 
     @autocompile
@@ -183,13 +184,28 @@ class OpsYlm(object):
         """Compute the location and value of the intensity minimum."""
         return self._minimize(y)
 
+    @autocompile
+    def get_positivity(self, y):
+        """Check whether the intensity is positive everywhere."""
+        return self._positivity(y)
+
+    @memoize
     @autocompile
     def X(self, theta, xo, yo, zo, ro, inc, obl, u, f, alpha, tau, delta):
         """Compute the light curve design matrix."""
+        return self._X(
+            theta, xo, yo, zo, ro, inc, obl, u, [f], alpha, tau, delta
+        )[0]
+
+    def _X(self, theta, xo, yo, zo, ro, inc, obl, u, fs, alpha, tau, delta):
+        """Compute the light curve design matrix for each filter in `fs`.
+
+        The occultation solution is computed only once and shared
+        among all filters.
+        """
         # Determine shapes
         rows = theta.shape[0]
         cols = self.rTA1.shape[1]
-        X = tt.zeros((rows, cols))
 
         # Compute the occultation mask
         b = tt.sqrt(xo ** 2 + yo ** 2)
@@ -198,49 +214,150 @@ class OpsYlm(object):
         i_rot = tt.arange(b.size)[b_rot]
         i_occ = tt.arange(b.size)[b_occ]
 
-        # Compute filter operator
-        if self.filter:
-            F = self.F(u, f)
-
-        # Rotation operator
-        if self.filter:
-            rTA1 = ts.dot(tt.dot(self.rT, F), self.A1)
-        else:
-            rTA1 = self.rTA1
-        rTA1 = tt.tile(rTA1, (theta[i_rot].shape[0], 1))
-        X = tt.set_subtensor(
-            X[i_rot],
-            self.right_project(
-                rTA1, inc, obl, theta[i_rot], alpha, tau, delta
-            ),
-        )
-
         # Occultation + rotation operator
-        sT = self.sT(b[i_occ], ro)
+        sT = self.sT(b[i_occ], (ro + tt.zeros_like(b))[i_occ])
         sTA = ts.dot(sT, self.A)
         theta_z = tt.arctan2(xo[i_occ], yo[i_occ])
-        sTAR = self.tensordotRz(sTA, theta_z)
-        if self.filter:
-            A1InvFA1 = ts.dot(ts.dot(self.A1Inv, F), self.A1)
-            sTAR = tt.dot(sTAR, A1InvFA1)
-        X = tt.set_subtensor(
-            X[i_occ],
-            self.right_project(
-                sTAR, inc, obl, theta[i_occ], alpha, tau, delta
-            ),
-        )
+        sTAR0 = self.tensordotRz(sTA, theta_z)
 
-        return X
+        Xs = []
+        for f in fs:
+
+            X = tt.zeros((rows, cols))
+
+            # Compute filter operator
+            if self.filter:
+                F = self.F(u, f)
+
+            # Rotation operator
+            if self.filter:
+                rTA1 = ts.dot(ts.dot(self.rT, F), self.A1)
+            else:
+                rTA1 = self.rTA1
+            rTA1 = tt.tile(rTA1, (theta[i_rot].shape[0], 1))
+            X = tt.set_subtensor(
+                X[i_rot],
+                self.right_project(
+                    rTA1, inc, obl, theta[i_rot], alpha, tau, delta
+                ),
+            )
+
+            # Occultation + rotation operator
+            if self.filter:
+                A1InvFA1 = ts.dot(ts.dot(self.A1Inv, F), self.A1)
+                sTAR = ts.dot(sTAR0, A1InvFA1)
+            else:
+                sTAR = sTAR0
+            X = tt.set_subtensor(
+                X[i_occ],
+                self.right_project(
+                    sTAR, inc, obl, theta[i_occ], alpha, tau, delta
+                ),
+            )
+            Xs.append(X)
+
+        return Xs
 
-    @autocompile
     def flux(
         self, theta, xo, yo, zo, ro, inc, obl, y, u, f, alpha, tau, delta
     ):
         """Compute the light curve."""
+        args = (theta, xo, yo, zo, ro, inc, obl, u, f, alpha, tau, delta)
+        if config.cache_size > 0 and not is_theano(y, *args):
+            # Only the final dot product depends on `y`, so we can
+            # reuse the (memoized) design matrix. Filtered maps only
+            # reuse it if it is already in the cache; building it is
+            # more expensive than the matrix-free path in `_flux`.
+            if not (self.filter and self.nw is None):
+                return np.dot(self.X(*args, copy=False), y)
+            X = self.X(*args, copy=False, compute=False)
+            if X is not None:
+                return np.dot(X, y)
+        return self._flux(
+            theta, xo, yo, zo, ro, inc, obl, y, u, f, alpha, tau, delta
+        )
+
+    @autocompile
+    def _flux(
+        self, theta, xo, yo, zo, ro, inc, obl, y, u, f, alpha, tau, delta
+    ):
+        """Compute the light curve."""
+        if self.filter and self.nw is None:
+            return self.filtered_flux(
+                theta, xo, yo, zo, ro, inc, obl, y, u, f, alpha, tau, delta
+            )
         return tt.dot(
             self.X(theta, xo, yo, zo, ro, inc, obl, u, f, alpha, tau, delta), y
         )
 
+    @autocompile
+    def filtered_flux(
+        self, theta, xo, yo, zo, ro, inc, obl, y, u, f, alpha, tau, delta
+    ):
+        """Compute the light curve of a filtered map.
+
+        This is equivalent to ``X . y``, but instead of building the
+        filtered design matrix, we rotate the map and multiply the
+        filter polynomial directly into the map polynomial at each
+        cadence.
+        """
+        return self._filtered_flux(
+            theta, xo, yo, zo, ro, inc, obl, y, u, [f], alpha, tau, delta
+        )[0]
+
+    def _filtered_flux(
+        self, theta, xo, yo, zo, ro, inc, obl, y, u, fs, alpha, tau, delta
+    ):
+        """Compute the light curve of a filtered map for each filter in `fs`.
+
+        The rotated map and the occultation solution are computed only
+        once and shared among all filters.
+        """
+        # Compute the occultation mask
+        b = tt.sqrt(xo ** 2 + yo ** 2)
+        b_rot = tt.ge(b, 1.0 + ro) | tt.le(zo, 0.0) | tt.eq(ro, 0.0)
+        b_occ = tt.invert(b_rot)
+        i_rot = tt.arange(b.size)[b_rot]
+        i_occ = tt.arange(b.size)[b_occ]
+
+        # Rotate the map and apply the filter in the polynomial basis
+        Ry = self.left_project(
+            tt.transpose(tt.tile(y, [theta.shape[0], 1])),
+            inc,
+            obl,
+            theta,
+            alpha,
+            tau,
+            delta,
+        )
+        A1Ry = ts.dot(self.A1, Ry)
+
+        # Occultation + rotation operator
+        sT = self.sT(b[i_occ], (ro + tt.zeros_like(b))[i_occ])
+        sTA = ts.dot(sT, self.A)
+        theta_z = tt.arctan2(xo[i_occ], yo[i_occ])
+        sTAR = self.tensordotRz(sTA, theta_z)
+
+        fluxes = []
+        for f in fs:
+
+            FA1Ry = self.Fdot(u, f, A1Ry)
+            flux = tt.zeros_like(theta)
+
+            # Rotation operator
+            flux = tt.set_subtensor(
+                flux[i_rot], tt.dot(self.rT, FA1Ry[:, i_rot])[0]
+            )
+
+            # Occultation + rotation operator
+            A1InvFA1Ry = ts.dot(self.A1Inv, FA1Ry[:, i_occ])
+            flux = tt.set_subtensor(
+                flux[i_occ], tt.sum(sTAR * tt.transpose(A1InvFA1Ry), axis=1)
+            )
+            fluxes.append(flux)
+
+        return fluxes
+
     @autocompile
     def P(self, lat, lon):
         """Compute the pixelization matrix, no filters or illumination."""
@@ -307,7 +424,7 @@ class OpsYlm(object):
             u0 = tt.zeros_like(u)
             u0 = tt.set_subtensor(u0[0], -1.0)
             A1y = ifelse(
-                ld, tt.dot(self.F(u, f), A1y), tt.dot(self.F(u0, f), A1y)
+                ld, ts.dot(self.F(u, f), A1y), ts.dot(self.F(u0, f), A1y)
             )
 
         # Dot the polynomial into the basis
@@ -375,8 +492,8 @@ class OpsYlm(object):
             u0 = tt.set_subtensor(u0[0], -1.0)
             A1Ry = ifelse(
                 tt.eq(projection, STARRY_ORTHOGRAPHIC_PROJECTION),
-                tt.dot(self.F(u, f), A1Ry),
-                tt.dot(self.F(u0, f0), A1Ry),
+                ts.dot(self.F(u, f), A1Ry),
+                ts.dot(self.F(u0, f0), A1Ry),
             )
 
         # Dot the polynomial into the basis
@@ -387,7 +504,13 @@ class OpsYlm(object):
 
     @autocompile
     def expand_spot(self, amp, sigma, lat, lon):
-        """Return the spherical harmonic expansion of a Gaussian spot."""
+        """Return the spherical harmonic expansion of a Gaussian spot.
+
+        The arguments ``sigma``, ``lat``, and ``lon`` may also be vectors,
+        in which case ``amp`` should have one row per spot and the summed
+        expansion of all the spots is computed in a single call.
+
+        """
         return self.spotYlm(amp, sigma, lat, lon)
 
     @autocompile
@@ -742,11 +865,15 @@ class OpsLD(object):
         # Set up the ops
         self._get_cl = GetClOp()
         self._limbdark = LimbDarkOp()
-        self._LimbDarkIsPhysical = LDPhysicalOp(_c_ops.nroots)
+        self._LimbDarkIsPhysical = LDPhysicalOp(_c_ops.limbdark_is_physical)
 
     @autocompile
     def limbdark_is_physical(self, u):
-        """Return True if the limb darkening profile is physical."""
+        """Return True if the limb darkening profile is physical.
+
+        If `u` is a matrix, each row is checked separately and
+        the result is a mask.
+        """
         return self._LimbDarkIsPhysical(u)
 
     @autocompile
@@ -781,12 +908,13 @@ class OpsLD(object):
 
         # Compute the occultation flux
         los = zo[i_occ]
-        r = ro * tt.ones_like(los)
+        r = (ro + tt.zeros_like(b))[i_occ]
         flux = tt.set_subtensor(
             flux[i_occ], self._limbdark(c_norm, b[i_occ], r, los)[0]
         )
         return flux
 
+    @memoize
     @autocompile
     def X(self, theta, xo, yo, zo, ro, inc, obl, u, f, alpha, tau, delta):
         """
@@ -800,6 +928,17 @@ class OpsLD(object):
         X = tt.reshape(flux, (-1, 1))
         return X
 
+    def _X(self, theta, xo, yo, zo, ro, inc, obl, u, fs, alpha, tau, delta):
+        """Compute the design matrix for each filter in `fs`.
+
+        Since limb-darkened maps cannot be filtered, the design matrix
+        is the same for all filters.
+        """
+        X = self.X(
+            theta, xo, yo, zo, ro, inc, obl, u, fs[0], alpha, tau, delta
+        )
+        return [X for f in fs]
+
     @autocompile
     def render(
         self, res, projection, theta, inc, obl, y, u, f, alpha, tau, delta
@@ -908,18 +1047,49 @@ class OpsRV(OpsYlm):
         self, theta, xo, yo, zo, ro, inc, obl, y, u, veq, alpha, tau, delta
     ):
         """Compute the observed radial velocity anomaly."""
-        # Compute the velocity-weighted intensity
+        # The velocity-weighted filter and the identity filter
         f = self.compute_rv_filter(inc, obl, veq, alpha)
-        Iv = self.flux(
-            theta, xo, yo, zo, ro, inc, obl, y, u, f, alpha, tau, delta
-        )
-
-        # Compute the inverse of the intensity
         f0 = tt.zeros_like(f)
         f0 = tt.set_subtensor(f0[0], np.pi)
-        I = self.flux(
-            theta, xo, yo, zo, ro, inc, obl, y, u, f0, alpha, tau, delta
-        )
+
+        # Compute the velocity-weighted intensity and the intensity
+        # in a single pass over the geometry
+        if self.nw is None:
+            Iv, I = self._filtered_flux(
+                theta,
+                xo,
+                yo,
+                zo,
+                ro,
+                inc,
+                obl,
+                y,
+                u,
+                [f, f0],
+                alpha,
+                tau,
+                delta,
+            )
+        else:
+            Iv, I = [
+                tt.dot(X, y)
+                for X in self._X(
+                    theta,
+                    xo,
+                    yo,
+                    zo,
+                    ro,
+                    inc,
+                    obl,
+                    u,
+                    [f, f0],
+                    alpha,
+                    tau,
+                    delta,
+                )
+            ]
+
+        # Compute the inverse of the intensity
         invI = tt.ones((1,)) / I
         invI = tt.where(tt.isinf(invI), 0.0, invI)
 
@@ -934,6 +1104,9 @@ class OpsReflected(OpsYlm):
         super(OpsReflected, self).__init__(*args, reflected=True, **kwargs)
         self._rT = rTReflectedOp(self._c_ops.rTReflected, self._c_ops.N)
         self._sT = sTReflectedOp(self._c_ops.sTReflected, self._c_ops.N)
+        self._sTExtended = sTReflectedExtendedOp(
+            self._c_ops.sTReflectedExtended, self._c_ops.N
+        )
         self._A1Big = ts.as_sparse_variable(self._c_ops.A1Big)
 
         # Compute grid on unit disk with ~source_npts points
@@ -973,7 +1146,11 @@ class OpsReflected(OpsYlm):
 
     @autocompile
     def sT(self, b, theta, bo, ro, sigr):
-        return self._sT(b, theta, bo, ro, sigr)[0]
+        return self._sT(b, theta, bo, ro, sigr)
+
+    @autocompile
+    def sT_extended(self, b, theta, bo, ro, sigr, w):
+        return self._sTExtended(b, theta, bo, ro, sigr, w)
 
     @autocompile
     def intensity(
@@ -1034,7 +1211,7 @@ class OpsReflected(OpsYlm):
             u0 = tt.zeros_like(u)
             u0 = tt.set_subtensor(u0[0], -1.0)
             A1y = ifelse(
-                ld, tt.dot(self.F(u, f), A1y), tt.dot(self.F(u0, f), A1y)
+                ld, ts.dot(self.F(u, f), A1y), ts.dot(self.F(u0, f), A1y)
             )
 
         # Dot the polynomial into the basis
@@ -1119,7 +1296,7 @@ class OpsReflected(OpsYlm):
             u0 = tt.zeros_like(u)
             u0 = tt.set_subtensor(u0[0], -1.0)
             A1y = ifelse(
-                ld, tt.dot(self.F(u, f), A1y), tt.dot(self.F(u0, f), A1y)
+                ld, ts.dot(self.F(u, f), A1y), ts.dot(self.F(u0, f), A1y)
             )
 
         # Dot the polynomial into the basis.
@@ -1178,7 +1355,7 @@ class OpsReflected(OpsYlm):
         # Rotation operator
         rT = self.rT(b_term[i_rot], sigr)
         if self.filter:
-            rTA1 = ts.dot(tt.dot(rT, F), self.A1)
+            rTA1 = ts.dot(ts.dot(rT, F), self.A1)
         else:
             rTA1 = ts.dot(rT, self.A1)
         theta_z = tt.arctan2(xs[i_rot], ys[i_rot])
@@ -1191,13 +1368,19 @@ class OpsReflected(OpsYlm):
         )
 
         # Occultation + rotation operator
-        sT = self.sT(b_term[i_occ], theta_term[i_occ], bo[i_occ], ro, sigr)
+        sT = self.sT(
+            b_term[i_occ],
+            theta_term[i_occ],
+            bo[i_occ],
+            (ro + tt.zeros_like(bo))[i_occ],
+            sigr,
+        )
         sTA = ts.dot(sT, self.A)
         theta_z = tt.arctan2(xo[i_occ], yo[i_occ])
         sTAR = self.tensordotRz(sTA, theta_z)
         if self.filter:
             A1InvFA1 = ts.dot(ts.dot(self.A1Inv, F), self.A1)
-            sTAR = tt.dot(sTAR, A1InvFA1)
+            sTAR = ts.dot(sTAR, A1InvFA1)
         X = tt.set_subtensor(
             X[i_occ],
             self.right_project(
@@ -1214,6 +1397,130 @@ class OpsReflected(OpsYlm):
         # We're done
         return X
 
+    def X_extended_source(
+        self,
+        theta,
+        xs,
+        ys,
+        zs,
+        Rs,
+        xo,
+        yo,
+        zo,
+        ro,
+        inc,
+        obl,
+        u,
+        f,
+        alpha,
+        tau,
+        delta,
+        sigr,
+    ):
+        """Compute the light curve design matrix for an extended source.
+
+        The design matrix is the average of the point source design
+        matrices over a grid of points on the source disk. Since the map
+        orientation and the occultor geometry are the same for all points,
+        we average the solution vectors *before* rotating them into the
+        frame of the map, so the expensive rotations are only applied
+        once per timestep.
+
+        Each point on the source disk has its own terminator, so the
+        occultation solution and the rotation of the unocculted phase
+        curve are still computed once per point, and their cost scales
+        linearly with ``source_npts``.
+        """
+        # Determine shapes
+        rows = theta.shape[0]
+        cols = (self.ydeg + 1) ** 2
+        X = tt.zeros((rows, cols))
+
+        # Compute the occultation mask
+        bo = tt.sqrt(xo ** 2 + yo ** 2)
+        b_rot = tt.ge(bo, 1.0 + ro) | tt.le(zo, 0.0) | tt.eq(ro, 0.0)
+        b_occ = tt.invert(b_rot)
+        i_rot = tt.arange(bo.size)[b_rot]
+        i_occ = tt.arange(bo.size)[b_occ]
+
+        # Compute filter operator
+        if self.filter:
+            F = self.F(u, f)
+
+        # The effective size of the star as seen by the planet
+        # is smaller. Only include points
+        # that fall on this smaller disk.
+        rs = tt.sqrt(xs ** 2 + ys ** 2 + zs ** 2)
+        Reff = Rs * tt.sqrt(1 - ((Rs - 1) / rs) ** 2)
+        dx = tt.shape_padright(Reff) * self.source_dx
+        dy = tt.shape_padright(Reff) * self.source_dy
+        # Note that the star is *closer* to the planet, hence the - sign
+        dz = -tt.sqrt(Rs ** 2 - dx ** 2 - dy ** 2)
+
+        # Position of each point on the source disk, with one
+        # row per timestep and one column per point
+        xs = tt.shape_padright(xs) + dx
+        ys = tt.shape_padright(ys) + dy
+        zs = tt.shape_padright(zs) + dz
+
+        # Terminator
+        r2 = xs ** 2 + ys ** 2 + zs ** 2
+        b_term = -zs / tt.sqrt(r2)
+        theta_s = tt.arctan2(xs, ys)
+        theta_term = tt.shape_padright(tt.arctan2(xo, yo)) - theta_s
+
+        # Weight by the distance to each point and average
+        w = 1.0 / (self.source_npts * r2)
+
+        # Rotation operator. The terminator is oriented differently
+        # for each point, so we rotate before averaging.
+        rT = self.rT(tt.reshape(b_term[i_rot], (-1,)), sigr)
+        if self.filter:
+            rTA1 = ts.dot(ts.dot(rT, F), self.A1)
+        else:
+            rTA1 = ts.dot(rT, self.A1)
+        rTA1Rz = self.tensordotRz(rTA1, tt.reshape(theta_s[i_rot], (-1,)))
+        rTA1Rz *= tt.reshape(w[i_rot], (-1, 1))
+        rTA1Rz = tt.sum(
+            tt.reshape(
+                rTA1Rz,
+                (i_rot.shape[0], self.source_npts, rTA1Rz.shape[1]),
+            ),
+            axis=1,
+        )
+        X = tt.set_subtensor(
+            X[i_rot],
+            self.right_project(
+                rTA1Rz, inc, obl, theta[i_rot], alpha, tau, delta
+            ),
+        )
+
+        # Occultation + rotation operator. The occultor is at the same
+        # position for all points, so we average in the occultor frame.
+        sT = self.sT_extended(
+            b_term[i_occ],
+            theta_term[i_occ],
+            bo[i_occ],
+            (ro + tt.zeros_like(bo))[i_occ],
+            sigr,
+            w[i_occ],
+        )
+        sTA = ts.dot(sT, self.A)
+        theta_z = tt.arctan2(xo[i_occ], yo[i_occ])
+        sTAR = self.tensordotRz(sTA, theta_z)
+        if self.filter:
+            A1InvFA1 = ts.dot(ts.dot(self.A1Inv, F), self.A1)
+            sTAR = ts.dot(sTAR, A1InvFA1)
+        X = tt.set_subtensor(
+            X[i_occ],
+            self.right_project(
+                sTAR, inc, obl, theta[i_occ], alpha, tau, delta
+            ),
+        )
+
+        return X
+
+    @memoize
     @autocompile
     def X(
         self,
@@ -1260,39 +1567,6 @@ class OpsReflected(OpsYlm):
 
         else:
 
-            # The effective size of the star as seen by the planet
-            # is smaller. Only include points
-            # that fall on this smaller disk.
-            rs = tt.sqrt(xs ** 2 + ys ** 2 + zs ** 2)
-            Reff = Rs * tt.sqrt(1 - ((Rs - 1) / rs) ** 2)
-            dx = tt.shape_padright(Reff) * self.source_dx
-            dy = tt.shape_padright(Reff) * self.source_dy
-            # Note that the star is *closer* to the planet, hence the - sign
-            dz = -tt.sqrt(Rs ** 2 - dx ** 2 - dy ** 2)
-
-            # Compute the illumination for each point on the source disk
-            X = self.X_point_source(
-                tt.reshape(
-                    tt.shape_padright(theta) + tt.zeros_like(dx), (-1,)
-                ),
-                tt.reshape(tt.shape_padright(xs) + dx, (-1,)),
-                tt.reshape(tt.shape_padright(ys) + dy, (-1,)),
-                tt.reshape(tt.shape_padright(zs) + dz, (-1,)),
-                tt.reshape(tt.shape_padright(xo) + tt.zeros_like(dx), (-1,)),
-                tt.reshape(tt.shape_padright(yo) + tt.zeros_like(dx), (-1,)),
-                tt.reshape(tt.shape_padright(zo) + tt.zeros_like(dx), (-1,)),
-                ro,
-                inc,
-                obl,
-                u,
-                f,
-                alpha,
-                tau,
-                delta,
-                sigr,
-            )
-            X = tt.reshape(X, (X.shape[0], -1))
-
             # Point source approximation
             X0 = self.X_point_source(
                 theta,
@@ -1312,28 +1586,32 @@ class OpsReflected(OpsYlm):
                 delta,
                 sigr,
             )
-            X0 = tt.reshape(X0, (X0.shape[0], -1))
 
-            # Average over each profile if Rs != 0
+            # Average over the source disk if Rs != 0
             return ifelse(
                 Rs > 0,
-                ifelse(
-                    tt.shape(theta)[0] > 0,
-                    (
-                        tt.sum(
-                            tt.reshape(
-                                X, (tt.shape(theta)[0], self.source_npts, -1)
-                            ),
-                            axis=1,
-                        )
-                        / self.source_npts
-                    ),
-                    tt.zeros_like(X),
+                self.X_extended_source(
+                    theta,
+                    xs,
+                    ys,
+                    zs,
+                    Rs,
+                    xo,
+                    yo,
+                    zo,
+                    ro,
+                    inc,
+                    obl,
+                    u,
+                    f,
+                    alpha,
+                    tau,
+                    delta,
+                    sigr,
                 ),
                 X0,
             )
 
-    @autocompile
     def flux(
         self,
         theta,
@@ -1356,24 +1634,73 @@ class OpsReflected(OpsYlm):
         sigr,
     ):
         """Compute the reflected light curve."""
-        return tt.dot(
-            self.X(
-                theta,
-                xs,
-                ys,
-                zs,
-                Rs,
-                xo,
-                yo,
-                zo,
-                ro,
-                inc,
-                obl,
-                u,
-                f,
-                alpha,
-                tau,
-                delta,
+        args = (
+            theta,
+            xs,
+            ys,
+            zs,
+            Rs,
+            xo,
+            yo,
+            zo,
+            ro,
+            inc,
+            obl,
+            u,
+            f,
+            alpha,
+            tau,
+            delta,
+            sigr,
+        )
+        if config.cache_size > 0 and not is_theano(y, *args):
+            # Only the final dot product depends on `y`, so we can
+            # reuse the (memoized) design matrix. There is no
+            # matrix-free path in reflected light, so we always do.
+            return np.dot(self.X(*args, copy=False), y)
+        return self._flux(*args[:11], y, *args[11:])
+
+    @autocompile
+    def _flux(
+        self,
+        theta,
+        xs,
+        ys,
+        zs,
+        Rs,
+        xo,
+        yo,
+        zo,
+        ro,
+        inc,
+        obl,
+        y,
+        u,
+        f,
+        alpha,
+        tau,
+        delta,
+        sigr,
+    ):
+        """Compute the reflected light curve."""
+        return tt.dot(
+            self.X(
+                theta,
+                xs,
+                ys,
+                zs,
+                Rs,
+                xo,
+                yo,
+                zo,
+                ro,
+                inc,
+                obl,
+                u,
+                f,
+                alpha,
+                tau,
+                delta,
                 sigr,
             ),
             y,
@@ -1499,8 +1826,8 @@ class OpsReflected(OpsYlm):
         u0 = tt.set_subtensor(u0[0], -1.0)
         A1Ry = ifelse(
             tt.eq(projection, STARRY_ORTHOGRAPHIC_PROJECTION),
-            tt.dot(self.F(u, f), A1Ry),
-            tt.dot(self.F(u0, f0), A1Ry),
+            ts.dot(self.F(u, f), A1Ry),
+            ts.dot(self.F(u0, f0), A1Ry),
         )
 
         # Dot the polynomial into the basis
@@ -1659,13 +1986,33 @@ class OpsSystem(object):
         self.texp = texp
         self.oversample = oversample
         self.order = order
+        self._occultations = OccultationsOp(_c_ops.occultations)
+        self._kepler = KeplerOp(_c_ops.kepler_position)
+        self._invc = 1.0 / c_light if light_delay else 0.0
+
+        # In emitted light, the design matrix of the whole system is
+        # computed by a single C++ engine, so the size of the graph does
+        # not depend on the number of bodies. Limb-darkened maps are
+        # handled as spherical harmonic maps of degree zero.
+        self._system_X = None
+        bodies = [primary] + list(secondaries)
+        if not reflected and all(body.map.nw is None for body in bodies):
+            c_ops = [
+                body.map.ops._c_ops
+                if hasattr(body.map.ops, "_c_ops")
+                else _c_ops.Ops(0, body.map.ops.udeg, 0, 2.0, 1.0e-12)
+                for body in bodies
+            ]
+            self._system_X = SystemXOp(
+                _c_ops.SystemDesignMatrix(c_ops).X,
+                sum(ops.Ny for ops in c_ops),
+            )
 
-        # Require exoplanet
-        assert (
-            exoplanet is not None
-        ), "This class requires exoplanet >= {}.".format(
-            STARRY_EXOPLANET_MIN_VERSION
-        )
+    def _semi_major_axis(self, pri_m, sec_m, sec_porb):
+        """Semi-major axes of the secondary orbits (relative to the primary)."""
+        return (
+            G_grav * (pri_m + sec_m) * sec_porb ** 2 / (4 * np.pi ** 2)
+        ) ** (1.0 / 3)
 
     @autocompile
     def position(
@@ -1682,34 +2029,21 @@ class OpsSystem(object):
         sec_iorb,
     ):
         """Compute the Cartesian positions of all bodies."""
-        orbit = exoplanet.orbits.KeplerianOrbit(
-            period=sec_porb,
-            t0=sec_t0,
-            incl=sec_iorb,
-            ecc=sec_ecc,
-            omega=sec_w,
-            Omega=sec_Omega,
-            m_planet=sec_m,
-            m_star=pri_m,
-            r_star=1.0,  # doesn't matter
-        )
-        # Position of the primary
-        if len(self.secondaries) > 1:
-            x_pri, y_pri, z_pri = tt.sum(orbit.get_star_position(t), axis=-1)
-        else:
-            x_pri, y_pri, z_pri = orbit.get_star_position(t)
+        a = self._semi_major_axis(pri_m, sec_m, sec_porb)
+        elements = (sec_t0, sec_porb, sec_ecc, sec_w, sec_Omega, sec_iorb)
+
+        # Position of the primary, which is the sum of its reflex motions
+        x_pri, y_pri, z_pri = [
+            tt.sum(q, axis=-1, keepdims=True)
+            for q in self._kepler(
+                t, *elements, a * sec_m / (pri_m + sec_m), 0.0
+            )
+        ]
 
         # Positions of the secondaries
-        try:
-            x_sec, y_sec, z_sec = orbit.get_planet_position(
-                t, light_delay=self.light_delay
-            )
-        except TypeError:
-            if self.light_delay:
-                logger.warn(
-                    "This version of `exoplanet` does not model light delays."
-                )
-            x_sec, y_sec, z_sec = orbit.get_planet_position(t)
+        x_sec, y_sec, z_sec = self._kepler(
+            t, *elements, -a * pri_m / (pri_m + sec_m), self._invc
+        )
 
         # Concatenate them
         x = tt.transpose(tt.concatenate((x_pri, x_sec), axis=-1))
@@ -1718,6 +2052,7 @@ class OpsSystem(object):
 
         return x, y, z
 
+    @memoize
     @autocompile
     def X(
         self,
@@ -1756,6 +2091,85 @@ class OpsSystem(object):
         sec_sigr,
     ):
         """Compute the system light curve design matrix."""
+        return self._X(
+            t,
+            pri_r,
+            pri_m,
+            pri_prot,
+            pri_t0,
+            pri_theta0,
+            pri_amp,
+            pri_inc,
+            pri_obl,
+            pri_u,
+            [pri_f],
+            pri_alpha,
+            pri_tau,
+            pri_delta,
+            sec_r,
+            sec_m,
+            sec_prot,
+            sec_t0,
+            sec_theta0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            sec_amp,
+            sec_inc,
+            sec_obl,
+            sec_u,
+            [sec_f],
+            sec_alpha,
+            sec_tau,
+            sec_delta,
+            sec_sigr,
+        )[0]
+
+    def _X(
+        self,
+        t,
+        pri_r,
+        pri_m,
+        pri_prot,
+        pri_t0,
+        pri_theta0,
+        pri_amp,
+        pri_inc,
+        pri_obl,
+        pri_u,
+        pri_fs,
+        pri_alpha,
+        pri_tau,
+        pri_delta,
+        sec_r,
+        sec_m,
+        sec_prot,
+        sec_t0,
+        sec_theta0,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_iorb,
+        sec_amp,
+        sec_inc,
+        sec_obl,
+        sec_u,
+        sec_fs,
+        sec_alpha,
+        sec_tau,
+        sec_delta,
+        sec_sigr,
+    ):
+        """Compute the system light curve design matrix for each filter.
+
+        The filters of the primary are given in the list `pri_fs` and
+        those of the secondaries in the list `sec_fs`. The orbits, the
+        occultation indices, and the occultation solutions are computed
+        only once and shared among all filters.
+        """
         # Exposure time integration?
         if self.texp != 0.0:
 
@@ -1786,27 +2200,17 @@ class OpsSystem(object):
             t = tt.reshape(t, (-1,))
 
         # Compute the relative positions of all bodies
-        orbit = exoplanet.orbits.KeplerianOrbit(
-            period=sec_porb,
-            t0=sec_t0,
-            incl=sec_iorb,
-            ecc=sec_ecc,
-            omega=sec_w,
-            Omega=sec_Omega,
-            m_planet=sec_m,
-            m_star=pri_m,
-            r_star=pri_r,
+        x, y, z = self._kepler(
+            t,
+            sec_t0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            -self._semi_major_axis(pri_m, sec_m, sec_porb),
+            self._invc,
         )
-        try:
-            x, y, z = orbit.get_relative_position(
-                t, light_delay=self.light_delay
-            )
-        except TypeError:
-            if self.light_delay:
-                logger.warn(
-                    "This version of `exoplanet` does not model light delays."
-                )
-            x, y, z = orbit.get_relative_position(t)
 
         # Get all rotational phases
         pri_prot = ifelse(
@@ -1820,137 +2224,249 @@ class OpsSystem(object):
             tt.shape_padleft(t) - tt.shape_padright(sec_t0)
         ) + tt.shape_padright(sec_theta0)
 
+        if self._system_X is not None:
+
+            # Compute the design matrices of all bodies in a single call
+            def stack(pri, sec):
+                return tt.concatenate((tt.reshape(pri, (1,)), sec))
+
+            X = self._system_X(
+                tt.concatenate((tt.shape_padleft(theta_pri), theta_sec)),
+                x,
+                y,
+                z,
+                stack(pri_r, sec_r),
+                stack(pri_inc, sec_inc),
+                stack(pri_obl, sec_obl),
+                pri_u,
+                sec_u,
+                tt.stack(pri_fs),
+                tt.stack(sec_fs),
+                stack(pri_alpha, sec_alpha),
+                stack(pri_tau, sec_tau),
+                stack(pri_delta, sec_delta),
+                stack(pri_amp, sec_amp),
+            )
+            Xs = [X[j] for j in range(len(pri_fs))]
+
+        else:
+
+            Xs = self._X_bodies(
+                t,
+                x,
+                y,
+                z,
+                theta_pri,
+                theta_sec,
+                pri_r,
+                pri_amp,
+                pri_inc,
+                pri_obl,
+                pri_u,
+                pri_fs,
+                pri_alpha,
+                pri_tau,
+                pri_delta,
+                sec_r,
+                sec_amp,
+                sec_inc,
+                sec_obl,
+                sec_u,
+                sec_fs,
+                sec_alpha,
+                sec_tau,
+                sec_delta,
+                sec_sigr,
+            )
+
+        # Sum and return
+        if self.texp == 0.0:
+
+            return Xs
+
+        else:
+
+            stencil = tt.shape_padright(tt.shape_padleft(stencil, 1), 1)
+            return [
+                tt.sum(
+                    stencil * tt.reshape(X, (-1, self.oversample, X.shape[1])),
+                    axis=1,
+                )
+                for X in Xs
+            ]
+
+    def _X_bodies(
+        self,
+        t,
+        x,
+        y,
+        z,
+        theta_pri,
+        theta_sec,
+        pri_r,
+        pri_amp,
+        pri_inc,
+        pri_obl,
+        pri_u,
+        pri_fs,
+        pri_alpha,
+        pri_tau,
+        pri_delta,
+        sec_r,
+        sec_amp,
+        sec_inc,
+        sec_obl,
+        sec_u,
+        sec_fs,
+        sec_alpha,
+        sec_tau,
+        sec_delta,
+        sec_sigr,
+    ):
+        """Compute the system design matrices body by body.
+
+        This is the fallback for the systems the C++ engine does not
+        handle (reflected light and spectral maps). It still builds a
+        separate graph for each body: all occultations of a body are
+        computed in a single call to its design matrix op, so the graph
+        (and the compile time) grows linearly, not quadratically, with
+        the number of bodies.
+        """
         # Compute all the phase curves
-        phase_pri = pri_amp * self.primary.map.ops.X(
-            theta_pri,
-            tt.zeros_like(t),
-            tt.zeros_like(t),
-            tt.zeros_like(t),
-            math.to_tensor(0.0),
-            pri_inc,
-            pri_obl,
-            pri_u,
-            pri_f,
-            pri_alpha,
-            pri_tau,
-            pri_delta,
-        )
+        phase_pri = [
+            pri_amp * X
+            for X in self.primary.map.ops._X(
+                theta_pri,
+                tt.zeros_like(t),
+                tt.zeros_like(t),
+                tt.zeros_like(t),
+                math.to_tensor(0.0),
+                pri_inc,
+                pri_obl,
+                pri_u,
+                pri_fs,
+                pri_alpha,
+                pri_tau,
+                pri_delta,
+            )
+        ]
         if self._reflected:
             phase_sec = [
-                pri_amp
-                * sec_amp[i]
-                * sec.map.ops.X(
-                    theta_sec[i],
-                    -x[:, i] / sec_r[i],
-                    -y[:, i] / sec_r[i],
-                    -z[:, i] / sec_r[i],
-                    pri_r / sec_r[i],  # scaled source radius
-                    tt.zeros_like(x[:, i]),
-                    tt.zeros_like(x[:, i]),
-                    tt.zeros_like(x[:, i]),
-                    math.to_tensor(0.0),  # occultor of zero radius
-                    sec_inc[i],
-                    sec_obl[i],
-                    sec_u[i],
-                    sec_f[i],
-                    sec_alpha[i],
-                    sec_tau[i],
-                    sec_delta[i],
-                    sec_sigr[i],
-                )
+                [
+                    pri_amp
+                    * sec_amp[i]
+                    * sec.map.ops.X(
+                        theta_sec[i],
+                        -x[:, i] / sec_r[i],
+                        -y[:, i] / sec_r[i],
+                        -z[:, i] / sec_r[i],
+                        pri_r / sec_r[i],  # scaled source radius
+                        tt.zeros_like(x[:, i]),
+                        tt.zeros_like(x[:, i]),
+                        tt.zeros_like(x[:, i]),
+                        math.to_tensor(0.0),  # occultor of zero radius
+                        sec_inc[i],
+                        sec_obl[i],
+                        sec_u[i],
+                        sec_f[i],
+                        sec_alpha[i],
+                        sec_tau[i],
+                        sec_delta[i],
+                        sec_sigr[i],
+                    )
+                    for sec_f in sec_fs
+                ]
                 for i, sec in enumerate(self.secondaries)
             ]
         else:
             phase_sec = [
-                sec_amp[i]
-                * sec.map.ops.X(
-                    theta_sec[i],
-                    -x[:, i],
-                    -y[:, i],
-                    -z[:, i],
-                    math.to_tensor(0.0),  # occultor of zero radius
-                    sec_inc[i],
-                    sec_obl[i],
-                    sec_u[i],
-                    sec_f[i],
-                    sec_alpha[i],
-                    sec_tau[i],
-                    sec_delta[i],
-                )
+                [
+                    sec_amp[i] * X
+                    for X in sec.map.ops._X(
+                        theta_sec[i],
+                        -x[:, i],
+                        -y[:, i],
+                        -z[:, i],
+                        math.to_tensor(0.0),  # occultor of zero radius
+                        sec_inc[i],
+                        sec_obl[i],
+                        sec_u[i],
+                        [sec_f[i] for sec_f in sec_fs],
+                        sec_alpha[i],
+                        sec_tau[i],
+                        sec_delta[i],
+                    )
+                ]
                 for i, sec in enumerate(self.secondaries)
             ]
 
-        # Compute any occultations
-        occ_pri = tt.zeros_like(phase_pri)
-        occ_sec = [tt.zeros_like(ps) for ps in phase_sec]
+        # Find the time indices of all occultations in a single pass
+        nbodies = len(self.secondaries) + 1
+        radii = tt.concatenate((tt.reshape(pri_r, (1,)), sec_r))
+        offsets, occ_idx, occultor = self._occultations(x, y, z, radii)
 
-        # Compute the period if we were given a semi-major axis
-        sec_porb = tt.switch(
-            tt.eq(sec_porb, 0.0),
-            (G_grav * (pri_m + sec_m) * sec_porb ** 2 / (4 * np.pi ** 2))
-            ** (1.0 / 3),
-            sec_porb,
-        )
+        # Positions of all bodies (including the primary) relative
+        # to the primary
+        pos = [
+            tt.concatenate((tt.zeros_like(q[:, :1]), q), axis=1)
+            for q in (x, y, z)
+        ]
 
-        # Compute transits across the primary
-        for i, _ in enumerate(self.secondaries):
-            xo = x[:, i] / pri_r
-            yo = y[:, i] / pri_r
-            zo = z[:, i] / pri_r
-            ro = sec_r[i] / pri_r
-            b = tt.sqrt(xo ** 2 + yo ** 2)
-            b_occ = tt.invert(
-                tt.ge(b, 1.0 + ro) | tt.le(zo, 0.0) | tt.eq(ro, 0.0)
-            )
-            idx = tt.arange(b.shape[0])[b_occ]
-            occ_pri = tt.set_subtensor(
-                occ_pri[idx],
-                occ_pri[idx]
-                + pri_amp
-                * self.primary.map.ops.X(
+        def occultations(k):
+            """
+            Time indices, occultor positions, and occultor radii (in units
+            of the radius of body `k`) for all occultations of body `k`.
+
+            """
+            inds = slice(offsets[k * nbodies], offsets[(k + 1) * nbodies])
+            idx = occ_idx[inds]
+            l = occultor[inds]
+            xo, yo, zo = [(q[idx, l] - q[idx, k]) / radii[k] for q in pos]
+            return idx, xo, yo, zo, radii[l] / radii[k]
+
+        # Compute transits across the primary. All occultors are
+        # handled in a single call, so the size of the graph is
+        # linear in the number of bodies.
+        idx, xo, yo, zo, ro = occultations(0)
+        occ_pri = [
+            tt.inc_subtensor(tt.zeros_like(ph)[idx], pri_amp * X - ph[idx])
+            for X, ph in zip(
+                self.primary.map.ops._X(
                     theta_pri[idx],
-                    xo[idx],
-                    yo[idx],
-                    zo[idx],
+                    xo,
+                    yo,
+                    zo,
                     ro,
                     pri_inc,
                     pri_obl,
                     pri_u,
-                    pri_f,
+                    pri_fs,
                     pri_alpha,
                     pri_tau,
                     pri_delta,
-                )
-                - phase_pri[idx],
+                ),
+                phase_pri,
             )
+        ]
 
-        # Compute occultations by the primary
+        # Compute occultations of the secondaries by the primary
+        # and by each other
+        occ_sec = [None for sec in self.secondaries]
         for i, sec in enumerate(self.secondaries):
-
-            xo = -x[:, i] / sec_r[i]
-            yo = -y[:, i] / sec_r[i]
-            zo = -z[:, i] / sec_r[i]
-            ro = pri_r / sec_r[i]
-            b = tt.sqrt(xo ** 2 + yo ** 2)
-            b_occ = tt.invert(
-                tt.ge(b, 1.0 + ro) | tt.le(zo, 0.0) | tt.eq(ro, 0.0)
-            )
-            idx = tt.arange(b.shape[0])[b_occ]
+            idx, xo, yo, zo, ro = occultations(i + 1)
             if self._reflected:
-                occ_sec[i] = tt.set_subtensor(
-                    occ_sec[i][idx],
-                    occ_sec[i][idx]
-                    + pri_amp
+                occ = [
+                    pri_amp
                     * sec_amp[i]
                     * sec.map.ops.X(
                         theta_sec[i, idx],
-                        xo[idx],  # the primary is both the source...
-                        yo[idx],
-                        zo[idx],
-                        ro,
-                        xo[idx],  # ... and the occultor
-                        yo[idx],
-                        zo[idx],
+                        -x[idx, i] / sec_r[i],  # the primary is the source
+                        -y[idx, i] / sec_r[i],
+                        -z[idx, i] / sec_r[i],
+                        pri_r / sec_r[i],
+                        xo,
+                        yo,
+                        zo,
                         ro,
                         sec_inc[i],
                         sec_obl[i],
@@ -1961,113 +2477,39 @@ class OpsSystem(object):
                         sec_delta[i],
                         sec_sigr[i],
                     )
-                    - phase_sec[i][idx],
-                )
+                    for sec_f in sec_fs
+                ]
             else:
-                occ_sec[i] = tt.set_subtensor(
-                    occ_sec[i][idx],
-                    occ_sec[i][idx]
-                    + sec_amp[i]
-                    * sec.map.ops.X(
+                occ = [
+                    sec_amp[i] * X
+                    for X in sec.map.ops._X(
                         theta_sec[i, idx],
-                        xo[idx],
-                        yo[idx],
-                        zo[idx],
+                        xo,
+                        yo,
+                        zo,
                         ro,
                         sec_inc[i],
                         sec_obl[i],
                         sec_u[i],
-                        sec_f[i],
+                        [sec_f[i] for sec_f in sec_fs],
                         sec_alpha[i],
                         sec_tau[i],
                         sec_delta[i],
                     )
-                    - phase_sec[i][idx],
-                )
-
-        # Compute secondary-secondary occultations
-        for i, sec in enumerate(self.secondaries):
-            for j, _ in enumerate(self.secondaries):
-                if i == j:
-                    continue
-                xo = (-x[:, i] + x[:, j]) / sec_r[i]
-                yo = (-y[:, i] + y[:, j]) / sec_r[i]
-                zo = (-z[:, i] + z[:, j]) / sec_r[i]
-                ro = sec_r[j] / sec_r[i]
-                b = tt.sqrt(xo ** 2 + yo ** 2)
-                b_occ = tt.invert(
-                    tt.ge(b, 1.0 + ro) | tt.le(zo, 0.0) | tt.eq(ro, 0.0)
-                )
-                idx = tt.arange(b.shape[0])[b_occ]
-                if self._reflected:
-                    xs = -x[:, i] / sec_r[i]
-                    ys = -y[:, i] / sec_r[i]
-                    zs = -z[:, i] / sec_r[i]
-                    occ_sec[i] = tt.set_subtensor(
-                        occ_sec[i][idx],
-                        occ_sec[i][idx]
-                        + sec_amp[i]
-                        * pri_amp
-                        * sec.map.ops.X(
-                            theta_sec[i, idx],
-                            xs[idx],  # the primary is the source
-                            ys[idx],
-                            zs[idx],
-                            pri_r / sec_r[i],
-                            xo[idx],  # another secondary is the occultor
-                            yo[idx],
-                            zo[idx],
-                            ro,
-                            sec_inc[i],
-                            sec_obl[i],
-                            sec_u[i],
-                            sec_f[i],
-                            sec_alpha[i],
-                            sec_tau[i],
-                            sec_delta[i],
-                            sec_sigr[i],
-                        )
-                        - phase_sec[i][idx],
-                    )
-                else:
-                    occ_sec[i] = tt.set_subtensor(
-                        occ_sec[i][idx],
-                        occ_sec[i][idx]
-                        + sec_amp[i]
-                        * sec.map.ops.X(
-                            theta_sec[i, idx],
-                            xo[idx],
-                            yo[idx],
-                            zo[idx],
-                            ro,
-                            sec_inc[i],
-                            sec_obl[i],
-                            sec_u[i],
-                            sec_f[i],
-                            sec_alpha[i],
-                            sec_tau[i],
-                            sec_delta[i],
-                        )
-                        - phase_sec[i][idx],
-                    )
+                ]
+            occ_sec[i] = [
+                tt.inc_subtensor(tt.zeros_like(ph)[idx], X - ph[idx])
+                for X, ph in zip(occ, phase_sec[i])
+            ]
 
         # Concatenate the design matrices
-        X_pri = phase_pri + occ_pri
-        X_sec = [ps + os for ps, os in zip(phase_sec, occ_sec)]
-        X = tt.horizontal_stack(X_pri, *X_sec)
-
-        # Sum and return
-        if self.texp == 0.0:
-
-            return X
+        Xs = []
+        for j in range(len(pri_fs)):
+            X_pri = phase_pri[j] + occ_pri[j]
+            X_sec = [ps[j] + os[j] for ps, os in zip(phase_sec, occ_sec)]
+            Xs.append(tt.horizontal_stack(X_pri, *X_sec))
 
-        else:
-
-            stencil = tt.shape_padright(tt.shape_padleft(stencil, 1), 1)
-            return tt.sum(
-                stencil * tt.reshape(X, (-1, self.oversample, X.shape[1])),
-                axis=1,
-            )
+        return Xs
 
     @autocompile
     def rv(
@@ -2110,11 +2552,6 @@ class OpsSystem(object):
         keplerian,
     ):
         """Compute the observed system radial velocity (RV maps only)."""
-        # TODO: This method is currently very inefficient, as it
-        # calls `X` twice per call and instantiates an `orbit`
-        # instance up to three separate times per call. We should
-        # re-code the logic from `X()` in here to optimize it.
-
         # Compute the RV filter
         pri_f = self.primary.map.ops.compute_rv_filter(
             pri_inc, pri_obl, pri_veq, pri_alpha
@@ -2133,44 +2570,9 @@ class OpsSystem(object):
         pri_f0 = tt.set_subtensor(pri_f0[0], np.pi)
         sec_f0 = tt.as_tensor_variable([pri_f0 for sec in self.secondaries])
 
-        # Compute the two design matrices
-        X = self.X(
-            t,
-            pri_r,
-            pri_m,
-            pri_prot,
-            pri_t0,
-            pri_theta0,
-            pri_amp,
-            pri_inc,
-            pri_obl,
-            pri_u,
-            pri_f,
-            pri_alpha,
-            pri_tau,
-            pri_delta,
-            sec_r,
-            sec_m,
-            sec_prot,
-            sec_t0,
-            sec_theta0,
-            sec_porb,
-            sec_ecc,
-            sec_w,
-            sec_Omega,
-            sec_iorb,
-            sec_amp,
-            sec_inc,
-            sec_obl,
-            sec_u,
-            sec_f,
-            sec_alpha,
-            sec_tau,
-            sec_delta,
-            sec_sigr,
-        )
-
-        X0 = self.X(
+        # Compute the two design matrices in a single pass, sharing
+        # the orbits and the occultation solutions
+        X, X0 = self._X(
             t,
             pri_r,
             pri_m,
@@ -2181,7 +2583,7 @@ class OpsSystem(object):
             pri_inc,
             pri_obl,
             pri_u,
-            pri_f0,
+            [pri_f, pri_f0],
             pri_alpha,
             pri_tau,
             pri_delta,
@@ -2199,7 +2601,7 @@ class OpsSystem(object):
             sec_inc,
             sec_obl,
             sec_u,
-            sec_f0,
+            [sec_f, sec_f0],
             sec_alpha,
             sec_tau,
             sec_delta,
@@ -2236,31 +2638,33 @@ class OpsSystem(object):
         # The RV anomaly is just the product
         rv = Iv * invI
 
-        # Compute the Keplerian RV
-        orbit = exoplanet.orbits.KeplerianOrbit(
-            period=sec_porb,
-            t0=sec_t0,
-            incl=sec_iorb,
-            ecc=sec_ecc,
-            omega=sec_w,
-            Omega=sec_Omega,
-            m_planet=sec_m,
-            m_star=pri_m,
-            r_star=pri_r,
+        # Compute the Keplerian RV of the primary, K [cos(w + f) + e cos(w)].
+        # We get cos(w + f) from the in-plane position on a unit orbit.
+        x, y, z = self._kepler(
+            t,
+            sec_t0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            tt.ones_like(sec_t0),
+            0.0,
         )
-        return ifelse(
-            keplerian,
-            tt.inc_subtensor(
-                rv[0],
-                tt.reshape(
-                    orbit.get_radial_velocity(
-                        t, output_units=units.m / units.s
-                    ),
-                    (-1,),
-                ),
-            ),
-            rv,
+        cosu = (tt.cos(sec_Omega) * x + tt.sin(sec_Omega) * y) / tt.sqrt(
+            x ** 2 + y ** 2 + z ** 2
+        )
+        K = (
+            (2 * np.pi / sec_porb)
+            * self._semi_major_axis(pri_m, sec_m, sec_porb)
+            * sec_m
+            / (pri_m + sec_m)
+            * tt.sin(sec_iorb)
+            / tt.sqrt(1 - sec_ecc ** 2)
         )
+        rv_kep = tt.sum(K * (cosu + sec_ecc * tt.cos(sec_w)), axis=-1)
+        rv_kep *= (units.R_sun / units.day).to(units.m / units.s)
+        return ifelse(keplerian, tt.inc_subtensor(rv[0], rv_kep), rv)
 
     @autocompile
     def render(
@@ -2302,27 +2706,17 @@ class OpsSystem(object):
     ):
         """Render all of the bodies in the system."""
         # Compute the relative positions of all bodies
-        orbit = exoplanet.orbits.KeplerianOrbit(
-            period=sec_porb,
-            t0=sec_t0,
-            incl=sec_iorb,
-            ecc=sec_ecc,
-            omega=sec_w,
-            Omega=sec_Omega,
-            m_planet=sec_m,
-            m_star=pri_m,
-            r_star=pri_r,
+        x, y, z = self._kepler(
+            t,
+            sec_t0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            -self._semi_major_axis(pri_m, sec_m, sec_porb),
+            self._invc,
         )
-        try:
-            x, y, z = orbit.get_relative_position(
-                t, light_delay=self.light_delay
-            )
-        except TypeError:
-            if self.light_delay:
-                logger.warn(
-                    "This version of `exoplanet` does not model light delays."
-                )
-            x, y, z = orbit.get_relative_position(t)
 
         # Get all rotational phases
         pri_prot = ifelse(
@@ -1,6 +1,8 @@
 # -*- coding: utf-8 -*-
 from .. import config
+from .. import _c_ops
 from .utils import *
+from .ops import CeleriteFactorOp, CeleriteSolveOp
 from .._constants import *
 import theano
 import theano.tensor as tt
@@ -21,12 +23,92 @@ def _cho_solve(cho_A, b):
     return _solve_upper(tt.transpose(cho_A), _solve_lower(cho_A, b))
 
 
+# Quasiseparable (celerite) factorization & solve
+_celerite_factor = CeleriteFactorOp(_c_ops.celerite_factor)
+_celerite_solve = CeleriteSolveOp(_c_ops.celerite_solve)
+
+
+def _celerite_cho_solve(U, P, d, W, b):
+    """Compute C^-1 . b for a factorized celerite covariance."""
+    if b.ndim == 1:
+        return _celerite_solve(U, P, d, W, tt.shape_padright(b))[:, 0]
+    else:
+        return _celerite_solve(U, P, d, W, b)
+
+
+def _map_solution(X, CInvX, flux, mu, LInv):
+    """Compute the MAP coefficients given X and C^-1 . X."""
+    return _map_solution_normal(
+        tt.dot(tt.transpose(X), CInvX),
+        tt.dot(tt.transpose(CInvX), flux),
+        mu,
+        LInv,
+    )
+
+
+def _map_solution_normal(XTCInvX, XTCInvf, mu, LInv):
+    """Compute the MAP coefficients given the normal equations."""
+    # Compute W = X^T . C^-1 . X + L^-1
+    W = XTCInvX
+    if LInv.ndim == 0:
+        W = tt.inc_subtensor(
+            W[tuple((tt.arange(W.shape[0]), tt.arange(W.shape[0])))], LInv
+        )
+        LInvmu = mu * LInv
+    elif LInv.ndim == 1:
+        W = tt.inc_subtensor(
+            W[tuple((tt.arange(W.shape[0]), tt.arange(W.shape[0])))], LInv
+        )
+        LInvmu = mu * LInv
+    else:
+        W += LInv
+        LInvmu = tt.dot(LInv, mu)
+
+    # Compute the max like y and its covariance matrix
+    cho_W = sla.cholesky(W)
+    yhat = _cho_solve(cho_W, XTCInvf + LInvmu)
+    ycov = _cho_solve(cho_W, tt.eye(cho_W.shape[0]))
+    cho_ycov = sla.cholesky(ycov)
+
+    return yhat, cho_ycov
+
+
+def _woodbury_lnlike(X, r, CInvr, U, LInv, lndetC, lndetL):
+    """Compute the marginal likelihood given C^-1 . r and U = C^-1 . X."""
+    # W = X^T . C^-1 . X + L^-1
+    if LInv.ndim == 0:
+        W = tt.dot(tt.transpose(X), U) + LInv * tt.eye(U.shape[1])
+    elif LInv.ndim == 1:
+        W = tt.dot(tt.transpose(X), U) + tt.diag(LInv)
+    else:
+        W = tt.dot(tt.transpose(X), U) + LInv
+    cho_W = sla.cholesky(W)
+
+    # By the Woodbury identity, the quadratic form is
+    # r^T . S^-1 . r = r^T . C^-1 . r - (U^T . r)^T . W^-1 . (U^T . r)
+    UTr = tt.dot(tt.transpose(U), r)
+    z = _solve_lower(cho_W, UTr)
+    rSInvr = tt.sum(r * CInvr) - tt.sum(z * z)
+
+    # Determinant of GP covariance (`lndetL` may be given per body)
+    lndetW = 2 * tt.sum(tt.log(tt.diag(cho_W)))
+    lndetS = lndetW + lndetC + tt.sum(lndetL)
+
+    # Compute the marginal likelihood
+    N = X.shape[0]
+    lnlike = -0.5 * rSInvr
+    lnlike -= 0.5 * lndetS
+    lnlike -= 0.5 * N * tt.log(2 * np.pi)
+
+    return lnlike
+
+
 def _get_covariance(math, linalg, C=None, cho_C=None, N=None):
     """A container for covariance matrices.
 
     Args:
-        C (scalar, vector, or matrix, optional): The covariance.
-            Defaults to None.
+        C (scalar, vector, matrix, or CeleriteCovariance, optional): The
+            covariance. Defaults to None.
         cho_C (matrix, optional): The lower Cholesky factorization of
             the covariance. Defaults to None.
         N (int, optional): The number of rows/columns in the covariance
@@ -43,6 +125,16 @@ def _get_covariance(math, linalg, C=None, cho_C=None, N=None):
         kind = "cholesky"
         N = cho_C.shape[0]
 
+    # User provided a quasiseparable (celerite) covariance
+    elif hasattr(C, "get_celerite_matrices"):
+
+        value = C.get_celerite_matrices(math)
+        cholesky = None
+        inverse = None
+        lndet = None
+        kind = "celerite"
+        N = C.N
+
     # User provided the covariance as a scalar, vector, or matrix
     elif C is not None:
 
@@ -235,34 +327,121 @@ class LinAlgType(type):
         if cho_C.ndim == 0:
             CInvX = X / cho_C ** 2
         elif cho_C.ndim == 1:
-            CInvX = tt.dot(tt.diag(1 / cho_C ** 2), X)
+            CInvX = X / tt.shape_padright(cho_C ** 2)
         else:
             CInvX = _cho_solve(cho_C, X)
 
-        # Compute W = X^T . C^-1 . X + L^-1
-        W = tt.dot(tt.transpose(X), CInvX)
-        if LInv.ndim == 0:
-            W = tt.inc_subtensor(
-                W[tuple((tt.arange(W.shape[0]), tt.arange(W.shape[0])))], LInv
-            )
-            LInvmu = mu * LInv
-        elif LInv.ndim == 1:
-            W = tt.inc_subtensor(
-                W[tuple((tt.arange(W.shape[0]), tt.arange(W.shape[0])))], LInv
-            )
-            LInvmu = mu * LInv
-        else:
-            W += LInv
-            LInvmu = tt.dot(LInv, mu)
+        return _map_solution(X, CInvX, flux, mu, LInv)
+
+    @autocompile
+    def solve_celerite(cls, X, flux, a, U, V, P, mu, LInv):
+        """
+        Compute the maximum a posteriori (MAP) prediction for the
+        spherical harmonic coefficients of a map given a flux timeseries
+        with a quasiseparable (celerite) data covariance.
+
+        Args:
+            X (matrix): The flux design matrix.
+            flux (array): The flux timeseries.
+            a, U, V, P: The celerite representation of the data
+                covariance (see :py:class:`starry.linalg.CeleriteCovariance`).
+            mu (array): The prior mean of the spherical harmonic coefficients.
+            LInv (scalar/vector/matrix): The inverse prior covariance of the
+                spherical harmonic coefficients.
+
+        Returns:
+            The vector of spherical harmonic coefficients corresponding to the
+            MAP solution and the Cholesky factorization of the corresponding
+            covariance matrix.
+
+        """
+        d, W, _ = _celerite_factor(a, U, V, P)
+        CInvX = _celerite_cho_solve(U, P, d, W, X)
+        return _map_solution(X, CInvX, flux, mu, LInv)
+
+    @autocompile
+    def solve_normal(cls, XTCInvX, XTCInvf, mu, LInv):
+        """
+        Compute the maximum a posteriori (MAP) prediction for the
+        spherical harmonic coefficients of a map given the normal
+        equations of the linear problem.
+
+        Args:
+            XTCInvX (matrix): The matrix ``X^T . C^-1 . X``.
+            XTCInvf (array): The vector ``X^T . C^-1 . flux``.
+            mu (array): The prior mean of the spherical harmonic coefficients.
+            LInv (scalar/vector/matrix): The inverse prior covariance of the
+                spherical harmonic coefficients.
+
+        Returns:
+            The vector of spherical harmonic coefficients corresponding to the
+            MAP solution and the Cholesky factorization of the corresponding
+            covariance matrix.
 
-        # Compute the max like y and its covariance matrix
-        cho_W = sla.cholesky(W)
-        M = _cho_solve(cho_W, tt.transpose(CInvX))
-        yhat = tt.dot(M, flux) + _cho_solve(cho_W, LInvmu)
-        ycov = _cho_solve(cho_W, tt.eye(cho_W.shape[0]))
-        cho_ycov = sla.cholesky(ycov)
+        """
+        return _map_solution_normal(XTCInvX, XTCInvf, mu, LInv)
+
+    def normal_equations(cls, get_chunk, CInv, N, chunk_size):
+        """
+        Accumulate the normal equations of the linear problem in chunks.
 
-        return yhat, cho_ycov
+        The design matrix is generated and discarded one block of
+        ``chunk_size`` rows at a time, so the memory footprint is
+        independent of the number of data points. The blocks bypass
+        the design matrix cache, which would otherwise end up holding
+        all of them. Each block is weighted by ``C^-1/2`` in a reusable
+        buffer and added to the normal equations in place with a BLAS
+        rank-k update (``syrk``), so no per-chunk temporaries of the
+        size of the block or of the output are allocated.
+
+        Args:
+            get_chunk (callable): A function that takes a ``slice`` of
+                data point indices and returns the corresponding rows of
+                the design matrix and of the flux vector.
+            CInv (scalar/vector): The inverse of the (diagonal) data
+                covariance.
+            N (int): The number of data points.
+            chunk_size (int): The number of data points per chunk.
+
+        Returns:
+            The matrix ``X^T . C^-1 . X`` and the vector
+            ``X^T . C^-1 . flux``.
+
+        """
+        if cls.lazy:
+            raise ValueError(
+                "Chunked solves are only available in greedy mode."
+            )
+        sqrtCInv = np.sqrt(np.asarray(CInv, dtype=float))
+        XTCInvX = None
+        with no_memoize():
+            for i in range(0, N, chunk_size):
+                inds = slice(i, min(i + chunk_size, N))
+                X, f = get_chunk(inds)
+                if XTCInvX is None:
+                    ncols = X.shape[1]
+                    syrk, gemv = scipy.linalg.blas.get_blas_funcs(
+                        ("syrk", "gemv"), dtype=np.float64
+                    )
+                    XTCInvX = np.zeros((ncols, ncols), order="F")
+                    XTCInvf = np.zeros(ncols)
+                    buf = np.empty((min(chunk_size, N), ncols))
+
+                # Weight the rows by C^-1/2. The C-ordered block is the
+                # Fortran-ordered transpose that BLAS expects.
+                w = sqrtCInv if sqrtCInv.ndim == 0 else sqrtCInv[inds]
+                A = buf[: X.shape[0]]
+                np.multiply(X, np.reshape(w, (-1, 1)), out=A)
+
+                # Accumulate the upper triangle of A^T A and A^T (w f)
+                XTCInvX = syrk(1.0, A.T, beta=1.0, c=XTCInvX, overwrite_c=1)
+                XTCInvf = gemv(
+                    1.0, A.T, w * f, beta=1.0, y=XTCInvf, overwrite_y=1
+                )
+
+        # Fill in the lower triangle
+        XTCInvX = np.triu(XTCInvX) + np.triu(XTCInvX, 1).T
+        return XTCInvX, XTCInvf
 
     @autocompile
     def lnlike(cls, X, flux, C, mu, L):
@@ -345,44 +524,56 @@ class LinAlgType(type):
         # Residual vector
         r = tt.reshape(flux - gp_mu, (-1, 1))
 
-        # Inverse of GP covariance via Woodbury identity
+        # Compute C^-1 . r and U = C^-1 . X without forming
+        # any N x N intermediates
         if CInv.ndim == 0:
+            CInvr = r * CInv
             U = X * CInv
         elif CInv.ndim == 1:
-            U = tt.dot(tt.diag(CInv), X)
+            CInvr = r * tt.shape_padright(CInv)
+            U = X * tt.shape_padright(CInv)
         else:
+            CInvr = tt.dot(CInv, r)
             U = tt.dot(CInv, X)
 
-        if LInv.ndim == 0:
-            W = tt.dot(tt.transpose(X), U) + LInv * tt.eye(U.shape[1])
-        elif LInv.ndim == 1:
-            W = tt.dot(tt.transpose(X), U) + tt.diag(LInv)
-        else:
-            W = tt.dot(tt.transpose(X), U) + LInv
-        cho_W = sla.cholesky(W)
+        return _woodbury_lnlike(X, r, CInvr, U, LInv, lndetC, lndetL)
 
-        if CInv.ndim == 0:
-            SInv = CInv * tt.eye(U.shape[0]) - tt.dot(
-                U, _cho_solve(cho_W, tt.transpose(U))
-            )
-        elif CInv.ndim == 1:
-            SInv = tt.diag(CInv) - tt.dot(
-                U, _cho_solve(cho_W, tt.transpose(U))
-            )
-        else:
-            SInv = CInv - tt.dot(U, _cho_solve(cho_W, tt.transpose(U)))
+    @autocompile
+    def lnlike_celerite(cls, X, flux, a, U, V, P, mu, LInv, lndetL):
+        """
+        Compute the log marginal likelihood of the data given a design matrix
+        and a quasiseparable (celerite) data covariance.
+
+        Args:
+            X (matrix): The flux design matrix.
+            flux (array): The flux timeseries.
+            a, U, V, P: The celerite representation of the data
+                covariance (see :py:class:`starry.linalg.CeleriteCovariance`).
+            mu (array): The prior mean of the spherical harmonic coefficients.
+            LInv (scalar/vector/matrix): The inverse prior covariance of the
+                spherical harmonic coefficients.
+            lndetL (scalar/vector): The log determinant of the prior
+                covariance.
 
-        # Determinant of GP covariance
-        lndetW = 2 * tt.sum(tt.log(tt.diag(cho_W)))
-        lndetS = lndetW + lndetC + lndetL
+        Returns:
+            The log marginal likelihood of the `flux` vector conditioned on
+            the design matrix `X`. All operations involving the data
+            covariance are O(N J^2), where J is the number of celerite terms.
 
-        # Compute the marginal likelihood
-        N = X.shape[0]
-        lnlike = -0.5 * tt.dot(tt.transpose(r), tt.dot(SInv, r))
-        lnlike -= 0.5 * lndetS
-        lnlike -= 0.5 * N * tt.log(2 * np.pi)
+        """
+        # Factorize the data covariance
+        d, W, _ = _celerite_factor(a, U, V, P)
+        lndetC = tt.sum(tt.log(d))
+
+        # Compute C^-1 . r and C^-1 . X in a single pass
+        r = tt.reshape(flux - tt.dot(X, mu), (-1, 1))
+        CInvrX = _celerite_cho_solve(
+            U, P, d, W, tt.concatenate((r, X), axis=1)
+        )
+        CInvr = CInvrX[:, :1]
+        CInvX = CInvrX[:, 1:]
 
-        return lnlike[0, 0]
+        return _woodbury_lnlike(X, r, CInvr, CInvX, LInv, lndetC, lndetL)
 
     @autocompile
     def _cho_solve(cls, cho_A, b):
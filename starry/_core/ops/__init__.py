@@ -1,5 +1,6 @@
 # -*- coding: utf-8 -*-
 from .exceptions import *
+from .celerite import *
 from .diffrot import *
 from .filter import *
 from .integration import *
@@ -8,3 +9,4 @@ from .minimize import *
 from .polybasis import *
 from .rotation import *
 from .spot import *
+from .system import *
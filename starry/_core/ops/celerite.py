@@ -0,0 +1,108 @@
+# -*- coding: utf-8 -*-
+from __future__ import division, print_function
+import numpy as np
+from theano import gof
+import theano.tensor as tt
+from theano.gradient import DisconnectedType
+
+
+__all__ = ["CeleriteFactorOp", "CeleriteSolveOp"]
+
+
+class CeleriteFactorOp(tt.Op):
+    def __init__(self, func):
+        self.func = func
+        self._grad_op = CeleriteFactorGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [
+            tt.TensorType(inputs[-1].dtype, (False,))(),
+            tt.TensorType(inputs[-1].dtype, (False, False))(),
+            tt.TensorType(inputs[-1].dtype, (False, False))(),
+        ]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return [
+            shapes[0],
+            shapes[1],
+            (shapes[1][0], shapes[1][1] * shapes[1][1]),
+        ]
+
+    def perform(self, node, inputs, outputs):
+        d, W, S = self.func(*inputs)
+        outputs[0][0] = np.reshape(d, np.shape(inputs[0]))
+        outputs[1][0] = W
+        outputs[2][0] = S
+
+    def grad(self, inputs, gradients):
+        results = self(*inputs)
+        bd, bW = gradients[:2]
+        if isinstance(bd.type, DisconnectedType):
+            bd = tt.zeros_like(results[0])
+        if isinstance(bW.type, DisconnectedType):
+            bW = tt.zeros_like(results[1])
+        return self._grad_op(*(inputs + results + [bd, bW]))
+
+
+class CeleriteFactorGradientOp(tt.Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:4]]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return shapes[:4]
+
+    def perform(self, node, inputs, outputs):
+        ba, bU, bV, bP = self.base_op.func(*inputs)
+        outputs[0][0] = np.reshape(ba, np.shape(inputs[0]))
+        outputs[1][0] = np.reshape(bU, np.shape(inputs[1]))
+        outputs[2][0] = np.reshape(bV, np.shape(inputs[2]))
+        outputs[3][0] = np.reshape(bP, np.shape(inputs[3]))
+
+
+class CeleriteSolveOp(tt.Op):
+    def __init__(self, func):
+        self.func = func
+        self._grad_op = CeleriteSolveGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.TensorType(inputs[-1].dtype, (False, False))()]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return [shapes[4]]
+
+    def perform(self, node, inputs, outputs):
+        Z = self.func(*inputs)
+        outputs[0][0] = np.reshape(Z, np.shape(inputs[4]))
+
+    def grad(self, inputs, gradients):
+        return self._grad_op(*(inputs + [gradients[0]]))
+
+
+class CeleriteSolveGradientOp(tt.Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:5]]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return shapes[:5]
+
+    def perform(self, node, inputs, outputs):
+        bU, bP, bd, bW, bY = self.base_op.func(*inputs)
+        outputs[0][0] = np.reshape(bU, np.shape(inputs[0]))
+        outputs[1][0] = np.reshape(bP, np.shape(inputs[1]))
+        outputs[2][0] = np.reshape(bd, np.shape(inputs[2]))
+        outputs[3][0] = np.reshape(bW, np.shape(inputs[3]))
+        outputs[4][0] = np.reshape(bY, np.shape(inputs[4]))
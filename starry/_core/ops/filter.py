@@ -7,7 +7,7 @@ import theano.sparse as ts
 from ..._c_ops import STARRY_OREN_NAYAR_DEG
 
 
-__all__ = ["FOp", "OrenNayarOp"]
+__all__ = ["FOp", "FdotOp", "OrenNayarOp"]
 
 
 class FOp(tt.Op):
@@ -19,7 +19,7 @@ class FOp(tt.Op):
 
     def make_node(self, *inputs):
         inputs = [tt.as_tensor_variable(i) for i in inputs]
-        outputs = [tt.TensorType(inputs[-1].dtype, (False, False))()]
+        outputs = [ts.csc_matrix(dtype=inputs[-1].dtype)]
         return gof.Apply(self, inputs, outputs)
 
     def infer_shape(self, node, shapes):
@@ -34,7 +34,10 @@ class FOp(tt.Op):
         outputs[0][0] = self.func(*inputs)
 
     def grad(self, inputs, gradients):
-        return self._grad_op(*(inputs + gradients))
+        bF = gradients[0]
+        if ts.basic._is_sparse_variable(bF):
+            bF = ts.dense_from_sparse(bF)
+        return self._grad_op(*(inputs + [bF]))
 
 
 class FGradientOp(tt.Op):
@@ -55,6 +58,51 @@ class FGradientOp(tt.Op):
         outputs[1][0] = np.reshape(bf, np.shape(inputs[1]))
 
 
+class FdotOp(tt.Op):
+    def __init__(self, func, N):
+        self.func = func
+        self.N = N
+        self._grad_op = FdotGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.TensorType(inputs[-1].dtype, (False, False))()]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return [(self.N, shapes[2][1])]
+
+    def R_op(self, inputs, eval_points):
+        if eval_points[0] is None:
+            return eval_points
+        return self.grad(inputs, eval_points)
+
+    def perform(self, node, inputs, outputs):
+        outputs[0][0] = self.func(*inputs)
+
+    def grad(self, inputs, gradients):
+        return self._grad_op(*(inputs + gradients))
+
+
+class FdotGradientOp(tt.Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:-1]]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return shapes[:-1]
+
+    def perform(self, node, inputs, outputs):
+        bu, bf, bM = self.base_op.func(*inputs)
+        outputs[0][0] = np.reshape(bu, np.shape(inputs[0]))
+        outputs[1][0] = np.reshape(bf, np.shape(inputs[1]))
+        outputs[2][0] = np.reshape(bM, np.shape(inputs[2]))
+
+
 class OrenNayarOp(tt.Op):
     def __init__(self, func):
         self.func = func
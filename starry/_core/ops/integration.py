@@ -3,9 +3,11 @@ from __future__ import division, print_function
 import numpy as np
 from theano import gof
 import theano.tensor as tt
+from ... import config
+from ..utils import reuse_output
 
 
-__all__ = ["sTOp", "rTReflectedOp", "sTReflectedOp"]
+__all__ = ["sTOp", "rTReflectedOp", "sTReflectedOp", "sTReflectedExtendedOp"]
 
 
 class sTOp(tt.Op):
@@ -28,7 +30,13 @@ class sTOp(tt.Op):
         return self.grad(inputs, eval_points)
 
     def perform(self, node, inputs, outputs):
-        outputs[0][0] = self.func(*inputs)
+        b, r = inputs
+        if np.ndim(b) == 1:
+            out = reuse_output(outputs[0], (len(b), self.N))
+            self.func(b, np.atleast_1d(r), out=out)
+            outputs[0][0] = out
+        else:
+            outputs[0][0] = self.func(b, np.atleast_1d(r))
 
     def grad(self, inputs, gradients):
         return self._grad_op(*(inputs + gradients))
@@ -47,7 +55,8 @@ class sTGradientOp(tt.Op):
         return shapes[:-1]
 
     def perform(self, node, inputs, outputs):
-        bb, br = self.base_op.func(*inputs)
+        b, r, bsT = inputs
+        bb, br = self.base_op.func(b, np.atleast_1d(r), bsT)
         outputs[0][0] = np.reshape(bb, np.shape(inputs[0]))
         outputs[1][0] = np.reshape(br, np.shape(inputs[1]))
 
@@ -120,25 +129,11 @@ class sTReflectedOp(tt.Op):
 
     def make_node(self, *inputs):
         inputs = [tt.as_tensor_variable(i) for i in inputs]
-        outputs = [
-            tt.TensorType(inputs[-1].dtype, (False, False))(),
-            tt.TensorType(inputs[-1].dtype, (False, False))(),
-            tt.TensorType(inputs[-1].dtype, (False, False))(),
-            tt.TensorType(inputs[-1].dtype, (False, False))(),
-            tt.TensorType(inputs[-1].dtype, (False, False))(),
-            tt.TensorType(inputs[-1].dtype, (False, False))(),
-        ]
+        outputs = [tt.TensorType(inputs[-1].dtype, (False, False))()]
         return gof.Apply(self, inputs, outputs)
 
     def infer_shape(self, node, shapes):
-        return [
-            shapes[0] + (tt.as_tensor(self.N),),
-            shapes[0] + (tt.as_tensor(self.N),),
-            shapes[0] + (tt.as_tensor(self.N),),
-            shapes[0] + (tt.as_tensor(self.N),),
-            shapes[0] + (tt.as_tensor(self.N),),
-            shapes[0] + (tt.as_tensor(self.N),),
-        ]
+        return [shapes[0] + (tt.as_tensor(self.N),)]
 
     def R_op(self, inputs, eval_points):
         if eval_points[0] is None:
@@ -147,20 +142,19 @@ class sTReflectedOp(tt.Op):
 
     def perform(self, node, inputs, outputs):
         b, theta, bo, ro, sigr = inputs
-        sT, ddb, ddtheta, ddbo, ddro, ddsigr = self.func(
-            b, theta, bo, ro, sigr
-        )
-        outputs[0][0] = sT
-        outputs[1][0] = ddb
-        outputs[2][0] = ddtheta
-        outputs[3][0] = ddbo
-        outputs[4][0] = ddro
-        outputs[5][0] = ddsigr
+        if np.ndim(b) == 1:
+            out = reuse_output(outputs[0], (len(b), self.N))
+            self.func(
+                b, theta, bo, np.atleast_1d(ro), sigr, config.nthreads, out=out
+            )
+            outputs[0][0] = out
+        else:
+            outputs[0][0] = self.func(
+                b, theta, bo, np.atleast_1d(ro), sigr, config.nthreads
+            )
 
     def grad(self, inputs, gradients):
-        results = self(*inputs)
-        grad = self._grad_op(*(inputs + results + [gradients[0]]))
-        return grad
+        return self._grad_op(*(inputs + gradients))
 
 
 class sTReflectedGradientOp(tt.Op):
@@ -169,34 +163,77 @@ class sTReflectedGradientOp(tt.Op):
 
     def make_node(self, *inputs):
         inputs = [tt.as_tensor_variable(i) for i in inputs]
-        outputs = [i.type() for i in inputs[:5]]
+        outputs = [i.type() for i in inputs[:-1]]
         return gof.Apply(self, inputs, outputs)
 
     def infer_shape(self, node, shapes):
-        return shapes[:5]
+        return shapes[:-1]
 
     def perform(self, node, inputs, outputs):
-        (
-            b,
-            theta,
-            bo,
-            ro,
-            sigr,
-            sT,
-            ddb,
-            ddtheta,
-            ddbo,
-            ddro,
-            ddsigr,
-            bsT,
-        ) = inputs
-        bb = (bsT * ddb).sum(-1)
-        btheta = (bsT * ddtheta).sum(-1)
-        bbo = (bsT * ddbo).sum(-1)
-        bro = (bsT * ddro).sum()
-        bsigr = (bsT * ddsigr).sum()
+        b, theta, bo, ro, sigr, bsT = inputs
+        bb, btheta, bbo, bro, bsigr = self.base_op.func(
+            b, theta, bo, np.atleast_1d(ro), sigr, bsT, config.nthreads
+        )
+        outputs[0][0] = np.reshape(bb, np.shape(b))
+        outputs[1][0] = np.reshape(btheta, np.shape(theta))
+        outputs[2][0] = np.reshape(bbo, np.shape(bo))
+        outputs[3][0] = np.array(np.reshape(bro, np.shape(ro)))
+        outputs[4][0] = np.array(np.reshape(bsigr, np.shape(sigr)))
+
+
+class sTReflectedExtendedOp(tt.Op):
+    """Reflected light occultation solution for an extended source.
+
+    The inputs `b` and `theta` have one row per timestep and one column
+    per point on the source; the output is the sum over the points of
+    the point source solutions weighted by `w`.
+    """
+
+    def __init__(self, func, N):
+        self.func = func
+        self.N = N
+        self._grad_op = sTReflectedExtendedGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.TensorType(inputs[-1].dtype, (False, False))()]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return [(shapes[0][0], tt.as_tensor(self.N))]
+
+    def perform(self, node, inputs, outputs):
+        b, theta, bo, ro, sigr, w = inputs
+        out = reuse_output(outputs[0], (len(b), self.N))
+        self.func(
+            b, theta, bo, np.atleast_1d(ro), sigr, w, config.nthreads, out=out
+        )
+        outputs[0][0] = out
+
+    def grad(self, inputs, gradients):
+        return self._grad_op(*(inputs + gradients))
+
+
+class sTReflectedExtendedGradientOp(tt.Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:-1]]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return shapes[:-1]
+
+    def perform(self, node, inputs, outputs):
+        b, theta, bo, ro, sigr, w, bsT = inputs
+        bb, btheta, bbo, bro, bsigr, bw = self.base_op.func(
+            b, theta, bo, np.atleast_1d(ro), sigr, w, bsT, config.nthreads
+        )
         outputs[0][0] = np.reshape(bb, np.shape(b))
         outputs[1][0] = np.reshape(btheta, np.shape(theta))
         outputs[2][0] = np.reshape(bbo, np.shape(bo))
         outputs[3][0] = np.array(np.reshape(bro, np.shape(ro)))
         outputs[4][0] = np.array(np.reshape(bsigr, np.shape(sigr)))
+        outputs[5][0] = np.reshape(bw, np.shape(w))
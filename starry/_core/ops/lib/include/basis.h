@@ -573,6 +573,7 @@ public:
   RowVector<T> x_cache, y_cache, z_cache;
   int deg_cache;
   Matrix<T, RowMajor> pT;
+  Matrix<T> xpow, ypow;
 
   // Constructor: compute the matrices
   explicit Basis(int ydeg, int udeg, int fdeg, T norm = 2.0 / root_pi<T>())
@@ -615,8 +616,9 @@ public:
     Compute the polynomial basis at a vector of points.
 
   */
-  inline void computePolyBasis(const int deg, const RowVector<T> &x,
-                               const RowVector<T> &y, const RowVector<T> &z) {
+  inline void computePolyBasis(const int deg, const RowVectorRef<T> &x,
+                               const RowVectorRef<T> &y,
+                               const RowVectorRef<T> &z) {
     // Dimensions
     size_t npts = x.cols();
     int N = (deg + 1) * (deg + 1);
@@ -634,48 +636,33 @@ public:
     z_cache = z;
     deg_cache = deg;
 
-    // Optimized polynomial basis computation
-    // A little opaque, sorry...
-    Matrix<T> xarr(npts, N), yarr(npts, N);
-    RowVector<T> xterm(npts), yterm(npts);
-    xterm.setOnes();
-    yterm.setOnes();
-    xterm += 0.0 * z; // Ensures we get `nan`s off the disk
-    yterm += 0.0 * z; // Ensures we get `nan`s off the disk
-    int i0 = 0, di0 = 3, j0 = 0, dj0 = 2;
-    int i, j, di, dj, n;
-    for (n = 0; n < deg + 1; ++n) {
-      i = i0;
-      di = di0;
-      xarr.col(i) = xterm;
-      j = j0;
-      dj = dj0;
-      yarr.col(j) = yterm;
-      i = i0 + di - 1;
-      j = j0 + dj - 1;
-      while (i + 1 < N) {
-        xarr.col(i) = xterm;
-        xarr.col(i + 1) = xterm;
-        di += 2;
-        i += di;
-        yarr.col(j) = yterm;
-        yarr.col(j + 1) = yterm;
-        dj += 2;
-        j += dj - 1;
-      }
-      xterm = xterm.cwiseProduct(x);
-      i0 += 2 * n + 1;
-      di0 += 2;
-      yterm = yterm.cwiseProduct(y);
-      j0 += 2 * (n + 1) + 1;
-      dj0 += 2;
+    // Tabulate the powers of `x` and `y` in the scratch arrays
+    xpow.resize(npts, deg + 1);
+    ypow.resize(npts, deg + 1);
+    xpow.col(0).setOnes();
+    ypow.col(0).setOnes();
+    xpow.col(0) += 0.0 * z.transpose(); // Ensures we get `nan`s off the disk
+    ypow.col(0) += 0.0 * z.transpose(); // Ensures we get `nan`s off the disk
+    for (int k = 1; k < deg + 1; ++k) {
+      xpow.col(k) = xpow.col(k - 1).cwiseProduct(x.transpose());
+      ypow.col(k) = ypow.col(k - 1).cwiseProduct(y.transpose());
     }
-    n = 0;
+
+    // The terms are `x^(mu / 2) y^(nu / 2)` if `nu` is even
+    // and `x^((mu - 1) / 2) y^((nu - 1) / 2) z` otherwise
+    int n = 0;
+    int mu, nu;
     for (int l = 0; l < deg + 1; ++l) {
       for (int m = -l; m < l + 1; ++m) {
-        pT.col(n) = xarr.col(n).cwiseProduct(yarr.col(n));
-        if ((l + m) % 2 != 0)
-          pT.col(n) = pT.col(n).cwiseProduct(z.transpose());
+        mu = l - m;
+        nu = l + m;
+        if (is_even(nu)) {
+          pT.col(n) = xpow.col(mu / 2).cwiseProduct(ypow.col(nu / 2));
+        } else {
+          pT.col(n) = xpow.col((mu - 1) / 2)
+                          .cwiseProduct(ypow.col((nu - 1) / 2))
+                          .cwiseProduct(z.transpose());
+        }
         ++n;
       }
     }
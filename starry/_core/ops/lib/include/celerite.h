@@ -0,0 +1,270 @@
+/**
+\file celerite.h
+\brief Linear algebra for quasiseparable (celerite) covariance matrices.
+
+Covariance matrices of the form
+
+    K = diag(a) + tril(U . V^T) + triu(V . U^T),
+
+where the off-diagonal elements are damped by the exponential factors `P`
+between consecutive rows, can be factorized as `K = L . diag(d) . L^T` with
+`L = I + tril(U . W^T)` in O(N J^2). This is the algorithm of
+Foreman-Mackey et al. (2017) <https://github.com/dfm/celerite>, in the form
+used in `celerite2`. The reverse-mode gradients of the factorization and of
+the solve are computed by differentiating through each recursion.
+
+*/
+
+#ifndef _STARRY_CELERITE_H_
+#define _STARRY_CELERITE_H_
+
+#include "utils.h"
+
+namespace starry {
+namespace celerite {
+
+using namespace utils;
+
+/**
+Compute the factorization `K = L . diag(d) . L^T` of a quasiseparable
+matrix. The rows of `S` are the (flattened) `J x J` state matrices at each
+step, which are needed to backpropagate through the factorization.
+
+*/
+template <typename T>
+inline void factor(const VectorRef<T> &a, const MatrixRef<T> &U,
+                   const MatrixRef<T> &V, const MatrixRef<T> &P, Vector<T> &d,
+                   Matrix<T> &W, Matrix<T> &S) {
+  const int N = U.rows();
+  const int J = U.cols();
+  d.resize(N);
+  W.resize(N, J);
+  S.setZero(N, J * J);
+  Matrix<T> Sn(J, J);
+  RowVector<T> tmp(J);
+  Sn.setZero();
+
+  d(0) = a(0);
+  if (d(0) <= 0)
+    throw std::runtime_error(
+        "The covariance matrix is not positive definite.");
+  W.row(0) = V.row(0) / d(0);
+  for (int n = 1; n < N; ++n) {
+    Sn.noalias() += d(n - 1) * W.row(n - 1).transpose() * W.row(n - 1);
+    Sn = P.row(n - 1).asDiagonal() * Sn * P.row(n - 1).asDiagonal();
+    S.row(n) = Eigen::Map<RowVector<T>>(Sn.data(), J * J);
+    tmp.noalias() = U.row(n) * Sn;
+    d(n) = a(n) - tmp.dot(U.row(n));
+    if (d(n) <= 0)
+      throw std::runtime_error(
+          "The covariance matrix is not positive definite.");
+    W.row(n) = (V.row(n) - tmp) / d(n);
+  }
+}
+
+/**
+Backpropagate the gradients `bd` and `bW` through the factorization.
+
+*/
+template <typename T>
+inline void factor(const VectorRef<T> &a, const MatrixRef<T> &U,
+                   const MatrixRef<T> &V, const MatrixRef<T> &P,
+                   const VectorRef<T> &d, const MatrixRef<T> &W,
+                   const MatrixRef<T> &S, const VectorRef<T> &bd_,
+                   const MatrixRef<T> &bW_, Vector<T> &ba, Matrix<T> &bU,
+                   Matrix<T> &bV, Matrix<T> &bP) {
+  const int N = U.rows();
+  const int J = U.cols();
+  Vector<T> bd = bd_;
+  Matrix<T> bW = bW_;
+  ba.setZero(N);
+  bU.setZero(N, J);
+  bV.setZero(N, J);
+  bP.setZero(std::max(N - 1, 0), J);
+  Matrix<T> bS(J, J), Sn(J, J), Q(J, J), bQ(J, J);
+  RowVector<T> tmp(J), btmp(J);
+  bS.setZero();
+
+  for (int n = N - 1; n > 0; --n) {
+    Sn = Eigen::Map<const Matrix<T>>(S.row(n).eval().data(), J, J);
+    tmp.noalias() = U.row(n) * Sn;
+
+    // W_n = (V_n - U_n . S_n) / d_n
+    bV.row(n) += bW.row(n) / d(n);
+    btmp = -bW.row(n) / d(n);
+    bd(n) -= bW.row(n).dot(W.row(n)) / d(n);
+
+    // d_n = a_n - U_n . S_n . U_n^T
+    ba(n) += bd(n);
+    btmp -= bd(n) * U.row(n);
+    bU.row(n) -= bd(n) * tmp;
+
+    // tmp = U_n . S_n
+    bU.row(n) += btmp * Sn.transpose();
+    bS.noalias() += U.row(n).transpose() * btmp;
+
+    // S_n = diag(P_{n-1}) . Q . diag(P_{n-1})
+    Q = Eigen::Map<const Matrix<T>>(S.row(n - 1).eval().data(), J, J);
+    Q.noalias() += d(n - 1) * W.row(n - 1).transpose() * W.row(n - 1);
+    bQ = bS.cwiseProduct(Q);
+    bP.row(n - 1) +=
+        ((bQ + bQ.transpose()) * P.row(n - 1).transpose()).transpose();
+    bQ = P.row(n - 1).asDiagonal() * bS * P.row(n - 1).asDiagonal();
+
+    // Q = S_{n-1} + d_{n-1} . W_{n-1}^T . W_{n-1}
+    bd(n - 1) += W.row(n - 1) * bQ * W.row(n - 1).transpose();
+    bW.row(n - 1) += d(n - 1) * W.row(n - 1) * (bQ + bQ.transpose());
+    bS = bQ;
+  }
+
+  // d_0 = a_0, W_0 = V_0 / d_0
+  if (N > 0) {
+    bV.row(0) += bW.row(0) / d(0);
+    bd(0) -= bW.row(0).dot(W.row(0)) / d(0);
+    ba(0) += bd(0);
+  }
+}
+
+/**
+Compute `Z = K^-1 . Y` given the factorization of `K`. If `store` is true,
+the (flattened) forward and backward recursion states `F` and `G`, which
+are needed to backpropagate through the solve, are stored as well. These
+are `N x (J M)`, so we only keep them when computing gradients.
+
+*/
+template <typename T>
+inline void solve(const MatrixRef<T> &U, const MatrixRef<T> &P,
+                  const VectorRef<T> &d, const MatrixRef<T> &W,
+                  const MatrixRef<T> &Y, Matrix<T> &Z, Matrix<T> &F,
+                  Matrix<T> &G, const bool store) {
+  const int N = U.rows();
+  const int J = U.cols();
+  const int M = Y.cols();
+  Matrix<T> Fn(J, M);
+  Z = Y;
+  if (store) {
+    F.setZero(N, J * M);
+    G.setZero(N, J * M);
+  }
+
+  // Forward substitution, L . Z = Y
+  Fn.setZero();
+  for (int n = 1; n < N; ++n) {
+    Fn.noalias() += W.row(n - 1).transpose() * Z.row(n - 1);
+    Fn = P.row(n - 1).asDiagonal() * Fn;
+    if (store)
+      F.row(n) = Eigen::Map<RowVector<T>>(Fn.data(), J * M);
+    Z.row(n).noalias() -= U.row(n) * Fn;
+  }
+
+  // Diagonal solve
+  Z.array().colwise() /= d.array();
+
+  // Backward substitution, L^T . Z = Z
+  Fn.setZero();
+  for (int n = N - 2; n >= 0; --n) {
+    Fn.noalias() += U.row(n + 1).transpose() * Z.row(n + 1);
+    Fn = P.row(n).asDiagonal() * Fn;
+    if (store)
+      G.row(n) = Eigen::Map<RowVector<T>>(Fn.data(), J * M);
+    Z.row(n).noalias() -= W.row(n) * Fn;
+  }
+}
+
+/**
+Compute `Z = K^-1 . Y` given the factorization of `K`.
+
+*/
+template <typename T>
+inline void solve(const MatrixRef<T> &U, const MatrixRef<T> &P,
+                  const VectorRef<T> &d, const MatrixRef<T> &W,
+                  const MatrixRef<T> &Y, Matrix<T> &Z) {
+  Matrix<T> F, G;
+  solve(U, P, d, W, Y, Z, F, G, false);
+}
+
+/**
+Backpropagate the gradient `bZ` through the solve. The recursion states
+are recomputed here rather than kept around from the forward pass.
+
+*/
+template <typename T>
+inline void solve(const MatrixRef<T> &U, const MatrixRef<T> &P,
+                  const VectorRef<T> &d, const MatrixRef<T> &W,
+                  const MatrixRef<T> &Y, const MatrixRef<T> &bZ,
+                  Matrix<T> &bU, Matrix<T> &bP, Vector<T> &bd, Matrix<T> &bW,
+                  Matrix<T> &bY) {
+  const int N = U.rows();
+  const int J = U.cols();
+  const int M = Y.cols();
+  Matrix<T> Z, F, G;
+  solve(U, P, d, W, Y, Z, F, G, true);
+  bU.setZero(N, J);
+  bP.setZero(std::max(N - 1, 0), J);
+  bd.setZero(N);
+  bW.setZero(N, J);
+  Matrix<T> Gn(J, M), bGn(J, M), bT(J, M), Tn(J, M);
+
+  // Recover the intermediate solutions: `X` after the forward
+  // substitution and the diagonal solve
+  Matrix<T> X = Z;
+  for (int n = 0; n < N - 1; ++n)
+    X.row(n).noalias() +=
+        W.row(n) * Eigen::Map<const Matrix<T>>(G.row(n).eval().data(), J, M);
+
+  // Backward substitution
+  Matrix<T> bX = bZ;
+  bGn.setZero();
+  for (int n = 0; n < N - 1; ++n) {
+    // Z_n = X_n - W_n . G_n
+    Gn = Eigen::Map<const Matrix<T>>(G.row(n).eval().data(), J, M);
+    bW.row(n) -= (Gn * bX.row(n).transpose()).transpose();
+    bGn.noalias() -= W.row(n).transpose() * bX.row(n);
+
+    // G_n = diag(P_n) . (G_{n+1} + U_{n+1}^T . Z_{n+1})
+    if (n < N - 2)
+      Tn = Eigen::Map<const Matrix<T>>(G.row(n + 1).eval().data(), J, M);
+    else
+      Tn.setZero();
+    Tn.noalias() += U.row(n + 1).transpose() * Z.row(n + 1);
+    bP.row(n) += bGn.cwiseProduct(Tn).rowwise().sum().transpose();
+    bT = P.row(n).asDiagonal() * bGn;
+    bU.row(n + 1) += (bT * Z.row(n + 1).transpose()).transpose();
+    bX.row(n + 1).noalias() += U.row(n + 1) * bT;
+    bGn = bT;
+  }
+
+  // Diagonal solve: X_n = Y'_n / d_n
+  Matrix<T> bY_ = bX;
+  bY_.array().colwise() /= d.array();
+  bd = -(bX.cwiseProduct(X).rowwise().sum()).cwiseQuotient(d);
+
+  // Forward substitution
+  Matrix<T> Zf = X;
+  Zf.array().colwise() *= d.array();
+  bY = bY_;
+  Matrix<T> bFn(J, M);
+  bFn.setZero();
+  for (int n = N - 1; n > 0; --n) {
+    // Zf_n = Y_n - U_n . F_n
+    Tn = Eigen::Map<const Matrix<T>>(F.row(n).eval().data(), J, M);
+    bU.row(n) -= (Tn * bY.row(n).transpose()).transpose();
+    bFn.noalias() -= U.row(n).transpose() * bY.row(n);
+
+    // F_n = diag(P_{n-1}) . (F_{n-1} + W_{n-1}^T . Zf_{n-1})
+    if (n > 1)
+      Tn = Eigen::Map<const Matrix<T>>(F.row(n - 1).eval().data(), J, M);
+    else
+      Tn.setZero();
+    Tn.noalias() += W.row(n - 1).transpose() * Zf.row(n - 1);
+    bP.row(n - 1) += bFn.cwiseProduct(Tn).rowwise().sum().transpose();
+    bT = P.row(n - 1).asDiagonal() * bFn;
+    bW.row(n - 1) += (bT * Zf.row(n - 1).transpose()).transpose();
+    bY.row(n - 1).noalias() += W.row(n - 1) * bT;
+    bFn = bT;
+  }
+}
+
+} // namespace celerite
+} // namespace starry
+#endif
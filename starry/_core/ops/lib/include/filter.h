@@ -9,6 +9,8 @@
 
 #include "basis.h"
 #include "utils.h"
+#include <algorithm>
+#include <array>
 
 namespace starry {
 namespace filter {
@@ -31,51 +33,58 @@ protected:
   const int deg;  /**< */
   const int N;    /**< */
   const int Nuf;  /**< */
-  Vector<Eigen::SparseMatrix<Scalar>>
-      DFDp; /**< Deriv of the filter operator w/ respect to the complete filter
-               polynomial */
+  Eigen::SparseMatrix<Scalar>
+      DFDp; /**< Deriv of the nonzero values of the filter operator w/ respect
+               to the complete filter polynomial */
 
 public:
-  Matrix<Scalar>
-      F; /**< The filter operator in the polynomial basis. TODO: Make sparse? */
+  Eigen::SparseMatrix<Scalar> F; /**< The filter operator in the polynomial
+                                    basis (sparse, fixed sparsity pattern) */
+  Matrix<Scalar> FM; /**< The filter operator applied to a matrix */
   Vector<Scalar> bu;
   Vector<Scalar> bf;
+  Matrix<Scalar> bM;
 
   // Constructor: compute the matrices
   explicit Filter(basis::Basis<Scalar> &B)
       : B(B), ydeg(B.ydeg), Ny((ydeg + 1) * (ydeg + 1)), udeg(B.udeg),
         Nu(udeg + 1), fdeg(B.fdeg), Nf((fdeg + 1) * (fdeg + 1)), deg(B.deg),
-        N((deg + 1) * (deg + 1)), Nuf((udeg + fdeg + 1) * (udeg + fdeg + 1)),
-        DFDp((udeg + fdeg + 1) * (udeg + fdeg + 1)) {
-    // Pre-compute dF / dp
-    computePolynomialProductMatrixGradient();
+        N((deg + 1) * (deg + 1)), Nuf((udeg + fdeg + 1) * (udeg + fdeg + 1)) {
+    // Pre-compute the sparsity pattern of F and dF / dp
+    computePolynomialProductMatrixPattern();
   }
 
   /**
-  Compute the polynomial product matrix.
+  Compute the sparsity pattern of the polynomial product matrix `F`
+  and the (sparse) Jacobian of its nonzero values with respect to the
+  complete filter polynomial `p`. Both are independent of the filter
+  polynomials, so we can just pre-compute them! Computing `F` for a
+  given `p` then amounts to a single sparse matrix-vector product
+  into the value array of `F`.
 
   */
-  inline void computePolynomialProductMatrix(const int plmax,
-                                             const Vector<Scalar> &p,
-                                             Matrix<Scalar> &M) {
+  inline void computePolynomialProductMatrixPattern() {
+    using Triplet = Eigen::Triplet<Scalar>;
     bool odd1;
     int l, n;
     int n1 = 0, n2 = 0;
-    M.setZero((plmax + ydeg + 1) * (plmax + ydeg + 1), Ny);
+
+    // Each entry is (row of F, col of F, index into p, coefficient)
+    std::vector<std::array<int, 4>> terms;
     for (int l1 = 0; l1 < ydeg + 1; ++l1) {
       for (int m1 = -l1; m1 < l1 + 1; ++m1) {
         odd1 = (l1 + m1) % 2 == 0 ? false : true;
         n2 = 0;
-        for (int l2 = 0; l2 < plmax + 1; ++l2) {
+        for (int l2 = 0; l2 < udeg + fdeg + 1; ++l2) {
           for (int m2 = -l2; m2 < l2 + 1; ++m2) {
             l = l1 + l2;
             n = l * l + l + m1 + m2;
             if (odd1 && ((l2 + m2) % 2 != 0)) {
-              M(n - 4 * l + 2, n1) += p(n2);
-              M(n - 2, n1) -= p(n2);
-              M(n + 2, n1) -= p(n2);
+              terms.push_back({n - 4 * l + 2, n1, n2, 1});
+              terms.push_back({n - 2, n1, n2, -1});
+              terms.push_back({n + 2, n1, n2, -1});
             } else {
-              M(n, n1) += p(n2);
+              terms.push_back({n, n1, n2, 1});
             }
             ++n2;
           }
@@ -83,6 +92,29 @@ public:
         ++n1;
       }
     }
+
+    // The structure of F is the union of all the terms
+    std::vector<Triplet> pattern;
+    pattern.reserve(terms.size());
+    for (auto const &term : terms)
+      pattern.push_back(Triplet(term[0], term[1], 1));
+    F.resize(N, Ny);
+    F.setFromTriplets(pattern.begin(), pattern.end());
+    F.makeCompressed();
+
+    // Map each term onto its slot in the value array of F
+    std::vector<Triplet> jac;
+    jac.reserve(terms.size());
+    const int *inner = F.innerIndexPtr();
+    const int *outer = F.outerIndexPtr();
+    for (auto const &term : terms) {
+      const int *slot =
+          std::lower_bound(inner + outer[term[1]], inner + outer[term[1] + 1],
+                           term[0]);
+      jac.push_back(Triplet(int(slot - inner), term[2], Scalar(term[3])));
+    }
+    DFDp.resize(F.nonZeros(), Nuf);
+    DFDp.setFromTriplets(jac.begin(), jac.end());
   }
 
   /**
@@ -123,44 +155,6 @@ public:
     }
   }
 
-  /**
-  Compute the gradient of the polynomial product matrix.
-  This is independent of the filter polynomials, so we can
-  just pre-compute it!
-
-  */
-  inline void computePolynomialProductMatrixGradient() {
-    bool odd1;
-    int l, n;
-    int n1 = 0, n2 = 0;
-    Vector<Matrix<Scalar>> DFDp_dense(Nuf);
-    for (n = 0; n < Nuf; ++n)
-      DFDp_dense(n).setZero(N, Ny);
-    for (int l1 = 0; l1 < ydeg + 1; ++l1) {
-      for (int m1 = -l1; m1 < l1 + 1; ++m1) {
-        odd1 = (l1 + m1) % 2 == 0 ? false : true;
-        n2 = 0;
-        for (int l2 = 0; l2 < udeg + fdeg + 1; ++l2) {
-          for (int m2 = -l2; m2 < l2 + 1; ++m2) {
-            l = l1 + l2;
-            n = l * l + l + m1 + m2;
-            if (odd1 && ((l2 + m2) % 2 != 0)) {
-              DFDp_dense[n2](n - 4 * l + 2, n1) += 1;
-              DFDp_dense[n2](n - 2, n1) -= 1;
-              DFDp_dense[n2](n + 2, n1) -= 1;
-            } else {
-              DFDp_dense[n2](n, n1) += 1;
-            }
-            ++n2;
-          }
-        }
-        ++n1;
-      }
-    }
-    for (n = 0; n < Nuf; ++n)
-      DFDp(n) = DFDp_dense(n).sparseView();
-  }
-
   /**
   Compute the gradient of the polynomial product.
 
@@ -205,10 +199,13 @@ public:
   }
 
   /**
-  Compute the polynomial filter operator.
+  Compute the complete filter polynomial `p`, the product of the
+  limb darkening polynomial and the Ylm filter polynomial.
 
   */
-  void computeF(const Vector<Scalar> &u, const Vector<Scalar> &f) {
+  inline void computeFilterPolynomial(const Vector<Scalar> &u,
+                                      const Vector<Scalar> &f,
+                                      Vector<Scalar> &p) {
     // Compute the two polynomials
     Vector<Scalar> tmp = B.U1 * u;
     Scalar norm =
@@ -218,23 +215,21 @@ public:
     pf = B.A1_f * f;
 
     // Multiply them
-    Vector<Scalar> p;
     if (udeg > fdeg) {
       computePolynomialProduct(udeg, pu, fdeg, pf, p);
     } else {
       computePolynomialProduct(fdeg, pf, udeg, pu, p);
     }
-
-    // Compute the polynomial filter operator
-    computePolynomialProductMatrix(udeg + fdeg, p, F);
   }
 
   /**
-  Compute the gradient of the polynomial filter operator.
+  Backpropagate the gradient of the complete filter polynomial `p`
+  to the limb darkening and Ylm filter coefficients.
 
   */
-  void computeF(const Vector<Scalar> &u, const Vector<Scalar> &f,
-                const Matrix<Scalar> &bF) {
+  inline void computeFilterPolynomial(const Vector<Scalar> &u,
+                                      const Vector<Scalar> &f,
+                                      const RowVector<Scalar> &bp) {
     Matrix<Scalar> DpDpu;
     Matrix<Scalar> DpDpf;
 
@@ -248,18 +243,12 @@ public:
 
     // Multiply them
     // TODO: DpDpf and DpDpu are sparse, and we should probably exploit that
-    Vector<Scalar> p;
     if (udeg > fdeg) {
       computePolynomialProduct(udeg, pu, fdeg, pf, DpDpu, DpDpf);
     } else {
       computePolynomialProduct(fdeg, pf, udeg, pu, DpDpf, DpDpu);
     }
 
-    // Backprop p
-    RowVector<Scalar> bp(Nuf);
-    for (int j = 0; j < Nuf; ++j)
-      bp(j) = DFDp(j).cwiseProduct(bF).sum();
-
     // Compute the limb darkening derivatives
     Matrix<Scalar> DpuDu =
         pi<Scalar>() * norm * B.U1 -
@@ -269,6 +258,122 @@ public:
     // Compute the Ylm filter derivatives
     bf = bp * DpDpf * B.A1_f;
   }
+
+  /**
+  Compute the polynomial filter operator.
+
+  */
+  void computeF(const Vector<Scalar> &u, const Vector<Scalar> &f) {
+    Vector<Scalar> p;
+    computeFilterPolynomial(u, f, p);
+
+    // Compute the polynomial filter operator. The sparsity pattern
+    // is fixed, so we only need to fill in the nonzero values
+    Eigen::Map<Vector<Scalar>>(F.valuePtr(), F.nonZeros()) = DFDp * p;
+  }
+
+  /**
+  Compute the gradient of the polynomial filter operator.
+
+  */
+  void computeF(const Vector<Scalar> &u, const Vector<Scalar> &f,
+                const MatrixRef<Scalar> &bF) {
+    // Backprop p: gather the adjoint at the nonzero entries of F
+    Vector<Scalar> bFnz(F.nonZeros());
+    const int *inner = F.innerIndexPtr();
+    const int *outer = F.outerIndexPtr();
+    for (int j = 0; j < Ny; ++j) {
+      for (int k = outer[j]; k < outer[j + 1]; ++k)
+        bFnz(k) = bF(inner[k], j);
+    }
+    RowVector<Scalar> bp = (DFDp.transpose() * bFnz).transpose();
+
+    // Backprop u and f
+    computeFilterPolynomial(u, f, bp);
+  }
+
+  /**
+  Apply the polynomial filter operator to a matrix `M` whose columns
+  are polynomial map vectors, `F . M`, without building `F`. Each
+  column is just the product of the map polynomial and the filter
+  polynomial, so this is O(Ny Nuf) per column.
+
+  */
+  void computeFdot(const Vector<Scalar> &u, const Vector<Scalar> &f,
+                   const MatrixRef<Scalar> &M) {
+    Vector<Scalar> p;
+    computeFilterPolynomial(u, f, p);
+
+    int n1, n2, l1, m1, l2, m2, l, n;
+    bool odd1;
+    FM.setZero(N, M.cols());
+    n1 = 0;
+    for (l1 = 0; l1 < ydeg + 1; ++l1) {
+      for (m1 = -l1; m1 < l1 + 1; ++m1) {
+        odd1 = (l1 + m1) % 2 == 0 ? false : true;
+        n2 = 0;
+        for (l2 = 0; l2 < udeg + fdeg + 1; ++l2) {
+          for (m2 = -l2; m2 < l2 + 1; ++m2) {
+            l = l1 + l2;
+            n = l * l + l + m1 + m2;
+            if (odd1 && ((l2 + m2) % 2 != 0)) {
+              FM.row(n - 4 * l + 2) += p(n2) * M.row(n1);
+              FM.row(n - 2) -= p(n2) * M.row(n1);
+              FM.row(n + 2) -= p(n2) * M.row(n1);
+            } else {
+              FM.row(n) += p(n2) * M.row(n1);
+            }
+            ++n2;
+          }
+        }
+        ++n1;
+      }
+    }
+  }
+
+  /**
+  Compute the vector-Jacobian product of `F . M` with respect to
+  the limb darkening coefficients, the filter coefficients, and `M`.
+
+  */
+  void computeFdot(const Vector<Scalar> &u, const Vector<Scalar> &f,
+                   const MatrixRef<Scalar> &M, const MatrixRef<Scalar> &bFM) {
+    Vector<Scalar> p;
+    computeFilterPolynomial(u, f, p);
+
+    int n1, n2, l1, m1, l2, m2, l, n;
+    bool odd1;
+    RowVector<Scalar> bp;
+    bp.setZero(Nuf);
+    bM.setZero(Ny, M.cols());
+    n1 = 0;
+    for (l1 = 0; l1 < ydeg + 1; ++l1) {
+      for (m1 = -l1; m1 < l1 + 1; ++m1) {
+        odd1 = (l1 + m1) % 2 == 0 ? false : true;
+        n2 = 0;
+        for (l2 = 0; l2 < udeg + fdeg + 1; ++l2) {
+          for (m2 = -l2; m2 < l2 + 1; ++m2) {
+            l = l1 + l2;
+            n = l * l + l + m1 + m2;
+            if (odd1 && ((l2 + m2) % 2 != 0)) {
+              bM.row(n1) += p(n2) * (bFM.row(n - 4 * l + 2) -
+                                     bFM.row(n - 2) - bFM.row(n + 2));
+              bp(n2) += M.row(n1).dot(bFM.row(n - 4 * l + 2) -
+                                      bFM.row(n - 2) - bFM.row(n + 2));
+            } else {
+              bM.row(n1) += p(n2) * bFM.row(n);
+              bp(n2) += M.row(n1).dot(bFM.row(n));
+            }
+            ++n2;
+          }
+        }
+        ++n1;
+      }
+    }
+
+    // Backprop u and f
+    computeFilterPolynomial(u, f, bp);
+  }
 };
 
 } // namespace filter
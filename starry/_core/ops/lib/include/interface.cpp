@@ -11,9 +11,12 @@
 
 // Includes
 #include "basis.h"
+#include "celerite.h"
+#include "kepler.h"
 #include "ops.h"
 #include "reflected/scatter.h"
 #include "sturm.h"
+#include "system.h"
 #include "utils.h"
 #include <iostream>
 #include <pybind11/eigen.h>
@@ -31,7 +34,23 @@ using Scalar = Multi;
 using Scalar = double;
 #endif
 
-// Register the Python module
+// Copy `x` into the caller-provided output array `out`
+template <typename T>
+inline void copy_into(const Eigen::MatrixBase<T> &x,
+                      starry::utils::OutMatrix<double> out) {
+  if ((out.rows() != x.rows()) || (out.cols() != x.cols()))
+    throw std::length_error("Invalid shape for the output array `out`.");
+  out = x.template cast<double>();
+}
+
+// Register the Python module.
+//
+// Array arguments are bound as `Eigen::Ref` views, so numpy arrays of the
+// right dtype are passed through without a copy, and casts to `Scalar` are
+// no-ops in double precision. The most expensive methods also accept an
+// optional, preallocated output array `out`, which must be passed by
+// keyword: those overloads are registered after the gradient overloads of
+// the same name, so positional calls always resolve to the latter.
 PYBIND11_MODULE(_c_ops, m) {
   // Import some useful stuff
   using namespace starry::utils;
@@ -60,35 +79,42 @@ PYBIND11_MODULE(_c_ops, m) {
   Ops.def_property_readonly("N",
                             [](starry::Ops<Scalar> &ops) { return ops.N; });
 
-  // Occultation solution in emitted light
-  Ops.def("sT", [](starry::Ops<Scalar> &ops, const Vector<double> &b,
-                   const double &r) {
-    size_t npts = size_t(b.size());
-    Matrix<double, RowMajor> sT(npts, ops.N);
-    for (size_t n = 0; n < npts; ++n) {
-      ops.G.compute(static_cast<Scalar>(b(n)), static_cast<Scalar>(r));
-      sT.row(n) = ops.G.sT.template cast<double>();
-    }
+  // Occultation solution in emitted light. The occultor radius `r` may
+  // be a single value or one value per point.
+  Ops.def("sT", [](starry::Ops<Scalar> &ops, const VectorRef<double> &b,
+                   const VectorRef<double> &r) {
+    Matrix<double, RowMajor> sT(b.size(), ops.N);
+    ops.sT(b, r, sT);
     return sT;
   });
 
   // Gradient of occultation solution in emitted light
-  Ops.def("sT", [](starry::Ops<Scalar> &ops, const Vector<double> &b,
-                   const double &r, const Matrix<double, RowMajor> &bsT) {
+  Ops.def("sT", [](starry::Ops<Scalar> &ops, const VectorRef<double> &b,
+                   const VectorRef<double> &r, const MatrixRef<double> &bsT) {
     size_t npts = size_t(b.size());
+    bool scalar_r = (r.size() == 1);
     Vector<double> bb(npts);
-    double br = 0.0;
+    Vector<double> br;
+    br.setZero(r.size());
     for (size_t n = 0; n < npts; ++n) {
       ops.G.template compute<true>(static_cast<Scalar>(b(n)),
-                                   static_cast<Scalar>(r));
+                                   static_cast<Scalar>(r(scalar_r ? 0 : n)));
       bb(n) = static_cast<double>(
           ops.G.dsTdb.dot(bsT.row(n).template cast<Scalar>()));
-      br += static_cast<double>(
+      br(scalar_r ? 0 : n) += static_cast<double>(
           ops.G.dsTdr.dot(bsT.row(n).template cast<Scalar>()));
     }
     return py::make_tuple(bb, br);
   });
 
+  // Occultation solution in emitted light (into `out`)
+  Ops.def(
+      "sT",
+      [](starry::Ops<Scalar> &ops, const VectorRef<double> &b,
+         const VectorRef<double> &r,
+         OutMatrix<double> out) { ops.sT(b, r, out); },
+      py::arg("b"), py::arg("r"), py::arg("out"));
+
   // Change of basis matrix: Ylm to poly
   Ops.def_property_readonly("A1", [](starry::Ops<Scalar> &ops) {
 #ifdef STARRY_MULTI
@@ -132,113 +158,201 @@ PYBIND11_MODULE(_c_ops, m) {
 
   // Phase curve in reflected light (w/ fwd gradient)
   // NOTE: This vector is already weighted by the illumination.
-  Ops.def("rTReflected", [](starry::Ops<Scalar> &ops, const Vector<double> &b_,
-                            const double &sigr_) {
+  Ops.def("rTReflected", [](starry::Ops<Scalar> &ops,
+                            const VectorRef<double> &b_, const double &sigr_) {
 
     // Total number of terms in `r^T`
     int K = b_.size();
 
-    // Seed the derivatives. We'll compute them using forward
-    // diff and return them for the backprop call.
-    ADScalar<Scalar, 2> b, sigr;
-    b.derivatives() = Vector<Scalar>::Unit(2, 0);
-    sigr.derivatives() = Vector<Scalar>::Unit(2, 1);
-    sigr.value() = sigr_;
-
     // The output
-    Matrix<double> result(K, ops.N);
-    Matrix<double> ddb(K, ops.N);
-    Matrix<double> ddsigr(K, ops.N);
-
-    // Loop through the timeseries
+    Matrix<Scalar, RowMajor> result(K, ops.N);
+    Matrix<Scalar, RowMajor> ddb(K, ops.N);
+    Matrix<Scalar, RowMajor> ddsigr(K, ops.N);
+
+    // Loop through the timeseries. The integrals are interpolated
+    // in `b` at this value of `sigr` if the batch is long enough to
+    // pay for building the interpolant (or if it is already built).
+    ops.RPI.prepare(b_, static_cast<Scalar>(sigr_));
     for (int k = 0; k < K; ++k) {
-
-      // Hack: deriv undefined for b = +/- 1 (not a numerical issue)
-      if (b_(k) >= 1.0 - 1e-15) {
-        b.value() = Scalar(1.0) - Scalar(1e-15);
-      } else if (b_(k) <= -1.0 + 1e-15) {
-        b.value() = Scalar(-1.0) + Scalar(1e-15);
-      } else {
-        b.value() = static_cast<Scalar>(b_(k));
-      }
-
-      // Compute rT for this timestep
-      ops.RP.compute(b, sigr);
-
-      // Process the ADScalar
-      for (int n = 0; n < ops.N; ++n) {
-        result(k, n) = static_cast<double>(ops.RP.rT(n).value());
-        ddb(k, n) = static_cast<double>(ops.RP.rT(n).derivatives()(0));
-        ddsigr(k, n) = static_cast<double>(ops.RP.rT(n).derivatives()(1));
-      }
+      ops.RPI.compute(static_cast<Scalar>(b_(k)), static_cast<Scalar>(sigr_),
+                      result.row(k).data(), ddb.row(k).data(),
+                      ddsigr.row(k).data());
     }
 
     // Return the value & the forward derivs
-    return py::make_tuple(result, ddb, ddsigr);
+    return py::make_tuple(result.template cast<double>(),
+                          ddb.template cast<double>(),
+                          ddsigr.template cast<double>());
 
   });
 
-  // Occultation in reflected light (w/ fwd gradient)
-  // NOTE: This vector is already weighted by the illumination.
-  Ops.def("sTReflected", [](starry::Ops<Scalar> &ops, const Vector<double> &b_,
-                            const Vector<double> &theta_,
-                            const Vector<double> &bo_, const double &ro_,
-                            const double &sigr_) {
-
-    // Total number of terms in `s^T`
+  // Phase curve in reflected light, computed without the interpolant
+  Ops.def("rTReflectedExact", [](starry::Ops<Scalar> &ops,
+                                 const VectorRef<double> &b_,
+                                 const double &sigr_) {
     int K = b_.size();
-
-    // Seed the derivatives. We'll compute them using forward
-    // diff and return them for the backprop call.
-    ADScalar<Scalar, 5> b, theta, bo, ro, sigr;
-    b.derivatives() = Vector<Scalar>::Unit(5, 0);
-    theta.derivatives() = Vector<Scalar>::Unit(5, 1);
-    bo.derivatives() = Vector<Scalar>::Unit(5, 2);
-    ro.derivatives() = Vector<Scalar>::Unit(5, 3);
-    sigr.derivatives() = Vector<Scalar>::Unit(5, 4);
-    ro.value() = ro_;
-    sigr.value() = sigr_;
-
-    // The output
-    Matrix<double> result(K, ops.N);
-    Matrix<double> ddb(K, ops.N);
-    Matrix<double> ddtheta(K, ops.N);
-    Matrix<double> ddbo(K, ops.N);
-    Matrix<double> ddro(K, ops.N);
-    Matrix<double> ddsigr(K, ops.N);
-
-    // Loop through the timeseries
+    Matrix<Scalar, RowMajor> result(K, ops.N);
+    Matrix<Scalar, RowMajor> ddb(K, ops.N);
+    Matrix<Scalar, RowMajor> ddsigr(K, ops.N);
     for (int k = 0; k < K; ++k) {
-
-      // Hack: deriv undefined for b = +/- 1 (not a numerical issue)
-      if (b_(k) >= 1.0 - 1e-15) {
-        b.value() = Scalar(1.0) - Scalar(1e-15);
-      } else if (b_(k) <= -1.0 + 1e-15) {
-        b.value() = Scalar(-1.0) + Scalar(1e-15);
-      } else {
-        b.value() = static_cast<Scalar>(b_(k));
-      }
-
-      theta.value() = static_cast<Scalar>(theta_(k));
-      bo.value() = static_cast<Scalar>(bo_(k));
-
-      // Compute sT for this timestep
-      ops.RO.compute(b, theta, bo, ro, sigr);
-
-      // Process the ADScalar
-      for (int n = 0; n < ops.N; ++n) {
-        result(k, n) = static_cast<double>(ops.RO.sT(n).value());
-        ddb(k, n) = static_cast<double>(ops.RO.sT(n).derivatives()(0));
-        ddtheta(k, n) = static_cast<double>(ops.RO.sT(n).derivatives()(1));
-        ddbo(k, n) = static_cast<double>(ops.RO.sT(n).derivatives()(2));
-        ddro(k, n) = static_cast<double>(ops.RO.sT(n).derivatives()(3));
-        ddsigr(k, n) = static_cast<double>(ops.RO.sT(n).derivatives()(4));
-      }
+      ops.RPI.exact(static_cast<Scalar>(b_(k)), static_cast<Scalar>(sigr_),
+                    result.row(k).data(), ddb.row(k).data(),
+                    ddsigr.row(k).data());
     }
+    return py::make_tuple(result.template cast<double>(),
+                          ddb.template cast<double>(),
+                          ddsigr.template cast<double>());
+  });
 
-    // Return the value & the forward derivs
-    return py::make_tuple(result, ddb, ddtheta, ddbo, ddro, ddsigr);
-
+  // Occultation in reflected light
+  // NOTE: This vector is already weighted by the illumination.
+  Ops.def(
+      "sTReflected",
+      [](starry::Ops<Scalar> &ops, const VectorRef<double> &b,
+         const VectorRef<double> &theta, const VectorRef<double> &bo,
+         const VectorRef<double> &ro, const double &sigr,
+         const int nthreads) {
+        Matrix<double, RowMajor> sT(b.size(), ops.N);
+        {
+          py::gil_scoped_release release;
+          ops.sTReflected(b, theta, bo, ro, sigr, nthreads, sT);
+        }
+        return sT;
+      },
+      py::arg("b"), py::arg("theta"), py::arg("bo"), py::arg("ro"),
+      py::arg("sigr"), py::arg("nthreads") = 1);
+
+  // Occultation in reflected light (w/ fwd gradient) for a single
+  // occultor radius
+  Ops.def(
+      "sTReflected",
+      [](starry::Ops<Scalar> &ops, const VectorRef<double> &b,
+         const VectorRef<double> &theta, const VectorRef<double> &bo,
+         const double &ro, const double &sigr, const int nthreads) {
+        Matrix<double> sT, ddb, ddtheta, ddbo, ddro, ddsigr;
+        {
+          py::gil_scoped_release release;
+          ops.sTReflected(b, theta, bo, Vector<double>::Constant(1, ro), sigr,
+                          nthreads, sT, ddb, ddtheta, ddbo, ddro, ddsigr);
+        }
+        return py::make_tuple(sT, ddb, ddtheta, ddbo, ddro, ddsigr);
+      },
+      py::arg("b"), py::arg("theta"), py::arg("bo"), py::arg("ro"),
+      py::arg("sigr"), py::arg("nthreads") = 1);
+
+  // Gradient of occultation solution in reflected light
+  Ops.def(
+      "sTReflected",
+      [](starry::Ops<Scalar> &ops, const VectorRef<double> &b,
+         const VectorRef<double> &theta, const VectorRef<double> &bo,
+         const VectorRef<double> &ro, const double &sigr,
+         const MatrixRef<double> &bsT, const int nthreads) {
+        Vector<double> bb, btheta, bbo, bro;
+        double bsigr;
+        {
+          py::gil_scoped_release release;
+          ops.sTReflected(b, theta, bo, ro, sigr, bsT, nthreads, bb, btheta,
+                          bbo, bro, bsigr);
+        }
+        return py::make_tuple(bb, btheta, bbo, bro, bsigr);
+      },
+      py::arg("b"), py::arg("theta"), py::arg("bo"), py::arg("ro"),
+      py::arg("sigr"), py::arg("bsT"), py::arg("nthreads") = 1);
+
+  // Occultation in reflected light (into `out`)
+  Ops.def(
+      "sTReflected",
+      [](starry::Ops<Scalar> &ops, const VectorRef<double> &b,
+         const VectorRef<double> &theta, const VectorRef<double> &bo,
+         const VectorRef<double> &ro, const double &sigr, const int nthreads,
+         OutMatrix<double> out) {
+        py::gil_scoped_release release;
+        ops.sTReflected(b, theta, bo, ro, sigr, nthreads, out);
+      },
+      py::arg("b"), py::arg("theta"), py::arg("bo"), py::arg("ro"),
+      py::arg("sigr"), py::arg("nthreads") = 1, py::arg("out"));
+
+  // Occultation in reflected light for an extended source
+  Ops.def(
+      "sTReflectedExtended",
+      [](starry::Ops<Scalar> &ops, const MatrixRef<double> &b,
+         const MatrixRef<double> &theta, const VectorRef<double> &bo,
+         const VectorRef<double> &ro, const double &sigr,
+         const MatrixRef<double> &w, const int nthreads) {
+        Matrix<double, RowMajor> sT(b.rows(), ops.N);
+        {
+          py::gil_scoped_release release;
+          ops.sTReflected(b, theta, bo, ro, sigr, w, nthreads, sT);
+        }
+        return sT;
+      },
+      py::arg("b"), py::arg("theta"), py::arg("bo"), py::arg("ro"),
+      py::arg("sigr"), py::arg("w"), py::arg("nthreads") = 1);
+
+  // Gradient of occultation solution in reflected light for an
+  // extended source
+  Ops.def(
+      "sTReflectedExtended",
+      [](starry::Ops<Scalar> &ops, const MatrixRef<double> &b,
+         const MatrixRef<double> &theta, const VectorRef<double> &bo,
+         const VectorRef<double> &ro, const double &sigr,
+         const MatrixRef<double> &w, const MatrixRef<double> &bsT,
+         const int nthreads) {
+        Matrix<double> bb, btheta, bw;
+        Vector<double> bbo, bro;
+        double bsigr;
+        {
+          py::gil_scoped_release release;
+          ops.sTReflected(b, theta, bo, ro, sigr, w, bsT, nthreads, bb, btheta,
+                          bbo, bro, bsigr, bw);
+        }
+        return py::make_tuple(bb, btheta, bbo, bro, bsigr, bw);
+      },
+      py::arg("b"), py::arg("theta"), py::arg("bo"), py::arg("ro"),
+      py::arg("sigr"), py::arg("w"), py::arg("bsT"), py::arg("nthreads") = 1);
+
+  // Occultation in reflected light for an extended source (into `out`)
+  Ops.def(
+      "sTReflectedExtended",
+      [](starry::Ops<Scalar> &ops, const MatrixRef<double> &b,
+         const MatrixRef<double> &theta, const VectorRef<double> &bo,
+         const VectorRef<double> &ro, const double &sigr,
+         const MatrixRef<double> &w, const int nthreads,
+         OutMatrix<double> out) {
+        py::gil_scoped_release release;
+        ops.sTReflected(b, theta, bo, ro, sigr, w, nthreads, out);
+      },
+      py::arg("b"), py::arg("theta"), py::arg("bo"), py::arg("ro"),
+      py::arg("sigr"), py::arg("w"), py::arg("nthreads") = 1, py::arg("out"));
+
+  // Quadrature of the reflected light occultation integrals: use the
+  // tanh-sinh rule (default) or the fixed Gauss-Legendre rule?
+  Ops.def_property(
+      "adaptive_quad",
+      [](starry::Ops<Scalar> &ops) {
+        bool adaptive = true;
+        ops.forEachQuad([&](starry::quad::Quad<Scalar> &Q) {
+          adaptive = Q.adaptive;
+        });
+        return adaptive;
+      },
+      [](starry::Ops<Scalar> &ops, const bool adaptive) {
+        ops.forEachQuad(
+            [&](starry::quad::Quad<Scalar> &Q) { Q.adaptive = adaptive; });
+      });
+
+  // Number of integrand evaluations and of integrals computed by
+  // the quadrature of the reflected light occultation integrals
+  Ops.def("quad_counters", [](starry::Ops<Scalar> &ops) {
+    size_t nevals = 0, nintegrals = 0;
+    ops.forEachQuad([&](starry::quad::Quad<Scalar> &Q) {
+      nevals += Q.nevals;
+      nintegrals += Q.nintegrals;
+    });
+    return py::make_tuple(nevals, nintegrals);
+  });
+  Ops.def("reset_quad_counters", [](starry::Ops<Scalar> &ops) {
+    ops.forEachQuad([](starry::quad::Quad<Scalar> &Q) { Q.reset_counters(); });
   });
 
   // Rotation solution in emitted light dotted into Ylm space
@@ -248,16 +362,30 @@ PYBIND11_MODULE(_c_ops, m) {
 
   // Polynomial basis at a vector of points
   Ops.def("pT", [](starry::Ops<Scalar> &ops, const int deg,
-                   const RowVector<double> &x, const RowVector<double> &y,
-                   const RowVector<double> &z) {
+                   const RowVectorRef<double> &x, const RowVectorRef<double> &y,
+                   const RowVectorRef<double> &z) {
     ops.B.computePolyBasis(deg, x.template cast<Scalar>(),
                            y.template cast<Scalar>(),
                            z.template cast<Scalar>());
     return ops.B.pT.template cast<double>();
   });
 
+  // Polynomial basis at a vector of points (into `out`)
+  Ops.def(
+      "pT",
+      [](starry::Ops<Scalar> &ops, const int deg, const RowVectorRef<double> &x,
+         const RowVectorRef<double> &y, const RowVectorRef<double> &z,
+         OutMatrix<double> out) {
+        ops.B.computePolyBasis(deg, x.template cast<Scalar>(),
+                               y.template cast<Scalar>(),
+                               z.template cast<Scalar>());
+        copy_into(ops.B.pT, out);
+      },
+      py::arg("deg"), py::arg("x"), py::arg("y"), py::arg("z"),
+      py::arg("out"));
+
   // Rotation dot product operator (vectors)
-  Ops.def("dotR", [](starry::Ops<Scalar> &ops, const RowVector<double> &M,
+  Ops.def("dotR", [](starry::Ops<Scalar> &ops, const RowVectorRef<double> &M,
                      const double &x, const double &y, const double &z,
                      const double &theta) {
     ops.W.dotR(M.template cast<Scalar>(), static_cast<Scalar>(x),
@@ -267,19 +395,19 @@ PYBIND11_MODULE(_c_ops, m) {
   });
 
   // Rotation dot product operator (matrices)
-  Ops.def("dotR",
-          [](starry::Ops<Scalar> &ops, const Matrix<double> &M, const double &x,
-             const double &y, const double &z, const double &theta) {
-            ops.W.dotR(M.template cast<Scalar>(), static_cast<Scalar>(x),
-                       static_cast<Scalar>(y), static_cast<Scalar>(z),
-                       static_cast<Scalar>(theta));
-            return ops.W.dotR_result.template cast<double>();
-          });
+  Ops.def("dotR", [](starry::Ops<Scalar> &ops, const MatrixRef<double> &M,
+                     const double &x, const double &y, const double &z,
+                     const double &theta) {
+    ops.W.dotR(M.template cast<Scalar>(), static_cast<Scalar>(x),
+               static_cast<Scalar>(y), static_cast<Scalar>(z),
+               static_cast<Scalar>(theta));
+    return ops.W.dotR_result.template cast<double>();
+  });
 
   // Gradient of rotation dot product operator (vectors)
-  Ops.def("dotR", [](starry::Ops<Scalar> &ops, const RowVector<double> &M,
+  Ops.def("dotR", [](starry::Ops<Scalar> &ops, const RowVectorRef<double> &M,
                      const double &x, const double &y, const double &z,
-                     const double &theta, const Matrix<double> &bMR) {
+                     const double &theta, const MatrixRef<double> &bMR) {
     ops.W.dotR(M.template cast<Scalar>(), static_cast<Scalar>(x),
                static_cast<Scalar>(y), static_cast<Scalar>(z),
                static_cast<Scalar>(theta), bMR.template cast<Scalar>());
@@ -291,9 +419,9 @@ PYBIND11_MODULE(_c_ops, m) {
   });
 
   // Gradient of rotation dot product operator (matrices)
-  Ops.def("dotR", [](starry::Ops<Scalar> &ops, const Matrix<double> &M,
+  Ops.def("dotR", [](starry::Ops<Scalar> &ops, const MatrixRef<double> &M,
                      const double &x, const double &y, const double &z,
-                     const double &theta, const Matrix<double> &bMR) {
+                     const double &theta, const MatrixRef<double> &bMR) {
     ops.W.dotR(M.template cast<Scalar>(), static_cast<Scalar>(x),
                static_cast<Scalar>(y), static_cast<Scalar>(z),
                static_cast<Scalar>(theta), bMR.template cast<Scalar>());
@@ -304,31 +432,49 @@ PYBIND11_MODULE(_c_ops, m) {
                           static_cast<double>(ops.W.dotR_btheta));
   });
 
+  // Rotation dot product operator (matrices, into `out`)
+  Ops.def(
+      "dotR",
+      [](starry::Ops<Scalar> &ops, const MatrixRef<double> &M, const double &x,
+         const double &y, const double &z, const double &theta,
+         OutMatrix<double> out) {
+        ops.W.dotR(M.template cast<Scalar>(), static_cast<Scalar>(x),
+                   static_cast<Scalar>(y), static_cast<Scalar>(z),
+                   static_cast<Scalar>(theta));
+        copy_into(ops.W.dotR_result, out);
+      },
+      py::arg("M"), py::arg("x"), py::arg("y"), py::arg("z"),
+      py::arg("theta"), py::arg("out"));
+
   // Z rotation operator (vectors)
   Ops.def("tensordotRz", [](starry::Ops<Scalar> &ops,
-                            const RowVector<double> &M,
-                            const Vector<double> &theta) {
+                            const RowVectorRef<double> &M,
+                            const VectorRef<double> &theta) {
     ops.W.tensordotRz(M.template cast<Scalar>(), theta.template cast<Scalar>());
     return ops.W.tensordotRz_result.template cast<double>();
   });
 
   Ops.def("tensordotDz", [](starry::Ops<Scalar> &ops,
-                            const RowVector<double> &M,
-                            const Vector<double> &theta, const double &alpha) {
+                            const RowVectorRef<double> &M,
+                            const VectorRef<double> &theta,
+                            const double &alpha) {
     ops.W.tensordotDz(M.template cast<Scalar>(), theta.template cast<Scalar>(),
                       static_cast<Scalar>(alpha));
     return ops.W.tensordotDz_result.template cast<double>();
   });
 
   // Z rotation operator (matrices)
-  Ops.def("tensordotRz", [](starry::Ops<Scalar> &ops, const Matrix<double> &M,
-                            const Vector<double> &theta) {
+  Ops.def("tensordotRz", [](starry::Ops<Scalar> &ops,
+                            const MatrixRef<double> &M,
+                            const VectorRef<double> &theta) {
     ops.W.tensordotRz(M.template cast<Scalar>(), theta.template cast<Scalar>());
     return ops.W.tensordotRz_result.template cast<double>();
   });
 
-  Ops.def("tensordotDz", [](starry::Ops<Scalar> &ops, const Matrix<double> &M,
-                            const Vector<double> &theta, const double &alpha) {
+  Ops.def("tensordotDz", [](starry::Ops<Scalar> &ops,
+                            const MatrixRef<double> &M,
+                            const VectorRef<double> &theta,
+                            const double &alpha) {
     ops.W.tensordotDz(M.template cast<Scalar>(), theta.template cast<Scalar>(),
                       static_cast<Scalar>(alpha));
     return ops.W.tensordotDz_result.template cast<double>();
@@ -336,9 +482,9 @@ PYBIND11_MODULE(_c_ops, m) {
 
   // Gradient of Z rotation matrix (vectors)
   Ops.def("tensordotRz", [](starry::Ops<Scalar> &ops,
-                            const RowVector<double> &M,
-                            const Vector<double> &theta,
-                            const Matrix<double> &bMRz) {
+                            const RowVectorRef<double> &M,
+                            const VectorRef<double> &theta,
+                            const MatrixRef<double> &bMRz) {
     ops.W.tensordotRz(M.template cast<Scalar>(), theta.template cast<Scalar>(),
                       bMRz.template cast<Scalar>());
     return py::make_tuple(ops.W.tensordotRz_bM.template cast<double>(),
@@ -347,9 +493,9 @@ PYBIND11_MODULE(_c_ops, m) {
 
   // Gradient of Z rotation matrix (vectors)
   Ops.def("tensordotDz", [](starry::Ops<Scalar> &ops,
-                            const RowVector<double> &M,
-                            const Vector<double> &theta, const double &alpha,
-                            const Matrix<double> &bMDz) {
+                            const RowVectorRef<double> &M,
+                            const VectorRef<double> &theta, const double &alpha,
+                            const MatrixRef<double> &bMDz) {
     ops.W.tensordotDz(M.template cast<Scalar>(), theta.template cast<Scalar>(),
                       static_cast<Scalar>(alpha), bMDz.template cast<Scalar>());
     return py::make_tuple(ops.W.tensordotDz_bM.template cast<double>(),
@@ -358,9 +504,10 @@ PYBIND11_MODULE(_c_ops, m) {
   });
 
   // Gradient of Z rotation matrix (matrices)
-  Ops.def("tensordotRz", [](starry::Ops<Scalar> &ops, const Matrix<double> &M,
-                            const Vector<double> &theta,
-                            const Matrix<double> &bMRz) {
+  Ops.def("tensordotRz", [](starry::Ops<Scalar> &ops,
+                            const MatrixRef<double> &M,
+                            const VectorRef<double> &theta,
+                            const MatrixRef<double> &bMRz) {
     ops.W.tensordotRz(M.template cast<Scalar>(), theta.template cast<Scalar>(),
                       bMRz.template cast<Scalar>());
     return py::make_tuple(ops.W.tensordotRz_bM.template cast<double>(),
@@ -368,9 +515,10 @@ PYBIND11_MODULE(_c_ops, m) {
   });
 
   // Gradient of Z rotation matrix (matrices)
-  Ops.def("tensordotDz", [](starry::Ops<Scalar> &ops, const Matrix<double> &M,
-                            const Vector<double> &theta, const double &alpha,
-                            const Matrix<double> &bMDz) {
+  Ops.def("tensordotDz", [](starry::Ops<Scalar> &ops,
+                            const MatrixRef<double> &M,
+                            const VectorRef<double> &theta, const double &alpha,
+                            const MatrixRef<double> &bMDz) {
     ops.W.tensordotDz(M.template cast<Scalar>(), theta.template cast<Scalar>(),
                       static_cast<Scalar>(alpha), bMDz.template cast<Scalar>());
     return py::make_tuple(ops.W.tensordotDz_bM.template cast<double>(),
@@ -378,48 +526,125 @@ PYBIND11_MODULE(_c_ops, m) {
                           static_cast<double>(ops.W.tensordotDz_balpha));
   });
 
+  // Z rotation operator (matrices, into `out`)
+  Ops.def(
+      "tensordotRz",
+      [](starry::Ops<Scalar> &ops, const MatrixRef<double> &M,
+         const VectorRef<double> &theta, OutMatrix<double> out) {
+        ops.W.tensordotRz(M.template cast<Scalar>(),
+                          theta.template cast<Scalar>());
+        copy_into(ops.W.tensordotRz_result, out);
+      },
+      py::arg("M"), py::arg("theta"), py::arg("out"));
+
+  Ops.def(
+      "tensordotDz",
+      [](starry::Ops<Scalar> &ops, const MatrixRef<double> &M,
+         const VectorRef<double> &theta, const double &alpha,
+         OutMatrix<double> out) {
+        ops.W.tensordotDz(M.template cast<Scalar>(),
+                          theta.template cast<Scalar>(),
+                          static_cast<Scalar>(alpha));
+        copy_into(ops.W.tensordotDz_result, out);
+      },
+      py::arg("M"), py::arg("theta"), py::arg("alpha"), py::arg("out"));
+
   // Filter operator
-  Ops.def("F", [](starry::Ops<Scalar> &ops, const Vector<double> &u,
-                  const Vector<double> &f) {
+  Ops.def("F", [](starry::Ops<Scalar> &ops, const VectorRef<double> &u,
+                  const VectorRef<double> &f) {
     ops.F.computeF(u.template cast<Scalar>(), f.template cast<Scalar>());
-    return ops.F.F.template cast<double>();
+#ifdef STARRY_MULTI
+    return Eigen::SparseMatrix<double>(ops.F.F.template cast<double>());
+#else
+    return ops.F.F;
+#endif
   });
 
   // Gradient of filter operator
-  Ops.def("F", [](starry::Ops<Scalar> &ops, const Vector<double> &u,
-                  const Vector<double> &f, const Matrix<double> &bF) {
+  Ops.def("F", [](starry::Ops<Scalar> &ops, const VectorRef<double> &u,
+                  const VectorRef<double> &f, const MatrixRef<double> &bF) {
     ops.F.computeF(u.template cast<Scalar>(), f.template cast<Scalar>(),
                    bF.template cast<Scalar>());
     return py::make_tuple(ops.F.bu.template cast<double>(),
                           ops.F.bf.template cast<double>());
   });
 
-  // Compute the Ylm expansion of a gaussian spot
-  Ops.def("spotYlm", [](starry::Ops<Scalar> &ops, const RowVector<Scalar> &amp,
-                        const Scalar &sigma, const Scalar &lat,
-                        const Scalar &lon) {
+  // Filter operator applied to a matrix of polynomials
+  Ops.def("Fdot", [](starry::Ops<Scalar> &ops, const VectorRef<double> &u,
+                     const VectorRef<double> &f, const MatrixRef<double> &M) {
+    ops.F.computeFdot(u.template cast<Scalar>(), f.template cast<Scalar>(),
+                      M.template cast<Scalar>());
+    return ops.F.FM.template cast<double>();
+  });
+
+  // Gradient of filter operator applied to a matrix of polynomials
+  Ops.def("Fdot", [](starry::Ops<Scalar> &ops, const VectorRef<double> &u,
+                     const VectorRef<double> &f, const MatrixRef<double> &M,
+                     const MatrixRef<double> &bFM) {
+    ops.F.computeFdot(u.template cast<Scalar>(), f.template cast<Scalar>(),
+                      M.template cast<Scalar>(), bFM.template cast<Scalar>());
+    return py::make_tuple(ops.F.bu.template cast<double>(),
+                          ops.F.bf.template cast<double>(),
+                          ops.F.bM.template cast<double>());
+  });
+
+  // Compute the summed Ylm expansion of a set of gaussian spots
+  Ops.def("spotYlm", [](starry::Ops<Scalar> &ops, const MatrixRef<double> &amp,
+                        const VectorRef<double> &sigma,
+                        const VectorRef<double> &lat,
+                        const VectorRef<double> &lon) {
     return ops
-        .spotYlm(amp.template cast<double>(), static_cast<Scalar>(sigma),
-                 static_cast<Scalar>(lat), static_cast<Scalar>(lon))
+        .spotYlm(amp.template cast<Scalar>(), sigma.template cast<Scalar>(),
+                 lat.template cast<Scalar>(), lon.template cast<Scalar>())
         .template cast<double>();
   });
 
-  // Gradient of the Ylm expansion of a gaussian spot
-  Ops.def("spotYlm", [](starry::Ops<Scalar> &ops, const RowVector<Scalar> &amp,
-                        const Scalar &sigma, const Scalar &lat,
-                        const Scalar &lon, const Matrix<double> &by) {
-    ops.spotYlm(amp.template cast<double>(), static_cast<Scalar>(sigma),
-                static_cast<Scalar>(lat), static_cast<Scalar>(lon),
+  // Gradient of the summed Ylm expansion of a set of gaussian spots
+  Ops.def("spotYlm", [](starry::Ops<Scalar> &ops, const MatrixRef<double> &amp,
+                        const VectorRef<double> &sigma,
+                        const VectorRef<double> &lat,
+                        const VectorRef<double> &lon,
+                        const MatrixRef<double> &by) {
+    ops.spotYlm(amp.template cast<Scalar>(), sigma.template cast<Scalar>(),
+                lat.template cast<Scalar>(), lon.template cast<Scalar>(),
                 by.template cast<Scalar>());
+    return py::make_tuple(ops.bamp.template cast<double>(),
+                          ops.bsigma.template cast<double>(),
+                          ops.blat.template cast<double>(),
+                          ops.blon.template cast<double>());
+  });
+
+  // Global minimum of the map intensity
+  Ops.def("minimize", [](starry::Ops<Scalar> &ops, const VectorRef<double> &y,
+                         const int oversample, const int ntries,
+                         const int nthreads) {
+    Vector<Scalar> y_ = y.template cast<Scalar>();
+    {
+      py::gil_scoped_release release;
+      ops.M.compute(y_, oversample, ntries, nthreads);
+    }
     return py::make_tuple(
-        ops.bamp.template cast<double>(), static_cast<double>(ops.bsigma),
-        static_cast<double>(ops.blat), static_cast<double>(ops.blon));
+        static_cast<double>(ops.M.lat), static_cast<double>(ops.M.lon),
+        static_cast<double>(ops.M.I), ops.M.niter, ops.M.converged);
+  });
+
+  // Certified positivity of the map intensity
+  Ops.def("positivity", [](starry::Ops<Scalar> &ops, const VectorRef<double> &y,
+                           const int maxdepth, const int nthreads) {
+    Vector<Scalar> y_ = y.template cast<Scalar>();
+    {
+      py::gil_scoped_release release;
+      ops.P.compute(y_, nthreads, maxdepth);
+    }
+    return py::make_tuple(ops.P.status, static_cast<double>(ops.P.lat),
+                          static_cast<double>(ops.P.lon),
+                          static_cast<double>(ops.P.I), ops.P.ncells);
   });
 
   // Oren-Nayar (1994) illumination polynomial (reflected light)
   Ops.def("OrenNayarPolynomial",
-          [](starry::Ops<Scalar> &ops, const Vector<double> &b,
-             const Vector<double> &theta, const double &sigr) {
+          [](starry::Ops<Scalar> &ops, const VectorRef<double> &b,
+             const VectorRef<double> &theta, const double &sigr) {
             int N = (STARRY_OREN_NAYAR_DEG + 1) * (STARRY_OREN_NAYAR_DEG + 1);
             Matrix<double> p(N, b.size());
             for (int i = 0; i < b.size(); ++i) {
@@ -432,14 +657,196 @@ PYBIND11_MODULE(_c_ops, m) {
             return p;
           });
 
+#ifdef STARRY_COUNT_ALLOCATIONS
+  // Heap allocation counter (debug builds only)
+  m.def("reset_allocations", []() { starry::utils::allocations::reset(); });
+  m.def("allocations", []() { return starry::utils::allocations::count(); });
+#endif
+
   // Export the degree for access in theano
   m.attr("STARRY_OREN_NAYAR_DEG") = py::int_(STARRY_OREN_NAYAR_DEG);
 
+  // Bulirsch's `el2` for a vector of integration limits (scalar kernel)
+  m.def("el2", [](const VectorRef<double> &x, const double &kc,
+                  const double &a, const double &b) {
+    return starry::reflected::ellip::el2<double>(x, kc, a, b);
+  });
+
+  // Batched incomplete elliptic integrals `F` and `E` & their derivatives
+  m.def("el2", [](const VectorRef<double> &tanphi, const VectorRef<double> &m) {
+    Vector<double> F, E, dFdtanphi, dFdm, dEdtanphi, dEdm;
+    starry::reflected::ellip::el2<double>(tanphi, m, F, E, dFdtanphi, dFdm,
+                                          dEdtanphi, dEdm);
+    return py::make_tuple(F, E, dFdtanphi, dFdm, dEdtanphi, dEdm);
+  });
+
+  // Carlson's `RJ` (scalar kernel)
+  m.def("rj", [](const double &x, const double &y, const double &z,
+                 const double &p) {
+    return starry::reflected::ellip::rj<double>(x, y, z, p);
+  });
+
+  // Batched Carlson's `RJ` & its derivatives
+  m.def("rj", [](const VectorRef<double> &x, const VectorRef<double> &y,
+                 const VectorRef<double> &z, const VectorRef<double> &p) {
+    Vector<double> RJ;
+    Matrix<double> dRJ;
+    starry::reflected::ellip::rj<double>(x, y, z, p, RJ, dRJ);
+    return py::make_tuple(RJ, dRJ);
+  });
+
+  // Roots of a quartic (as used by the reflected occultation geometry)
+  m.def("quartic_roots", [](const VectorRef<double> &p) {
+    if (p.size() != 5)
+      throw std::length_error("Expected 5 polynomial coefficients.");
+    double coeffs[5] = {p(0), p(1), p(2), p(3), p(4)};
+    std::complex<double> roots[4];
+    starry::reflected::geometry::quartic_roots(coeffs, roots);
+    Eigen::Matrix<std::complex<double>, 4, 1> result;
+    for (int n = 0; n < 4; ++n)
+      result(n) = roots[n];
+    return result;
+  });
+
   // Sturm's theorem to get number of poly roots between `a` and `b`
   m.def("nroots",
-        [](const Vector<double> &p, const double &a, const double &b) {
-          return starry::sturm::polycountroots(p.template cast<Scalar>(),
-                                               static_cast<Scalar>(a),
-                                               static_cast<Scalar>(b));
+        [](const VectorRef<double> &p, const double &a, const double &b) {
+          return starry::sturm::polycountroots<Scalar>(
+              p.template cast<Scalar>(), static_cast<Scalar>(a),
+              static_cast<Scalar>(b));
+        });
+
+  // Batched limb darkening physicality check
+  m.def("limbdark_is_physical",
+        [](const MatrixRef<double> &u, const int nthreads) {
+          Eigen::Matrix<bool, Eigen::Dynamic, 1> physical;
+          {
+            py::gil_scoped_release release;
+            starry::sturm::limbdark_is_physical<Scalar>(u, physical, nthreads);
+          }
+          return physical;
+        });
+
+  // Factorization of a quasiseparable (celerite) covariance matrix
+  m.def("celerite_factor",
+        [](const VectorRef<double> &a, const MatrixRef<double> &U,
+           const MatrixRef<double> &V, const MatrixRef<double> &P) {
+          Vector<double> d;
+          Matrix<double> W, S;
+          starry::celerite::factor<double>(a, U, V, P, d, W, S);
+          return py::make_tuple(d, W, S);
+        });
+
+  // Gradient of the factorization
+  m.def("celerite_factor",
+        [](const VectorRef<double> &a, const MatrixRef<double> &U,
+           const MatrixRef<double> &V, const MatrixRef<double> &P,
+           const VectorRef<double> &d, const MatrixRef<double> &W,
+           const MatrixRef<double> &S, const VectorRef<double> &bd,
+           const MatrixRef<double> &bW) {
+          Vector<double> ba;
+          Matrix<double> bU, bV, bP;
+          starry::celerite::factor<double>(a, U, V, P, d, W, S, bd, bW, ba, bU,
+                                           bV, bP);
+          return py::make_tuple(ba, bU, bV, bP);
+        });
+
+  // Solve a linear system with a factorized celerite covariance matrix
+  m.def("celerite_solve",
+        [](const MatrixRef<double> &U, const MatrixRef<double> &P,
+           const VectorRef<double> &d, const MatrixRef<double> &W,
+           const MatrixRef<double> &Y) {
+          Matrix<double> Z;
+          starry::celerite::solve<double>(U, P, d, W, Y, Z);
+          return Z;
+        });
+
+  // Gradient of the solve
+  m.def("celerite_solve",
+        [](const MatrixRef<double> &U, const MatrixRef<double> &P,
+           const VectorRef<double> &d, const MatrixRef<double> &W,
+           const MatrixRef<double> &Y, const MatrixRef<double> &bZ) {
+          Vector<double> bd;
+          Matrix<double> bU, bP, bW, bY;
+          starry::celerite::solve<double>(U, P, d, W, Y, bZ, bU, bP, bd, bW,
+                                          bY);
+          return py::make_tuple(bU, bP, bd, bW, bY);
+        });
+
+  // Indices of all pairwise occultations in a system
+  m.def("occultations",
+        [](const MatrixRef<double> &x, const MatrixRef<double> &y,
+           const MatrixRef<double> &z, const VectorRef<double> &r) {
+          Vector<int> offsets, idx, occultor;
+          starry::system::occultations<double>(x, y, z, r, offsets, idx,
+                                               occultor);
+          return py::make_tuple(offsets, idx, occultor);
+        });
+
+  // Flux design matrix of a system of bodies in emitted light. The
+  // engine keeps the list of the bodies' `Ops` instances alive.
+  using DesignMatrix = starry::system::DesignMatrix<Scalar>;
+  py::class_<DesignMatrix> SystemX(m, "SystemDesignMatrix");
+  SystemX.def(py::init<std::vector<starry::Ops<Scalar> *>>(),
+              py::keep_alive<1, 2>());
+
+  // Design matrices, one per filter
+  SystemX.def(
+      "X",
+      [](DesignMatrix &S, const MatrixRef<double> &theta,
+         const MatrixRef<double> &x, const MatrixRef<double> &y,
+         const MatrixRef<double> &z, const VectorRef<double> &r,
+         const VectorRef<double> &inc, const VectorRef<double> &obl,
+         const std::vector<Vector<double>> &u,
+         const std::vector<Matrix<double>> &f, const VectorRef<double> &alpha,
+         const VectorRef<double> &tau, const VectorRef<double> &delta,
+         const VectorRef<double> &amp) {
+        S.compute(theta, x, y, z, r, inc, obl, u, f, alpha, tau, delta, amp);
+        return S.X;
+      });
+
+  // Gradient of the design matrices
+  SystemX.def(
+      "X",
+      [](DesignMatrix &S, const MatrixRef<double> &theta,
+         const MatrixRef<double> &x, const MatrixRef<double> &y,
+         const MatrixRef<double> &z, const VectorRef<double> &r,
+         const VectorRef<double> &inc, const VectorRef<double> &obl,
+         const std::vector<Vector<double>> &u,
+         const std::vector<Matrix<double>> &f, const VectorRef<double> &alpha,
+         const VectorRef<double> &tau, const VectorRef<double> &delta,
+         const VectorRef<double> &amp, const std::vector<Matrix<double>> &bX) {
+        S.compute(theta, x, y, z, r, inc, obl, u, f, alpha, tau, delta, amp,
+                  bX);
+        return py::make_tuple(S.btheta, S.bx, S.by, S.br, S.binc, S.bobl, S.bu,
+                              S.bf, S.balpha, S.btau, S.bdelta, S.bamp);
+      });
+
+  // Sky positions of bodies on Keplerian orbits
+  m.def("kepler_position",
+        [](const VectorRef<double> &t, const VectorRef<double> &t0,
+           const VectorRef<double> &porb, const VectorRef<double> &ecc,
+           const VectorRef<double> &w, const VectorRef<double> &Omega,
+           const VectorRef<double> &inc, const VectorRef<double> &a,
+           const double &invc) {
+          Matrix<double> x, y, z;
+          starry::kepler::position<double>(t, t0, porb, ecc, w, Omega, inc, a,
+                                           invc, x, y, z);
+          return py::make_tuple(x, y, z);
+        });
+
+  // Gradient of the sky positions
+  m.def("kepler_position",
+        [](const VectorRef<double> &t, const VectorRef<double> &t0,
+           const VectorRef<double> &porb, const VectorRef<double> &ecc,
+           const VectorRef<double> &w, const VectorRef<double> &Omega,
+           const VectorRef<double> &inc, const VectorRef<double> &a,
+           const double &invc, const MatrixRef<double> &bx,
+           const MatrixRef<double> &by, const MatrixRef<double> &bz) {
+          Vector<double> bt, bt0, bporb, becc, bw, bOmega, binc, ba;
+          starry::kepler::position<double>(t, t0, porb, ecc, w, Omega, inc, a,
+                                           invc, bx, by, bz, bt, bt0, bporb,
+                                           becc, bw, bOmega, binc, ba);
+          return py::make_tuple(bt, bt0, bporb, becc, bw, bOmega, binc, ba);
         });
 }
\ No newline at end of file
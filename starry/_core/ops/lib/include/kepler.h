@@ -0,0 +1,266 @@
+/**
+\file kepler.h
+\brief Keplerian orbits: positions and their gradients.
+
+The conventions follow those of `exoplanet`: the argument of periastron
+`w` is that of the body, `t0` is the time of transit (when the true
+anomaly is `pi / 2 - w`) and the sky frame is obtained by rotating the
+orbit by `w`, then by `-inc` about the line of nodes and finally by
+`Omega` on the sky, with `z` pointing toward the observer. Positions are
+returned in the units of the (signed) semi-major axis `a`.
+
+*/
+
+#ifndef _STARRY_KEPLER_H_
+#define _STARRY_KEPLER_H_
+
+#include "utils.h"
+
+namespace starry {
+namespace kepler {
+
+using namespace utils;
+
+/**
+Solve Kepler's equation `E - e sin(E) = M` for the sine and cosine of the
+eccentric anomaly using Halley's method with the starting guess of Danby
+(1988). This converges in a handful of iterations for all `0 <= e < 1`.
+
+*/
+template <typename T>
+inline void solve(const T &M, const T &ecc, T &sinE, T &cosE) {
+  // Reduce the mean anomaly to [-pi, pi)
+  T Mr = M - 2 * pi<T>() * floor((M + pi<T>()) / (2 * pi<T>()));
+  T E = Mr;
+  if (ecc > 0) {
+    E += (Mr < 0 ? -0.85 : 0.85) * ecc;
+    T f, fp, fpp, dE;
+    for (int iter = 0; iter < STARRY_KEPLER_MAX_ITER; ++iter) {
+      sinE = sin(E);
+      cosE = cos(E);
+      f = E - ecc * sinE - Mr;
+      fp = 1 - ecc * cosE;
+      fpp = ecc * sinE;
+      dE = -f / (fp - 0.5 * f * fpp / fp);
+      E += dE;
+      if (abs(dE) < 2 * mach_eps<T>())
+        break;
+    }
+  }
+  sinE = sin(E);
+  cosE = cos(E);
+}
+
+/**
+A single Keplerian orbit.
+
+*/
+template <typename T> class Orbit {
+
+  // Orbital elements
+  const T t0;
+  const T porb;
+  const T ecc;
+  const T a;
+  const T cosw, sinw;
+  const T cosO, sinO;
+  const T cosi, sini;
+
+  // Derived quantities
+  const T n;
+  const T se;
+  T M0;
+  T dM0de;
+  T dM0dw;
+
+  // State at the current time
+  T te;
+  T cosf, sinf;
+  T q, r;
+  T cosu, sinu;
+  T A, B;
+
+public:
+  T x, y, z;
+
+  explicit Orbit(const T &t0, const T &porb, const T &ecc, const T &w,
+                 const T &Omega, const T &inc, const T &a)
+      : t0(t0), porb(porb), ecc(ecc), a(a), cosw(cos(w)), sinw(sin(w)),
+        cosO(cos(Omega)), sinO(sin(Omega)), cosi(cos(inc)), sini(sin(inc)),
+        n(2 * pi<T>() / porb), se(sqrt(1 - ecc * ecc)) {
+
+    if (!(porb > 0))
+      throw std::invalid_argument("The orbital period must be positive.");
+    if (!((ecc >= 0) && (ecc < 1)))
+      throw std::invalid_argument(
+          "The eccentricity must be in the range [0, 1).");
+
+    // Mean anomaly at transit, where the true anomaly is `pi / 2 - w`
+    T E0 = 2 * atan2(sqrt(1 - ecc) * cosw, sqrt(1 + ecc) * (1 + sinw));
+    M0 = E0 - ecc * sin(E0);
+    T q0 = 1 + ecc * sinw;
+    dM0dw = -se * se * se / (q0 * q0);
+    dM0de = -cosw * (2 + ecc * sinw) * se / (q0 * q0);
+  }
+
+  /**
+  Compute the position at time `t`.
+
+  */
+  inline void evaluate(const T &t) {
+    te = t;
+    T sinE, cosE;
+    solve(n * (t - t0) + M0, ecc, sinE, cosE);
+    T den = 1 - ecc * cosE;
+    cosf = (cosE - ecc) / den;
+    sinf = se * sinE / den;
+    q = 1 + ecc * cosf;
+    r = a * se * se / q;
+    cosu = cosf * cosw - sinf * sinw;
+    sinu = sinf * cosw + cosf * sinw;
+    A = r * cosu;
+    B = r * sinu;
+    x = cosO * A - sinO * cosi * B;
+    y = sinO * A + cosO * cosi * B;
+    z = -sini * B;
+  }
+
+  /**
+  The time derivative of `z` at the current time.
+
+  */
+  inline T zdot() const { return -sini * n * a * (cosu + ecc * cosw) / se; }
+
+  /**
+  Compute the position at time `t`, or at the retarded time `t'` satisfying
+  `t' = t + invc * z(t')` if the inverse speed of light `invc` is nonzero.
+
+  */
+  inline void compute(const T &t, const T &invc) {
+    evaluate(t);
+    if (invc != 0) {
+      T dt;
+      for (int iter = 0; iter < STARRY_KEPLER_MAX_ITER; ++iter) {
+        dt = (te - t - invc * z) / (1 - invc * zdot());
+        evaluate(te - dt);
+        if (abs(dt) <= 2 * mach_eps<T>() * (1 + abs(te)))
+          break;
+      }
+    }
+  }
+
+  /**
+  Backpropagate the gradients of `x`, `y`, and `z` at the current time
+  into the orbital elements. Returns the gradient with respect to time.
+
+  */
+  inline T backprop(const T &bx, const T &by, const T &bz, T &bt0, T &bporb,
+                    T &becc, T &bw, T &bOmega, T &binc, T &ba) const {
+    // Sky rotation
+    T bA = cosO * bx + sinO * by;
+    T bB = cosi * (cosO * by - sinO * bx) - sini * bz;
+    bOmega += x * by - y * bx;
+    binc += sini * B * (sinO * bx - cosO * by) - cosi * B * bz;
+
+    // Orbital plane
+    T br = bA * cosu + bB * sinu;
+    T bf = A * bB - B * bA;
+    bw += bf;
+
+    // Radius
+    ba += br * se * se / q;
+    becc -= br * a * (2 * ecc + (1 + ecc * ecc) * cosf) / (q * q);
+    bf += br * r * ecc * sinf / q;
+
+    // True anomaly
+    T bM = bf * q * q / (se * se * se);
+    becc += bf * sinf * (2 + ecc * cosf) / (se * se);
+
+    // Mean anomaly
+    bt0 -= n * bM;
+    bporb -= n * (te - t0) / porb * bM;
+    becc += dM0de * bM;
+    bw += dM0dw * bM;
+    return n * bM;
+  }
+};
+
+/**
+Compute the sky positions of `nbodies` bodies on Keplerian orbits at times
+`t`. The result has one row per time and one column per body. If `invc`
+(the inverse of the speed of light) is nonzero, each body is placed at the
+retarded time `t'` satisfying `t' = t + invc * z(t')`, i.e., the light
+travel time across the system is accounted for relative to the plane
+`z = 0`.
+
+*/
+template <typename T>
+inline void position(const VectorRef<T> &t, const VectorRef<T> &t0,
+                     const VectorRef<T> &porb, const VectorRef<T> &ecc,
+                     const VectorRef<T> &w, const VectorRef<T> &Omega,
+                     const VectorRef<T> &inc, const VectorRef<T> &a,
+                     const T &invc, Matrix<T> &x, Matrix<T> &y, Matrix<T> &z) {
+  const int N = t.size();
+  const int nbodies = t0.size();
+  x.resize(N, nbodies);
+  y.resize(N, nbodies);
+  z.resize(N, nbodies);
+  for (int k = 0; k < nbodies; ++k) {
+    Orbit<T> orbit(t0(k), porb(k), ecc(k), w(k), Omega(k), inc(k), a(k));
+    for (int i = 0; i < N; ++i) {
+      orbit.compute(t(i), invc);
+      x(i, k) = orbit.x;
+      y(i, k) = orbit.y;
+      z(i, k) = orbit.z;
+    }
+  }
+}
+
+/**
+Backpropagate the gradients of the sky positions into the times and the
+orbital elements.
+
+*/
+template <typename T>
+inline void position(const VectorRef<T> &t, const VectorRef<T> &t0,
+                     const VectorRef<T> &porb, const VectorRef<T> &ecc,
+                     const VectorRef<T> &w, const VectorRef<T> &Omega,
+                     const VectorRef<T> &inc, const VectorRef<T> &a,
+                     const T &invc, const MatrixRef<T> &bx,
+                     const MatrixRef<T> &by, const MatrixRef<T> &bz,
+                     Vector<T> &bt, Vector<T> &bt0,
+                     Vector<T> &bporb, Vector<T> &becc, Vector<T> &bw,
+                     Vector<T> &bOmega, Vector<T> &binc, Vector<T> &ba) {
+  const int N = t.size();
+  const int nbodies = t0.size();
+  bt.setZero(N);
+  bt0.setZero(nbodies);
+  bporb.setZero(nbodies);
+  becc.setZero(nbodies);
+  bw.setZero(nbodies);
+  bOmega.setZero(nbodies);
+  binc.setZero(nbodies);
+  ba.setZero(nbodies);
+  for (int k = 0; k < nbodies; ++k) {
+    Orbit<T> orbit(t0(k), porb(k), ecc(k), w(k), Omega(k), inc(k), a(k));
+    for (int i = 0; i < N; ++i) {
+      orbit.compute(t(i), invc);
+
+      // Explicit dependence on the elements & the retarded time
+      T bte = orbit.backprop(bx(i, k), by(i, k), bz(i, k), bt0(k), bporb(k),
+                             becc(k), bw(k), bOmega(k), binc(k), ba(k));
+
+      // Implicit dependence through `t' = t + invc * z(t')`
+      if (invc != 0) {
+        bte /= 1 - invc * orbit.zdot();
+        orbit.backprop(0, 0, invc * bte, bt0(k), bporb(k), becc(k), bw(k),
+                       bOmega(k), binc(k), ba(k));
+      }
+      bt(i) += bte;
+    }
+  }
+}
+
+} // namespace kepler
+} // namespace starry
+#endif
@@ -0,0 +1,577 @@
+/**
+\file minimize.h
+\brief Global minimization of the map intensity.
+
+*/
+
+#ifndef _STARRY_MINIMIZE_H_
+#define _STARRY_MINIMIZE_H_
+
+#include "basis.h"
+#include "utils.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+namespace starry {
+namespace minimize {
+
+using namespace utils;
+
+/**
+A map in the polynomial basis. Only the nonzero terms are stored, and
+each term `x^a y^b z^c` (with `c` either zero or one) is evaluated
+along with its first and second derivatives with respect to
+`(x, y, z)`. Instances hold their own scratch space, so each thread
+needs its own copy.
+
+*/
+template <typename Scalar> class Polynomial {
+protected:
+  const int deg;             /**< */
+  Vector<Scalar> xpow, ypow; /**< Powers of x and y */
+
+public:
+  std::vector<Scalar> coeff;            /**< The nonzero coefficients */
+  std::vector<std::array<int, 3>> expo; /**< Exponents of x, y, z */
+
+  explicit Polynomial(int deg) : deg(deg), xpow(deg + 1), ypow(deg + 1) {}
+
+  /**
+  Set the polynomial from its vector of coefficients `p`.
+
+  */
+  inline void set(const Vector<Scalar> &p) {
+    coeff.clear();
+    expo.clear();
+    int n = 0;
+    for (int l = 0; l < deg + 1; ++l) {
+      for (int m = -l; m < l + 1; ++m) {
+        if (p(n) != 0) {
+          int mu = l - m;
+          int nu = l + m;
+          coeff.push_back(p(n));
+          if (nu % 2 == 0)
+            expo.push_back({mu / 2, nu / 2, 0});
+          else
+            expo.push_back({(mu - 1) / 2, (nu - 1) / 2, 1});
+        }
+        ++n;
+      }
+    }
+  }
+
+  /**
+  Evaluate the polynomial and its gradient (and optionally its Hessian)
+  at the point `r`.
+
+  */
+  inline Scalar evaluate(const UnitVector<Scalar> &r, UnitVector<Scalar> &grad,
+                         Eigen::Matrix<Scalar, 3, 3> &hess,
+                         bool hessian = true) {
+    xpow(0) = 1.0;
+    ypow(0) = 1.0;
+    for (int k = 1; k < deg + 1; ++k) {
+      xpow(k) = xpow(k - 1) * r(0);
+      ypow(k) = ypow(k - 1) * r(1);
+    }
+    Scalar f = 0.0;
+    grad.setZero();
+    hess.setZero();
+    for (size_t n = 0; n < coeff.size(); ++n) {
+      const Scalar &pn = coeff[n];
+      int a = expo[n][0], b = expo[n][1], c = expo[n][2];
+      Scalar zc = c ? r(2) : Scalar(1.0);
+      Scalar xa = xpow(a), yb = ypow(b);
+      Scalar xa1 = a > 0 ? a * xpow(a - 1) : Scalar(0.0);
+      Scalar yb1 = b > 0 ? b * ypow(b - 1) : Scalar(0.0);
+      f += pn * xa * yb * zc;
+      grad(0) += pn * xa1 * yb * zc;
+      grad(1) += pn * xa * yb1 * zc;
+      if (c)
+        grad(2) += pn * xa * yb;
+      if (hessian) {
+        Scalar xa2 = a > 1 ? a * (a - 1) * xpow(a - 2) : Scalar(0.0);
+        Scalar yb2 = b > 1 ? b * (b - 1) * ypow(b - 2) : Scalar(0.0);
+        hess(0, 0) += pn * xa2 * yb * zc;
+        hess(1, 1) += pn * xa * yb2 * zc;
+        hess(0, 1) += pn * xa1 * yb1 * zc;
+        if (c) {
+          hess(0, 2) += pn * xa1 * yb;
+          hess(1, 2) += pn * xa * yb1;
+        }
+      }
+    }
+    hess(1, 0) = hess(0, 1);
+    hess(2, 0) = hess(0, 2);
+    hess(2, 1) = hess(1, 2);
+    return f;
+  }
+};
+
+/**
+Find the global minimum of the intensity of a spherical harmonic map.
+
+We evaluate the map on a quasi-uniform (Fibonacci) grid of points on
+the sphere, pick the `ntries` lowest grid points that are not
+neighbors of each other, and refine each one with Newton's method on
+the sphere. The intensity is a polynomial in `(x, y, z)`, so its
+gradient and Hessian are cheap to compute exactly. Each Newton step is
+taken in the plane tangent to the current point and mapped back onto
+the sphere by normalization, so there are no coordinate singularities
+at the poles. The searches are independent, so they are distributed
+among `nthreads` threads, each with its own copy of the polynomial.
+
+*/
+template <typename Scalar> class Minimizer {
+protected:
+  basis::Basis<Scalar> &B;
+  const int ydeg; /**< */
+  const int Ny;   /**< Number of spherical harmonic `(l, m)` coefficients */
+
+  // The grid
+  int oversample;           /**< Grid oversampling factor */
+  Matrix<Scalar> xyz_grid;  /**< Grid points on the unit sphere */
+  Matrix<Scalar> pTA1_grid; /**< The Ylm basis evaluated on the grid */
+  Scalar cos_sep;           /**< Minimum separation between starting points */
+
+  Polynomial<Scalar> poly; /**< The map in the polynomial basis */
+
+  /**
+  Compute a Fibonacci grid with (at least) `oversample * ydeg^2`
+  points and the Ylm basis evaluated on it.
+
+  */
+  inline void setup(int oversample_) {
+    if ((oversample_ == oversample) && (xyz_grid.cols() > 0))
+      return;
+    oversample = oversample_;
+    int npts = std::max(oversample * ydeg * ydeg, 12);
+    xyz_grid.resize(3, npts);
+    Scalar dphi = pi<Scalar>() * (3.0 - sqrt(Scalar(5.0)));
+    for (int i = 0; i < npts; ++i) {
+      Scalar y = 1.0 - (2.0 * i + 1.0) / npts;
+      Scalar r = sqrt(1.0 - y * y);
+      xyz_grid(0, i) = r * sin(i * dphi);
+      xyz_grid(1, i) = y;
+      xyz_grid(2, i) = r * cos(i * dphi);
+    }
+    B.computePolyBasis(ydeg, xyz_grid.row(0), xyz_grid.row(1),
+                       xyz_grid.row(2));
+    pTA1_grid = B.pT.leftCols(Ny) * B.A1;
+
+    // Don't start two searches within two grid spacings of each other
+    cos_sep = cos(2 * sqrt(4 * pi<Scalar>() / npts));
+  }
+
+  /**
+  Refine a local minimum of the intensity `poly` starting at the point
+  `r` using Newton's method on the sphere. Returns the number of
+  iterations; `converged` is set to true if the gradient vanished.
+
+  */
+  static inline int newton(Polynomial<Scalar> &poly, UnitVector<Scalar> &r,
+                           Scalar &f, bool &converged) {
+    const int maxiter = 100;
+    const Scalar tol = 10 * mach_eps<Scalar>();
+    UnitVector<Scalar> grad, e1, e2, s, rnew;
+    Eigen::Matrix<Scalar, 3, 3> hess;
+    Eigen::Matrix<Scalar, 2, 1> g, d;
+    Eigen::Matrix<Scalar, 2, 2> H;
+    converged = false;
+    f = poly.evaluate(r, grad, hess);
+    int iter;
+    for (iter = 0; iter < maxiter; ++iter) {
+      // Orthonormal basis for the tangent plane
+      UnitVector<Scalar> a = UnitVector<Scalar>::Zero();
+      Eigen::Index imin;
+      r.cwiseAbs().minCoeff(&imin);
+      a(imin) = 1.0;
+      e1 = r.cross(a).normalized();
+      e2 = r.cross(e1);
+
+      // Riemannian gradient and Hessian in that basis
+      Scalar rg = r.dot(grad);
+      g << e1.dot(grad), e2.dot(grad);
+      H << e1.dot(hess * e1) - rg, e1.dot(hess * e2), e2.dot(hess * e1),
+          e2.dot(hess * e2) - rg;
+      Scalar gnorm = g.norm();
+      if (gnorm <= tol * (1 + abs(f))) {
+        converged = true;
+        break;
+      }
+
+      // Newton step if the Hessian is positive definite,
+      // steepest descent otherwise
+      Scalar det = H.determinant();
+      if ((det > 0) && (H(0, 0) > 0)) {
+        d << H(1, 1) * g(0) - H(0, 1) * g(1), H(0, 0) * g(1) - H(1, 0) * g(0);
+        d /= -det;
+      } else {
+        d = -g / gnorm;
+      }
+
+      // Don't step more than a radian at a time
+      Scalar dnorm = d.norm();
+      if (dnorm > 1)
+        d /= dnorm;
+
+      // Backtracking line search
+      Scalar slope = g.dot(d);
+      Scalar t = 1.0;
+      Scalar fnew;
+      UnitVector<Scalar> gradnew;
+      Eigen::Matrix<Scalar, 3, 3> hessnew;
+      while (true) {
+        s = t * (d(0) * e1 + d(1) * e2);
+        rnew = (r + s).normalized();
+        fnew = poly.evaluate(rnew, gradnew, hessnew);
+        if ((fnew <= f + 1e-4 * t * slope) || (t * dnorm < tol))
+          break;
+        t *= 0.5;
+      }
+      if (t * dnorm < tol) {
+        converged = true;
+        break;
+      }
+      r = rnew;
+      f = fnew;
+      grad = gradnew;
+      hess = hessnew;
+    }
+    return iter;
+  }
+
+public:
+  Scalar lat;     /**< Latitude of the minimum (radians) */
+  Scalar lon;     /**< Longitude of the minimum (radians) */
+  Scalar I;       /**< Intensity at the minimum */
+  int niter;      /**< Total number of Newton iterations */
+  bool converged; /**< Did the search from the best point converge? */
+
+  explicit Minimizer(basis::Basis<Scalar> &B)
+      : B(B), ydeg(B.ydeg), Ny((ydeg + 1) * (ydeg + 1)), oversample(0),
+        poly(ydeg) {}
+
+  /**
+  Compute the location and value of the global minimum of the
+  intensity of the map `y`.
+
+  */
+  inline void compute(const Vector<Scalar> &y, int oversample_, int ntries,
+                      int nthreads = 1) {
+    setup(oversample_);
+
+    // Transform to the polynomial basis
+    poly.set(B.A1 * y);
+
+    // Sort the grid points by intensity
+    Vector<Scalar> I_grid = pTA1_grid * y;
+    std::vector<Eigen::Index> idx(I_grid.size());
+    std::iota(idx.begin(), idx.end(), 0);
+    std::sort(idx.begin(), idx.end(),
+              [&I_grid](Eigen::Index i, Eigen::Index j) {
+                return I_grid(i) < I_grid(j);
+              });
+
+    // Refine the lowest points that aren't neighbors of each other
+    std::vector<Eigen::Index> starts;
+    for (Eigen::Index i : idx) {
+      if (int(starts.size()) >= std::max(ntries, 1))
+        break;
+      bool isolated = true;
+      for (Eigen::Index j : starts) {
+        if (xyz_grid.col(i).dot(xyz_grid.col(j)) > cos_sep) {
+          isolated = false;
+          break;
+        }
+      }
+      if (isolated)
+        starts.push_back(i);
+    }
+    const int nstarts = starts.size();
+    std::vector<UnitVector<Scalar>> r(nstarts);
+    std::vector<Scalar> f(nstarts);
+    std::vector<char> conv(nstarts);
+    std::vector<int> iters(nstarts);
+    std::atomic<int> next(0);
+    std::atomic<bool> failed(false);
+    auto work = [&](Polynomial<Scalar> &p) {
+      int i;
+      while (!failed && ((i = next++) < nstarts)) {
+        bool c;
+        r[i] = xyz_grid.col(starts[i]);
+        iters[i] = newton(p, r[i], f[i], c);
+        conv[i] = c;
+      }
+    };
+
+    if (nthreads <= 0)
+      nthreads = std::thread::hardware_concurrency();
+    nthreads = std::max(1, std::min(nthreads, nstarts));
+    if (nthreads == 1) {
+      work(poly);
+    } else {
+      // Parallel evaluation; errors are rethrown in the calling thread
+      std::vector<Polynomial<Scalar>> polys(nthreads - 1, poly);
+      std::exception_ptr error = nullptr;
+      std::mutex error_mutex;
+      auto guarded_work = [&](Polynomial<Scalar> &p) {
+        try {
+          work(p);
+        } catch (...) {
+          std::lock_guard<std::mutex> error_lock(error_mutex);
+          if (!error)
+            error = std::current_exception();
+          failed = true;
+        }
+      };
+      std::vector<std::thread> threads;
+      for (int t = 0; t < nthreads - 1; ++t)
+        threads.emplace_back(guarded_work, std::ref(polys[t]));
+      guarded_work(poly);
+      for (auto &thread : threads)
+        thread.join();
+      if (error)
+        std::rethrow_exception(error);
+    }
+
+    // Pick the lowest minimum, in the order of the starting points so
+    // the result doesn't depend on the number of threads
+    I = INFINITY;
+    niter = 0;
+    UnitVector<Scalar> rbest = zhat<Scalar>();
+    for (int i = 0; i < nstarts; ++i) {
+      niter += iters[i];
+      if (f[i] < I) {
+        I = f[i];
+        rbest = r[i];
+        converged = conv[i];
+      }
+    }
+
+    // Convert to lat-lon
+    lat = asin(std::max(Scalar(-1.0), std::min(Scalar(1.0), rbest(1))));
+    lon = atan2(rbest(0), rbest(2));
+  }
+};
+
+/**
+Certify that the intensity of a spherical harmonic map is positive
+everywhere on the sphere, or find a point where it is not.
+
+We recursively subdivide the faces of an icosahedron into spherical
+triangles. On each cell, with center `c` and angular radius `R`,
+Taylor's theorem along the geodesics from `c` gives the lower bound
+
+        I >= I(c) - |g(c)| R - M R^2 / 2
+
+where `g` is the gradient of the intensity on the sphere and `M`
+bounds its second derivative along any great circle. The restriction of
+a degree-`l` spherical harmonic to a great circle is a trigonometric
+polynomial of degree `l`, so by Bernstein's inequality its second
+derivative is at most `l^2` times its maximum, which by the addition
+theorem is `|Y_l0(north pole)|` times the norm of its coefficients.
+Cells whose lower bound is positive are pruned; the others are split in
+four until either the intensity at a cell center is negative (a
+witness) or the maximum depth is reached (an inconclusive result,
+which only happens if the minimum of the map is at or very near zero).
+
+The cells are distributed among `nthreads` threads.
+
+*/
+template <typename Scalar> class Positivity {
+protected:
+  basis::Basis<Scalar> &B;
+  const int ydeg; /**< */
+
+  using Cell = std::array<UnitVector<Scalar>, 3>;
+  std::vector<Cell> roots; /**< The cells we start from */
+  Vector<Scalar> Ymax;     /**< Maximum of a unit degree-`l` harmonic */
+
+  /**
+  Compute the faces of an icosahedron, subdivided `nsub` times.
+
+  */
+  inline void computeRoots(int nsub) {
+    const Scalar t = 0.5 * (1.0 + sqrt(Scalar(5.0)));
+    std::vector<UnitVector<Scalar>> v = {
+        {-1, t, 0}, {1, t, 0},  {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t},  {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1},  {-t, 0, -1}, {-t, 0, 1}};
+    for (auto &vi : v)
+      vi.normalize();
+    const int faces[20][3] = {
+        {0, 11, 5}, {0, 5, 1},  {0, 1, 7},   {0, 7, 10}, {0, 10, 11},
+        {1, 5, 9},  {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+        {3, 9, 4},  {3, 4, 2},  {3, 2, 6},   {3, 6, 8},  {3, 8, 9},
+        {4, 9, 5},  {2, 4, 11}, {6, 2, 10},  {8, 6, 7},  {9, 8, 1}};
+    roots.clear();
+    for (int i = 0; i < 20; ++i)
+      roots.push_back({v[faces[i][0]], v[faces[i][1]], v[faces[i][2]]});
+    for (int k = 0; k < nsub; ++k) {
+      std::vector<Cell> children;
+      for (auto &cell : roots)
+        subdivide(cell, children);
+      roots.swap(children);
+    }
+  }
+
+  /**
+  Split a spherical triangle into four.
+
+  */
+  static inline void subdivide(const Cell &cell, std::vector<Cell> &out) {
+    UnitVector<Scalar> m01 = (cell[0] + cell[1]).normalized();
+    UnitVector<Scalar> m12 = (cell[1] + cell[2]).normalized();
+    UnitVector<Scalar> m20 = (cell[2] + cell[0]).normalized();
+    out.push_back({cell[0], m01, m20});
+    out.push_back({m01, cell[1], m12});
+    out.push_back({m20, m12, cell[2]});
+    out.push_back({m01, m12, m20});
+  }
+
+public:
+  int status;  /**< 1 if positive, -1 if not, 0 if inconclusive */
+  Scalar lat;  /**< Latitude of the witness (or lowest point found) */
+  Scalar lon;  /**< Longitude of the witness (or lowest point found) */
+  Scalar I;    /**< Intensity at that point */
+  long ncells; /**< Number of cells visited */
+
+  explicit Positivity(basis::Basis<Scalar> &B)
+      : B(B), ydeg(B.ydeg), Ymax(ydeg + 1) {
+    // A few hundred cells to start with, so the threads stay busy
+    computeRoots(2);
+
+    // The zonal harmonics at the pole
+    RowVector<Scalar> x(1), y(1), z(1);
+    x(0) = 0.0;
+    y(0) = 0.0;
+    z(0) = 1.0;
+    B.computePolyBasis(ydeg, x, y, z);
+    RowVector<Scalar> Y = B.pT.leftCols((ydeg + 1) * (ydeg + 1)) * B.A1;
+    for (int l = 0; l < ydeg + 1; ++l)
+      Ymax(l) = abs(Y(l * l + l));
+  }
+
+  /**
+  Check whether the intensity of the map `y` is positive everywhere.
+
+  */
+  inline void compute(const Vector<Scalar> &y, int nthreads = 1,
+                      int maxdepth = 20) {
+    Polynomial<Scalar> poly(ydeg);
+    poly.set(B.A1 * y);
+
+    // Bound on the second derivative along great circles
+    Scalar M = 0.0;
+    for (int l = 1; l < ydeg + 1; ++l)
+      M += l * l * Ymax(l) * y.segment(l * l, 2 * l + 1).norm();
+
+    // Bound on the round-off error in evaluating the polynomial
+    Scalar err = 0.0;
+    for (size_t n = 0; n < poly.coeff.size(); ++n)
+      err += abs(poly.coeff[n]);
+    err *= 100 * (ydeg + 1) * mach_eps<Scalar>();
+
+    // Process the root cells until we're done or we find a witness
+    std::atomic<int> next(0);
+    std::atomic<bool> negative(false);
+    std::atomic<long> count(0);
+    std::mutex result_mutex;
+    std::atomic<bool> inconclusive(false);
+    UnitVector<Scalar> rlow = zhat<Scalar>();
+    Scalar flow = INFINITY;
+    auto work = [&](Polynomial<Scalar> &p) {
+      std::vector<std::pair<Cell, int>> stack;
+      std::vector<Cell> children;
+      UnitVector<Scalar> grad, rmin = zhat<Scalar>();
+      Eigen::Matrix<Scalar, 3, 3> hess;
+      Scalar fmin = INFINITY;
+      long visited = 0;
+      int i;
+      while (!negative && ((i = next++) < int(roots.size()))) {
+        stack.clear();
+        stack.push_back({roots[i], 0});
+        while (!stack.empty() && !negative) {
+          Cell cell = stack.back().first;
+          int depth = stack.back().second;
+          stack.pop_back();
+          ++visited;
+
+          // Cell center and angular radius
+          UnitVector<Scalar> c = (cell[0] + cell[1] + cell[2]).normalized();
+          Scalar R = 0.0;
+          for (int k = 0; k < 3; ++k)
+            R = std::max(R, 2 * asin(std::min(Scalar(1.0),
+                                              0.5 * (cell[k] - c).norm())));
+
+          // Intensity & gradient on the sphere at the center
+          Scalar f = p.evaluate(c, grad, hess, false);
+          Scalar g = (grad - c.dot(grad) * c).norm();
+          if (f < fmin) {
+            fmin = f;
+            rmin = c;
+          }
+          if (f < -err) {
+            negative = true;
+            break;
+          }
+
+          // Prune, split, or give up on this cell
+          Scalar bound = f - g * R - 0.5 * M * R * R - err;
+          if (bound > 0)
+            continue;
+          if (depth >= maxdepth) {
+            inconclusive = true;
+            continue;
+          }
+          children.clear();
+          subdivide(cell, children);
+          for (auto &child : children)
+            stack.push_back({child, depth + 1});
+        }
+      }
+      count += visited;
+
+      // Keep track of the lowest point we found
+      std::lock_guard<std::mutex> lock(result_mutex);
+      if (fmin < flow) {
+        flow = fmin;
+        rlow = rmin;
+      }
+    };
+
+    if (nthreads <= 0)
+      nthreads = std::thread::hardware_concurrency();
+    nthreads = std::max(1, std::min(nthreads, int(roots.size())));
+    std::vector<Polynomial<Scalar>> polys(nthreads - 1, poly);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads - 1; ++t)
+      threads.emplace_back(work, std::ref(polys[t]));
+    work(poly);
+    for (auto &thread : threads)
+      thread.join();
+
+    // Results
+    if (negative)
+      status = -1;
+    else if (inconclusive)
+      status = 0;
+    else
+      status = 1;
+    ncells = count;
+    I = flow;
+    lat = asin(std::max(Scalar(-1.0), std::min(Scalar(1.0), rlow(1))));
+    lon = atan2(rlow(0), rlow(2));
+  }
+};
+
+} // namespace minimize
+} // namespace starry
+
+#endif
@@ -16,18 +16,23 @@ namespace misc {
 using namespace utils;
 
 /**
-Compute the Ylm expansion of a spot at a given latitude/longitude on the map.
+Compute the zonal Ylm expansion of a unit-amplitude spot centered on
+the north pole, along with its derivative with respect to `sigma`.
+
+The Legendre integrals `IP` and `ID` are computed recursively in the
+parameter `a = 1 / (2 sigma^2)`; their derivatives follow from
+differentiating the recursion by hand. Only the `m = 0` terms are
+nonzero, so we return them indexed by `l`.
 
 */
 template <class Scalar>
-inline Matrix<Scalar> spotYlm(const RowVector<Scalar> &amp, const Scalar &sigma,
-                              const Scalar &lat, const Scalar &lon, int l,
-                              wigner::Wigner<Scalar> &W) {
-  // Compute the integrals recursively
-  Vector<Scalar> IP(l + 1);
-  Vector<Scalar> ID(l + 1);
-  Matrix<Scalar> y((l + 1) * (l + 1), amp.cols());
-  y.setZero();
+inline void spotZonal(const Scalar &sigma, int l, Vector<Scalar> &y,
+                      Vector<Scalar> &dydsigma) {
+  int lmax = l > 1 ? l : 1;
+  Vector<Scalar> IP(lmax + 1), dIP(lmax + 1);
+  Vector<Scalar> ID(lmax + 1), dID(lmax + 1);
+  y.resize(l + 1);
+  dydsigma.resize(l + 1);
 
   // Constants
   Scalar a = 1.0 / (2 * sigma * sigma);
@@ -41,164 +46,137 @@ inline Matrix<Scalar> spotYlm(const RowVector<Scalar> &amp, const Scalar &sigma,
   ID(0) = 0;
   ID(1) = IP(0);
 
+  // ...and their derivatives with respect to `a`
+  dIP(0) = term / a - IP(0) / (2 * a);
+  dIP(1) = (IP(0) - 2 * term) / (2 * a) - IP(1) / a;
+  dID(0) = 0;
+  dID(1) = dIP(0);
+
   // Recurse
   int sgn = -1;
   for (int n = 2; n < l + 1; ++n) {
-    IP(n) = (2.0 * n - 1.0) / (2.0 * n * a) * (ID(n - 1) + sgn * term - 1.0) +
-            (2.0 * n - 1.0) / n * IP(n - 1) - (n - 1.0) / n * IP(n - 2);
+    Scalar c1 = (2.0 * n - 1.0) / (2.0 * n * a);
+    Scalar c2 = (2.0 * n - 1.0) / n;
+    Scalar c3 = (n - 1.0) / n;
+    Scalar fac = ID(n - 1) + sgn * term - 1.0;
+    IP(n) = c1 * fac + c2 * IP(n - 1) - c3 * IP(n - 2);
+    dIP(n) = c1 * (dID(n - 1) - 4 * sgn * term - fac / a) +
+             c2 * dIP(n - 1) - c3 * dIP(n - 2);
     ID(n) = (2.0 * n - 1.0) * IP(n - 1) + ID(n - 2);
+    dID(n) = (2.0 * n - 1.0) * dIP(n - 1) + dID(n - 2);
     sgn *= -1;
   }
 
-  // Compute the coefficients of the expansion
-  for (int n = 0; n < l + 1; ++n)
-    y.row(n * n + n) = amp * sqrt(2 * n + 1) * (IP(n) / IP(0));
-
-  // Rotate the spot to the correct lat/lon
-  // We are computing the compound rotation matrix
-  //
-  //         R = R(yhat, lon) . R(xhat, -lat)
-  //
-  // in one go.
-  Scalar tol = 10 * mach_eps<Scalar>();
-  if ((abs(lat) > tol) || (abs(lon) > tol)) {
-    Scalar clat = cos(lat);
-    Scalar clon = cos(lon);
-    Scalar slat = sin(lat);
-    Scalar slon = sin(lon);
-    Scalar costheta = 0.5 * (clon + clat + clon * clat - 1);
-    UnitVector<Scalar> u;
-    u << -slat * (1 + clon), slon * (1 + clat), slon * slat;
-    Scalar normu = u.norm();
-    u /= normu;
-    Scalar sintheta = 0.5 * normu;
-    Scalar theta = atan2(sintheta, costheta);
-    W.dotR(y.transpose(), u(0), u(1), u(2), -theta);
-    y = W.dotR_result.transpose();
+  // Compute the coefficients of the expansion, normalized to `IP(0)`
+  Scalar dadsigma = -2 * a / sigma;
+  for (int n = 0; n < l + 1; ++n) {
+    Scalar norm = sqrt(2 * n + 1) / IP(0);
+    y(n) = norm * IP(n);
+    dydsigma(n) = norm * (dIP(n) - IP(n) * dIP(0) / IP(0)) * dadsigma;
   }
-
-  return y;
 }
 
 /**
-Compute the gradient of the Ylm expansion of a spot at a
-given latitude/longitude on the map.
+Compute the summed Ylm expansion of a set of gaussian spots. Row `i`
+of `amp` holds the (per-wavelength) amplitudes of the spot with
+standard deviation `sigma(i)` centered at `lat(i)`, `lon(i)`.
 
-This routine uses forward diff pretty inefficiently and
-can be sped up if we think about it more carefully.
+Since the expansion of each spot is zonal about its center, we
+rotate it into place with the addition theorem (see `ZonalRotation`).
 
 */
 template <class Scalar>
-inline void spotYlm(const RowVector<Scalar> &amp, const Scalar &sigma_,
-                    const Scalar &lat, const Scalar &lon,
-                    const Matrix<double> &by, int l, wigner::Wigner<Scalar> &W,
-                    RowVector<Scalar> &bamp, Scalar &bsigma, Scalar &blat,
-                    Scalar &blon) {
-
-  // Forward diff for sigma
-  // TODO: Compute the backprop expression
-  using ADType = ADScalar<Scalar, 1>;
-  ADType sigma = sigma_;
-  sigma.derivatives() = Vector<Scalar>::Unit(1, 0);
-
-  // Compute the integrals recursively
-  Vector<ADType> IP(l + 1);
-  Vector<ADType> ID(l + 1);
-  Vector<Scalar> y((l + 1) * (l + 1));
+inline Matrix<Scalar> spotYlm(const Matrix<Scalar> &amp,
+                              const Vector<Scalar> &sigma,
+                              const Vector<Scalar> &lat,
+                              const Vector<Scalar> &lon, int l,
+                              wigner::ZonalRotation<Scalar> &R) {
+  int Ny = (l + 1) * (l + 1);
+  int nspots = sigma.size();
+  if ((amp.rows() != nspots) || (lat.size() != nspots) ||
+      (lon.size() != nspots))
+    throw std::length_error("Mismatch in the number of spots.");
+  Matrix<Scalar> y(Ny, amp.cols());
   y.setZero();
-  ADType yn;
-  Vector<Scalar> dydsigma((l + 1) * (l + 1));
-  dydsigma.setZero();
+  Vector<Scalar> y0, dy0;
+  RowVector<Scalar> yrot(Ny);
 
-  // Constants
-  ADType a = 1.0 / (2 * sigma * sigma);
-  ADType sqrta = sqrt(a);
-  ADType erfa = erf(2 * sqrta.value());
-  erfa.derivatives()(0) =
-      -sqrt(32 / pi<Scalar>()) * exp(-4 * a.value()) * a.value();
-  ADType term = exp(-4 * a);
+  for (int i = 0; i < nspots; ++i) {
+    // The expansion at the north pole
+    spotZonal(sigma(i), l, y0, dy0);
 
-  // Seeding values
-  IP(0) = root_pi<Scalar>() / (2 * sqrta) * erfa;
-  IP(1) = (root_pi<Scalar>() * sqrta * erfa + term - 1) / (2 * a);
-  ID(0) = 0;
-  ID(1) = IP(0);
+    // Rotate it so the pole points toward the spot center
+    Scalar clat = cos(lat(i));
+    R.compute(clat * sin(lon(i)), sin(lat(i)), clat * cos(lon(i)));
+    for (int n = 0; n < l + 1; ++n)
+      yrot.segment(n * n, 2 * n + 1) = y0(n) * R.Z.segment(n * n, 2 * n + 1);
 
-  // Recurse
-  int sgn = -1;
-  for (int n = 2; n < l + 1; ++n) {
-    IP(n) = (2.0 * n - 1.0) / (2.0 * n * a) * (ID(n - 1) + sgn * term - 1.0) +
-            (2.0 * n - 1.0) / n * IP(n - 1) - (n - 1.0) / n * IP(n - 2);
-    ID(n) = (2.0 * n - 1.0) * IP(n - 1) + ID(n - 2);
-    sgn *= -1;
+    // Scale by the amplitude & accumulate
+    y.noalias() += yrot.transpose() * amp.row(i);
   }
 
-  // Compute the coefficients of the expansion (w/o the amplitude)
-  for (int n = 0; n < l + 1; ++n) {
-    yn = sqrt(2 * n + 1) * (IP(n) / IP(0));
-    y(n * n + n) = yn.value();
-    dydsigma(n * n + n) = yn.derivatives()(0);
-  }
+  return y;
+}
 
-  // Rotate the spot to the correct lat/lon
-  Scalar tol = 10 * mach_eps<Scalar>();
-  UnitVector<Scalar> u;
-  Scalar normu;
-  Scalar theta;
-  Scalar clat = cos(lat);
-  Scalar clon = cos(lon);
-  Scalar slat = sin(lat);
-  Scalar slon = sin(lon);
-
-  // Axis & angle of rotation
-  if ((abs(lat) > tol) || (abs(lon) > tol)) {
-    Scalar costheta = 0.5 * (clon + clat + clon * clat - 1);
-    u << -slat * (1 + clon), slon * (1 + clat), slon * slat;
-    normu = u.norm();
-    u /= normu;
-    Scalar sintheta = 0.5 * normu;
-    theta = atan2(sintheta, costheta);
-  } else {
-    theta = 0.0;
-    u << 0, 1, 0;
-    normu = 1;
-  }
+/**
+Compute the gradient of the summed Ylm expansion of a set of gaussian
+spots with respect to the amplitude, standard deviation, latitude,
+and longitude of each spot.
+
+Since the expansion scales linearly with the amplitude, we contract
+the output gradient `by` with the amplitudes of each spot first.
 
-  // Gradient w/ respect to lat, lon, and sigma
-  Matrix<Scalar> y_amp = y * amp;
-  W.dotR(y_amp.transpose(), u(0), u(1), u(2), -theta, by.transpose());
-
-  // lat
-  Scalar termz = (clat * (1 + clon) * (1 + clon) * slat - slat * slon * slon) /
-                 (normu * normu * normu);
-  Scalar dxdl = -clat * (1 + clon) / normu + (1 + clon) * slat * termz;
-  Scalar dydl = -slat * slon / normu - (1 + clat) * slon * termz;
-  Scalar dzdl = clat * slon / normu - slat * slon * termz;
-  Scalar dthetadl = -u(0);
-  blat = (dxdl * W.dotR_bx + dydl * W.dotR_by + dzdl * W.dotR_bz -
-          dthetadl * W.dotR_btheta);
-
-  // lon
-  termz = (clon * (1 + clat) * (1 + clat) * slon - slon * slat * slat) /
-          (normu * normu * normu);
-  dxdl = slat * slon / normu + (1 + clon) * slat * termz;
-  dydl = (1 + clat) * clon / normu - (1 + clat) * slon * termz;
-  dzdl = clon * slat / normu - slat * slon * termz;
-  dthetadl = u(1);
-  blon = (dxdl * W.dotR_bx + dydl * W.dotR_by + dzdl * W.dotR_bz -
-          dthetadl * W.dotR_btheta);
-
-  // sigma
-  W.dotR(dydsigma.transpose(), u(0), u(1), u(2), -theta);
-  dydsigma = W.dotR_result.transpose();
-  bsigma = (by.transpose() * dydsigma).dot(amp);
-
-  // Compute the actual result (w/o amplitude)
-  W.dotR(y.transpose(), u(0), u(1), u(2), -theta);
-  y = W.dotR_result.transpose();
-
-  // Gradient of amplitude
-  bamp = y.transpose() * by;
+*/
+template <class Scalar>
+inline void spotYlm(const Matrix<Scalar> &amp, const Vector<Scalar> &sigma,
+                    const Vector<Scalar> &lat, const Vector<Scalar> &lon,
+                    const Matrix<double> &by, int l,
+                    wigner::ZonalRotation<Scalar> &R, Matrix<Scalar> &bamp,
+                    Vector<Scalar> &bsigma, Vector<Scalar> &blat,
+                    Vector<Scalar> &blon) {
+  int Ny = (l + 1) * (l + 1);
+  int nspots = sigma.size();
+  if ((amp.rows() != nspots) || (lat.size() != nspots) ||
+      (lon.size() != nspots))
+    throw std::length_error("Mismatch in the number of spots.");
+  bamp.resize(nspots, amp.cols());
+  bsigma.resize(nspots);
+  blat.resize(nspots);
+  blon.resize(nspots);
+  Vector<Scalar> y0, dy0;
+  RowVector<Scalar> yrot(Ny), byamp(Ny), byZ(Ny);
+
+  for (int i = 0; i < nspots; ++i) {
+    // The expansion at the north pole
+    spotZonal(sigma(i), l, y0, dy0);
+
+    // Rotate it so the pole points toward the spot center
+    Scalar clat = cos(lat(i));
+    Scalar clon = cos(lon(i));
+    Scalar slat = sin(lat(i));
+    Scalar slon = sin(lon(i));
+    R.compute(clat * slon, slat, clat * clon, true);
+
+    // Backprop into the zonal terms & the rotation axis
+    byamp = (by * amp.row(i).transpose()).transpose();
+    Scalar bx = 0.0, by_ = 0.0, bz = 0.0;
+    bsigma(i) = 0.0;
+    for (int n = 0; n < l + 1; ++n) {
+      auto g = byamp.segment(n * n, 2 * n + 1);
+      yrot.segment(n * n, 2 * n + 1) = y0(n) * R.Z.segment(n * n, 2 * n + 1);
+      bsigma(i) += dy0(n) * g.dot(R.Z.segment(n * n, 2 * n + 1));
+      bx += y0(n) * g.dot(R.dZdx.segment(n * n, 2 * n + 1));
+      by_ += y0(n) * g.dot(R.dZdy.segment(n * n, 2 * n + 1));
+      bz += y0(n) * g.dot(R.dZdz.segment(n * n, 2 * n + 1));
+    }
+
+    // Chain rule for (x, y, z) = (clat slon, slat, clat clon)
+    blat(i) = -slat * slon * bx + clat * by_ - slat * clon * bz;
+    blon(i) = clat * clon * bx - clat * slon * bz;
+
+    // amplitude
+    bamp.row(i) = yrot * by;
+  }
 }
 
 } // namespace misc
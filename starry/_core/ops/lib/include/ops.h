@@ -4,8 +4,12 @@
 
 */
 
+#ifndef _STARRY_OPS_H_
+#define _STARRY_OPS_H_
+
 #include "basis.h"
 #include "filter.h"
+#include "minimize.h"
 #include "misc.h"
 #include "reflected/occultation.h"
 #include "reflected/phasecurve.h"
@@ -31,16 +35,30 @@ public:
 
   basis::Basis<Scalar> B;
   wigner::Wigner<Scalar> W;
+  wigner::ZonalRotation<Scalar> ZR;
   solver::Greens<Scalar> G; /**< The occultation integral solver class */
   reflected::phasecurve::PhaseCurve<ADScalar<Scalar, 2>> RP;
+  reflected::phasecurve::PhaseCurveInterpolant<ADScalar<Scalar, 2>> RPI;
   reflected::occultation::Occultation<ADScalar<Scalar, 5>> RO;
+  reflected::occultation::Occultation<ADScalar<Scalar, 0>> ROV; // No derivs
   filter::Filter<Scalar> F;
+  minimize::Minimizer<Scalar> M;  /**< The intensity minimizer */
+  minimize::Positivity<Scalar> P; /**< The positivity certifier */
+
+  // Additional reflected light occultation solvers, one per extra thread
+  std::vector<
+      std::unique_ptr<reflected::occultation::Occultation<ADScalar<Scalar, 5>>>>
+      RO_threads;
+  std::vector<
+      std::unique_ptr<reflected::occultation::Occultation<ADScalar<Scalar, 0>>>>
+      ROV_threads;
+  std::mutex RO_mutex;
 
   // Spot gradients
-  RowVector<Scalar> bamp;
-  Scalar bsigma;
-  Scalar blat;
-  Scalar blon;
+  Matrix<Scalar> bamp;
+  Vector<Scalar> bsigma;
+  Vector<Scalar> blat;
+  Vector<Scalar> blon;
 
   // Constructor
   explicit Ops(int ydeg, int udeg, int fdeg, Scalar dr_oversample,
@@ -48,8 +66,8 @@ public:
       : ydeg(ydeg), Ny((ydeg + 1) * (ydeg + 1)), udeg(udeg), Nu(udeg + 1),
         fdeg(fdeg), Nf((fdeg + 1) * (fdeg + 1)), deg(ydeg + udeg + fdeg),
         N((deg + 1) * (deg + 1)), B(ydeg, udeg, fdeg),
-        W(ydeg, udeg, fdeg, dr_oversample, dr_lam, B), G(deg), RP(deg, B),
-        RO(deg, B), F(B) {
+        W(ydeg, udeg, fdeg, dr_oversample, dr_lam, B), ZR(ydeg), G(deg),
+        RP(deg, B), RPI(RP, N), RO(deg, B), ROV(deg, B), F(B), M(B), P(B) {
     // Bounds checks
     if ((ydeg < 0) || (ydeg > STARRY_MAX_LMAX))
       throw std::out_of_range("Spherical harmonic degree out of range.");
@@ -57,22 +75,440 @@ public:
       throw std::out_of_range("Total degree out of range.");
   };
 
-  // Compute the Ylm expansion of a gaussian spot at a
-  // given latitude/longitude on the map.
-  inline Matrix<Scalar> spotYlm(const RowVector<Scalar> &amp,
-                                const Scalar &sigma, const Scalar &lat = 0,
-                                const Scalar &lon = 0) {
-    return misc::spotYlm(amp, sigma, lat, lon, ydeg, W);
+  // Compute the summed Ylm expansion of a set of gaussian spots
+  // at given latitudes/longitudes on the map.
+  inline Matrix<Scalar> spotYlm(const Matrix<Scalar> &amp,
+                                const Vector<Scalar> &sigma,
+                                const Vector<Scalar> &lat,
+                                const Vector<Scalar> &lon) {
+    return misc::spotYlm(amp, sigma, lat, lon, ydeg, ZR);
   }
 
-  // Compute the gradient of the Ylm expansion of a gaussian spot at a
-  // given latitude/longitude on the map.
-  inline void spotYlm(const RowVector<Scalar> &amp, const Scalar &sigma,
-                      const Scalar &lat, const Scalar &lon,
+  // Compute the gradient of the summed Ylm expansion of a set of
+  // gaussian spots at given latitudes/longitudes on the map.
+  inline void spotYlm(const Matrix<Scalar> &amp, const Vector<Scalar> &sigma,
+                      const Vector<Scalar> &lat, const Vector<Scalar> &lon,
                       const Matrix<double> &by) {
-    misc::spotYlm(amp, sigma, lat, lon, by, ydeg, W, bamp, bsigma, blat, blon);
+    misc::spotYlm(amp, sigma, lat, lon, by, ydeg, ZR, bamp, bsigma, blat, blon);
+  }
+
+  /**
+  Compute the emitted light occultation solution vector `sT` at each
+  point in a timeseries. The occultor radius `r` may be a single value or
+  one value per point. The result is written into `sT`, which must
+  already have one row per point.
+
+  */
+  inline void sT(const VectorRef<double> &b, const VectorRef<double> &r,
+                 OutMatrix<double> sT) {
+    const int npts = b.size();
+    const bool scalar_r = (r.size() == 1);
+    if ((sT.rows() != npts) || (sT.cols() != N))
+      throw std::length_error("Invalid shape for the output `sT`.");
+    for (int n = 0; n < npts; ++n) {
+      G.compute(static_cast<Scalar>(b(n)),
+                static_cast<Scalar>(r(scalar_r ? 0 : n)));
+      sT.row(n) = G.sT.template cast<double>();
+    }
+  }
+
+  /**
+  Loop over a timeseries of reflected light occultations, calling
+  `process(k, j, sT)` with the solution vector `sT` (already weighted by
+  the illumination) at each point `k`. The solver type sets the number
+  `NAD` of forward derivatives carried along: either five, with respect to
+  `b`, `theta`, `bo`, `ro`, and `sigr`, or none at all for the forward
+  pass, which only needs the values. Each row of `b` and `theta`
+  holds the terminator parameters for one or more illumination sources
+  `j` (e.g., points on the disk of an extended source), which share the
+  occultor position `bo`. The occultor radius `ro` may be a scalar or have
+  one entry per point.
+
+  The timesteps are distributed among `nthreads` threads (all hardware
+  threads if `nthreads <= 0`), each with its own solver. The cost of a
+  timestep varies by orders of magnitude: complete occultations are
+  trivial, occultations of a fully day- or night-side body only need the
+  standard solution, while those in which the occultor may cross the
+  terminator require the elliptic integrals. We therefore hand out the
+  timesteps one at a time, most expensive first, so that no thread is
+  left with a long tail of expensive ones.
+
+  If the incomplete elliptic integrals are enabled, the timesteps are
+  instead handed out in chunks. Each thread computes the angles of
+  intersection of all the occultations in its chunk, evaluates the `el2`
+  and `rj` kernels for all of them in a single batched call, and reuses
+  the angles when computing the solution vectors. The buffers for this
+  live in the solvers, so they are only allocated once.
+
+  */
+  template <int NAD, typename F>
+  inline void sTReflectedLoop(
+      const MatrixRef<double> &b_, const MatrixRef<double> &theta_,
+      const VectorRef<double> &bo_, const VectorRef<double> &ro_,
+      const double &sigr_, int nthreads,
+      reflected::occultation::Occultation<ADScalar<Scalar, NAD>> &solver0,
+      std::vector<std::unique_ptr<
+          reflected::occultation::Occultation<ADScalar<Scalar, NAD>>>> &solvers,
+      F &&process) {
+
+    using AD = ADScalar<Scalar, NAD>;
+    using Solver = reflected::occultation::Occultation<AD>;
+
+    const int K = b_.rows();
+    const int J = b_.cols();
+    const bool scalar_ro = (ro_.size() == 1);
+    if ((theta_.rows() != K) || (theta_.cols() != J) || (bo_.size() != K) ||
+        (!scalar_ro && (ro_.size() != K)))
+      throw std::length_error("Mismatch in the size of the inputs.");
+
+    // Sort the timesteps by decreasing (estimated) cost
+    auto cost = [&](int k) {
+      if (bo_(k) <= ro_(scalar_ro ? 0 : k) - 1.0)
+        return 0;
+      else if ((J > 0) && (abs(b_(k, 0)) >= 1.0))
+        return 1;
+      else
+        return 2;
+    };
+    std::vector<int> order(K);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int i, int j) { return cost(i) > cost(j); });
+
+    // Seed the derivatives
+    auto seed = [&](AD &b, AD &theta, AD &bo, AD &ro, AD &sigr) {
+      using D = Eigen::Matrix<Scalar, NAD, 1>;
+      if (NAD > 0) {
+        b.derivatives() = D::Unit(NAD, 0);
+        theta.derivatives() = D::Unit(NAD, 1);
+        bo.derivatives() = D::Unit(NAD, 2);
+        ro.derivatives() = D::Unit(NAD, 3);
+        sigr.derivatives() = D::Unit(NAD, 4);
+      }
+      sigr.value() = sigr_;
+    };
+
+    // Set the terminator parameters for timestep `k` & source `j`
+    auto set = [&](int k, int j, AD &b, AD &theta) {
+      // Hack: deriv undefined for b = +/- 1 (not a numerical issue)
+      if (b_(k, j) >= 1.0 - 1e-15) {
+        b.value() = Scalar(1.0) - Scalar(1e-15);
+      } else if (b_(k, j) <= -1.0 + 1e-15) {
+        b.value() = Scalar(-1.0) + Scalar(1e-15);
+      } else {
+        b.value() = static_cast<Scalar>(b_(k, j));
+      }
+      theta.value() = static_cast<Scalar>(theta_(k, j));
+    };
+
+    // The solvers are not re-entrant
+    std::lock_guard<std::mutex> lock(RO_mutex);
+
+    // Timesteps are handed out in chunks
+    if (nthreads <= 0)
+      nthreads = std::thread::hardware_concurrency();
+    nthreads = std::max(1, std::min(nthreads, K));
+#if (STARRY_USE_INCOMPLETE_INTEGRALS)
+    const int chunk = std::max(1, std::min(64, K / (4 * nthreads)));
+#else
+    const int chunk = 1;
+#endif
+
+    // Process chunks until there are none left
+    std::atomic<int> next(0);
+    std::atomic<bool> failed(false);
+    auto work = [&](Solver &solver) {
+      AD b, theta, bo, ro, sigr;
+      seed(b, theta, bo, ro, sigr);
+      int start;
+      while (!failed && ((start = next.fetch_add(chunk)) < K)) {
+        const int end = std::min(start + chunk, K);
+
+#if (STARRY_USE_INCOMPLETE_INTEGRALS)
+        // Batch the incomplete elliptic integrals of the chunk
+        if ((int)solver.prepared.size() < chunk * J)
+          solver.prepared.resize(chunk * J);
+        solver.batch.clear();
+        for (int i = start; i < end; ++i) {
+          int k = order[i];
+          bo.value() = static_cast<Scalar>(bo_(k));
+          ro.value() = static_cast<Scalar>(ro_(scalar_ro ? 0 : k));
+          for (int j = 0; j < J; ++j) {
+            set(k, j, b, theta);
+            solver.prepare(b, theta, bo, ro,
+                           solver.prepared[(i - start) * J + j], solver.batch);
+          }
+        }
+        solver.batch.compute();
+        for (int i = 0; i < (end - start) * J; ++i) {
+          if (solver.prepared[i].batched)
+            solver.prepared[i].integrals.finish(solver.batch);
+        }
+#endif
+
+        for (int i = start; i < end; ++i) {
+          int k = order[i];
+          bo.value() = static_cast<Scalar>(bo_(k));
+          ro.value() = static_cast<Scalar>(ro_(scalar_ro ? 0 : k));
+          for (int j = 0; j < J; ++j) {
+            set(k, j, b, theta);
+
+            // Compute sT for this timestep & source
+#if (STARRY_USE_INCOMPLETE_INTEGRALS)
+            solver.compute(b, theta, bo, ro, sigr,
+                           &solver.prepared[(i - start) * J + j]);
+#else
+            solver.compute(b, theta, bo, ro, sigr);
+#endif
+            process(k, j, solver.sT);
+          }
+        }
+      }
+    };
+
+    // Serial evaluation
+    if (nthreads == 1) {
+      work(solver0);
+      return;
+    }
+
+    // Parallel evaluation; the calling thread uses the main solver
+    while ((int)solvers.size() < nthreads - 1) {
+      solvers.emplace_back(new Solver(deg, B));
+      solvers.back()->QUAD.adaptive = solver0.QUAD.adaptive;
+    }
+    std::exception_ptr error = nullptr;
+    std::mutex error_mutex;
+    auto guarded_work = [&](Solver &solver) {
+      try {
+        work(solver);
+      } catch (...) {
+        std::lock_guard<std::mutex> error_lock(error_mutex);
+        if (!error)
+          error = std::current_exception();
+        failed = true;
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads - 1; ++t)
+      threads.emplace_back(guarded_work, std::ref(*solvers[t]));
+    guarded_work(solver0);
+    for (auto &thread : threads)
+      thread.join();
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  /**
+  Apply `f` to the quadrature of each of the reflected light occultation
+  solvers, e.g. to sum or reset their counters.
+
+  */
+  template <typename F> inline void forEachQuad(F &&f) {
+    std::lock_guard<std::mutex> lock(RO_mutex);
+    f(RO.QUAD);
+    f(ROV.QUAD);
+    for (auto &solver : RO_threads)
+      f(solver->QUAD);
+    for (auto &solver : ROV_threads)
+      f(solver->QUAD);
+  }
+
+  /**
+  Compute the reflected light occultation solution vector `sT` (already
+  weighted by the illumination) at each point in a timeseries. The result
+  is written into `sT`, which must already have one row per point.
+
+  */
+  inline void sTReflected(const VectorRef<double> &b,
+                          const VectorRef<double> &theta,
+                          const VectorRef<double> &bo,
+                          const VectorRef<double> &ro, const double &sigr,
+                          int nthreads, OutMatrix<double> sT) {
+    if ((sT.rows() != b.size()) || (sT.cols() != N))
+      throw std::length_error("Invalid shape for the output `sT`.");
+    sTReflectedLoop(
+        b, theta, bo, ro, sigr, nthreads, ROV, ROV_threads,
+        [&](int k, int /*j*/, const RowVector<ADScalar<Scalar, 0>> &sTk) {
+          for (int n = 0; n < N; ++n)
+            sT(k, n) = static_cast<double>(sTk(n).value());
+        });
+  }
+
+  /**
+  Compute the reflected light occultation solution vector `sT` (already
+  weighted by the illumination) and its forward derivatives with respect
+  to `b`, `theta`, `bo`, `ro`, and `sigr` at each point in a timeseries.
+
+  */
+  inline void sTReflected(const VectorRef<double> &b,
+                          const VectorRef<double> &theta,
+                          const VectorRef<double> &bo,
+                          const VectorRef<double> &ro, const double &sigr,
+                          int nthreads, Matrix<double> &sT,
+                          Matrix<double> &dsTdb, Matrix<double> &dsTdtheta,
+                          Matrix<double> &dsTdbo, Matrix<double> &dsTdro,
+                          Matrix<double> &dsTdsigr) {
+    const int K = b.size();
+    sT.resize(K, N);
+    dsTdb.resize(K, N);
+    dsTdtheta.resize(K, N);
+    dsTdbo.resize(K, N);
+    dsTdro.resize(K, N);
+    dsTdsigr.resize(K, N);
+    sTReflectedLoop(
+        b, theta, bo, ro, sigr, nthreads, RO, RO_threads,
+        [&](int k, int /*j*/, const RowVector<ADScalar<Scalar, 5>> &sTk) {
+          for (int n = 0; n < N; ++n) {
+            sT(k, n) = static_cast<double>(sTk(n).value());
+            dsTdb(k, n) = static_cast<double>(sTk(n).derivatives()(0));
+            dsTdtheta(k, n) = static_cast<double>(sTk(n).derivatives()(1));
+            dsTdbo(k, n) = static_cast<double>(sTk(n).derivatives()(2));
+            dsTdro(k, n) = static_cast<double>(sTk(n).derivatives()(3));
+            dsTdsigr(k, n) = static_cast<double>(sTk(n).derivatives()(4));
+          }
+        });
+  }
+
+  /**
+  Backpropagate the gradient `bsT` of the reflected light occultation
+  solution into `b`, `theta`, `bo`, `ro`, and `sigr`. The forward
+  derivatives are contracted with `bsT` one timestep at a time, so the
+  (dense) Jacobian is never stored.
+
+  */
+  inline void sTReflected(const VectorRef<double> &b,
+                          const VectorRef<double> &theta,
+                          const VectorRef<double> &bo,
+                          const VectorRef<double> &ro, const double &sigr,
+                          const MatrixRef<double> &bsT, int nthreads,
+                          Vector<double> &bb, Vector<double> &btheta,
+                          Vector<double> &bbo, Vector<double> &bro,
+                          double &bsigr) {
+    const int K = b.size();
+    if ((bsT.rows() != K) || (bsT.cols() != N))
+      throw std::length_error("Invalid shape for the gradient `bsT`.");
+    bb.resize(K);
+    btheta.resize(K);
+    bbo.resize(K);
+    Vector<double> bro_k(K), bsigr_k(K);
+    sTReflectedLoop(
+        b, theta, bo, ro, sigr, nthreads, RO, RO_threads,
+        [&](int k, int /*j*/, const RowVector<ADScalar<Scalar, 5>> &sTk) {
+          Eigen::Matrix<Scalar, 5, 1> g;
+          g.setZero();
+          for (int n = 0; n < N; ++n)
+            g += static_cast<Scalar>(bsT(k, n)) * sTk(n).derivatives();
+          bb(k) = static_cast<double>(g(0));
+          btheta(k) = static_cast<double>(g(1));
+          bbo(k) = static_cast<double>(g(2));
+          bro_k(k) = static_cast<double>(g(3));
+          bsigr_k(k) = static_cast<double>(g(4));
+        });
+
+    // Sum over the timesteps for the scalar parameters
+    if (ro.size() == 1) {
+      bro.resize(1);
+      bro(0) = bro_k.sum();
+    } else {
+      bro = bro_k;
+    }
+    bsigr = bsigr_k.sum();
+  }
+
+  /**
+  Compute the reflected light occultation solution vector for an extended
+  illumination source, sampled at `J` points. Row `k` of the result is
+  the sum over `j` of the point source solution for the terminator
+  parameters `b(k, j)` and `theta(k, j)`, weighted by `w(k, j)`. Since
+  the occultor geometry is shared among the samples, the caller only
+  needs to rotate and project a single vector per timestep. The result
+  is written into `sT`, which must already have one row per timestep.
+
+  Each sample has its own terminator, and hence its own angles of
+  intersection and primitive integrals, so the cost is still linear in
+  `J`. Only the standard occultation solution, which depends on the
+  occultor alone, is computed once per timestep.
+
+  */
+  inline void sTReflected(const MatrixRef<double> &b,
+                          const MatrixRef<double> &theta,
+                          const VectorRef<double> &bo,
+                          const VectorRef<double> &ro, const double &sigr,
+                          const MatrixRef<double> &w, int nthreads,
+                          OutMatrix<double> sT) {
+    if ((w.rows() != b.rows()) || (w.cols() != b.cols()))
+      throw std::length_error("Invalid shape for the weights `w`.");
+    if ((sT.rows() != b.rows()) || (sT.cols() != N))
+      throw std::length_error("Invalid shape for the output `sT`.");
+    sT.setZero();
+    sTReflectedLoop(
+        b, theta, bo, ro, sigr, nthreads, ROV, ROV_threads,
+        [&](int k, int j, const RowVector<ADScalar<Scalar, 0>> &sTk) {
+          for (int n = 0; n < N; ++n)
+            sT(k, n) += w(k, j) * static_cast<double>(sTk(n).value());
+        });
+  }
+
+  /**
+  Backpropagate the gradient `bsT` of the extended source reflected light
+  occultation solution into `b`, `theta`, `bo`, `ro`, `sigr`, and the
+  weights `w`.
+
+  */
+  inline void sTReflected(const MatrixRef<double> &b,
+                          const MatrixRef<double> &theta,
+                          const VectorRef<double> &bo,
+                          const VectorRef<double> &ro, const double &sigr,
+                          const MatrixRef<double> &w,
+                          const MatrixRef<double> &bsT, int nthreads,
+                          Matrix<double> &bb, Matrix<double> &btheta,
+                          Vector<double> &bbo, Vector<double> &bro,
+                          double &bsigr, Matrix<double> &bw) {
+    const int K = b.rows();
+    const int J = b.cols();
+    if ((w.rows() != K) || (w.cols() != J))
+      throw std::length_error("Invalid shape for the weights `w`.");
+    if ((bsT.rows() != K) || (bsT.cols() != N))
+      throw std::length_error("Invalid shape for the gradient `bsT`.");
+    bb.resize(K, J);
+    btheta.resize(K, J);
+    bw.resize(K, J);
+    bbo.setZero(K);
+    Vector<double> bro_k, bsigr_k;
+    bro_k.setZero(K);
+    bsigr_k.setZero(K);
+    sTReflectedLoop(
+        b, theta, bo, ro, sigr, nthreads, RO, RO_threads,
+        [&](int k, int j, const RowVector<ADScalar<Scalar, 5>> &sTk) {
+          Eigen::Matrix<Scalar, 5, 1> g;
+          g.setZero();
+          Scalar gw = 0.0;
+          for (int n = 0; n < N; ++n) {
+            g += static_cast<Scalar>(bsT(k, n)) * sTk(n).derivatives();
+            gw += static_cast<Scalar>(bsT(k, n)) * sTk(n).value();
+          }
+          g *= static_cast<Scalar>(w(k, j));
+          bb(k, j) = static_cast<double>(g(0));
+          btheta(k, j) = static_cast<double>(g(1));
+          bbo(k) += static_cast<double>(g(2));
+          bro_k(k) += static_cast<double>(g(3));
+          bsigr_k(k) += static_cast<double>(g(4));
+          bw(k, j) = static_cast<double>(gw);
+        });
+
+    // Sum over the timesteps for the scalar parameters
+    if (ro.size() == 1) {
+      bro.resize(1);
+      bro(0) = bro_k.sum();
+    } else {
+      bro = bro_k;
+    }
+    bsigr = bsigr_k.sum();
   }
 
 }; // class Ops
 
-} // namespace starry
\ No newline at end of file
+} // namespace starry
+
+#endif
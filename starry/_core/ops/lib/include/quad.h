@@ -1,8 +1,8 @@
 /**
 \file quad.h
-\brief Gauss-Legendre quadrature.
+\brief Gauss-Legendre and tanh-sinh quadrature.
 
-Adapted from
+The Gauss-Legendre implementation is adapted from
 https://rosettacode.org/wiki/Numerical_integration/Gauss-Legendre_Quadrature
 
 */
@@ -40,10 +40,100 @@ public:
     for (int i = 1; i <= eDEGREE; ++i) {
       sum += legpoly.weight(i) * f(p * legpoly.root(i) + q);
     }
+    nevals += eDEGREE;
 
     return p * sum;
   }
 
+  /*! Compute the integrals of the `M` components of a vector-valued
+  *   functor to a given tolerance with tanh-sinh quadrature.
+  *
+  *   The step size is halved, reusing all previous nodes, until the
+  *   estimates from two consecutive levels agree to within `tol` times
+  *   the integral of the absolute value of each component, or until
+  *   `STARRY_QUAD_MAX_LEVEL` levels. Since the nodes cluster double
+  *   exponentially at the limits, this is very efficient for integrands
+  *   with (integrable) singularities in their derivatives there, as is
+  *   the case when the limits are the intersection points of two
+  *   curves. The nodes are computed once and cached. All components
+  *   share the same nodes, so the functor should compute them together.
+  *   If `adaptive` is false, the fixed Gauss-Legendre rule of `integrate`
+  *   is used instead.
+  *
+  *   @param a    lower limit of integration
+  *   @param b    upper limit of integration
+  *   @param f    the function to integrate, called as `f(x, result)`
+  *               where `result` is an `Eigen::Array<T, M, 1>`
+  *   @param tol  relative tolerance
+  */
+  template <int M, typename Function>
+  inline Eigen::Array<T, M, 1> integrate_adaptive(T a, T b, Function f,
+                                                  T tol = STARRY_QUAD_TOL) {
+    using Array = Eigen::Array<T, M, 1>;
+    ++nintegrals;
+    Array fx, sum, sumabs, result, previous;
+
+    // The fixed rule
+    if (!adaptive) {
+      const LegendrePolynomial &legpoly = s_LegendrePolynomial;
+      T p = (b - a) / 2;
+      T q = (b + a) / 2;
+      sum.setZero();
+      for (int i = 1; i <= eDEGREE; ++i) {
+        f(p * legpoly.root(i) + q, fx);
+        sum += legpoly.weight(i) * fx;
+      }
+      nevals += eDEGREE;
+      return p * sum;
+    }
+
+    const TanhSinhNodes &nodes = s_TanhSinhNodes;
+    const T width = b - a;
+    const T half = 0.5 * width;
+
+    // The midpoint
+    f(a + half, fx);
+    ++nevals;
+    sum = nodes.weight(0, 0) * fx;
+    sumabs = sum.abs();
+
+    // Add the nodes on either side
+    auto add = [&](int level, int k) {
+      T du = width * nodes.node(level, k);
+      T w = nodes.weight(level, k);
+      T x = a + du;
+      if (x != a) {
+        f(x, fx);
+        sum += w * fx;
+        sumabs += w * fx.abs();
+        ++nevals;
+      }
+      x = b - du;
+      if (x != b) {
+        f(x, fx);
+        sum += w * fx;
+        sumabs += w * fx.abs();
+        ++nevals;
+      }
+    };
+
+    // Refine
+    result.setZero();
+    T h = 1.0;
+    for (int level = 0; level < STARRY_QUAD_MAX_LEVEL; ++level) {
+      for (int k = (level == 0) ? 1 : 0; k < nodes.size(level); ++k)
+        add(level, k);
+      if (level > 0)
+        h *= 0.5;
+      previous = result;
+      result = half * h * sum;
+      if ((level > 1) &&
+          ((result - previous).abs() <= tol * abs(half) * h * sumabs).all())
+        break;
+    }
+    return result;
+  }
+
   /*! Print out roots and weights for information
   */
   void print_roots_and_weights(std::ostream &out) const {
@@ -60,6 +150,21 @@ public:
     out << '\n';
   }
 
+  //! Use tanh-sinh quadrature in `integrate_adaptive`?
+  bool adaptive = true;
+
+  //! Number of integrand evaluations
+  size_t nevals = 0;
+
+  //! Number of calls to the adaptive integrator
+  size_t nintegrals = 0;
+
+  //! Reset the counters
+  void reset_counters() {
+    nevals = 0;
+    nintegrals = 0;
+  }
+
 private:
   /*! Implementation of the Legendre polynomials that form
   *   the basis of this quadrature
@@ -124,14 +229,56 @@ private:
     };
   };
 
+  /*! The nodes of tanh-sinh quadrature on `[0, 1]`, `(1 - tanh(s)) / 2`
+  *   with `s = pi / 2 sinh(t)`, and their weights, for `t = k h` with
+  *   `|t| <= STARRY_QUAD_TMAX`. Level `0` has `h = 1` and includes the
+  *   midpoint (`k = 0`); level `l > 0` has the new nodes at odd `k` with
+  *   `h = 2^-l`. Each node is used at both ends of the interval.
+  */
+  class TanhSinhNodes {
+  public:
+    TanhSinhNodes() {
+      _u.resize(STARRY_QUAD_MAX_LEVEL);
+      _w.resize(STARRY_QUAD_MAX_LEVEL);
+      T h = 1.0;
+      for (int level = 0; level < STARRY_QUAD_MAX_LEVEL; ++level) {
+        int k0 = (level == 0) ? 0 : 1;
+        int dk = (level == 0) ? 1 : 2;
+        for (int k = k0; k * h <= STARRY_QUAD_TMAX; k += dk) {
+          T t = k * h;
+          T s = 0.5 * pi<T>() * sinh(t);
+          T cs = cosh(s);
+          _u[level].push_back(0.5 * exp(-s) / cs);
+          _w[level].push_back(0.5 * pi<T>() * cosh(t) / (cs * cs));
+        }
+        h *= 0.5;
+      }
+    }
+
+    T node(int level, int k) const { return _u[level][k]; }
+    T weight(int level, int k) const { return _w[level][k]; }
+    int size(int level) const { return _u[level].size(); }
+
+  private:
+    std::vector<std::vector<T>> _u;
+    std::vector<std::vector<T>> _w;
+  };
+
   /*! Pre-compute the weights and abscissae of the Legendre polynomials
   */
   static LegendrePolynomial s_LegendrePolynomial;
+
+  /*! Pre-compute the tanh-sinh nodes and weights
+  */
+  static TanhSinhNodes s_TanhSinhNodes;
 };
 
 template <typename T>
 typename Quad<T>::LegendrePolynomial Quad<T>::s_LegendrePolynomial;
 
+template <typename T>
+typename Quad<T>::TanhSinhNodes Quad<T>::s_TanhSinhNodes;
+
 } // namespace quad
 } // namespace starry
 
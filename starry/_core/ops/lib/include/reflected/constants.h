@@ -21,6 +21,28 @@
 #define STARRY_EL2_MAX_ITER 100
 #endif
 
+//! Absolute tolerance (relative to the largest term) of the interpolated
+//! phase curve integrals
+#ifndef STARRY_PHASECURVE_TOL
+#define STARRY_PHASECURVE_TOL 1e-12
+#endif
+
+//! Maximum number of Chebyshev nodes per panel of the phase curve interpolant
+#ifndef STARRY_PHASECURVE_MAX_NODES
+#define STARRY_PHASECURVE_MAX_NODES 243
+#endif
+
+//! Number of roughnesses for which the phase curve interpolant is cached
+#ifndef STARRY_PHASECURVE_CACHE_SIZE
+#define STARRY_PHASECURVE_CACHE_SIZE 4
+#endif
+
+//! Smallest number of points at a new roughness for which the phase curve
+//! interpolant is built; smaller batches are evaluated exactly
+#ifndef STARRY_PHASECURVE_MIN_BATCH
+#define STARRY_PHASECURVE_MIN_BATCH STARRY_PHASECURVE_MAX_NODES
+#endif
+
 // --------------------------
 // ---------- Fixed ---------
 // --------------------------
@@ -48,6 +70,9 @@
 // Square root of the desired precision in `el2`
 #define STARRY_EL2_CA 1e-8
 
+// Desired precision times 1e-2 in `el2`; used if the sequence `y` hits zero
+#define STARRY_EL2_CB 1e-18
+
 // Replace `inf` with this value in argument to `el2`
 #define STARRY_HUGE_TAN 1e15
 
@@ -65,6 +90,9 @@
 // Maximum number of root polishing iterations
 #define STARRY_ROOT_MAX_ITER 50
 
+// Number of Newton steps applied to the closed-form quartic roots
+#define STARRY_QUARTIC_POLISH_ITER 2
+
 // If |b| is less than this value, set equal to 0
 #define STARRY_B_ZERO_TOL 1e-8
 
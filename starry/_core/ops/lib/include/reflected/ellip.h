@@ -135,7 +135,7 @@ inline Vector<T> el2(const Vector<T> &x_, const T &kc_, const T &a_,
     m = kc + m;
     a = (b / m + a) / 2;
     y = -e / y + y;
-    y = (y == 0).select(sqrt(e) * c * b, y);
+    y = (y == 0).select(T(sqrt(e) * STARRY_EL2_CB), y);
 
     if (abs(gp - kc) > STARRY_EL2_CA * gp) {
 
@@ -166,6 +166,119 @@ inline Vector<T> el2(const Vector<T> &x_, const T &kc_, const T &a_,
   return (q + c * z).matrix();
 }
 
+/**
+  Batched incomplete elliptic integrals of the first and second kinds,
+
+      F(phi_i | m_i) and E(phi_i | m_i),
+
+  and their derivatives with respect to `tan(phi_i)` and `m_i`, for many
+  pairs `(tan(phi_i), m_i)` at once. Unlike the `el2` function above,
+  the parameter `m` may differ between pairs, so this may be used to
+  evaluate the integrals for an entire time series in one go.
+
+  This is Bulirsch's `el2` evaluated for `F` and `E` simultaneously
+  (the two share the same Landen sequence) on plain arrays. Each pair
+  iterates until its own halting condition is met, after which it is
+  masked out, so the result for each pair is identical to that of the
+  scalar algorithm.
+
+*/
+template <typename T>
+inline void el2(const Vector<T> &tanphi, const Vector<T> &m, Vector<T> &F,
+                Vector<T> &E, Vector<T> &dFdtanphi, Vector<T> &dFdm,
+                Vector<T> &dEdtanphi, Vector<T> &dEdm) {
+
+  using Array = Eigen::Array<T, Eigen::Dynamic, 1>;
+  using Mask = Eigen::Array<bool, Eigen::Dynamic, 1>;
+  const int K = tanphi.size();
+  auto x = tanphi.array();
+
+  // The complementary parameter
+  Array b0 = 1.0 - m.array();
+  Array kc = sqrt(b0);
+  if ((kc == 0).any()) {
+    std::stringstream args;
+    args << "tanphi = " << tanphi << ", "
+         << "m = " << m;
+    throw StarryException(
+        "Elliptic integral el2 did not converge because k = 1.",
+        "reflected/ellip.h", "el2", args.str());
+  }
+
+  // Initial conditions. For `F` we have `a = b = 1`, in which case `a`
+  // remains unity throughout; we only need to track `a` and `b` for `E`.
+  // The sequences `y` and `l` do not depend on `a` or `b`, so they are
+  // shared by the two.
+  Array c = x * x;
+  Array d = c + 1.0;
+  Array p = sqrt((1.0 + kc * kc * c) / d);
+  d = x / d;
+  c = d / (2 * p);
+  Array f = Array::Zero(K);
+  Array l = Array::Zero(K);
+  Array i = Array::Ones(K);
+  Array a = (1.0 + b0) / 2;
+  Array b = b0;
+  Array y = abs(1.0 / x);
+  Array h = Array::Ones(K);
+  Array e(K), g(K), hp(K);
+  Mask active = Mask::Constant(K, true);
+  Mask more(K);
+
+  // Iterate until all pairs have converged
+  int n;
+  for (n = 0; n < STARRY_EL2_MAX_ITER; ++n) {
+
+    b = active.select(i * kc + b, b);
+    e = h * kc;
+    g = e / p;
+    d = active.select(f * g + d, d);
+    f = active.select(c, f);
+    i = active.select(a, i);
+    p = active.select(g + p, p);
+    c = active.select((d / p + c) / 2, c);
+    hp = h;
+    h = active.select(kc + h, h);
+    a = active.select((b / h + a) / 2, a);
+    y = active.select(-e / y + y, y);
+    y = (active && (y == 0)).select(sqrt(e) * STARRY_EL2_CB, y);
+
+    more = active && (abs(hp - kc) > STARRY_EL2_CA * hp);
+    kc = more.select(sqrt(e) * 2, kc);
+    l = more.select(l * 2, l);
+    l = (more && (y < 0)).select(1.0 + l, l);
+    active = more;
+    if (!active.any())
+      break;
+  }
+
+  // Check for convergence
+  if (n == STARRY_EL2_MAX_ITER) {
+    std::stringstream args;
+    args << "tanphi = " << tanphi << ", "
+         << "m = " << m;
+    throw StarryException("Elliptic integral el2 did not converge.",
+                          "reflected/ellip.h", "el2", args.str());
+  }
+
+  l = (y < 0).select(1.0 + l, l);
+  Array q = atan(h / y) + pi<T>() * l;
+  q = (x < 0).select(-q, q);
+  F = (q / h).matrix();
+  E = (q * a / h + c * (1.0 - b0)).matrix();
+
+  // Derivatives
+  Array t2 = x * x;
+  Array p2 = 1.0 / (1.0 + t2);
+  Array sqrtdelta = sqrt(1.0 - m.array() * p2 * t2);
+  dFdtanphi = (p2 / sqrtdelta).matrix();
+  dFdm = (0.5 * (E.array() / (m.array() * b0) - F.array() / m.array() -
+                 x * dFdtanphi.array() / b0))
+             .matrix();
+  dEdtanphi = (p2 * sqrtdelta).matrix();
+  dEdm = (0.5 * (E.array() - F.array()) / m.array()).matrix();
+}
+
 /**
   Scalar implementation of the Carlson elliptic integral RJ.
 
@@ -300,10 +413,237 @@ inline T rj(const T &x_, const T &y_, const T &z_, const T &p_) {
                         "reflected/ellip.h", "rj", args.str());
 }
 
-template <class T> class IncompleteEllipticIntegrals {
+/**
+  Batched Carlson elliptic integral RJ and its derivatives.
+
+  Evaluates `RJ(x_i, y_i, z_i, p_i)` for many sets of arguments at once
+  on plain doubles; the columns of `dRJ` are the derivatives with respect
+  to `x`, `y`, `z` and `p`. The derivatives are propagated by hand
+  through the duplication steps as fixed-size arrays (which map onto
+  SIMD registers), using
+
+      dRC(a, b) / da = (RC(a, b) - 1 / sqrt(a)) / (2 (b - a))
+      dRC(a, b) / db = (sqrt(a) / b - RC(a, b)) / (2 (b - a))
+
+  for the `RC` terms accumulated at each step, so we don't need to
+  autodiff the scalar implementation above. The values are identical
+  to those of the scalar algorithm. Arguments outside of the clamping
+  limits have zero derivative.
+
+*/
+template <typename T>
+inline void rj(const Vector<T> &x_, const Vector<T> &y_, const Vector<T> &z_,
+               const Vector<T> &p_, Vector<T> &RJ, Matrix<T> &dRJ) {
+
+  using Tangent = Eigen::Array<T, 4, 1>;
+  const int K = x_.size();
+  RJ.resize(K);
+  dRJ.resize(K, 4);
+
+  // Constants
+  const T C1 = 3.0 / 14.0;
+  const T C2 = 1.0 / 3.0;
+  const T C3 = 3.0 / 22.0;
+  const T C4 = 3.0 / 26.0;
+
+  T s[4], dev[4], r[3];
+  Tangent ds[4], ddev[4], dr[3];
+  T mu, eps, sigma, power4, lam, alpha0, alpha, beta, rc, drcda, drcdb;
+  T ea, eb, ec, e2, e3, S;
+  Tangent dmu, dsigma, dlam, dalpha, dbeta, dea, deb, dec, de2, de3, dS;
+
+  for (int i = 0; i < K; ++i) {
+
+    // Clamp the arguments & seed the derivatives
+    const T args[4] = {x_(i), y_(i), z_(i), p_(i)};
+    for (int j = 0; j < 4; ++j) {
+      ds[j].setZero();
+      if (args[j] < STARRY_CRJ_LO_LIM) {
+        s[j] = STARRY_CRJ_LO_LIM;
+      } else if (args[j] > STARRY_CRJ_HI_LIM) {
+        s[j] = STARRY_CRJ_HI_LIM;
+      } else {
+        s[j] = args[j];
+        ds[j](j) = 1.0;
+      }
+    }
+    sigma = 0.0;
+    dsigma.setZero();
+    power4 = 1.0;
+
+    int k;
+    for (k = 0; k < STARRY_CRJ_MAX_ITER; ++k) {
+
+      mu = 0.2 * (s[0] + s[1] + s[2] + s[3] + s[3]);
+      dmu = 0.2 * (ds[0] + ds[1] + ds[2] + ds[3] + ds[3]);
+      eps = 0.0;
+      for (int j = 0; j < 4; ++j) {
+        dev[j] = (mu - s[j]) / mu;
+        if (abs(dev[j]) > eps)
+          eps = abs(dev[j]);
+      }
+
+      if (eps < STARRY_CRJ_TOL) {
+
+        // Series expansion about the mean & its derivative
+        for (int j = 0; j < 4; ++j)
+          ddev[j] = (s[j] * dmu - mu * ds[j]) / (mu * mu);
+        const T &X = dev[0], &Y = dev[1], &Z = dev[2], &P = dev[3];
+        const Tangent &dX = ddev[0], &dY = ddev[1], &dZ = ddev[2],
+                      &dP = ddev[3];
+        ea = X * (Y + Z) + Y * Z;
+        eb = X * Y * Z;
+        ec = P * P;
+        e2 = ea - 3.0 * ec;
+        e3 = eb + 2.0 * P * (ea - ec);
+        S = 1.0 + e2 * (-C1 + 0.75 * C3 * e2 - 1.5 * C4 * e3) +
+            eb * (0.5 * C2 + P * (-C3 - C3 + P * C4)) +
+            P * ea * (C2 - P * C3) - C2 * P * ec;
+        dea = (Y + Z) * dX + (X + Z) * dY + (X + Y) * dZ;
+        deb = (Y * Z) * dX + (X * Z) * dY + (X * Y) * dZ;
+        dec = (2.0 * P) * dP;
+        de2 = dea - 3.0 * dec;
+        de3 = deb + (2.0 * (ea - ec)) * dP + (2.0 * P) * (dea - dec);
+        dS = (-C1 + 1.5 * C3 * e2 - 1.5 * C4 * e3) * de2 -
+             (1.5 * C4 * e2) * de3 +
+             (0.5 * C2 + P * (-C3 - C3 + P * C4)) * deb +
+             (eb * (-C3 - C3 + 2.0 * P * C4) + C2 * ea -
+              2.0 * C3 * P * ea - C2 * ec) *
+                 dP +
+             (C2 * P - C3 * P * P) * dea - (C2 * P) * dec;
+        RJ(i) = 3.0 * sigma + power4 * S / (mu * sqrt(mu));
+        dRJ.row(i) = (3.0 * dsigma +
+                      power4 * (dS / (mu * sqrt(mu)) -
+                                (1.5 * S / (mu * mu * sqrt(mu))) * dmu))
+                         .transpose();
+        break;
+      }
+
+      // Duplication step
+      for (int j = 0; j < 3; ++j) {
+        r[j] = sqrt(s[j]);
+        dr[j] = ds[j] / (2.0 * r[j]);
+      }
+      lam = r[0] * (r[1] + r[2]) + r[1] * r[2];
+      dlam = (r[1] + r[2]) * dr[0] + (r[0] + r[2]) * dr[1] +
+             (r[0] + r[1]) * dr[2];
+      alpha0 = s[3] * (r[0] + r[1] + r[2]) + r[0] * r[1] * r[2];
+      dalpha = (2.0 * alpha0) *
+               ((r[0] + r[1] + r[2]) * ds[3] + s[3] * (dr[0] + dr[1] + dr[2]) +
+                (r[1] * r[2]) * dr[0] + (r[0] * r[2]) * dr[1] +
+                (r[0] * r[1]) * dr[2]);
+      alpha = alpha0 * alpha0;
+      beta = s[3] * (s[3] + lam) * (s[3] + lam);
+      dbeta = ((s[3] + lam) * (s[3] + lam)) * ds[3] +
+              (2.0 * s[3] * (s[3] + lam)) * (ds[3] + dlam);
+
+      // The RC(alpha, beta) term & its derivatives
+      if (alpha < beta) {
+        rc = acos(sqrt(alpha / beta)) / sqrt(beta - alpha);
+        drcda = (rc - 1.0 / sqrt(alpha)) / (2.0 * (beta - alpha));
+        drcdb = (sqrt(alpha) / beta - rc) / (2.0 * (beta - alpha));
+      } else if (alpha > beta) {
+        rc = acosh(sqrt(alpha / beta)) / sqrt(alpha - beta);
+        drcda = (rc - 1.0 / sqrt(alpha)) / (2.0 * (beta - alpha));
+        drcdb = (sqrt(alpha) / beta - rc) / (2.0 * (beta - alpha));
+      } else {
+        rc = 1.0 / sqrt(beta);
+        drcda = -rc / (6.0 * alpha);
+        drcdb = -rc / (3.0 * alpha);
+      }
+      sigma += power4 * rc;
+      dsigma += power4 * (drcda * dalpha + drcdb * dbeta);
+
+      power4 *= 0.25;
+      for (int j = 0; j < 4; ++j) {
+        s[j] = 0.25 * (s[j] + lam);
+        ds[j] = 0.25 * (ds[j] + dlam);
+      }
+    }
+
+    // Bad...
+    if (k == STARRY_CRJ_MAX_ITER) {
+      std::stringstream args_;
+      args_ << "x_ = " << x_(i) << ", "
+            << "y_ = " << y_(i) << ", "
+            << "z_ = " << z_(i) << ", "
+            << "p_ = " << p_(i);
+      throw StarryException("Elliptic integral rj did not converge.",
+                            "reflected/ellip.h", "rj", args_.str());
+    }
+  }
+}
+
+/**
+  The arguments and results of the batched `el2` and `rj` kernels above
+  for many occultations. Each occultation appends its arguments in
+  `IncompleteEllipticIntegrals::setup`, the kernels are evaluated for
+  all of them in a single call to `compute`, and each occultation reads
+  its results back in `IncompleteEllipticIntegrals::finish`.
+
+*/
+template <typename T> class Batch {
+
+public:
+  // Arguments
+  std::vector<T> tanphi; /**< Tangent of the amplitude for `el2` */
+  std::vector<T> m;      /**< Parameter for `el2` */
+  std::vector<T> x;      /**< First argument of `rj` */
+  std::vector<T> y;      /**< Second argument of `rj` */
+  std::vector<T> z;      /**< Third argument of `rj` */
+  std::vector<T> p;      /**< Fourth argument of `rj` */
+
+  // Results
+  Vector<T> F;
+  Vector<T> E;
+  Vector<T> dFdtanphi;
+  Vector<T> dFdm;
+  Vector<T> dEdtanphi;
+  Vector<T> dEdm;
+  Vector<T> RJ;
+  Matrix<T> dRJ;
+
+  //! Discard the arguments of the previous batch
+  inline void clear() {
+    tanphi.clear();
+    m.clear();
+    x.clear();
+    y.clear();
+    z.clear();
+    p.clear();
+  }
 
-  // Autodiff wrt {b, theta, bo, ro}
-  using A = ADScalar<T, 4>;
+  //! Evaluate the kernels for all of the arguments
+  inline void compute() {
+    using Map = Eigen::Map<const Vector<T>>;
+    if (tanphi.size()) {
+      el2(Vector<T>(Map(tanphi.data(), tanphi.size())),
+          Vector<T>(Map(m.data(), m.size())), F, E, dFdtanphi, dFdm,
+          dEdtanphi, dEdm);
+    }
+    if (x.size()) {
+      const int K = x.size();
+      rj(Vector<T>(Map(x.data(), K)), Vector<T>(Map(y.data(), K)),
+         Vector<T>(Map(z.data(), K)), Vector<T>(Map(p.data(), K)), RJ, dRJ);
+    }
+  }
+};
+
+/**
+  Incomplete elliptic integrals of the first, second and third kinds
+  for the occultor parameters `bo`, `ro` and the angles `kappa`. The
+  template parameter is the autodiff type of the occultation solver.
+
+  The integrals may be computed in one go with the constructor, or in
+  two stages around a `Batch` shared with other occultations: `setup`
+  appends the arguments of the `el2` and `rj` kernels to the batch, and
+  `finish` chains the results into the autodiff variables once the
+  batch has been computed.
+
+*/
+template <class A> class IncompleteEllipticIntegrals {
+
+  using T = typename A::Scalar;
 
 protected:
   // Inputs
@@ -335,71 +675,80 @@ protected:
   A E0;
   A PIp0;
 
+  // Arguments of the `el2` kernel
+  Vector<A> tanphi;
+  A m;
+
+  // Offsets of our arguments in the batch (-1 if there are none)
+  int el2_offset;
+  int rj_offset;
+
   // Vectorized output
   Vector<A> Fv;
   Vector<A> Ev;
 
   /**
+    Append the arguments of the `el2` kernel for the incomplete elliptic
+    integrals of the first and second kinds to the batch.
 
   */
-  inline void compute_el2(const Vector<A> &tanphi_, const A &m_) {
+  inline void setup_FE(Batch<T> &batch) {
 
-    // Get the values
-    Vector<T> tanphi(K);
-    for (size_t i = 0; i < K; ++i)
-      tanphi(i) = tanphi_(i).value();
-    T m = m_.value();
-    T mc = 1 - m;
+    tanphi.resize(K);
+    if (k2 < 1) {
 
-    // Compute the elliptic integrals
-    Fv = el2(tanphi, sqrt(1 - m), 1.0, 1.0);
-    Ev = el2(tanphi, sqrt(1 - m), 1.0, 1 - m);
+      // Analytic continuation from (17.4.15-16) in Abramowitz & Stegun
+      // A better format is here: https://dlmf.nist.gov/19.7#ii
+      Vector<A> arg(K), arg2(K);
+      arg.array() = kinv * sin(0.5 * kappa.array());
+      arg2.array() = 1.0 - arg.array() * arg.array();
+      tanphi.array() =
+          (arg.array() >= 1.0)
+              .select(STARRY_HUGE_TAN,
+                      (arg.array() <= -1.0)
+                          .select(-STARRY_HUGE_TAN,
+                                  arg.array() * pow(arg2.array(), -0.5)));
+      m = k2;
 
-    // Compute their derivatives
-    T p2, q2, t2, ddtanphi, ddm;
+    } else {
+
+      tanphi.array() = tan(0.5 * kappa.array());
+      m = k2inv;
+    }
+
+    el2_offset = batch.tanphi.size();
     for (size_t i = 0; i < K; ++i) {
-      t2 = tanphi(i) * tanphi(i);
-      p2 = 1.0 / (1.0 + t2);
-      q2 = p2 * t2;
-      ddtanphi = p2 / sqrt(1.0 - m * q2);
-      ddm = 0.5 * (Ev(i).value() / (m * mc) - Fv(i).value() / m -
-                   tanphi(i) * ddtanphi / mc);
-      Fv(i).derivatives() =
-          ddtanphi * tanphi_(i).derivatives() + ddm * m_.derivatives();
-      ddtanphi = p2 * sqrt(1.0 - m * q2);
-      ddm = 0.5 * (Ev(i).value() - Fv(i).value()) / m;
-      Ev(i).derivatives() =
-          ddtanphi * tanphi_(i).derivatives() + ddm * m_.derivatives();
+      batch.tanphi.push_back(tanphi(i).value());
+      batch.m.push_back(m.value());
     }
   }
 
   /**
-    Compute the incomplete elliptic integrals of the first and second kinds.
+    Chain the results of the `el2` kernel into the autodiff variables and
+    compute the incomplete elliptic integrals of the first and second kinds.
 
   */
-  inline void compute_FE() {
+  inline void finish_FE(const Batch<T> &batch) {
+
+    // Get the incomplete elliptic integrals & their derivatives
+    Fv.resize(K);
+    Ev.resize(K);
+    for (size_t i = 0; i < K; ++i) {
+      const int n = el2_offset + i;
+      Fv(i).value() = batch.F(n);
+      Fv(i).derivatives() = batch.dFdtanphi(n) * tanphi(i).derivatives() +
+                            batch.dFdm(n) * m.derivatives();
+      Ev(i).value() = batch.E(n);
+      Ev(i).derivatives() = batch.dEdtanphi(n) * tanphi(i).derivatives() +
+                            batch.dEdm(n) * m.derivatives();
+    }
 
     F = 0.0;
     E = 0.0;
 
     if (k2 < 1) {
 
-      // Analytic continuation from (17.4.15-16) in Abramowitz & Stegun
-      // A better format is here: https://dlmf.nist.gov/19.7#ii
-
-      // Helper variables
-      Vector<A> arg(K), arg2(K), tanphi(K);
-      arg.array() = kinv * sin(0.5 * kappa.array());
-      arg2.array() = 1.0 - arg.array() * arg.array();
-      tanphi.array() =
-          (arg.array() >= 1.0)
-              .select(STARRY_HUGE_TAN,
-                      (arg.array() <= -1.0)
-                          .select(-STARRY_HUGE_TAN,
-                                  arg.array() * pow(arg2.array(), -0.5)));
-
-      // Compute the incomplete elliptic integrals
-      compute_el2(tanphi, k2);
+      // Undo the analytic continuation
       Fv.array() *= k;
       Ev.array() = kinv * (Ev.array() - (1 - k2) * kinv * Fv.array());
 
@@ -422,13 +771,6 @@ protected:
 
     } else {
 
-      // Helper variables
-      Vector<A> tanphi(K);
-      tanphi.array() = tan(0.5 * kappa.array());
-
-      // Compute the incomplete elliptic integrals
-      compute_el2(tanphi, k2inv);
-
       // Compute the *definite* integrals
       // Add offsets to account for the limited domain of `el2`
       int sgn = -1;
@@ -471,32 +813,56 @@ protected:
     term (2) in the primitive integral P, based on the expressions in Pal
     (2012).
 
-    NOTE: We are currently autodiffing the Carlson RJ expression to get the
-          derivative of this integral. The RJ function is already numerically
-          unstable, so autodiffing it is a **terrible** idea.
+    This method appends the arguments of RJ, valid for -pi < kappa < pi,
+    to the batch; its value and derivatives are computed alongside those
+    of all other occultations in the batch by the batched `rj` above.
 
   */
-  inline void compute_PIp() {
+  inline void setup_PIp(Batch<T> &batch) {
 
     // Stability hack
     if (fabs(bo.value() - ro.value()) < STARRY_PAL_BO_EQUALS_RO_TOL) {
-      PIp = 0.0;
+      rj_offset = -1;
       return;
     }
 
-    // Helper variables
-    A val;
+    rj_offset = batch.x.size();
+    for (size_t i = 0; i < K; ++i) {
+      if (w(i) < 0)
+        w(i) = 0.0;
+      batch.x.push_back(w(i).value());
+      batch.y.push_back(sinphi(i).value() * sinphi(i).value());
+      batch.z.push_back(1.0);
+      batch.p.push_back(p(i).value());
+    }
+  }
+
+  /**
+    Chain the results of the `rj` kernel into the autodiff variables and
+    compute the modified incomplete elliptic integral of the third kind.
+
+  */
+  inline void finish_PIp(const Batch<T> &batch) {
+
+    // Stability hack
+    if (rj_offset < 0) {
+      PIp = 0.0;
+      return;
+    }
 
     // Compute the integrals
+    A val, rjA;
     int sgn = -1;
     PIp = 0.0;
     for (size_t i = 0; i < K; ++i) {
 
-      // Compute the integral, valid for -pi < kappa < pi
-      if (w(i) < 0)
-        w(i) = 0.0;
-      val = (1.0 - coskap(i)) * cosphi(i) *
-            rj(w(i), A(sinphi(i) * sinphi(i)), A(1.0), p(i));
+      const int n = rj_offset + i;
+      rjA.value() = batch.RJ(n);
+      rjA.derivatives() =
+          batch.dRJ(n, 0) * w(i).derivatives() +
+          batch.dRJ(n, 1) * 2 * sinphi(i).value() * sinphi(i).derivatives() +
+          batch.dRJ(n, 3) * p(i).derivatives();
+      val = (1.0 - coskap(i)) * cosphi(i) * rjA;
 
       // Add offsets to account for the limited domain of `rj`
       if (kappa(i) > 3 * pi<T>()) {
@@ -517,11 +883,25 @@ public:
   A E;
   A PIp;
 
-  //! Constructor
-  explicit IncompleteEllipticIntegrals(const A &bo, const A &ro,
-                                       const Vector<A> &kappa)
-      : bo(bo), ro(ro), kappa(kappa), K(kappa.size()), p(K), phi(K), coskap(K),
-        cosphi(K), sinphi(K), w(K) {
+  /**
+    Compute the helper variables and the complete elliptic integrals, and
+    append the arguments of the `el2` and `rj` kernels to `batch`.
+
+  */
+  inline void setup(const A &bo_, const A &ro_, const Limits<A> &kappa_,
+                    Batch<T> &batch) {
+
+    // Inputs
+    bo = bo_;
+    ro = ro_;
+    kappa = kappa_;
+    K = kappa.size();
+    p.resize(K);
+    phi.resize(K);
+    coskap.resize(K);
+    cosphi.resize(K);
+    sinphi.resize(K);
+    w.resize(K);
 
     // Helper vars
     phi.array() = 0.5 * (kappa.array() - pi<T>());
@@ -624,11 +1004,30 @@ public:
       }
     }
 
-    // First and second kinds
-    compute_FE();
+    // Kernel arguments
+    setup_FE(batch);
+    setup_PIp(batch);
+  }
+
+  /**
+    Compute the integrals once `batch` has been computed.
 
-    // Third kind
-    compute_PIp();
+  */
+  inline void finish(const Batch<T> &batch) {
+    finish_FE(batch);
+    finish_PIp(batch);
+  }
+
+  //! Default constructor; call `setup` and `finish` to compute the integrals
+  IncompleteEllipticIntegrals() {}
+
+  //! Constructor
+  explicit IncompleteEllipticIntegrals(const A &bo, const A &ro,
+                                       const Limits<A> &kappa) {
+    Batch<T> batch;
+    setup(bo, ro, kappa, batch);
+    batch.compute();
+    finish(batch);
   }
 };
 
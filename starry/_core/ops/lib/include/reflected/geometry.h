@@ -9,7 +9,7 @@
 
 #include "../utils.h"
 #include "constants.h"
-#include <Eigen/Eigenvalues>
+#include <complex>
 
 namespace starry {
 namespace reflected {
@@ -30,6 +30,39 @@ inline bool on_dayside(const T &b, const T &theta, const T &costheta,
   return bool(yr >= yt);
 }
 
+/**
+    Autodiff-safe two-argument arc tangent. Eigen's version returns
+    a dynamically-sized derivative vector, which allocates.
+*/
+template <typename T, int N>
+inline ADScalar<T, N> arctan2(const ADScalar<T, N> &y,
+                              const ADScalar<T, N> &x) {
+  ADScalar<T, N> result;
+  result.value() = atan2(y.value(), x.value());
+  result.derivatives() =
+      (y.derivatives() * x.value() - y.value() * x.derivatives()) /
+      (y.value() * y.value() + x.value() * x.value());
+  return result;
+}
+
+/**
+    The angle `phi` along the occultor of the point where it
+    intersects the terminator at `x`.
+*/
+template <typename T>
+inline T get_phi(const T &b, const T &theta, const T &xo, const T &yo,
+                 const T &x) {
+  return theta + arctan2(T(b * sqrt(1 - x * x) - yo), T(x - xo));
+}
+
+/**
+    The angle `xi` along the terminator of the point where it
+    intersects the occultor at `x`.
+*/
+template <typename T> inline T get_xi(const T &x) {
+  return arctan2(T(sqrt(1 - x * x)), x);
+}
+
 /**
     Sort a pair of `phi` angles.
 
@@ -37,14 +70,14 @@ inline bool on_dayside(const T &b, const T &theta, const T &costheta,
     always span the dayside.
 */
 template <typename T>
-inline Vector<T> sort_phi(const T &b, const T &theta, const T &costheta,
+inline Limits<T> sort_phi(const T &b, const T &theta, const T &costheta,
                           const T &sintheta, const T &bo, const T &ro,
-                          const Vector<T> &phi_) {
+                          const Limits<T> &phi_) {
 
   // First ensure the range is correct
   T phi1 = angle(phi_(0));
   T phi2 = angle(phi_(1));
-  Vector<T> phi(2);
+  Limits<T> phi(2);
   phi << phi1, phi2;
   if (phi(1) < phi(0))
     phi(1) += 2 * pi<T>();
@@ -73,13 +106,13 @@ inline Vector<T> sort_phi(const T &b, const T &theta, const T &costheta,
     arranged in decreasing order.
 */
 template <typename T>
-inline Vector<T> sort_xi(const T &b, const T &theta, const T &costheta,
+inline Limits<T> sort_xi(const T &b, const T &theta, const T &costheta,
                          const T &sintheta, const T &bo, const T &ro,
-                         const Vector<T> &xi_) {
+                         const Limits<T> &xi_) {
 
   T xi1 = angle(xi_(0));
   T xi2 = angle(xi_(1));
-  Vector<T> xi(2);
+  Limits<T> xi(2);
   if (xi1 > xi2)
     xi << xi1, xi2;
   else
@@ -95,14 +128,14 @@ inline Vector<T> sort_xi(const T &b, const T &theta, const T &costheta,
     dayside.
 */
 template <typename T>
-inline Vector<T> sort_lam(const T &b, const T &theta, const T &costheta,
+inline Limits<T> sort_lam(const T &b, const T &theta, const T &costheta,
                           const T &sintheta, const T &bo, const T &ro,
-                          const Vector<T> &lam_) {
+                          const Limits<T> &lam_) {
 
   // First ensure the range is correct
   T lam1 = angle(lam_(0));
   T lam2 = angle(lam_(1));
-  Vector<T> lam(2);
+  Limits<T> lam(2);
   lam << lam1, lam2;
   if (lam(1) < lam(0))
     lam(1) += 2 * pi<T>();
@@ -123,44 +156,128 @@ inline Vector<T> sort_lam(const T &b, const T &theta, const T &costheta,
 }
 
 /**
-    Polynomial root finder using an eigensolver.
-    `coeffs` is a vector of coefficients, highest power first.
+    Refine a root of the polynomial with coefficients `coeffs` (highest
+    power first) with a few steps of Newton's method.
+*/
+template <typename T, int N>
+inline void polish_root(const T (&coeffs)[N], std::complex<T> &x) {
+  std::complex<T> f, df;
+  for (int k = 0; k < STARRY_QUARTIC_POLISH_ITER; ++k) {
+    f = coeffs[0];
+    df = T(0.0);
+    for (int n = 1; n < N; ++n) {
+      df = df * x + f;
+      f = f * x + coeffs[n];
+    }
+    if (df == std::complex<T>(T(0.0)))
+      break;
+    x -= f / df;
+  }
+}
 
-    Adapted from http://www.sgh1.net/posts/cpp-root-finder.md
+/**
+    Closed-form roots of the quartic
+
+        coeffs[0] x^4 + coeffs[1] x^3 + coeffs[2] x^2 + coeffs[3] x + coeffs[4]
+
+    via Ferrari's method. The quartic is depressed and factored into two
+    quadratics using the root of largest magnitude of the resolvent cubic,
+    which is found with Cardano's formula; choosing the largest root
+    avoids the catastrophic cancellation in the quadratic coefficients
+    when the other roots are small. All roots, including the one of the
+    resolvent, are refined with a few Newton steps on the original
+    polynomial.
+
+    If the leading coefficient is smaller than the constant term (e.g.,
+    for `b -> 1` in `get_roots`), one of the roots may be very large, and
+    the monic form loses the others to cancellation. In that case we solve
+    for the reciprocals of the roots, which are the roots of the reversed
+    polynomial, instead.
 */
 template <typename T>
-inline std::vector<std::complex<T>> eigen_roots(const std::vector<T> &coeffs,
-                                                bool &success) {
-  int N = coeffs.size();
-  int matsz = N - 1;
-  std::vector<std::complex<T>> vret;
+inline void quartic_roots(const T (&coeffs)[5], std::complex<T> (&roots)[4]) {
+  using Complex = std::complex<T>;
 
-  Matrix<T> companion_mat(matsz, matsz);
-  companion_mat.setZero();
+  // Solve for the reciprocals of the roots?
+  if (abs(coeffs[0]) < abs(coeffs[4])) {
+    T reversed[5] = {coeffs[4], coeffs[3], coeffs[2], coeffs[1], coeffs[0]};
+    quartic_roots(reversed, roots);
+    for (int n = 0; n < 4; ++n) {
+      roots[n] = T(1.0) / roots[n];
+      if (std::isfinite(abs(roots[n])))
+        polish_root(coeffs, roots[n]);
+    }
+    return;
+  }
 
-  for (int n = 0; n < matsz; ++n) {
-    for (int m = 0; m < matsz; ++m) {
+  // Monic form
+  T a = coeffs[1] / coeffs[0];
+  T b = coeffs[2] / coeffs[0];
+  T c = coeffs[3] / coeffs[0];
+  T d = coeffs[4] / coeffs[0];
+
+  // Depressed quartic y^4 + p y^2 + q y + r with x = y - a / 4
+  T a2 = a * a;
+  T p = b - 0.375 * a2;
+  T q = c - 0.5 * a * b + 0.125 * a2 * a;
+  T r = d - 0.25 * a * c + 0.0625 * a2 * b - 3.0 / 256.0 * a2 * a2;
+
+  if (q == 0) {
+
+    // Biquadratic: solve for y^2
+    Complex D = sqrt(Complex(p * p - 4 * r));
+    Complex y1 = sqrt(T(0.5) * (-p + D));
+    Complex y2 = sqrt(T(0.5) * (-p - D));
+    roots[0] = y1;
+    roots[1] = -y1;
+    roots[2] = y2;
+    roots[3] = -y2;
 
-      if (n == m + 1)
-        companion_mat(n, m) = 1.0;
+  } else {
 
-      if (m == matsz - 1)
-        companion_mat(n, m) = -coeffs[matsz - n] / coeffs[0];
+    // Resolvent cubic m^3 + p m^2 + (p^2 / 4 - r) m - q^2 / 8, depressed
+    // to z^3 + P z + Q with m = z - p / 3
+    T P = -(p * p / 12 + r);
+    T Q = -p * p * p / 108 + p * r / 3 - q * q / 8;
+    Complex D = sqrt(Complex(0.25 * Q * Q + P * P * P / 27));
+    Complex w = -T(0.5) * Q + D;
+    Complex w_ = -T(0.5) * Q - D;
+    if (abs(w_) > abs(w))
+      w = w_;
+    Complex m = -p / 3;
+    if (abs(w) > 0) {
+      Complex u = std::polar(pow(abs(w), T(1.0) / 3), arg(w) / 3);
+      Complex v = -P / (T(3.0) * u);
+      Complex omega(T(-0.5), T(0.5) * sqrt(T(3.0)));
+      Complex mk;
+      m = u + v - p / 3;
+      for (int k = 1; k < 3; ++k) {
+        u *= omega;
+        v *= conj(omega);
+        mk = u + v - p / 3;
+        if (abs(mk) > abs(m))
+          m = mk;
+      }
     }
+    T resolvent[4] = {1.0, p, 0.25 * p * p - r, -0.125 * q * q};
+    polish_root(resolvent, m);
+
+    // Factor into y^2 -/+ s y + (p / 2 + m +/- q / (2 s)), with s^2 = 2 m
+    Complex s = sqrt(T(2.0) * m);
+    Complex t = q / s;
+    Complex D1 = sqrt(-T(2.0) * (p + m + t));
+    Complex D2 = sqrt(-T(2.0) * (p + m - t));
+    roots[0] = T(0.5) * (s + D1);
+    roots[1] = T(0.5) * (s - D1);
+    roots[2] = T(0.5) * (-s + D2);
+    roots[3] = T(0.5) * (-s - D2);
   }
 
-  Eigen::EigenSolver<Matrix<T>> solver(companion_mat);
-  if (solver.info() == Eigen::Success) {
-    success = true;
-  } else {
-    success = false;
+  // Undo the shift & polish
+  for (int n = 0; n < 4; ++n) {
+    roots[n] -= T(0.25) * a;
+    polish_root(coeffs, roots[n]);
   }
-
-  Matrix<std::complex<T>> eig = solver.eigenvalues();
-  for (int i = 0; i < matsz; ++i)
-    vret.push_back(eig(i));
-
-  return vret;
 }
 
 /**
@@ -168,7 +285,7 @@ inline std::vector<std::complex<T>> eigen_roots(const std::vector<T> &coeffs,
 
 */
 template <typename T>
-inline Vector<T> get_roots(const T &b_, const T &theta_, const T &costheta_,
+inline Limits<T> get_roots(const T &b_, const T &theta_, const T &costheta_,
                            const T &sintheta_, const T &bo_, const T &ro_) {
 
   // Get the *values*
@@ -182,7 +299,7 @@ inline Vector<T> get_roots(const T &b_, const T &theta_, const T &costheta_,
 
   // Roots and derivs
   int nroots = 0;
-  Vector<Scalar> x(4), dxdb(4), dxdtheta(4), dxdbo(4), dxdro(4);
+  Limits<Scalar> x(4), dxdb(4), dxdtheta(4), dxdbo(4), dxdro(4);
 
   // We'll solve for occultor-terminator intersections
   // in the frame where the semi-major axis of the
@@ -225,28 +342,14 @@ inline Vector<T> get_roots(const T &b_, const T &theta_, const T &costheta_,
     // Need to solve a quartic
   } else {
 
-    // Get the roots (eigenvalue problem)
-    std::vector<Scalar> coeffs;
-    coeffs.push_back((1 - b2) * (1 - b2));
-    coeffs.push_back(-4 * xo * (1 - b2));
-    coeffs.push_back(-2 *
-                     (b4 + ro2 - 3 * xo2 - yo2 - b2 * (1 + ro2 - xo2 + yo2)));
-    coeffs.push_back(-4 * xo * (b2 - ro2 + xo2 + yo2));
-    coeffs.push_back(b4 - 2 * b2 * (ro2 - xo2 + yo2) +
-                     (ro2 - xo2 - yo2) * (ro2 - xo2 - yo2));
-    bool success = false;
-    std::vector<std::complex<Scalar>> roots = eigen_roots(coeffs, success);
-    if (!success) {
-      std::stringstream args;
-      args << "b_ = " << b_ << ", "
-           << "theta_ = " << theta_ << ", "
-           << "costheta_ = " << costheta_ << ", "
-           << "sintheta_ = " << sintheta_ << ", "
-           << "bo_ = " << bo_ << ", "
-           << "ro_ = " << ro_;
-      throw StarryException("Root eigensolver did not converge.",
-                            "reflected/geometry.h", "get_roots", args.str());
-    }
+    // Get the roots of the quartic
+    Scalar coeffs[5] = {
+        (1 - b2) * (1 - b2), -4 * xo * (1 - b2),
+        -2 * (b4 + ro2 - 3 * xo2 - yo2 - b2 * (1 + ro2 - xo2 + yo2)),
+        -4 * xo * (b2 - ro2 + xo2 + yo2),
+        b4 - 2 * b2 * (ro2 - xo2 + yo2) + (ro2 - xo2 - yo2) * (ro2 - xo2 - yo2)};
+    Complex roots[4];
+    quartic_roots(coeffs, roots);
 
     // Polish the roots using Newton's method on the *original*
     // function, which is more stable than the quartic expression.
@@ -391,7 +494,7 @@ inline Vector<T> get_roots(const T &b_, const T &theta_, const T &costheta_,
   }
 
   // We're done!
-  Vector<T> result(nroots);
+  Limits<T> result(nroots);
   for (int n = 0; n < nroots; ++n) {
     result(n).value() = x(n);
     result(n).derivatives() =
@@ -405,7 +508,7 @@ inline Vector<T> get_roots(const T &b_, const T &theta_, const T &costheta_,
 template <typename T>
 inline int get_angles(const T &b, const T &theta_, const T &costheta_,
                       const T &sintheta_, const T &bo_, const T &ro,
-                      Vector<T> &kappa, Vector<T> &lam, Vector<T> &xi) {
+                      Limits<T> &kappa, Limits<T> &lam, Limits<T> &xi) {
 
   // We may need to adjust these, so make a copy
   T bo = bo_;
@@ -414,7 +517,7 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
   T sintheta = sintheta_;
 
   // Helper angle
-  Vector<T> phi;
+  Limits<T> phi;
 
   // Trivial cases
   if (bo <= ro - 1 + STARRY_COMPLETE_OCC_TOL) {
@@ -470,7 +573,7 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
   // These are the roots to a quartic equation.
   T xo = bo * sintheta;
   T yo = bo * costheta;
-  Vector<T> x = get_roots(b, theta, costheta, sintheta, bo, ro);
+  Limits<T> x = get_roots(b, theta, costheta, sintheta, bo, ro);
   int nroots = x.size();
 
   // P-Q
@@ -557,7 +660,7 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
       phi_l = pi<T>() - phi_l;
 
     // Angle of intersection with the terminator
-    T phi_t = theta + atan2(b * sqrt(1 - x(0) * x(0)) - yo, x(0) - xo);
+    T phi_t = get_phi(b, theta, xo, yo, x(0));
 
     // Now ensure phi *only* spans the dayside.
     phi.resize(2);
@@ -593,7 +696,7 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
     // --
 
     // Angle of intersection with occultor
-    T xi_o = atan2(sqrt(1 - x(0) * x(0)), x(0));
+    T xi_o = get_xi(x(0));
 
     // Angle of intersection with the limb
     T xi_l = ((1 - xo) * (1 - xo) + yo * yo < ro * ro) ? 0 : pi<T>();
@@ -612,15 +715,15 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
     // Angles are easy
     lam.setZero(0);
     phi.resize(2);
-    T phi0 = angle(T(theta + atan2(b * sqrt(1 - x(0) * x(0)) - yo, x(0) - xo)));
-    T phi1 = angle(T(theta + atan2(b * sqrt(1 - x(1) * x(1)) - yo, x(1) - xo)));
+    T phi0 = angle(get_phi(b, theta, xo, yo, x(0)));
+    T phi1 = angle(get_phi(b, theta, xo, yo, x(1)));
     if (phi0 > phi1)
       phi << phi1, phi0;
     else
       phi << phi0, phi1;
     xi.resize(2);
-    T xi0 = angle(T(atan2(sqrt(1 - x(0) * x(0)), x(0))));
-    T xi1 = angle(T(atan2(sqrt(1 - x(1) * x(1)), x(1))));
+    T xi0 = angle(get_xi(x(0)));
+    T xi1 = angle(get_xi(x(1)));
     if (xi0 > xi1)
       xi << xi1, xi0;
     else
@@ -646,12 +749,12 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
       // We're going to choose xi(0) to be the rightmost point in
       // this frame, so that the integration is counter-clockwise along
       // the terminator to xi(1).
-      Vector<T> x(2), y(2), xr(2);
+      Limits<T> x(2), y(2), xr(2);
       x.array() = costheta * cos(xi.array()) - b * sintheta * sin(xi.array());
       y.array() = sintheta * cos(xi.array()) + b * costheta * sin(xi.array());
       xr.array() = x.array() * costheta + y.array() * sintheta;
       if (xr(1) > xr(0)) {
-        Vector<T> tmp(2);
+        Limits<T> tmp(2);
         tmp << xi(1), xi(0);
         xi = tmp;
       }
@@ -669,7 +772,7 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
       T d1 = (x_xi1 - x_phi1) * (x_xi1 - x_phi1) +
              (y_xi1 - y_phi1) * (y_xi1 - y_phi1);
       if (d1 < d0) {
-        Vector<T> tmp(2);
+        Limits<T> tmp(2);
         tmp << phi(1), phi(0);
         phi = tmp;
       }
@@ -707,7 +810,7 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
           // the terminator is *under* the arc along the limb
           // and we should instead start at the *leftmost* xi
           // value.
-          Vector<T> tmp(2);
+          Limits<T> tmp(2);
           tmp << phi(1), phi(0);
           phi = tmp;
           kappa.resize(phi.size());
@@ -718,7 +821,7 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
         } else {
           // Dayside visible
           if (b < 0) {
-            Vector<T> tmp(2);
+            Limits<T> tmp(2);
             tmp << phi(1), phi(0);
             phi = tmp;
             tmp << xi(1), xi(0);
@@ -761,16 +864,13 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
 
       if ((-1 - xo) * (-1 - xo) + yo * yo < ro * ro) {
 
-        Vector<T> tmp(3);
+        Limits<T> tmp(3);
         tmp << x(2), x(1), x(0);
         x = tmp;
 
-        phi(0) =
-            angle(T(theta + atan2(b * sqrt(1 - x(0) * x(0)) - yo, x(0) - xo)));
-        phi(1) =
-            angle(T(theta + atan2(b * sqrt(1 - x(1) * x(1)) - yo, x(1) - xo)));
-        phi(2) =
-            angle(T(theta + atan2(b * sqrt(1 - x(2) * x(2)) - yo, x(2) - xo)));
+        phi(0) = angle(get_phi(b, theta, xo, yo, x(0)));
+        phi(1) = angle(get_phi(b, theta, xo, yo, x(1)));
+        phi(2) = angle(get_phi(b, theta, xo, yo, x(2)));
         phi(3) = angle(phi_l);
         while (phi(1) < phi(0))
           phi(1) += 2 * pi<T>();
@@ -779,9 +879,8 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
         while (phi(3) < phi(2))
           phi(3) += 2 * pi<T>();
 
-        xi << angle(atan2(sqrt(1 - x(1) * x(1)), x(1))),
-            angle(atan2(sqrt(1 - x(0) * x(0)), x(0))), pi<T>(),
-            angle(atan2(sqrt(1 - x(2) * x(2)), x(2)));
+        xi << angle(get_xi(x(1))), angle(get_xi(x(0))), pi<T>(),
+            angle(get_xi(x(2)));
 
         lam << angle(lam_o), angle(pi<T>() + theta);
         if (lam(1) < lam(0))
@@ -789,17 +888,14 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
 
       } else {
 
-        Vector<T> tmp(3);
+        Limits<T> tmp(3);
         tmp << x(1), x(0), x(2);
         x = tmp;
 
-        phi(0) =
-            angle(T(theta + atan2(b * sqrt(1 - x(0) * x(0)) - yo, x(0) - xo)));
-        phi(1) =
-            angle(T(theta + atan2(b * sqrt(1 - x(1) * x(1)) - yo, x(1) - xo)));
+        phi(0) = angle(get_phi(b, theta, xo, yo, x(0)));
+        phi(1) = angle(get_phi(b, theta, xo, yo, x(1)));
         phi(2) = angle(pi<T>() - phi_l);
-        phi(3) =
-            angle(T(theta + atan2(b * sqrt(1 - x(2) * x(2)) - yo, x(2) - xo)));
+        phi(3) = angle(get_phi(b, theta, xo, yo, x(2)));
         while (phi(1) < phi(0))
           phi(1) += 2 * pi<T>();
         while (phi(2) < phi(1))
@@ -807,9 +903,8 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
         while (phi(3) < phi(2))
           phi(3) += 2 * pi<T>();
 
-        xi << angle(atan2(sqrt(1 - x(1) * x(1)), x(1))),
-            angle(atan2(sqrt(1 - x(0) * x(0)), x(0))),
-            angle(atan2(sqrt(1 - x(2) * x(2)), x(2))), 0.0;
+        xi << angle(get_xi(x(1))), angle(get_xi(x(0))), angle(get_xi(x(2))),
+            0.0;
 
         lam << angle(theta), angle(pi<T>() - lam_o);
         if (lam(1) < lam(0))
@@ -824,17 +919,14 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
 
       if ((-1 - xo) * (-1 - xo) + yo * yo < ro * ro) {
 
-        Vector<T> tmp(3);
+        Limits<T> tmp(3);
         tmp << x(1), x(2), x(0);
         x = tmp;
 
-        phi(0) =
-            angle(T(theta + atan2(b * sqrt(1 - x(0) * x(0)) - yo, x(0) - xo)));
-        phi(1) =
-            angle(T(theta + atan2(b * sqrt(1 - x(1) * x(1)) - yo, x(1) - xo)));
+        phi(0) = angle(get_phi(b, theta, xo, yo, x(0)));
+        phi(1) = angle(get_phi(b, theta, xo, yo, x(1)));
         phi(2) = angle(pi<T>() - phi_l);
-        phi(3) =
-            angle(T(theta + atan2(b * sqrt(1 - x(2) * x(2)) - yo, x(2) - xo)));
+        phi(3) = angle(get_phi(b, theta, xo, yo, x(2)));
         while (phi(1) < phi(0))
           phi(1) += 2 * pi<T>();
         while (phi(2) < phi(1))
@@ -842,9 +934,8 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
         while (phi(3) < phi(2))
           phi(3) += 2 * pi<T>();
 
-        xi << angle(atan2(sqrt(1 - x(1) * x(1)), x(1))),
-            angle(atan2(sqrt(1 - x(0) * x(0)), x(0))),
-            angle(atan2(sqrt(1 - x(2) * x(2)), x(2))), pi<T>();
+        xi << angle(get_xi(x(1))), angle(get_xi(x(0))), angle(get_xi(x(2))),
+            pi<T>();
 
         lam << angle(pi<T>() + theta), angle(pi<T>() - lam_o);
         if (lam(1) < lam(0))
@@ -852,12 +943,9 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
 
       } else {
 
-        phi(0) =
-            angle(T(theta + atan2(b * sqrt(1 - x(0) * x(0)) - yo, x(0) - xo)));
-        phi(1) =
-            angle(T(theta + atan2(b * sqrt(1 - x(1) * x(1)) - yo, x(1) - xo)));
-        phi(2) =
-            angle(T(theta + atan2(b * sqrt(1 - x(2) * x(2)) - yo, x(2) - xo)));
+        phi(0) = angle(get_phi(b, theta, xo, yo, x(0)));
+        phi(1) = angle(get_phi(b, theta, xo, yo, x(1)));
+        phi(2) = angle(get_phi(b, theta, xo, yo, x(2)));
         phi(3) = angle(phi_l);
         while (phi(1) < phi(0))
           phi(1) += 2 * pi<T>();
@@ -866,9 +954,8 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
         while (phi(3) < phi(2))
           phi(3) += 2 * pi<T>();
 
-        xi << angle(atan2(sqrt(1 - x(1) * x(1)), x(1))),
-            angle(atan2(sqrt(1 - x(0) * x(0)), x(0))), 0.0,
-            angle(atan2(sqrt(1 - x(2) * x(2)), x(2)));
+        xi << angle(get_xi(x(1))), angle(get_xi(x(0))), 0.0,
+            angle(get_xi(x(2)));
 
         lam << angle(lam_o), angle(theta);
         if (lam(1) < lam(0))
@@ -887,28 +974,26 @@ inline int get_angles(const T &b, const T &theta_, const T &costheta_,
     phi.resize(4);
     xi.resize(4);
 
-    phi << angle(theta + atan2(b * sqrt(1 - x(0) * x(0)) - yo, x(0) - xo)),
-        angle(theta + atan2(b * sqrt(1 - x(1) * x(1)) - yo, x(1) - xo)),
-        angle(theta + atan2(b * sqrt(1 - x(2) * x(2)) - yo, x(2) - xo)),
-        angle(theta + atan2(b * sqrt(1 - x(3) * x(3)) - yo, x(3) - xo));
+    phi << angle(get_phi(b, theta, xo, yo, x(0))),
+        angle(get_phi(b, theta, xo, yo, x(1))),
+        angle(get_phi(b, theta, xo, yo, x(2))),
+        angle(get_phi(b, theta, xo, yo, x(3)));
     std::sort(phi.data(), phi.data() + phi.size());
 
-    Vector<T> tmp(4);
+    Limits<T> tmp(4);
     tmp << phi(1), phi(0), phi(3), phi(2);
     phi = tmp;
     kappa.resize(phi.size());
     kappa.array() = phi.array() + pi<T>() / 2;
 
-    xi << angle(atan2(sqrt(1 - x(0) * x(0)), x(0))),
-        angle(atan2(sqrt(1 - x(1) * x(1)), x(1))),
-        angle(atan2(sqrt(1 - x(2) * x(2)), x(2))),
-        angle(atan2(sqrt(1 - x(3) * x(3)), x(3)));
+    xi << angle(get_xi(x(0))), angle(get_xi(x(1))), angle(get_xi(x(2))),
+        angle(get_xi(x(3)));
     std::sort(xi.data(), xi.data() + xi.size());
 
     if (b > 0) {
       return FLUX_QUAD_NIGHT_VIS;
     } else {
-      Vector<T> tmp(4);
+      Limits<T> tmp(4);
       tmp << xi(1), xi(0), xi(3), xi(2);
       xi = tmp;
       return FLUX_QUAD_DAY_VIS;
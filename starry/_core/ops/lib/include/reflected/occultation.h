@@ -39,16 +39,25 @@ protected:
   int N;
   int N_lamb;
   int N_on94;
-  Eigen::SparseMatrix<T> I;
-  Vector<T> kappa;
-  Vector<T> lam;
-  Vector<T> xi;
+  scatter::Illumination<T> ILLUM;
+  Limits<T> kappa;
+  Limits<T> lam;
+  Limits<T> xi;
   Vector<T> PIntegral;
   Vector<T> QIntegral;
   Vector<T> TIntegral;
   RowVector<T> PQT;
   RowVector<T> total_em;
 
+  // Scratch space
+  RowVector<T> sTA2;
+  RowVector<T> sTw;
+  RowVector<T> sTtmp;
+  RowVector<T> rT0hat;
+  RowVector<T> rThat;
+  RowVector<T> rTA1;
+  RowVector<T> rTA1R;
+
   // Angles
   T costheta;
   T sintheta;
@@ -62,53 +71,64 @@ protected:
   phasecurve::PhaseCurve<T> R;
   solver::Solver<T, true> G_Small; // Lambertian case
   solver::Solver<T, true> G_Big;   // Oren-Nayar case
+  primitive::Workspace<T> WS_Small; // Lambertian case
+  primitive::Workspace<T> WS_Big;   // Oren-Nayar case
 
-  // Numerical integration
-  quad::Quad<Scalar> QUAD;
+  // Occultor parameters of the last standard solutions (see `sTe`)
+  bool sTe_cached[2];
+  T sTe_bo[2];
+  T sTe_ro[2];
 
   /**
-      Weight the solution vector by the illumination profile.
+      Weight the solution vector `u` by the illumination profile and
+      store the result in `v`.
       This profile contains both the cosine illumination *and*
       the scattering law (constant, i.e. isotropic, if sigr == 0).
       Note that we need I to transform Greens --> Greens.
 
   */
-  inline RowVector<T> illuminate(const T &b, const T &theta,
-                                 const RowVector<T> &sT, const T &sigr) {
-    scatter::computeI(deg, I, b, theta, sigr, B);
-    RowVector<T> sTw;
-    sTw = sT * B.A2_Reflected.block(0, 0, sT.cols(), sT.cols());
-    sTw = sTw * I;
-    sTw = sTw * B.A2Inv_Reflected.block(0, 0, sTw.cols(), sTw.cols());
-    return sTw;
+  inline void illuminate(const T &b, const T &theta, const RowVector<T> &u,
+                         const T &sigr, RowVector<T> &v) {
+    sTA2.noalias() = u * B.A2_Reflected.block(0, 0, u.cols(), u.cols());
+    ILLUM.apply(sTA2, b, theta, sigr, B, sTw);
+    v.noalias() = sTw * B.A2Inv_Reflected.block(0, 0, sTw.cols(), sTw.cols());
   }
 
   /**
-      AutoDiff-enabled standard starry occultation solution.
+      AutoDiff-enabled standard starry occultation solution. Since it
+      only depends on the occultor, we skip the computation if `bo` and
+      `ro` are the same as in the previous call, as is the case for all
+      the samples of an extended source at a given timestep.
 
   */
-  inline RowVector<T> sTe(const T &bo, const T &ro, const T &sigr) {
-    if (sigr > 0) {
-      G_Big.compute(bo, ro);
-      return G_Big.sT;
-    } else {
-      G_Small.compute(bo, ro);
-      return G_Small.sT;
+  inline const RowVector<T> &sTe(const T &bo, const T &ro, const T &sigr) {
+    const int i = (sigr > 0) ? 1 : 0;
+    solver::Solver<T, true> &G = (sigr > 0) ? G_Big : G_Small;
+    if (!sTe_cached[i] || !same(bo, sTe_bo[i]) || !same(ro, sTe_ro[i])) {
+      G.compute(bo, ro);
+      sTe_bo[i] = bo;
+      sTe_ro[i] = ro;
+      sTe_cached[i] = true;
     }
+    return G.sT;
+  }
+
+  //! Are two variables (and their derivatives) identical?
+  static inline bool same(const T &x, const T &y) {
+    return (x.value() == y.value()) && (x.derivatives() == y.derivatives());
   }
 
   /**
-   *
-  */
-  inline RowVector<T> sTr(const T &b, const T &theta, const T &sigr) {
+      Rotate a solution vector `rT` in the terminator frame into
+      the occultor frame and store the result in `v`.
 
-    // Compute the reflection solution in the terminator frame
-    R.compute(b, sigr);
+  */
+  inline void rotate(const T &theta, const RowVector<T> &rT,
+                     RowVector<T> &v) {
 
     // Transform to ylms and rotate into the occultor frame
-    RowVector<T> rTA1 =
-        R.rT * B.A1_Reflected.block(0, 0, R.rT.cols(), R.rT.cols());
-    RowVector<T> rTA1R(N);
+    rTA1.noalias() = rT * B.A1_Reflected.block(0, 0, rT.cols(), rT.cols());
+    rTA1R.resize(N);
     cosnt(1) = cos(theta);
     sinnt(1) = sin(-theta);
     for (int n = 2; n < deg + 1; ++n) {
@@ -134,13 +154,28 @@ protected:
     }
 
     // Transform back to Green's polynomials
-    return rTA1R * B.AInv_Reflected.block(0, 0, rTA1R.cols(), rTA1R.cols());
+    v.noalias() =
+        rTA1R * B.AInv_Reflected.block(0, 0, rTA1R.cols(), rTA1R.cols());
+  }
+
+  /**
+    The reflected light phase curve solution in the occultor frame.
+  */
+  inline void sTr(const T &b, const T &theta, const T &sigr,
+                  RowVector<T> &v) {
+
+    // Compute the reflection solution in the terminator frame
+    R.compute(b, sigr);
+
+    // Rotate it into the occultor frame
+    rotate(theta, R.rT, v);
   }
 
   /**
     The complement of sTr.
   */
-  inline RowVector<T> sTr_hat(const T &b, const T &theta, const T &sigr) {
+  inline void sTr_hat(const T &b, const T &theta, const T &sigr,
+                      RowVector<T> &v) {
 
     // Compute the complement of the reflection
     // solution in the terminator frame.
@@ -150,49 +185,26 @@ protected:
     else
       deg_eff = deg_lamb;
     R.compute_unweighted(b, deg_eff);
-    scatter::computeI(deg, I, b, T(0.0), sigr, B);
-    RowVector<T> rT = -(total_em.segment(0, R.rT0.cols()) - R.rT0) * I;
-
-    // Transform to ylms and rotate into the occultor frame
-    RowVector<T> rTA1 = rT * B.A1_Reflected.block(0, 0, rT.cols(), rT.cols());
-    RowVector<T> rTA1R(N);
-    cosnt(1) = cos(theta);
-    sinnt(1) = sin(-theta);
-    for (int n = 2; n < deg + 1; ++n) {
-      cosnt(n) = 2.0 * cosnt(n - 1) * cosnt(1) - cosnt(n - 2);
-      sinnt(n) = 2.0 * sinnt(n - 1) * cosnt(1) - sinnt(n - 2);
-    }
-    int n = 0;
-    for (int l = 0; l < deg + 1; ++l) {
-      for (int m = -l; m < 0; ++m) {
-        cosmt(n) = cosnt(-m);
-        sinmt(n) = -sinnt(-m);
-        ++n;
-      }
-      for (int m = 0; m < l + 1; ++m) {
-        cosmt(n) = cosnt(m);
-        sinmt(n) = sinnt(m);
-        ++n;
-      }
-      for (int j = 0; j < 2 * l + 1; ++j) {
-        rTA1R(l * l + j) = rTA1(l * l + j) * cosmt(l * l + j) +
-                           rTA1(l * l + 2 * l - j) * sinmt(l * l + j);
-      }
-    }
+    rT0hat = R.rT0 - total_em.segment(0, R.rT0.cols());
+    ILLUM.apply(rT0hat, b, T(0.0), sigr, B, rThat);
 
-    // Transform back to Green's polynomials
-    return rTA1R * B.AInv_Reflected.block(0, 0, rTA1R.cols(), rTA1R.cols());
+    // Rotate it into the occultor frame
+    rotate(theta, rThat, v);
   }
 
 public:
   int code;
   RowVector<T> sT;
+  quad::Quad<Scalar> QUAD; // Numerical integration
 
   explicit Occultation(int deg, const basis::Basis<Scalar> &B)
       : deg(deg), deg_lamb(deg + 1), deg_on94(deg + STARRY_OREN_NAYAR_DEG),
         N((deg + 1) * (deg + 1)), N_lamb((deg_lamb + 1) * (deg_lamb + 1)),
-        N_on94((deg_on94 + 1) * (deg_on94 + 1)), B(B), R(deg, B),
-        G_Small(deg_lamb), G_Big(deg_on94), sT(N) {
+        N_on94((deg_on94 + 1) * (deg_on94 + 1)), ILLUM(deg), B(B), R(deg, B),
+        G_Small(deg_lamb), G_Big(deg_on94), WS_Small(deg_lamb),
+        WS_Big(deg_on94), sT(N) {
+
+    sTe_cached[0] = sTe_cached[1] = false;
 
     // Rotation vectors
     cosnt.resize(max(2, deg + 1));
@@ -207,11 +219,53 @@ public:
   }
 
   /**
-      Compute the full solution vector s^T.
+      The angles of intersection of an occultation and, if its solution
+      vector requires them, its incomplete elliptic integrals.
+
+  */
+  struct Prepared {
+    int code;
+    Limits<T> kappa;
+    Limits<T> lam;
+    Limits<T> xi;
+    bool batched; /**< Do we need the integrals? */
+    ellip::IncompleteEllipticIntegrals<T> integrals;
+  };
+
+  // Buffers for the batched evaluation of several occultations
+  std::vector<Prepared> prepared;
+  ellip::Batch<Scalar> batch;
+
+  /**
+      Compute the angles of intersection and, if the solution vector
+      requires the incomplete elliptic integrals, set them up in `batch`.
+      Once the batch has been computed and the integrals finished,
+      `prepared` may be passed to `compute`.
+
+  */
+  inline void prepare(const T &b, const T &theta, const T &bo, const T &ro,
+                      Prepared &prepared, ellip::Batch<Scalar> &batch) {
+    costheta = cos(theta);
+    sintheta = sin(theta);
+    prepared.code = get_angles(b, theta, costheta, sintheta, bo, ro,
+                               prepared.kappa, prepared.lam, prepared.xi);
+    prepared.batched = !(
+        (prepared.code == FLUX_ZERO) || (prepared.code == FLUX_SIMPLE_OCC) ||
+        (prepared.code == FLUX_SIMPLE_REFL) ||
+        (prepared.code == FLUX_SIMPLE_OCC_REFL) ||
+        (prepared.code == FLUX_NOON) || (prepared.kappa.size() == 0));
+    if (prepared.batched)
+      prepared.integrals.setup(nudge_bo(bo, ro), ro, prepared.kappa, batch);
+  }
+
+  /**
+      Compute the full solution vector s^T. If the occultation was
+      prepared in a batch (see `prepare`), the angles of intersection and
+      the incomplete elliptic integrals are taken from `prepared`.
 
   */
   inline void compute(const T &b, const T &theta, const T &bo, const T &ro,
-                      const T &sigr) {
+                      const T &sigr, const Prepared *prepared = nullptr) {
 
     int deg_eff;
     if (sigr > 0)
@@ -222,7 +276,14 @@ public:
     // Get the angles of intersection
     costheta = cos(theta);
     sintheta = sin(theta);
-    code = get_angles(b, theta, costheta, sintheta, bo, ro, kappa, lam, xi);
+    if (prepared) {
+      code = prepared->code;
+      kappa = prepared->kappa;
+      lam = prepared->lam;
+      xi = prepared->xi;
+    } else {
+      code = get_angles(b, theta, costheta, sintheta, bo, ro, kappa, lam, xi);
+    }
 
     // The full solution vector is a combination of the
     // current vector, the standard starry vector, and the
@@ -238,24 +299,25 @@ public:
 
       // The occultor is blocking all of the nightside
       // and some dayside flux
-      sT = illuminate(b, theta, sTe(bo, ro, sigr), sigr);
+      illuminate(b, theta, sTe(bo, ro, sigr), sigr, sT);
 
     } else if (code == FLUX_SIMPLE_REFL) {
 
       // The total flux is the full dayside flux
-      sT = sTr(b, theta, sigr);
+      sTr(b, theta, sigr, sT);
 
     } else if (code == FLUX_SIMPLE_OCC_REFL) {
 
       // The occultor is only blocking dayside flux
-      sT = illuminate(b, theta, sTe(bo, ro, sigr), sigr) +
-           sTr_hat(b, theta, sigr);
+      illuminate(b, theta, sTe(bo, ro, sigr), sigr, sT);
+      sTr_hat(b, theta, sigr, sTtmp);
+      sT += sTtmp;
 
     } else if (code == FLUX_NOON) {
 
       // The substellar point is the center of the disk, so this is
       // analytically equivalent to the linear limb darkening solution
-      sT = illuminate(b, theta, sTe(bo, ro, sigr), sigr);
+      illuminate(b, theta, sTe(bo, ro, sigr), sigr, sT);
 
     } else {
 
@@ -263,31 +325,40 @@ public:
       // elliptic integrals.
 
       // Compute the primitive integrals
-      computeP(deg_eff, bo, ro, kappa, PIntegral, QUAD);
-      computeQ(deg_eff, lam, QIntegral);
-      computeT(deg_eff, b, theta, xi, TIntegral);
+      primitive::Workspace<T> &WS = (sigr > 0) ? WS_Big : WS_Small;
+      WS.integrals =
+          (prepared && prepared->batched) ? &prepared->integrals : nullptr;
+      computeP(deg_eff, bo, ro, kappa, PIntegral, QUAD, WS);
+      WS.integrals = nullptr;
+      computeQ(deg_eff, lam, QIntegral, WS);
+      computeT(deg_eff, b, theta, xi, TIntegral, WS);
       PQT = (PIntegral + QIntegral + TIntegral).transpose();
 
       if ((code == FLUX_DAY_OCC) || (code == FLUX_TRIP_DAY_OCC)) {
 
         //
-        sT = sTr(b, theta, sigr) - illuminate(b, theta, PQT, sigr);
+        sTr(b, theta, sigr, sT);
+        illuminate(b, theta, PQT, sigr, sTtmp);
+        sT -= sTtmp;
 
       } else if ((code == FLUX_NIGHT_OCC) || (code == FLUX_TRIP_NIGHT_OCC)) {
 
         //
-        sT = illuminate(b, theta, sTe(bo, ro, sigr) + PQT, sigr) +
-             sTr_hat(b, theta, sigr);
+        PQT += sTe(bo, ro, sigr);
+        illuminate(b, theta, PQT, sigr, sT);
+        sTr_hat(b, theta, sigr, sTtmp);
+        sT += sTtmp;
 
       } else if ((code == FLUX_DAY_VIS) || (code == FLUX_QUAD_DAY_VIS)) {
 
         // The solution vector is *just* the reflected light solution vector.
-        sT = illuminate(b, theta, PQT, sigr);
+        illuminate(b, theta, PQT, sigr, sT);
 
       } else if ((code == FLUX_NIGHT_VIS) || (code == FLUX_QUAD_NIGHT_VIS)) {
 
         //
-        sT = illuminate(b, theta, sTe(bo, ro, sigr) - PQT, sigr);
+        PQT = sTe(bo, ro, sigr) - PQT;
+        illuminate(b, theta, PQT, sigr, sT);
 
       } else {
 
@@ -36,7 +36,7 @@ protected:
   Vector<T> kj;
   Matrix<T> Lij;
   Matrix<T> Mij;
-  Eigen::SparseMatrix<T> ILLUM;
+  scatter::Illumination<T> ILLUM;
   basis::Basis<typename T::Scalar> B;
   T tol;
 
@@ -148,20 +148,298 @@ public:
       compute_unweighted(bterm, deg_on94);
     else
       compute_unweighted(bterm, deg_lamb);
-    scatter::computeI(deg, ILLUM, bterm, T(0.0), sigr, B);
-    rT = rT0 * ILLUM;
+    ILLUM.apply(rT0, bterm, T(0.0), sigr, B, rT);
   }
 
   explicit PhaseCurve(int deg, const basis::Basis<typename T::Scalar> &B)
       : deg(deg), deg_lamb(deg + 1), deg_on94(deg + STARRY_OREN_NAYAR_DEG),
         N((deg + 1) * (deg + 1)), N_lamb((deg_lamb + 1) * (deg_lamb + 1)),
-        N_on94((deg_on94 + 1) * (deg_on94 + 1)), B(B), tol(sqrt(mach_eps<T>())),
-        rT(N) {
+        N_on94((deg_on94 + 1) * (deg_on94 + 1)), ILLUM(deg), B(B),
+        tol(sqrt(mach_eps<T>())), rT(N) {
     // Pre-compute the Lij and Mij matrices for the largest case
     computeJK(deg_on94);
   }
 };
 
+/**
+  Interpolant of the reflected light phase curve integrals and
+  their derivatives at a fixed roughness `sigr`.
+
+  Since `rT` depends only on the terminator parameter `b` and
+  on `sigr`, we tabulate it in terms of `phi = arccos(b)`, in which
+  all the terms are smooth, as a Chebyshev series on the two panels
+  `b > 0` and `b < 0`. The split at `b = 0` is needed because the
+  Oren-Nayar correction vanishes identically on the day side. We
+  interpolate `rT`, `sin(phi) * drT / db` and `drT / dsigr`; dividing
+  the second one by `sin(phi)` gives back the (divergent) derivative
+  with respect to `b`. The number of nodes on each panel is tripled
+  until the interpolant agrees with the exact computation to within
+  `STARRY_PHASECURVE_TOL` (or to within the precision of the latter,
+  which degrades close to `|b| = 1`) at all the new nodes. Panels that do not
+  converge, as well as the region within `STARRY_B_ONE_TOL` of
+  `|b| = 1`, are evaluated exactly.
+
+  Building a table takes up to `STARRY_PHASECURVE_MAX_NODES` exact
+  evaluations per panel, so it only pays off for long time series.
+  Each batch of points is announced with `prepare`: if fewer than
+  `STARRY_PHASECURVE_MIN_BATCH` of its points can be interpolated, the
+  whole batch is evaluated exactly, *even if* a table at its roughness
+  is already cached. Otherwise the table is used, and built if needed.
+  The tables for the last `STARRY_PHASECURVE_CACHE_SIZE` roughnesses
+  are kept, so alternating between a few values of `sigr` does not
+  trigger a rebuild. Since a table depends only on its roughness, the
+  result for a batch depends only on the batch itself, and not on the
+  calls that preceded it.
+
+*/
+template <class T> class PhaseCurveInterpolant {
+
+protected:
+  using Scalar = typename T::Scalar;
+
+  /**
+    Chebyshev tables of the two panels at a given roughness.
+
+  */
+  struct Table {
+    Scalar sigr;                 /**< Roughness of the table */
+    int nodes[2];                /**< Number of nodes on each panel */
+    Matrix<Scalar> coeffs[2][3]; /**< Chebyshev coefficients */
+  };
+
+  PhaseCurve<T> &RP;
+  const int N;
+  Scalar bmax;
+  Scalar phi[3];
+  std::vector<Table> tables;
+  const Table *table;
+  int next;
+  Vector<Scalar> cheb;
+  T b_ad, sigr_ad;
+
+  /**
+    Chebyshev coefficients of the function tabulated at the `n`
+    nodes `cos(pi * (j + 1/2) / n)`.
+
+  */
+  inline Matrix<Scalar> fit(const Matrix<Scalar> &F) {
+    const int n = F.rows();
+    Matrix<Scalar> M(n, n);
+    for (int k = 0; k < n; ++k) {
+      for (int j = 0; j < n; ++j) {
+        M(k, j) = (k == 0 ? 1.0 : 2.0) / n *
+                  cos(pi<Scalar>() * k * (j + 0.5) / n);
+      }
+    }
+    return M * F;
+  }
+
+  /**
+    Chebyshev polynomials of the first kind at `x`.
+
+  */
+  inline void chebyshev(const Scalar &x, const int n) {
+    cheb(0) = 1.0;
+    if (n > 1)
+      cheb(1) = x;
+    for (int k = 2; k < n; ++k)
+      cheb(k) = 2.0 * x * cheb(k - 1) - cheb(k - 2);
+  }
+
+  /**
+    Tabulate panel `p` of `table`, tripling the number of nodes until
+    the interpolant matches the function at the new nodes.
+
+  */
+  inline void build(Table &table, const int p) {
+    const Scalar mid = 0.5 * (phi[p + 1] + phi[p]);
+    const Scalar half = 0.5 * (phi[p + 1] - phi[p]);
+    table.nodes[p] = 0;
+    int n = 3;
+    Matrix<Scalar> F[3], G[3];
+    for (int q = 0; q < 3; ++q)
+      F[q].resize(n, N);
+    Vector<Scalar> f(3 * N);
+    auto tabulate = [&](const Scalar &x) {
+      Scalar phix = mid + half * x;
+      exact(cos(phix), table.sigr, f.data(), f.data() + N, f.data() + 2 * N);
+      f.segment(N, N) *= sin(phix);
+    };
+    for (int j = 0; j < n; ++j) {
+      tabulate(cos(pi<Scalar>() * (j + 0.5) / n));
+      for (int q = 0; q < 3; ++q)
+        F[q].row(j) = f.segment(q * N, N).transpose();
+    }
+    while (3 * n <= STARRY_PHASECURVE_MAX_NODES) {
+
+      // Fit the current nodes
+      Scalar scale[3];
+      for (int q = 0; q < 3; ++q) {
+        table.coeffs[p][q] = fit(F[q]);
+        scale[q] = F[q].cwiseAbs().maxCoeff();
+      }
+
+      // Tabulate at the refined nodes, reusing every third one
+      bool converged = true;
+      for (int q = 0; q < 3; ++q)
+        G[q].resize(3 * n, N);
+      for (int i = 0; i < 3 * n; ++i) {
+        if (i % 3 == 1) {
+          for (int q = 0; q < 3; ++q)
+            G[q].row(i) = F[q].row(i / 3);
+          continue;
+        }
+        Scalar x = cos(pi<Scalar>() * (i + 0.5) / (3 * n));
+        tabulate(x);
+        chebyshev(x, n);
+
+        // The exact derivatives lose precision as `1 / sin(phi)^2`
+        // close to `|b| = 1`, so we allow for that
+        Scalar sinx = sin(mid + half * x);
+        Scalar tol = STARRY_PHASECURVE_TOL + mach_eps<Scalar>() / (sinx * sinx);
+        for (int q = 0; q < 3; ++q) {
+          G[q].row(i) = f.segment(q * N, N).transpose();
+          if (converged) {
+            Scalar err =
+                (cheb.head(n).transpose() * table.coeffs[p][q] - G[q].row(i))
+                    .cwiseAbs()
+                    .maxCoeff();
+            if (err > tol * scale[q])
+              converged = false;
+          }
+        }
+      }
+      if (converged) {
+        table.nodes[p] = n;
+        return;
+      }
+      for (int q = 0; q < 3; ++q)
+        F[q] = G[q];
+      n *= 3;
+    }
+  }
+
+  /**
+    Return the table at roughness `sigr`, or `nullptr` if there is none.
+
+  */
+  inline const Table *find(const Scalar &sigr) const {
+    for (auto &table : tables) {
+      if (table.sigr == sigr)
+        return &table;
+    }
+    return nullptr;
+  }
+
+  /**
+    Build the table at roughness `sigr`, evicting the oldest one if
+    the cache is full.
+
+  */
+  inline const Table *add(const Scalar &sigr) {
+    Table *table;
+    if (int(tables.size()) < STARRY_PHASECURVE_CACHE_SIZE) {
+      tables.emplace_back();
+      table = &tables.back();
+    } else {
+      table = &tables[next];
+      next = (next + 1) % STARRY_PHASECURVE_CACHE_SIZE;
+    }
+    table->sigr = sigr;
+    build(*table, 0);
+    build(*table, 1);
+    return table;
+  }
+
+public:
+  /**
+    Evaluate `rT`, `drT / db` and `drT / dsigr` exactly.
+
+  */
+  inline void exact(const Scalar &b, const Scalar &sigr, Scalar *rT,
+                    Scalar *drTdb, Scalar *drTdsigr) {
+    // Hack: deriv undefined for b = +/- 1 (not a numerical issue)
+    if (b >= 1.0 - 1e-15) {
+      b_ad.value() = Scalar(1.0) - Scalar(1e-15);
+    } else if (b <= -1.0 + 1e-15) {
+      b_ad.value() = Scalar(-1.0) + Scalar(1e-15);
+    } else {
+      b_ad.value() = b;
+    }
+    sigr_ad.value() = sigr;
+    RP.compute(b_ad, sigr_ad);
+    for (int n = 0; n < N; ++n) {
+      rT[n] = RP.rT(n).value();
+      drTdb[n] = RP.rT(n).derivatives()(0);
+      drTdsigr[n] = RP.rT(n).derivatives()(1);
+    }
+  }
+
+  /**
+    Select the table for a batch of points `b` at roughness `sigr`. Short
+    batches are evaluated exactly, so they don't use a table even if one
+    is cached; for longer ones the table is built if needed.
+
+  */
+  template <typename V> inline void prepare(const V &b, const Scalar &sigr) {
+    int npts = 0;
+    for (int k = 0; k < b.size(); ++k) {
+      if (abs(static_cast<Scalar>(b(k))) < bmax)
+        ++npts;
+    }
+    if (npts < STARRY_PHASECURVE_MIN_BATCH) {
+      table = nullptr;
+    } else {
+      table = find(sigr);
+      if (!table)
+        table = add(sigr);
+    }
+  }
+
+  /**
+    Compute `rT` and its derivatives with respect to `b` and `sigr`,
+    interpolating in the table selected by the last call to `prepare`
+    if it is at this roughness.
+
+  */
+  inline void compute(const Scalar &b, const Scalar &sigr, Scalar *rT,
+                      Scalar *drTdb, Scalar *drTdsigr) {
+
+    // Interpolate
+    if (table && (table->sigr == sigr) && (abs(b) < bmax)) {
+      int p = (b < 0) ? 1 : 0;
+      const int n = table->nodes[p];
+      if (n > 0) {
+        Scalar phib = acos(b);
+        chebyshev((phib - 0.5 * (phi[p + 1] + phi[p])) /
+                      (0.5 * (phi[p + 1] - phi[p])),
+                  n);
+        Scalar sinphi = sqrt(1.0 - b * b);
+        for (int k = 0; k < N; ++k) {
+          rT[k] = cheb.head(n).dot(table->coeffs[p][0].col(k));
+          drTdb[k] = cheb.head(n).dot(table->coeffs[p][1].col(k)) / sinphi;
+          drTdsigr[k] = cheb.head(n).dot(table->coeffs[p][2].col(k));
+        }
+        return;
+      }
+    }
+
+    // Evaluate exactly
+    exact(b, sigr, rT, drTdb, drTdsigr);
+  }
+
+  explicit PhaseCurveInterpolant(PhaseCurve<T> &RP, const int N)
+      : RP(RP), N(N), bmax(1.0 - STARRY_B_ONE_TOL), table(nullptr), next(0),
+        cheb(STARRY_PHASECURVE_MAX_NODES) {
+    phi[0] = acos(bmax);
+    phi[1] = 0.5 * pi<Scalar>();
+    phi[2] = pi<Scalar>() - phi[0];
+    tables.reserve(STARRY_PHASECURVE_CACHE_SIZE);
+    b_ad.derivatives() = Vector<Scalar>::Unit(2, 0);
+    sigr_ad.derivatives() = Vector<Scalar>::Unit(2, 1);
+  }
+};
+
 } // namespace phasecurve
 } // namespace reflected
 } // namespace starry
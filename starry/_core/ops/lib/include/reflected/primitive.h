@@ -111,24 +111,64 @@ public:
   }
 };
 
+/**
+    Scratch space for the primitive integrals at degree `ydeg`. It is
+    owned by the caller, so that repeated calls at the same degree
+    don't allocate.
+
+*/
+template <class T> class Workspace {
+  using Scalar = typename T::Scalar;
+
+public:
+  Vieta<T> A;                        /**< Vieta coefficients */
+  Vector<T> tworo;                   /**< Powers of `2 * ro` */
+  Vector<T> UIntegral;               /**< The helper integral U */
+  Vector<T> IIntegral;               /**< The helper integral I */
+  Vector<T> WIntegral;               /**< The helper integral W */
+  Vector<T> JIntegral;               /**< The helper integral J */
+  Matrix<T> HIntegral;               /**< The helper integral H */
+  Matrix<Limits<Scalar>> dH;         /**< Derivatives of H wrt the limits */
+  Vector<T> indef;                   /**< Indefinite integral at two limits */
+  Vector<T> lo;                      /**< Indefinite integral at lower limit */
+  Vector<T> hi;                      /**< Indefinite integral at upper limit */
+  Matrix<T> tridiag;                 /**< Tridiagonal matrix of J recursion */
+  Vector<T> rhs;                     /**< Right hand side of J recursion */
+  Eigen::PartialPivLU<Matrix<T>> lu; /**< Factorization of `tridiag` */
+  const IncompleteEllipticIntegrals<T> *integrals; /**< Precomputed, if any */
+
+  explicit Workspace(int ydeg) : A(ydeg), integrals(nullptr) {}
+};
+
+/**
+    Nudge the occultor impact parameter `bo` away from the instability
+    at `bo = ro`.
+
+*/
+template <typename T> inline T nudge_bo(const T &bo, const T &ro) {
+  if (abs(bo - ro) < STARRY_BO_EQUALS_RO_TOL)
+    return ro + (bo > ro ? STARRY_BO_EQUALS_RO_TOL : -STARRY_BO_EQUALS_RO_TOL);
+  return bo;
+}
+
 /**
 
     Given s1 = sin(0.5 * kappa), compute the integral of
 
         cos(x) sin^{2v + 1}(x)
 
-    from 0.5 * kappa1 to 0.5 * kappa2 recursively and return an array
-    containing the values of this function from v = 0 to v = vmax.
+    from 0.5 * kappa1 to 0.5 * kappa2 recursively and store the values
+    of this function from v = 0 to v = vmax in `result`.
 
 */
-template <typename T> inline Vector<T> U(const int vmax, const Vector<T> &s2) {
-  Vector<T> result(vmax + 1);
-  Vector<T> term = s2;
+template <typename T>
+inline void U(const int vmax, const Limits<T> &s2, Vector<T> &result) {
+  result.resize(vmax + 1);
+  Limits<T> term = s2;
   for (int v = 0; v < vmax + 1; ++v) {
     result(v) = pairdiff(term) / (2 * v + 2);
     term.array() *= s2.array();
   }
-  return result;
 }
 
 /**
@@ -147,15 +187,16 @@ template <typename T> inline Vector<T> U(const int vmax, const Vector<T> &s2) {
           I don't *think* these cases are encountered in practice, but
           we should look into it.
 
+    The result is stored in `result`; `indef` is scratch space.
+
 */
 template <typename T>
-inline Vector<T> I(const int nmax, const Vector<T> &kappa_,
-                   const Vector<T> &s1_, const Vector<T> &c1_,
-                   Quad<typename T::Scalar> &QUAD) {
-  Vector<T> result(nmax + 1);
-  result.setZero();
-  Vector<T> indef(nmax + 1);
-  Vector<T> kappa(2), s1(2), c1(2), s2(2);
+inline void I(const int nmax, const Limits<T> &kappa_, const Limits<T> &s1_,
+              const Limits<T> &c1_, Quad<typename T::Scalar> &QUAD,
+              Vector<T> &indef, Vector<T> &result) {
+  result.setZero(nmax + 1);
+  indef.resize(nmax + 1);
+  Limits<T> kappa(2), s1(2), c1(2), s2(2);
 
   // Loop through the pairs of limits
   size_t K = kappa_.size();
@@ -172,7 +213,7 @@ inline Vector<T> I(const int nmax, const Vector<T> &kappa_,
     if ((abs(s2(0)) > 0.5) || (abs(s2(1)) > 0.5)) {
 
       indef(0) = 0.5 * pairdiff(kappa);
-      Vector<T> term(2);
+      Limits<T> term(2);
       term.array() = s1.array() * c1.array();
       for (int v = 1; v < nmax + 1; ++v) {
         indef(v) =
@@ -183,31 +224,28 @@ inline Vector<T> I(const int nmax, const Vector<T> &kappa_,
       // Downward recursion
     } else {
 
-      // Compute the trig part upwards...
-      Vector<T> term(nmax + 1);
+      // Compute the trig part upwards, storing it in `indef`...
       T termlo = s1(0) * c1(0);
       T termhi = s1(1) * c1(1);
-      term(0) = termhi - termlo;
-      for (int v = 1; v < nmax + 1; ++v) {
+      indef(0) = termhi - termlo;
+      for (int v = 1; v < nmax; ++v) {
         termlo *= s2(0);
         termhi *= s2(1);
-        term(v) = termhi - termlo;
+        indef(v) = termhi - termlo;
       }
 
       // Evaluate numerically
       indef(nmax) = I_numerical(nmax, kappa, QUAD);
 
-      // Recurse down
+      // Recurse down, overwriting the trig part as we go
       for (int v = nmax - 1; v > -1; --v) {
-        indef(v) = ((2.0 * v + 2.0) * indef(v + 1) + term(v)) / (2.0 * v + 1);
+        indef(v) = ((2.0 * v + 2.0) * indef(v + 1) + indef(v)) / (2.0 * v + 1);
       }
     }
 
     // Definite integral
     result += indef;
   }
-
-  return result;
 }
 
 /**
@@ -223,13 +261,13 @@ inline Vector<T> I(const int nmax, const Vector<T> &kappa_,
         q = (1 - s^2 / k^2)^1/2
 
     by either upward recursion (stable for |1 - q^2| > 1/2) or downward
-    recursion (always stable).
+    recursion (always stable). The result is stored in `result`.
 
 */
 template <typename T>
-inline Vector<T> W_indef(const int nmax, const T &s2_, const T &q2,
-                         const T &q3) {
-  Vector<T> result(nmax + 1);
+inline void W_indef(const int nmax, const T &s2_, const T &q2, const T &q3,
+                    Vector<T> &result) {
+  result.resize(nmax + 1);
 
   // TODO: Is this instability encountered in practice?
   // If so, find the limiting value of W when s2 = 0.
@@ -282,24 +320,25 @@ inline Vector<T> W_indef(const int nmax, const T &s2_, const T &q2,
     }
   }
 
-  return 0.5 * result;
+  result *= 0.5;
 }
 
 /**
-    Compute the definite helper integral W from W_indef.
+    Compute the definite helper integral W from W_indef and store it
+    in `result`; `lo` and `hi` are scratch space.
 
 */
 template <typename T>
-inline Vector<T> W(const int nmax, const Vector<T> &s2, const Vector<T> &q2,
-                   const Vector<T> &q3) {
+inline void W(const int nmax, const Limits<T> &s2, const Limits<T> &q2,
+              const Limits<T> &q3, Vector<T> &lo, Vector<T> &hi,
+              Vector<T> &result) {
   size_t K = s2.size();
-  Vector<T> result(nmax + 1);
-  result.setZero();
+  result.setZero(nmax + 1);
   for (size_t i = 0; i < K; i += 2) {
-    result += W_indef(nmax, s2(i + 1), q2(i + 1), q3(i + 1)) -
-              W_indef(nmax, s2(i), q2(i), q3(i));
+    W_indef(nmax, s2(i + 1), q2(i + 1), q3(i + 1), hi);
+    W_indef(nmax, s2(i), q2(i), q3(i), lo);
+    result += hi - lo;
   }
-  return result;
 }
 
 /**
@@ -308,71 +347,72 @@ inline Vector<T> W(const int nmax, const Vector<T> &s2, const Vector<T> &q2,
     Returns the array J[0 .. nmax], computed recursively using
     a tridiagonal solver and a lower boundary condition
     (analytic in terms of elliptic integrals) and an upper
-    boundary condition (computed numerically).
+    boundary condition (computed numerically). The result is stored
+    in `result`; `A`, `c` and `lu` are scratch space for the solve.
 
 */
 template <typename T>
-inline Vector<T>
-J(const int nmax, const T &k2, const T &km2, const Vector<T> &kappa,
-  const Vector<T> &s1, const Vector<T> &s2, const Vector<T> &c1,
-  const Vector<T> &q2, const T &F, const T &E, Quad<typename T::Scalar> &QUAD) {
+inline void J(const int nmax, const T &k2, const T &km2,
+              const Limits<T> &kappa, const Limits<T> &s1,
+              const Limits<T> &s2, const Limits<T> &c1, const Limits<T> &q2,
+              const T &F, const T &E, Quad<typename T::Scalar> &QUAD,
+              Matrix<T> &A, Vector<T> &c, Eigen::PartialPivLU<Matrix<T>> &lu,
+              Vector<T> &result) {
 
   // Useful variables
   size_t K = kappa.size();
-  Vector<T> z(K);
-  Vector<T> sqrtq2(K);
+  Limits<T> z(K);
+  Limits<T> sqrtq2(K);
   sqrtq2.array() = (q2.array() > 0).select(sqrt(q2.array()), 0.0);
   z.array() = s1.array() * c1.array() * sqrtq2.array();
 
 #if (STARRY_USE_INCOMPLETE_INTEGRALS)
   // Lower boundary: analytic
   T f0 = (1.0 / 3.0) * (2 * (2 - km2) * E + (km2 - 1) * F + km2 * pairdiff(z));
-#else
-  // Lower boundary: numerical
-  T f0 = J_numerical(0, k2, kappa, QUAD);
-#endif
 
   // Upper boundary
   T fN = J_numerical(nmax, k2, kappa, QUAD);
+#else
+  // Lower & upper boundaries: numerical, in a single pass
+  const int Ns[2] = {0, nmax};
+  T f0N[2];
+  J_numerical(Ns, k2, kappa, QUAD, f0N);
+  T f0 = f0N[0];
+  T fN = f0N[1];
+#endif
 
-  // Set up the tridiagonal problem
-  Vector<T> a(nmax - 1), b(nmax - 1), c(nmax - 1);
-  Vector<T> term(K);
+  // Set up the tridiagonal problem, filling in the diagonal and
+  // the subdiagonal of the matrix as we go
+  // TODO: We should probably use a sparse solve here!
+  A.setZero(nmax - 1, nmax - 1);
+  A.diagonal(1).setOnes();
+  c.resize(nmax - 1);
+  Limits<T> term(K);
   term.array() = k2 * z.array() * q2.array() * q2.array();
-  T amp;
+  T amp, b0;
   int i = 0;
   for (int v = 2; v < nmax + 1; ++v) {
     amp = 1.0 / (2 * v + 3);
-    a(i) = -2 * (v + (v - 1) * k2 + 1) * amp;
-    b(i) = (2 * v - 3) * k2 * amp;
+    A(i, i) = -2 * (v + (v - 1) * k2 + 1) * amp;
+    if (i == 0)
+      b0 = (2 * v - 3) * k2 * amp;
+    else
+      A(i, i - 1) = (2 * v - 3) * k2 * amp;
     c(i) = pairdiff(term) * amp;
     term.array() *= s2.array();
     ++i;
   }
 
   // Add the boundary conditions
-  c(0) -= b(0) * f0;
+  c(0) -= b0 * f0;
   c(nmax - 2) -= fN;
 
-  // Construct the tridiagonal matrix
-  // TODO: We should probably use a sparse solve here!
-  Matrix<T> A(nmax - 1, nmax - 1);
-  A.setZero();
-  A.diagonal(0) = a;
-  A.diagonal(-1) = b.segment(1, nmax - 2);
-  A.diagonal(1).setOnes();
-
-  // Solve
-  Vector<T> soln = A.lu().solve(c);
-
-  // Append lower and upper boundary conditions
-  Vector<T> result(nmax + 1);
+  // Solve, and append the lower and upper boundary conditions
+  lu.compute(A);
+  result.resize(nmax + 1);
   result(0) = f0;
   result(nmax) = fN;
-  result.segment(1, nmax - 1) = soln;
-
-  // We're done
-  return result;
+  result.segment(1, nmax - 1) = lu.solve(c);
 }
 
 /**
@@ -398,28 +438,26 @@ inline T L(Vieta<T> &A, const Vector<T> &J, const int u, const int v,
 /**
     Compute the helper integral H.
     The forward derivatives are used in the recursion, so we compute them
-   manually.
+   manually. The result is stored in `f`; `df` is scratch space for the
+   derivatives with respect to the limits.
 
 */
 template <typename T, int N>
-inline Matrix<ADScalar<T, N>> H(const int uvmax,
-                                const Vector<ADScalar<T, N>> &xi) {
+inline void H(const int uvmax, const Limits<ADScalar<T, N>> &xi,
+              Matrix<ADScalar<T, N>> &f, Matrix<Limits<T>> &df) {
 
-  Matrix<ADScalar<T, N>> f(uvmax + 1, uvmax + 1);
-  f.setZero();
+  f.setZero(uvmax + 1, uvmax + 1);
+  df.resize(uvmax + 1, uvmax + 1);
   size_t K = xi.size();
   int sgn;
 
-  // Split xi into its value and derivs
-  Vector<T> xi_value(K);
-  Matrix<T> dxi(N, K);
-  for (size_t i = 0; i < K; ++i) {
+  // The values of the limits
+  Limits<T> xi_value(K);
+  for (size_t i = 0; i < K; ++i)
     xi_value(i) = xi(i).value();
-    dxi.col(i) = xi(i).derivatives();
-  }
 
   // Helper vars
-  Vector<T> c(K), s(K), cs(K), cc(K), ss(K);
+  Limits<T> c(K), s(K), cs(K), cc(K), ss(K);
   c.array() = cos(xi_value.array());
   s.array() = sin(xi_value.array());
   cs.array() = c.array() * s.array();
@@ -427,7 +465,6 @@ inline Matrix<ADScalar<T, N>> H(const int uvmax,
   ss.array() = s.array() * s.array();
 
   // Compute H and dH / dxi
-  Matrix<Vector<T>> df(uvmax + 1, uvmax + 1);
 
   // Lower boundary
   f(0, 0).value() = pairdiff(xi_value);
@@ -451,7 +488,7 @@ inline Matrix<ADScalar<T, N>> H(const int uvmax,
   // Recurse upward
   for (int u = 0; u < 2; ++u) {
     for (int v = 2; v < uvmax + 1 - u; ++v) {
-      f(u, v).value() = (-pairdiff(Vector<T>(df(u, v - 2).cwiseProduct(cs))) +
+      f(u, v).value() = (-pairdiff(Limits<T>(df(u, v - 2).cwiseProduct(cs))) +
                          (v - 1) * f(u, v - 2).value()) /
                         (u + v);
       df(u, v) = df(u, v - 2).cwiseProduct(ss);
@@ -464,7 +501,7 @@ inline Matrix<ADScalar<T, N>> H(const int uvmax,
   }
   for (int u = 2; u < uvmax + 1; ++u) {
     for (int v = 0; v < uvmax + 1 - u; ++v) {
-      f(u, v).value() = (pairdiff(Vector<T>(df(u - 2, v).cwiseProduct(cs))) +
+      f(u, v).value() = (pairdiff(Limits<T>(df(u - 2, v).cwiseProduct(cs))) +
                          (u - 1) * f(u - 2, v).value()) /
                         (u + v);
       df(u, v) = df(u - 2, v).cwiseProduct(cc);
@@ -475,8 +512,6 @@ inline Matrix<ADScalar<T, N>> H(const int uvmax,
       }
     }
   }
-
-  return f;
 }
 
 /**
@@ -531,7 +566,7 @@ template <typename T> inline T T2_indef(const T &b, const T &xi) {
 */
 template <typename S>
 inline void computeT(const int ydeg, const S &b_, const S &theta,
-                     const Vector<S> &xi, Vector<S> &T) {
+                     const Limits<S> &xi, Vector<S> &T, Workspace<S> &WS) {
 
   // Check for trivial result
   T.setZero((ydeg + 1) * (ydeg + 1));
@@ -539,7 +574,8 @@ inline void computeT(const int ydeg, const S &b_, const S &theta,
     return;
 
   // Pre-compute H
-  Matrix<S> HIntegral = H(ydeg + 2, xi);
+  Matrix<S> &HIntegral = WS.HIntegral;
+  H(ydeg + 2, xi, HIntegral, WS.dH);
 
   // HACK: We should derive exact expressions in this limit.
   S b = b_;
@@ -710,7 +746,8 @@ inline void computeT(const int ydeg, const S &b_, const S &theta,
 
 */
 template <typename T>
-inline void computeQ(const int ydeg, const Vector<T> &lam, Vector<T> &Q) {
+inline void computeQ(const int ydeg, const Limits<T> &lam, Vector<T> &Q,
+                     Workspace<T> &WS) {
 
   // Allocate
   Q.setZero((ydeg + 1) * (ydeg + 1));
@@ -720,7 +757,8 @@ inline void computeQ(const int ydeg, const Vector<T> &lam, Vector<T> &Q) {
     return;
 
   // Pre-compute H
-  Matrix<T> HIntegral = H(ydeg + 2, lam);
+  Matrix<T> &HIntegral = WS.HIntegral;
+  H(ydeg + 2, lam, HIntegral, WS.dH);
 
   // Note that the linear term is special
   Q(2) = pairdiff(lam) / 3.0;
@@ -746,8 +784,8 @@ inline void computeQ(const int ydeg, const Vector<T> &lam, Vector<T> &Q) {
 */
 template <typename T>
 inline void computeP(const int ydeg, const T &bo_, const T &ro_,
-                     const Vector<T> &kappa, Vector<T> &P,
-                     Quad<typename T::Scalar> &QUAD) {
+                     const Limits<T> &kappa, Vector<T> &P,
+                     Quad<typename T::Scalar> &QUAD, Workspace<T> &WS) {
 
   // Check for trivial result
   P.resize((ydeg + 1) * (ydeg + 1));
@@ -757,44 +795,53 @@ inline void computeP(const int ydeg, const T &bo_, const T &ro_,
   }
 
   // Nudge away from instability at bo = ro
-  T bo = bo_;
+  T bo = nudge_bo(bo_, ro_);
   T ro = ro_;
-  if (abs(bo - ro) < STARRY_BO_EQUALS_RO_TOL)
-    bo = ro + (bo > ro ? STARRY_BO_EQUALS_RO_TOL : -STARRY_BO_EQUALS_RO_TOL);
 
   // Basic variables
   T delta = (bo - ro) / (2 * ro);
   T k2 = (1 - ro * ro - bo * bo + 2 * bo * ro) / (4 * bo * ro);
   T km2 = 1.0 / k2;
   T k3fourbr15 = pow(1 - ro * ro - bo * bo + 2 * bo * ro, 1.5);
-  Vector<T> tworo(ydeg + 4);
+  Vector<T> &tworo = WS.tworo;
+  tworo.resize(ydeg + 4);
   tworo(0) = 1.0;
   for (int i = 1; i < ydeg + 4; ++i) {
     tworo(i) = tworo(i - 1) * 2 * ro;
   }
-  Vieta<T> A(ydeg);
+  Vieta<T> &A = WS.A;
 
   // Pre-compute the helper integrals
   size_t M = kappa.size();
-  Vector<T> x(M), s1(M), s2(M), c1(M), q2(M), q3(M);
+  Limits<T> x(M), s1(M), s2(M), c1(M), q2(M), q3(M);
   x = 0.5 * kappa;
   s1.array() = sin(x.array());
   s2.array() = s1.array() * s1.array();
   c1.array() = cos(x.array());
   q2.array() = (s2.array() * km2 < 1.0).select(1.0 - s2.array() * km2, 0.0);
   q3.array() = (q2.array() > 0).select(q2.array() * sqrt(q2.array()), 0.0);
-  Vector<T> UIntegral = U(ydeg + 2, s2);
-  Vector<T> IIntegral = I(ydeg + 3, kappa, s1, c1, QUAD);
-  Vector<T> WIntegral = W(ydeg, s2, q2, q3);
+  Vector<T> &UIntegral = WS.UIntegral;
+  Vector<T> &IIntegral = WS.IIntegral;
+  Vector<T> &WIntegral = WS.WIntegral;
+  U(ydeg + 2, s2, UIntegral);
+  I(ydeg + 3, kappa, s1, c1, QUAD, WS.indef, IIntegral);
+  W(ydeg, s2, q2, q3, WS.lo, WS.hi, WIntegral);
   A.reset(delta);
 
-// Compute the elliptic integrals?
+// Compute the elliptic integrals, unless the caller has already
+// computed them (in a batch with other occultations)
 #if (STARRY_USE_INCOMPLETE_INTEGRALS)
-  auto integrals =
-      IncompleteEllipticIntegrals<typename T::Scalar>(bo, ro, kappa);
-  T F = integrals.F;
-  T E = integrals.E;
-  T PIp = integrals.PIp;
+  T F, E, PIp;
+  if (WS.integrals) {
+    F = WS.integrals->F;
+    E = WS.integrals->E;
+    PIp = WS.integrals->PIp;
+  } else {
+    auto integrals = IncompleteEllipticIntegrals<T>(bo, ro, kappa);
+    F = integrals.F;
+    E = integrals.E;
+    PIp = integrals.PIp;
+  }
 #else
   T F = 0;
   T E = 0;
@@ -802,10 +849,11 @@ inline void computeP(const int ydeg, const T &bo_, const T &ro_,
 #endif
 
   // Compute J
-  Vector<T> JIntegral;
+  Vector<T> &JIntegral = WS.JIntegral;
   if (km2 > 0.0) {
     // Compute by recursion
-    JIntegral = J(ydeg + 1, k2, km2, kappa, s1, s2, c1, q2, F, E, QUAD);
+    J(ydeg + 1, k2, km2, kappa, s1, s2, c1, q2, F, E, QUAD, WS.tridiag, WS.rhs,
+      WS.lu, JIntegral);
   } else {
     // Special limit, k2 -> inf
     JIntegral = IIntegral.head(ydeg + 2);
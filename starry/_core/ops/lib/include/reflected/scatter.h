@@ -18,13 +18,13 @@ namespace scatter {
 
 using namespace utils;
 
-template <typename T>
-inline void computeI_Lambertian(const int deg, Eigen::SparseMatrix<T> &I,
-                                const T &b, const T &theta) {
+/**
+  The Lambertian illumination function in the polynomial basis,
+  i.e., the coefficients of `x`, `z`, and `y`.
 
-  int N_out = (deg + 2) * (deg + 2);
-  int N_in = (deg + 1) * (deg + 1);
-  I.resize(N_out, N_in);
+*/
+template <typename T>
+inline void LambertianPolynomial(const T &b, const T &theta, Vector<T> &p) {
 
   // Compute illumination x, y, z coefficients
   T y0, x, y, z;
@@ -37,52 +37,38 @@ inline void computeI_Lambertian(const int deg, Eigen::SparseMatrix<T> &I,
     y = 0;
   }
   z = -b;
-  Vector<T> p(3);
-
-  // Illumination function in the polynomial basis
+  p.resize(3);
   p << x, z, y;
+}
 
-  // Empirical number of coefficients in the matrix (approximate)
-  int nillum = max(4, int(ceil(5.5 * deg * deg + 9.5 * deg + 3)));
-
-  // Populate the triplets
-  typedef Eigen::Triplet<T> T3;
-  std::vector<T3> tripletList;
-  tripletList.reserve(nillum);
-  int n1 = 0;
-  int n2 = 0;
-  int l, n;
-  bool odd1;
-  for (int l1 = 0; l1 < deg + 1; ++l1) {
-    for (int m1 = -l1; m1 < l1 + 1; ++m1) {
-      if (is_even(l1 + m1))
-        odd1 = false;
-      else
-        odd1 = true;
-      n2 = 0;
-      for (int m2 = -1; m2 < 2; ++m2) {
-        l = l1 + 1;
-        n = l * l + l + m1 + m2;
-        if (odd1 && (is_even(m2))) {
-          tripletList.push_back(T3(n - 4 * l + 2, n1, p(n2)));
-          tripletList.push_back(T3(n - 2, n1, -p(n2)));
-          tripletList.push_back(T3(n + 2, n1, -p(n2)));
-        } else {
-          tripletList.push_back(T3(n, n1, p(n2)));
-        }
-        n2 += 1;
-      }
-      n1 += 1;
-    }
-  }
+/**
+  Scratch space for `OrenNayarPolynomial`, so that repeated
+  evaluations don't touch the heap.
 
-  // Create the sparse illumination matrix
-  I.setFromTriplets(tripletList.begin(), tripletList.end());
-}
+*/
+template <typename T> struct OrenNayarWorkspace {
+  Vector<T> bbc;
+  Vector<T> cosnt;
+  Vector<T> sinnt;
+  Vector<T> cosmt;
+  Vector<T> sinmt;
+  Vector<T> A1Invp;
+  Vector<T> RA1Invp;
+
+  OrenNayarWorkspace()
+      : bbc(STARRY_OREN_NAYAR_NB * STARRY_OREN_NAYAR_NB),
+        cosnt(STARRY_OREN_NAYAR_DEG + 1), sinnt(STARRY_OREN_NAYAR_DEG + 1),
+        cosmt(STARRY_OREN_NAYAR_N), sinmt(STARRY_OREN_NAYAR_N),
+        A1Invp(STARRY_OREN_NAYAR_N), RA1Invp(STARRY_OREN_NAYAR_N) {
+    cosnt(0) = 1.0;
+    sinnt(0) = 0.0;
+  }
+};
 
 template <typename T, typename Scalar>
-inline Vector<T> OrenNayarPolynomial(const T &b, const T &theta, const T &sigr,
-                                     const basis::Basis<Scalar> &B) {
+inline void OrenNayarPolynomial(const T &b, const T &theta, const T &sigr,
+                                const basis::Basis<Scalar> &B,
+                                OrenNayarWorkspace<T> &W, Vector<T> &p) {
 
   /*
     This is the function
@@ -93,8 +79,7 @@ inline Vector<T> OrenNayarPolynomial(const T &b, const T &theta, const T &sigr,
 
     from Equation (30) in Oren & Nayar (1994)
   */
-  Vector<T> f(STARRY_OREN_NAYAR_N);
-  f.setZero();
+  p.setZero(STARRY_OREN_NAYAR_N);
 
   // Oren-Nayar roughness coefficients
   T sig2 = sigr * sigr;
@@ -113,7 +98,7 @@ inline Vector<T> OrenNayarPolynomial(const T &b, const T &theta, const T &sigr,
     // we need `f = 0` eveywhere when `b = 0` for
     // a smooth transition to Lambertian at crescent
     // phase.
-    Vector<T> bbc(STARRY_OREN_NAYAR_NB * STARRY_OREN_NAYAR_NB);
+    Vector<T> &bbc = W.bbc;
     bbc(0) = b;
     for (int l = 1; l < STARRY_OREN_NAYAR_NB; ++l) {
       bbc(l) = bc * bbc(l - 1);
@@ -127,129 +112,198 @@ inline Vector<T> OrenNayarPolynomial(const T &b, const T &theta, const T &sigr,
     }
 
     // Sum over the bbc basis to obtain the Oren-Nayar
-    // coefficients in the polynomial basis
+    // coefficients in the polynomial basis, weighted
+    // by the roughness
+    T f;
     for (int n = 0; n < STARRY_OREN_NAYAR_N; ++n) {
+      f = 0.0;
       for (int m = 0; m < STARRY_OREN_NAYAR_NB * STARRY_OREN_NAYAR_NB; ++m) {
-        f(n) += STARRY_OREN_NAYAR_COEFFS[m +
-                                         STARRY_OREN_NAYAR_NB *
-                                             STARRY_OREN_NAYAR_NB * n] *
-                bbc(m);
+        f += STARRY_OREN_NAYAR_COEFFS[m +
+                                      STARRY_OREN_NAYAR_NB *
+                                          STARRY_OREN_NAYAR_NB * n] *
+             bbc(m);
       }
+      p(n) = cB * f;
     }
   }
 
-  // Account for the roughness and add in the Lambertian term
-  Vector<T> p = cB * f;
+  // Add in the Lambertian term
   p(2) -= cA * b;
   p(3) += cA * bc;
 
   // Rotate the polynomial to the correct orientation on the sky
   if (theta != 0.0) {
 
-    Vector<T> cosnt(STARRY_OREN_NAYAR_DEG + 1);
-    Vector<T> sinnt(STARRY_OREN_NAYAR_DEG + 1);
-    Vector<T> cosmt(STARRY_OREN_NAYAR_N);
-    Vector<T> sinmt(STARRY_OREN_NAYAR_N);
-    cosnt(0) = 1.0;
-    sinnt(0) = 0.0;
-
     // Transform to ylms
-    Vector<T> A1Invp = B.A1Inv_Reflected.block(0, 0, STARRY_OREN_NAYAR_N,
-                                               STARRY_OREN_NAYAR_N) *
-                       p;
+    W.A1Invp.noalias() =
+        B.A1Inv_Reflected.block(0, 0, STARRY_OREN_NAYAR_N,
+                                STARRY_OREN_NAYAR_N) *
+        p;
 
     // Rotate on the sky
-    Vector<T> RA1Invp(STARRY_OREN_NAYAR_N);
-    cosnt(1) = cos(theta);
-    sinnt(1) = sin(-theta);
+    W.cosnt(1) = cos(theta);
+    W.sinnt(1) = sin(-theta);
     for (int n = 2; n < STARRY_OREN_NAYAR_DEG + 1; ++n) {
-      cosnt(n) = 2.0 * cosnt(n - 1) * cosnt(1) - cosnt(n - 2);
-      sinnt(n) = 2.0 * sinnt(n - 1) * cosnt(1) - sinnt(n - 2);
+      W.cosnt(n) = 2.0 * W.cosnt(n - 1) * W.cosnt(1) - W.cosnt(n - 2);
+      W.sinnt(n) = 2.0 * W.sinnt(n - 1) * W.cosnt(1) - W.sinnt(n - 2);
     }
     int n = 0;
     for (int l = 0; l < STARRY_OREN_NAYAR_DEG + 1; ++l) {
       for (int m = -l; m < 0; ++m) {
-        cosmt(n) = cosnt(-m);
-        sinmt(n) = -sinnt(-m);
+        W.cosmt(n) = W.cosnt(-m);
+        W.sinmt(n) = -W.sinnt(-m);
         ++n;
       }
       for (int m = 0; m < l + 1; ++m) {
-        cosmt(n) = cosnt(m);
-        sinmt(n) = sinnt(m);
+        W.cosmt(n) = W.cosnt(m);
+        W.sinmt(n) = W.sinnt(m);
         ++n;
       }
       for (int j = 0; j < 2 * l + 1; ++j) {
-        RA1Invp(l * l + j) = A1Invp(l * l + j) * cosmt(l * l + j) +
-                             A1Invp(l * l + 2 * l - j) * sinmt(l * l + j);
+        W.RA1Invp(l * l + j) =
+            W.A1Invp(l * l + j) * W.cosmt(l * l + j) +
+            W.A1Invp(l * l + 2 * l - j) * W.sinmt(l * l + j);
       }
     }
 
     // Transform back to polynomials
-    p = B.A1_Reflected.block(0, 0, STARRY_OREN_NAYAR_N, STARRY_OREN_NAYAR_N) *
-        RA1Invp;
+    p.noalias() = B.A1_Reflected.block(0, 0, STARRY_OREN_NAYAR_N,
+                                       STARRY_OREN_NAYAR_N) *
+                  W.RA1Invp;
   }
+}
 
-  return p;
-};
+/**
+  The Oren-Nayar (1994) illumination function in the polynomial basis.
 
+*/
 template <typename T, typename Scalar>
-inline void computeI_OrenNayar(const int deg, Eigen::SparseMatrix<T> &I,
-                               const T &b, const T &theta, const T &sigr,
-                               const basis::Basis<Scalar> &B) {
-
-  // Get the polynomial illumination function
-  Vector<T> p = OrenNayarPolynomial(b, theta, sigr, B);
-
-  // Declare the output
-  int N_out =
-      (deg + 1 + STARRY_OREN_NAYAR_DEG) * (deg + 1 + STARRY_OREN_NAYAR_DEG);
-  int N_in = (deg + 1) * (deg + 1);
-  I.resize(N_out, N_in);
-
-  // Populate the triplets
-  typedef Eigen::Triplet<T> T3;
-  std::vector<T3> tripletList;
-  tripletList.reserve(
-      int(1.25 * STARRY_OREN_NAYAR_N * N_in)); // very approximate!
-  int n1 = 0;
-  int n2 = 0;
-  int l, n;
-  bool odd1;
-  for (int l1 = 0; l1 < deg + 1; ++l1) {
-    for (int m1 = -l1; m1 < l1 + 1; ++m1) {
-      odd1 = !is_even(l1 + m1);
-      n2 = 0;
-      for (int l2 = 0; l2 < STARRY_OREN_NAYAR_DEG + 1; ++l2) {
-        for (int m2 = -l2; m2 < l2 + 1; ++m2) {
-          l = l1 + l2;
-          n = l * l + l + m1 + m2;
-          if (odd1 && (!is_even(l2 + m2))) {
-            tripletList.push_back(T3(n - 4 * l + 2, n1, p(n2)));
-            tripletList.push_back(T3(n - 2, n1, -p(n2)));
-            tripletList.push_back(T3(n + 2, n1, -p(n2)));
-          } else {
-            tripletList.push_back(T3(n, n1, p(n2)));
+inline Vector<T> OrenNayarPolynomial(const T &b, const T &theta, const T &sigr,
+                                     const basis::Basis<Scalar> &B) {
+  OrenNayarWorkspace<T> W;
+  Vector<T> p;
+  OrenNayarPolynomial(b, theta, sigr, B, W, p);
+  return p;
+}
+
+/**
+  The illumination transform in the polynomial basis.
+
+  Multiplying a polynomial of degree `deg` by an illumination
+  function whose terms have degree `lmin` through `lmax` is a linear
+  map whose nonzero elements are all equal to plus or minus one of
+  the coefficients of the illumination function. Since only the
+  latter depend on `b`, `theta`, and `sigr`, we tabulate the structure
+  of the map once and contract it directly with the illumination
+  coefficients instead of assembling a sparse matrix every time.
+
+*/
+class IlluminationTensor {
+
+protected:
+  /**
+    A term of the product: the coefficient `term` of the illumination
+    function times the input coefficient `in` contributes to the output
+    coefficient `out[0]`, or, if `out[1] >= 0`, to `out[0] - out[1] -
+    out[2]` (since `z^2 = 1 - x^2 - y^2`).
+
+  */
+  struct Entry {
+    int in;
+    int term;
+    int out[3];
+  };
+  std::vector<Entry> entries;
+
+public:
+  const int N_in;
+  const int N_out;
+
+  /**
+    Computes `v = u . I`, where `I` is the illumination matrix
+    for the illumination function `p`.
+
+  */
+  template <typename T>
+  inline void apply(const RowVector<T> &u, const Vector<T> &p,
+                    RowVector<T> &v) const {
+    v.setZero(N_in);
+    for (const Entry &e : entries) {
+      if (e.out[1] < 0)
+        v(e.in) += u(e.out[0]) * p(e.term);
+      else
+        v(e.in) += (u(e.out[0]) - u(e.out[1]) - u(e.out[2])) * p(e.term);
+    }
+  }
+
+  explicit IlluminationTensor(const int deg, const int lmin, const int lmax)
+      : N_in((deg + 1) * (deg + 1)),
+        N_out((deg + lmax + 1) * (deg + lmax + 1)) {
+    int n1 = 0;
+    int n2, l, n;
+    bool odd1;
+    for (int l1 = 0; l1 < deg + 1; ++l1) {
+      for (int m1 = -l1; m1 < l1 + 1; ++m1) {
+        odd1 = !is_even(l1 + m1);
+        n2 = 0;
+        for (int l2 = lmin; l2 < lmax + 1; ++l2) {
+          for (int m2 = -l2; m2 < l2 + 1; ++m2) {
+            l = l1 + l2;
+            n = l * l + l + m1 + m2;
+            if (odd1 && (!is_even(l2 + m2))) {
+              entries.push_back({n1, n2, {n - 4 * l + 2, n - 2, n + 2}});
+            } else {
+              entries.push_back({n1, n2, {n, -1, -1}});
+            }
+            n2 += 1;
           }
-          n2 += 1;
         }
+        n1 += 1;
       }
-      n1 += 1;
     }
   }
+};
 
-  // Create the sparse illumination matrix
-  I.setFromTriplets(tripletList.begin(), tripletList.end());
-}
+/**
+  Weights polynomials of degree `deg` by the illumination profile,
+  which includes both the cosine illumination and the scattering law.
 
-template <typename T, typename Scalar>
-inline void computeI(const int deg, Eigen::SparseMatrix<T> &I, const T &b,
-                     const T &theta, const T &sigr,
-                     const basis::Basis<Scalar> &B) {
-  if (sigr > 0.0)
-    computeI_OrenNayar(deg, I, b, theta, sigr, B);
-  else
-    computeI_Lambertian(deg, I, b, theta);
-}
+*/
+template <typename T> class Illumination {
+
+protected:
+  IlluminationTensor lamb;
+  IlluminationTensor on94;
+
+  // Scratch space for the illumination functions
+  Vector<T> p_lamb;
+  Vector<T> p_on94;
+  OrenNayarWorkspace<T> W;
+
+public:
+  /**
+    Computes `v = u . I`, where `I` is the illumination matrix. The
+    input `u` must have `(deg + 2)^2` terms if `sigr = 0` and
+    `(deg + 1 + STARRY_OREN_NAYAR_DEG)^2` terms otherwise.
+
+  */
+  template <typename Scalar>
+  inline void apply(const RowVector<T> &u, const T &b, const T &theta,
+                    const T &sigr, const basis::Basis<Scalar> &B,
+                    RowVector<T> &v) {
+    if (sigr > 0.0) {
+      OrenNayarPolynomial(b, theta, sigr, B, W, p_on94);
+      on94.apply(u, p_on94, v);
+    } else {
+      LambertianPolynomial(b, theta, p_lamb);
+      lamb.apply(u, p_lamb, v);
+    }
+  }
+
+  explicit Illumination(const int deg)
+      : lamb(deg, 1, 1), on94(deg, 0, STARRY_OREN_NAYAR_DEG), p_lamb(3),
+        p_on94(STARRY_OREN_NAYAR_N) {}
+};
 
 } // namespace scatter
 } // namespace reflected
@@ -27,7 +27,7 @@ using namespace quad;
   the antiderivatives at each of the integration limits.
 
 */
-template <typename T> inline T pairdiff(const Vector<T> &array) {
+template <typename T> inline T pairdiff(const Limits<T> &array) {
   size_t K = array.size();
   if (K > 1) {
     if (K % 2 == 0) {
@@ -65,81 +65,50 @@ inline T P2_integrand(const T &bo, const T &ro, const T &phi) {
   return (1.0 - z * sqrt(z)) / (1.0 - z) * (ro + bo * c) * ro / 3.0;
 }
 
-/**
-  Derivative of the integrand of the P_2 term, for numerical integration.
-*/
-template <typename T>
-inline T dP2dbo_integrand(const T &bo, const T &ro, const T &phi) {
-  T c = cos(phi);
-  T z = 1 - ro * ro - bo * bo - 2 * bo * ro * c;
-  if (z < 1e-12)
-    z = 1e-12;
-  if (z > 1 - 1e-12)
-    z = 1 - 1e-12;
-  T P = (1.0 - z * sqrt(z)) / (1.0 - z) * (ro + bo * c) * ro / 3.0;
-  T q = 3.0 * sqrt(z) / (1.0 - z * sqrt(z)) - 2.0 / (1.0 - z);
-  return P * ((bo + ro * c) * q + 1.0 / (bo + ro / c));
-}
-
-/**
-  Derivative of the integrand of the P_2 term, for numerical integration.
-*/
-template <typename T>
-inline T dP2dro_integrand(const T &bo, const T &ro, const T &phi) {
-  T c = cos(phi);
-  T z = 1 - ro * ro - bo * bo - 2 * bo * ro * c;
-  if (z < 1e-12)
-    z = 1e-12;
-  if (z > 1 - 1e-12)
-    z = 1 - 1e-12;
-  T P = (1.0 - z * sqrt(z)) / (1.0 - z) * (ro + bo * c) * ro / 3.0;
-  T q = 3.0 * sqrt(z) / (1.0 - z * sqrt(z)) - 2.0 / (1.0 - z);
-  return P * ((ro + bo * c) * q + 1.0 / ro + 1.0 / (ro + bo * c));
-}
-
 /**
   Numerical version of the Pal integrals (P2), used in cases where
   the analytic expression is numerically unstable.
 
 */
 template <typename T>
-inline T P2_numerical(const T &bo, const T &ro, const Vector<T> &kappa,
+inline T P2_numerical(const T &bo, const T &ro, const Limits<T> &kappa,
                       Quad<typename T::Scalar> &QUAD) {
 
   using Scalar = typename T::Scalar;
   size_t K = kappa.size();
 
-  std::function<Scalar(Scalar)> f = [bo, ro](Scalar phi) {
-    return P2_integrand(bo.value(), ro.value(), phi);
+  // The integrand and its derivatives wrt `bo` and `ro`, evaluated together
+  const Scalar b = bo.value();
+  const Scalar r = ro.value();
+  auto f = [b, r](const Scalar &phi, Eigen::Array<Scalar, 3, 1> &res) {
+    Scalar c = cos(phi);
+    Scalar z = 1 - r * r - b * b - 2 * b * r * c;
+    if (z < 1e-12)
+      z = 1e-12;
+    if (z > 1 - 1e-12)
+      z = 1 - 1e-12;
+    Scalar P = (1.0 - z * sqrt(z)) / (1.0 - z) * (r + b * c) * r / 3.0;
+    Scalar q = 3.0 * sqrt(z) / (1.0 - z * sqrt(z)) - 2.0 / (1.0 - z);
+    res(0) = P;
+    res(1) = P * ((b + r * c) * q + 1.0 / (b + r / c));
+    res(2) = P * ((r + b * c) * q + 1.0 / r + 1.0 / (r + b * c));
   };
-  std::function<Scalar(Scalar)> dfdbo = [bo, ro](Scalar phi) {
-    return dP2dbo_integrand(bo.value(), ro.value(), phi);
-  };
-  std::function<Scalar(Scalar)> dfdro = [bo, ro](Scalar phi) {
-    return dP2dro_integrand(bo.value(), ro.value(), phi);
-  };
-
-  // Compute the function value
-  T res = 0.0;
-  for (size_t i = 0; i < K; i += 2)
-    res.value() += QUAD.integrate(kappa(i).value() - pi<Scalar>(),
-                                  kappa(i + 1).value() - pi<Scalar>(), f);
 
-  // Compute the derivatives.
+  // Compute the function value and the derivatives.
   // Deriv wrt kappa is easy; need to integrate for the other two
+  T res = 0.0;
   for (size_t i = 0; i < K; i += 2) {
+    Eigen::Array<Scalar, 3, 1> integral = QUAD.template integrate_adaptive<3>(
+        kappa(i).value() - pi<Scalar>(), kappa(i + 1).value() - pi<Scalar>(),
+        f);
+    res.value() += integral(0);
     res.derivatives() +=
-        f(kappa(i + 1).value() - pi<Scalar>()) * kappa(i + 1).derivatives();
-    res.derivatives() -=
-        f(kappa(i).value() - pi<Scalar>()) * kappa(i).derivatives();
-    res.derivatives() +=
-        bo.derivatives() *
-        QUAD.integrate(kappa(i).value() - pi<Scalar>(),
-                       kappa(i + 1).value() - pi<Scalar>(), dfdbo);
-    res.derivatives() +=
-        ro.derivatives() *
-        QUAD.integrate(kappa(i).value() - pi<Scalar>(),
-                       kappa(i + 1).value() - pi<Scalar>(), dfdro);
+        P2_integrand(b, r, kappa(i + 1).value() - pi<Scalar>()) *
+        kappa(i + 1).derivatives();
+    res.derivatives() -= P2_integrand(b, r, kappa(i).value() - pi<Scalar>()) *
+                         kappa(i).derivatives();
+    res.derivatives() += bo.derivatives() * integral(1);
+    res.derivatives() += ro.derivatives() * integral(2);
   }
 
   return res;
@@ -151,8 +120,8 @@ inline T P2_numerical(const T &bo, const T &ro, const Vector<T> &kappa,
 
 */
 template <typename T>
-inline T P2(const T &bo, const T &ro, const T &k2, const Vector<T> &kappa,
-            const Vector<T> &s1, const Vector<T> &s2, const Vector<T> &c1,
+inline T P2(const T &bo, const T &ro, const T &k2, const Limits<T> &kappa,
+            const Limits<T> &s1, const Limits<T> &s2, const Limits<T> &c1,
             const T &F, const T &E, const T &PIp,
             Quad<typename T::Scalar> &QUAD) {
 
@@ -176,7 +145,7 @@ inline T P2(const T &bo, const T &ro, const T &k2, const Vector<T> &kappa,
   T d2 = r2 + b2 - 2 * br;
   T term = 0.5 / sqrt(br * k2);
   T p0 = 4.0 - 7.0 * r2 - b2;
-  Vector<T> q2(K);
+  Limits<T> q2(K);
   q2.array() = r2 + b2 - 2 * br * (1 - 2 * s2.array());
 
   // Special cases
@@ -253,58 +222,71 @@ inline T J_integrand(const int N, const T &k2, const T &phi) {
   return pow(s2, N) * term * sqrt(term);
 }
 
-/**
-  Derivative of the integrand of the J_N term, for numerical integration.
-*/
-template <typename T>
-inline T dJdk2_integrand(const int N, const T &k2, const T &phi) {
-  T s2 = sin(phi);
-  s2 *= s2;
-  T term = 1 - s2 / k2;
-  if (term < 0)
-    term = 0;
-  return (1.5 / (k2 * k2)) * pow(s2, N + 1) * sqrt(term);
-}
-
 /**
   J is analytic from recursion relations, but gets unstable for high `n`. We
   evaluate J for `n = 0` (analytically) `n = nmax` (numerically) and solve the
   problem with a forward & backward pass to improve numerical stability.
 
+  This computes `J_N` for each of the `M` orders `N`, sharing the
+  quadrature nodes among them.
+
 */
-template <typename T>
-inline T J_numerical(const int N, const T &k2, const Vector<T> &kappa,
-                     Quad<typename T::Scalar> &QUAD) {
+template <typename T, int M>
+inline void J_numerical(const int (&N)[M], const T &k2, const Limits<T> &kappa,
+                        Quad<typename T::Scalar> &QUAD, T (&res)[M]) {
 
   using Scalar = typename T::Scalar;
   size_t K = kappa.size();
 
-  std::function<Scalar(Scalar)> f = [N, k2](Scalar phi) {
-    return J_integrand(N, k2.value(), phi);
-  };
-  std::function<Scalar(Scalar)> dfdk2 = [N, k2](Scalar phi) {
-    return dJdk2_integrand(N, k2.value(), phi);
+  // The integrands and their derivatives wrt k2, evaluated together:
+  // the latter are `1.5 / k2^2 * s2^(N + 1) * (1 - s2 / k2)^(1/2)`
+  auto f = [&N, k2](const Scalar &phi,
+                    Eigen::Array<Scalar, 2 * M, 1> &result) {
+    Scalar s2 = sin(phi);
+    s2 *= s2;
+    Scalar term = 1 - s2 / k2.value();
+    if (term < 0)
+      term = 0;
+    Scalar sqrtterm = sqrt(term);
+    for (int m = 0; m < M; ++m) {
+      Scalar s2n = pow(s2, N[m]);
+      result(m) = s2n * term * sqrtterm;
+      result(M + m) = (1.5 / (k2.value() * k2.value())) * s2n * s2 * sqrtterm;
+    }
   };
 
-  // Compute the function value
-  T res = 0.0;
-  for (size_t i = 0; i < K; i += 2)
-    res.value() +=
-        QUAD.integrate(0.5 * kappa(i).value(), 0.5 * kappa(i + 1).value(), f);
-
-  // Compute the derivatives.
+  // Compute the function value and the derivatives.
   // Deriv wrt kappa is easy; need to integrate for k2
+  for (int m = 0; m < M; ++m)
+    res[m] = 0.0;
   for (size_t i = 0; i < K; i += 2) {
-    res.derivatives() +=
-        0.5 * f(0.5 * kappa(i + 1).value()) * kappa(i + 1).derivatives();
-    res.derivatives() -=
-        0.5 * f(0.5 * kappa(i).value()) * kappa(i).derivatives();
-    res.derivatives() += k2.derivatives() *
-                         QUAD.integrate(0.5 * kappa(i).value(),
-                                        0.5 * kappa(i + 1).value(), dfdk2);
+    Eigen::Array<Scalar, 2 * M, 1> integral =
+        QUAD.template integrate_adaptive<2 * M>(
+            0.5 * kappa(i).value(), 0.5 * kappa(i + 1).value(), f);
+    for (int m = 0; m < M; ++m) {
+      res[m].value() += integral(m);
+      res[m].derivatives() +=
+          0.5 * J_integrand(N[m], k2.value(), 0.5 * kappa(i + 1).value()) *
+          kappa(i + 1).derivatives();
+      res[m].derivatives() -=
+          0.5 * J_integrand(N[m], k2.value(), 0.5 * kappa(i).value()) *
+          kappa(i).derivatives();
+      res[m].derivatives() += k2.derivatives() * integral(M + m);
+    }
   }
+}
 
-  return res;
+/**
+  The J helper integral of order `N`, evaluated numerically.
+
+*/
+template <typename T>
+inline T J_numerical(const int N, const T &k2, const Limits<T> &kappa,
+                     Quad<typename T::Scalar> &QUAD) {
+  const int Ns[1] = {N};
+  T res[1];
+  J_numerical(Ns, k2, kappa, QUAD, res);
+  return res[0];
 }
 
 /**
@@ -373,28 +355,25 @@ template <typename T> inline T I_integrand(const int N, const T &phi) {
 
 */
 template <typename T>
-inline T I_numerical(const int N, const Vector<T> &kappa,
+inline T I_numerical(const int N, const Limits<T> &kappa,
                      Quad<typename T::Scalar> &QUAD) {
 
   using Scalar = typename T::Scalar;
   size_t K = kappa.size();
 
-  std::function<Scalar(Scalar)> f = [N](Scalar phi) {
-    return I_integrand(N, phi);
+  auto f = [N](const Scalar &phi, Eigen::Array<Scalar, 1, 1> &result) {
+    result(0) = I_integrand(N, phi);
   };
 
-  // Compute the function value
+  // Compute the function value and the derivatives (easy)
   T res = 0.0;
-  for (size_t i = 0; i < K; i += 2)
-    res.value() +=
-        QUAD.integrate(0.5 * kappa(i).value(), 0.5 * kappa(i + 1).value(), f);
-
-  // Compute the derivatives (easy)
   for (size_t i = 0; i < K; i += 2) {
-    res.derivatives() +=
-        0.5 * f(0.5 * kappa(i + 1).value()) * kappa(i + 1).derivatives();
-    res.derivatives() -=
-        0.5 * f(0.5 * kappa(i).value()) * kappa(i).derivatives();
+    res.value() += QUAD.template integrate_adaptive<1>(
+        0.5 * kappa(i).value(), 0.5 * kappa(i + 1).value(), f)(0);
+    res.derivatives() += 0.5 * I_integrand(N, 0.5 * kappa(i + 1).value()) *
+                         kappa(i + 1).derivatives();
+    res.derivatives() -= 0.5 * I_integrand(N, 0.5 * kappa(i).value()) *
+                         kappa(i).derivatives();
   }
 
   return res;
@@ -10,8 +10,12 @@
 #define _STARRY_STURM_H_
 
 #include <Eigen/Core>
+#include <atomic>
 #include <cfloat>
 #include <cmath>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <utils.h>
 #include <vector>
 
@@ -118,57 +122,222 @@ template <typename T> inline int sgn(T val) {
   return (T(0) < val) - (val < T(0));
 }
 
+/**
+Sturm sequence root counter that works entirely in preallocated storage.
+
+The coefficients of the polynomials in the sequence live in three buffers
+that are rotated as the remainders are computed, so once an instance has
+been sized for a given degree, counting roots never touches the heap.
+Instances are not thread-safe; give each thread its own.
+
+*/
+template <typename T> class RootCounter {
+
+protected:
+  int nmax;
+  std::vector<T> buf0, buf1, buf2;
+
+  inline T val(const T *p, int np, const T &x) const {
+    T result = T(0.0);
+    for (int i = 0; i < np; ++i)
+      result = result * x + p[i];
+    return result;
+  }
+
+public:
+  explicit RootCounter(int n = 0) { resize(n); }
+
+  //! Make room for polynomials with up to `n` coefficients.
+  inline void resize(int n) {
+    nmax = std::max(n, 1);
+    buf0.resize(nmax);
+    buf1.resize(nmax);
+    buf2.resize(nmax);
+  }
+
+  /**
+  Count the roots of the polynomial with the `np` coefficients `p`
+  (highest order first) in the interval [a, b].
+
+  */
+  inline int count(const T *p, int np, const T &a = 0, const T &b = 1) {
+    using std::abs;
+    if (np <= 1)
+      return 0;
+    if (np > nmax)
+      resize(np);
+    int n = np - 1, count = 0;
+
+    // The polynomial itself...
+    T *b0 = buf0.data(), *p0 = b0;
+    int n0 = np;
+    for (int i = 0; i < np; ++i)
+      p0[i] = p[i];
+
+    // HACK: for stability
+    if (p0[n] == 0)
+      p0[n] = -utils::mach_eps<T>();
+    if ((n > 1) && (p0[n - 1] == 0))
+      p0[n - 1] = utils::mach_eps<T>();
+
+    // ...and its derivative
+    T *b1 = buf1.data(), *p1 = b1;
+    int n1 = n;
+    for (int i = 0; i < n; ++i)
+      p1[i] = p0[i] * T(n - i);
+
+    // The scratch buffer for the remainders
+    T *r = buf2.data();
+
+    // Initial signs and sign changes
+    int s_0 = sgn(val(p1, n1, a));
+    int s_1 = sgn(val(p1, n1, b));
+    int s;
+    count += (sgn(val(p0, n0, a)) != s_0);
+    count -= (sgn(val(p0, n0, b)) != s_1);
+
+    // Loop over the Sturm sequence
+    for (int k = 0; k < n; ++k) {
+
+      // The negative of the remainder of p0 / p1, in place.
+      // The leading (near-)zero coefficients are stripped by
+      // advancing the pointer into the buffer.
+      int m = n0 - 1, p = n0 - n1 + 1;
+      T d, scale = T(1.0) / p1[0];
+      for (int i = 0; i < n0; ++i)
+        r[i] = p0[i];
+      for (int j = 0; j < p; ++j) {
+        d = scale * r[j];
+        for (int i = 0; i < n1; ++i)
+          r[j + i] -= d * p1[i];
+      }
+      int strt;
+      for (strt = 0; strt < m; ++strt) {
+        if (abs(r[strt]) >= T(POLYTOL))
+          break;
+      }
+      int nr = m + 1 - strt;
+      for (int i = 0; i < nr; ++i)
+        r[strt + i] *= -1.0;
+
+      // Rotate the buffers: p0 <- p1, p1 <- r, r <- p0
+      T *tmp = b0;
+      b0 = b1;
+      p0 = p1;
+      n0 = n1;
+      b1 = r;
+      p1 = r + strt;
+      n1 = nr;
+      r = tmp;
+
+      // Count the roots for this next polynomial
+      s = s_0;
+      s_0 = sgn(val(p1, n1, a));
+      count += (s != s_0);
+      s = s_1;
+      s_1 = sgn(val(p1, n1, b));
+      count -= (s != s_1);
+
+      if (n1 == 1)
+        break;
+    }
+    return count;
+  }
+};
+
 // Count the positive roots of a polynomial over the domain [0, 1] using Sturm's
 // theorem. `p` are the polynomial coefficients, highest order first.
 template <typename T>
 inline int polycountroots(const Eigen::Matrix<T, Eigen::Dynamic, 1> &p,
                           const T &a = 0, const T &b = 1) {
-  if (p.rows() <= 1)
-    return 0;
-
-  int n = p.rows() - 1, count = 0;
-
-  // Compute the initial signs and count any initial sign change.
-  Eigen::Matrix<T, Eigen::Dynamic, 1> p0 = p;
+  RootCounter<T> counter(p.rows());
+  return counter.count(p.data(), p.rows(), a, b);
+}
 
-  // HACK: for stability
-  if (p0(n) == 0)
-    p0(n) = -utils::mach_eps<T>();
-  if ((n > 1) && (p0(n - 1) == 0))
-    p0(n - 1) = utils::mach_eps<T>();
+/**
+Check whether each row of `u`, a set of limb darkening coefficient vectors
+`(u_0, u_1, ..., u_N)`, describes a physical profile: one that is positive
+everywhere on the disk and decreases monotonically toward the limb. This is
+the same check as `LDPhysicalOp`, with Sturm's theorem applied to the
+intensity polynomial and to its derivative on [0, 1]. The rows are
+distributed among `nthreads` threads; each thread allocates its scratch
+space once, so the cost per sample is just the root counting. Errors in
+any of the threads are rethrown in the calling thread.
 
-  Eigen::Matrix<T, Eigen::Dynamic, 1> p1 = polyder(p0);
-  Eigen::Matrix<T, Eigen::Dynamic, 1> tmp;
+*/
+template <typename T>
+inline void
+limbdark_is_physical(const utils::MatrixRef<double> &u,
+                     Eigen::Matrix<bool, Eigen::Dynamic, 1> &physical,
+                     int nthreads = 1) {
+  const int nsamples = u.rows(), N = u.cols();
+  physical.resize(nsamples);
+  if (nsamples == 0)
+    return;
 
-  // Sign at x = a
-  int s_0 = sgn(polyval(p1, a));
+  // Rows are handed out in chunks to keep the counter uncontended
+  const int chunk = 256;
+  std::atomic<int> next(0);
+  std::atomic<bool> failed(false);
+  auto work = [&]() {
+    RootCounter<T> counter(N);
+    utils::Vector<T> p(std::max(N, 1));
+    int start;
+    while (!failed && ((start = next.fetch_add(chunk)) < nsamples)) {
+      int stop = std::min(start + chunk, nsamples);
+      for (int n = start; n < stop; ++n) {
 
-  // Sign at x = b
-  int s_1 = sgn(polyval(p1, b));
+        // Ensure the function is *decreasing* toward the limb
+        if (u.row(n).sum() < -1) {
+          physical(n) = false;
+          continue;
+        }
 
-  int s;
-  count += (sgn(polyval(p0, a)) != s_0);
-  count -= (sgn(polyval(p0, b)) != s_1);
+        // Sturm's theorem on the intensity to ensure positivity
+        for (int i = 0; i < N; ++i)
+          p(i) = u(n, N - 1 - i);
+        if (counter.count(p.data(), N, T(0), T(1)) > 0) {
+          physical(n) = false;
+          continue;
+        }
 
-  // Loop over the Sturm sequence and compute each polynomial.
-  for (int k = 0; k < n; ++k) {
-    tmp = p1;
-    p1 = polyrem(p0, p1);
-    p1 *= -1.0;
-    p0 = tmp;
-
-    // Count the roots for this next polynomial.
-    s = s_0;
-    s_0 = sgn(polyval(p1, a));
-    count += (s != s_0);
-    s = s_1;
-    s_1 = sgn(polyval(p1, b));
-    count -= (s != s_1);
+        // Sturm's theorem on the derivative to ensure monotonicity
+        for (int i = 0; i < N - 1; ++i)
+          p(i) = T(N - 1 - i) * T(u(n, N - 1 - i));
+        physical(n) = (counter.count(p.data(), N - 1, T(0), T(1)) == 0);
+      }
+    }
+  };
 
-    if (p1.rows() == 1)
-      break;
+  if (nthreads <= 0)
+    nthreads = std::thread::hardware_concurrency();
+  nthreads = std::max(1, std::min(nthreads, (nsamples + chunk - 1) / chunk));
+  if (nthreads == 1) {
+    work();
+    return;
   }
-  return count;
+
+  // Parallel evaluation; errors are rethrown in the calling thread
+  std::exception_ptr error = nullptr;
+  std::mutex error_mutex;
+  auto guarded_work = [&]() {
+    try {
+      work();
+    } catch (...) {
+      std::lock_guard<std::mutex> error_lock(error_mutex);
+      if (!error)
+        error = std::current_exception();
+      failed = true;
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nthreads - 1; ++t)
+    threads.emplace_back(guarded_work);
+  guarded_work();
+  for (auto &thread : threads)
+    thread.join();
+  if (error)
+    std::rethrow_exception(error);
 }
 
 } // namespace sturm
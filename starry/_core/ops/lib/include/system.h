@@ -0,0 +1,543 @@
+/**
+\file system.h
+\brief Utilities for modeling systems of bodies.
+
+*/
+
+#ifndef _STARRY_SYSTEM_H_
+#define _STARRY_SYSTEM_H_
+
+#include "ops.h"
+#include "utils.h"
+
+namespace starry {
+namespace system {
+
+using namespace utils;
+
+/**
+Find all occultations in a system of bodies.
+
+Given the sky positions `x`, `y`, `z` of `nsec` secondaries relative to
+the primary (one column per secondary) and the radii `r` of all bodies
+(primary first), this computes the indices of the time samples at which
+body `k` is occulted by body `l` for every ordered pair `(k, l)`. The
+primary is body `0` and sits at the origin. The result is stored in
+compressed form: the indices for the pair `(k, l)` are
+`idx[offsets(p) : offsets(p + 1)]`, where `p = k * (nsec + 1) + l`, and
+`occultor` holds the index `l` of the occultor for each entry of `idx`.
+Since the pairs are sorted by the occulted body, all occultations of body
+`k` are stored contiguously.
+
+At each time step the bodies are sorted along `x` by the lower edge of
+their bounding circles and swept to find the pairs whose extents overlap
+in both `x` and `y`. Since the ordering changes little between adjacent
+time steps, an insertion sort makes this O(nbodies) per step in the
+typical case. Only the surviving candidate pairs are subjected to the
+exact overlap test, which is identical to the one applied in the
+occultation branches of the design matrix.
+
+*/
+template <typename T>
+inline void occultations(const MatrixRef<T> &x, const MatrixRef<T> &y,
+                         const MatrixRef<T> &z, const VectorRef<T> &r,
+                         Vector<int> &offsets, Vector<int> &idx,
+                         Vector<int> &occultor) {
+  const int N = x.rows();
+  const int nsec = x.cols();
+  const int nbodies = nsec + 1;
+  if ((y.rows() != N) || (z.rows() != N) || (y.cols() != nsec) ||
+      (z.cols() != nsec) || (r.size() != nbodies))
+    throw std::length_error("Invalid shape for the body positions or radii.");
+
+  // Sky position of body `k` at time `n`
+  auto pos = [&](const MatrixRef<T> &q, int n, int k) -> T {
+    return k == 0 ? T(0.0) : q(n, k - 1);
+  };
+
+  // Sweep and prune: gather the occultation indices for each pair
+  std::vector<std::vector<int>> pairs(nbodies * nbodies);
+  std::vector<int> order(nbodies);
+  std::vector<int> active;
+  active.reserve(nbodies);
+  std::vector<T> lower(nbodies);
+  for (int k = 0; k < nbodies; ++k)
+    order[k] = k;
+  for (int n = 0; n < N; ++n) {
+
+    // Sort the bodies by the lower edge of their extent along `x`
+    for (int k = 0; k < nbodies; ++k)
+      lower[k] = pos(x, n, k) - r(k);
+    for (int i = 1; i < nbodies; ++i) {
+      int k = order[i];
+      int j = i - 1;
+      while ((j >= 0) && (lower[order[j]] > lower[k])) {
+        order[j + 1] = order[j];
+        --j;
+      }
+      order[j + 1] = k;
+    }
+
+    // Sweep along `x`, keeping a list of the bodies whose extents overlap
+    active.clear();
+    for (int i = 0; i < nbodies; ++i) {
+      int k = order[i];
+      T yk = pos(y, n, k);
+      int m = 0;
+      for (int l : active) {
+        T xl = pos(x, n, l);
+        if (xl + r(l) < lower[k])
+          continue;
+        active[m++] = l;
+
+        // Prune along `y`
+        T yl = pos(y, n, l);
+        if (abs(yk - yl) > r(k) + r(l))
+          continue;
+
+        // The body in front is the occultor
+        T dz = pos(z, n, l) - pos(z, n, k);
+        int a, b;
+        if (dz > 0) {
+          a = k;
+          b = l;
+        } else if (dz < 0) {
+          a = l;
+          b = k;
+        } else {
+          continue;
+        }
+        if ((r(a) == 0) || (r(b) == 0))
+          continue;
+
+        // Exact test, in units of the occulted body's radius
+        T xo = (pos(x, n, b) - pos(x, n, a)) / r(a);
+        T yo = (pos(y, n, b) - pos(y, n, a)) / r(a);
+        if (sqrt(xo * xo + yo * yo) < 1.0 + r(b) / r(a))
+          pairs[a * nbodies + b].push_back(n);
+      }
+      active.resize(m);
+      active.push_back(k);
+    }
+  }
+
+  // Compress
+  offsets.resize(nbodies * nbodies + 1);
+  offsets(0) = 0;
+  for (int p = 0; p < nbodies * nbodies; ++p)
+    offsets(p + 1) = offsets(p) + pairs[p].size();
+  idx.resize(offsets(nbodies * nbodies));
+  occultor.resize(offsets(nbodies * nbodies));
+  for (int p = 0; p < nbodies * nbodies; ++p) {
+    std::copy(pairs[p].begin(), pairs[p].end(), idx.data() + offsets(p));
+    occultor.segment(offsets(p), pairs[p].size()).setConstant(p % nbodies);
+  }
+}
+
+/**
+The flux design matrix of a system of bodies in emitted light.
+
+The whole system is computed in a single pass, so the size of the
+(Theano) graph of a system light curve does not depend on the number of
+bodies. Each body `k` is handled by its own `Ops` instance: before the
+rotation to the observer's frame, its rows are `rT F A1 R` out of
+occultation and `sT(b, ro) A Rz(theta_z) A1^-1 F A1 R` in occultation,
+where `F` is the filter operator and `R` the rotation from the map frame
+to the sky frame. The occultations are found with `occultations`, and
+simultaneous occultations of the same body add.
+
+The inputs are the rotational phases `theta` (one row per body, primary
+first), the positions `x`, `y`, `z` of the secondaries relative to the
+primary (one column per secondary), and the radii `r`, inclinations `inc`,
+obliquities `obl`, limb darkening coefficients `u`, filters `f`,
+differential rotation parameters `alpha`, `tau`, and `delta`, and
+amplitudes `amp` of all bodies. Each matrix in `f` has one row per filter,
+and the result `X` holds one design matrix per filter, with the columns
+of all bodies side by side. The occultation solutions are shared among
+the filters.
+
+The gradient overload backpropagates the adjoints `bX` of the design
+matrices into all inputs except `z`, which only enters through the
+occultation test. It recomputes the forward pass body by body, so
+nothing is kept between the two calls.
+
+*/
+template <class Scalar> class DesignMatrix {
+protected:
+  std::vector<Ops<Scalar> *> bodies;
+  const int nbodies;
+  Vector<int> offsets, idx, occultor;
+
+  /**
+  Compute the design matrices or, if `GRADIENT` is set, backpropagate
+  the adjoints `bX` into the inputs.
+
+  */
+  template <bool GRADIENT>
+  inline void
+  compute(const MatrixRef<double> &theta, const MatrixRef<double> &x,
+          const MatrixRef<double> &y, const MatrixRef<double> &z,
+          const VectorRef<double> &r, const VectorRef<double> &inc,
+          const VectorRef<double> &obl, const std::vector<Vector<double>> &u,
+          const std::vector<Matrix<double>> &f, const VectorRef<double> &alpha,
+          const VectorRef<double> &tau, const VectorRef<double> &delta,
+          const VectorRef<double> &amp,
+          const std::vector<Matrix<double>> &bX) {
+
+    // Shape checks
+    const int nt = x.rows();
+    const int nsec = x.cols();
+    if ((nsec + 1 != nbodies) || (theta.rows() != nbodies) ||
+        (theta.cols() != nt) || (r.size() != nbodies) ||
+        (inc.size() != nbodies) || (obl.size() != nbodies) ||
+        (int(u.size()) != nbodies) || (int(f.size()) != nbodies) ||
+        (alpha.size() != nbodies) || (tau.size() != nbodies) ||
+        (delta.size() != nbodies) || (amp.size() != nbodies))
+      throw std::length_error("Invalid shape for the system parameters.");
+    const int nf = f[0].rows();
+    int ncols = 0;
+    for (int k = 0; k < nbodies; ++k) {
+      if ((u[k].size() != bodies[k]->Nu) || (f[k].rows() != nf) ||
+          (f[k].cols() != bodies[k]->Nf))
+        throw std::length_error("Invalid shape for the filter coefficients.");
+      ncols += bodies[k]->Ny;
+    }
+    if (GRADIENT) {
+      if (int(bX.size()) != nf)
+        throw std::length_error("Invalid shape for the gradient `bX`.");
+      for (int j = 0; j < nf; ++j) {
+        if ((bX[j].rows() != nt) || (bX[j].cols() != ncols))
+          throw std::length_error("Invalid shape for the gradient `bX`.");
+      }
+    }
+
+    // Find all occultations
+    occultations<double>(x, y, z, r, offsets, idx, occultor);
+
+    // Initialize the outputs
+    if (GRADIENT) {
+      btheta.setZero(nbodies, nt);
+      bx.setZero(nt, nsec);
+      by.setZero(nt, nsec);
+      br.setZero(nbodies);
+      binc.setZero(nbodies);
+      bobl.setZero(nbodies);
+      balpha.setZero(nbodies);
+      btau.setZero(nbodies);
+      bdelta.setZero(nbodies);
+      bamp.setZero(nbodies);
+      bu.resize(nbodies);
+      bf.resize(nbodies);
+    } else {
+      X.resize(nf);
+      for (int j = 0; j < nf; ++j)
+        X[j].resize(nt, ncols);
+    }
+
+    // Sky position of body `k` at time `n`
+    auto pos = [&](const MatrixRef<double> &q, int n, int k) -> Scalar {
+      return k == 0 ? Scalar(0.0) : static_cast<Scalar>(q(n, k - 1));
+    };
+
+    const Scalar zero = 0.0, one = 1.0, halfpi = 0.5 * pi<Scalar>();
+    int col = 0;
+    for (int k = 0; k < nbodies; ++k) {
+
+      Ops<Scalar> &ops = *bodies[k];
+      const int ydeg = ops.ydeg;
+      const int Ny = ops.Ny;
+      const int N = ops.N;
+      const bool filtered = (ops.udeg > 0) || (ops.fdeg > 0);
+      const Scalar rk = r(k);
+      const Scalar inc_k = inc(k);
+      const Scalar obl_k = obl(k);
+      const Scalar alpha_k = alpha(k);
+      const Scalar amp_k = amp(k);
+      const Vector<Scalar> theta_k = theta.row(k).transpose().cast<Scalar>();
+      const Vector<Scalar> u_k = u[k].cast<Scalar>();
+
+      // Occultor positions (in units of the radius of body `k`) and the
+      // occultation solutions, rotated into the frame of each occultor
+      const int start = offsets(k * nbodies);
+      const int nev = offsets((k + 1) * nbodies) - start;
+      Vector<Scalar> xo(nev), yo(nev), b(nev), ro(nev), theta_z(nev);
+      Matrix<Scalar> sA(nev, N), dsTdb, dsTdr;
+      if (GRADIENT) {
+        dsTdb.resize(nev, N);
+        dsTdr.resize(nev, N);
+      }
+      for (int e = 0; e < nev; ++e) {
+        const int n = idx(start + e);
+        const int l = occultor(start + e);
+        xo(e) = (pos(x, n, l) - pos(x, n, k)) / rk;
+        yo(e) = (pos(y, n, l) - pos(y, n, k)) / rk;
+        b(e) = sqrt(xo(e) * xo(e) + yo(e) * yo(e));
+        ro(e) = r(l) / rk;
+        theta_z(e) = atan2(xo(e), yo(e));
+        ops.G.template compute<GRADIENT>(b(e), ro(e));
+        sA.row(e) = ops.G.sT * ops.B.A;
+        if (GRADIENT) {
+          dsTdb.row(e) = ops.G.dsTdb;
+          dsTdr.row(e) = ops.G.dsTdr;
+        }
+      }
+      ops.W.tensordotRz(sA, theta_z);
+      const Matrix<Scalar> sAR = ops.W.tensordotRz_result;
+
+      // Rotation from the map frame to the sky frame, `R`, and from the
+      // sky frame to the polar frame
+      const Matrix<Scalar> I = Matrix<Scalar>::Identity(Ny, Ny);
+      Matrix<Scalar> R0, R1, R, Rpol;
+      if (ydeg > 0) {
+        ops.W.dotR(I, -cos(obl_k), -sin(obl_k), zero, inc_k - halfpi);
+        R0 = ops.W.dotR_result;
+        ops.W.dotR(R0, zero, zero, one, obl_k);
+        R1 = ops.W.dotR_result;
+        ops.W.dotR(R1, one, zero, zero, -halfpi);
+        R = ops.W.dotR_result;
+        ops.W.dotR(I, one, zero, zero, halfpi);
+        Rpol = ops.W.dotR_result;
+      }
+
+      // Differential rotation damping
+      const Scalar eps = alpha_k + 1e-8;
+      const Scalar sig = 2 * pi<Scalar>() * tau(k) / eps;
+      const Scalar theta0 = 2 * pi<Scalar>() * delta(k) / eps;
+      const Vector<Scalar> q = (theta_k.array() - theta0) / sig;
+      const Vector<Scalar> damp = (-0.5 * q.array().square()).exp();
+
+      // Adjoints shared among the filters
+      Matrix<Scalar> bR, bsAR;
+      Vector<Scalar> btheta_k;
+      Scalar balpha_k = 0.0, btau_k = 0.0, bdelta_k = 0.0, bamp_k = 0.0;
+      if (GRADIENT) {
+        bR.setZero(Ny, Ny);
+        bsAR.setZero(nev, N);
+        btheta_k.setZero(nt);
+        bu[k].setZero(ops.Nu);
+        bf[k].setZero(nf, ops.Nf);
+      }
+
+      for (int j = 0; j < nf; ++j) {
+
+        // Apply the filter
+        RowVector<Scalar> rTA1;
+        Matrix<Scalar> sARA1, sARA1Inv;
+        const Vector<Scalar> f_kj = f[k].row(j).transpose().cast<Scalar>();
+        if (filtered) {
+          ops.F.computeF(u_k, f_kj);
+          rTA1 = ops.B.rT * ops.F.F * ops.B.A1;
+          sARA1Inv = sAR * ops.B.A1Inv;
+          sARA1 = sARA1Inv * ops.F.F * ops.B.A1;
+        } else {
+          rTA1 = ops.B.rTA1;
+          sARA1 = sAR;
+        }
+
+        // Assemble the rows in the sky frame
+        const RowVector<Scalar> w = (ydeg > 0) ? (rTA1 * R).eval() : rTA1;
+        const Matrix<Scalar> v = (ydeg > 0) ? (sARA1 * R).eval() : sARA1;
+        Matrix<Scalar> M = w.replicate(nt, 1);
+        for (int e = 0; e < nev; ++e)
+          M.row(idx(start + e)) += v.row(e) - w;
+
+        // Rotate to the correct phase and to the polar frame
+        Matrix<Scalar> D, Xk;
+        if (ydeg == 0) {
+          Xk = M;
+        } else if (alpha_k == 0) {
+          ops.W.tensordotRz(M, theta_k);
+          Xk = ops.W.tensordotRz_result * Rpol;
+        } else {
+          ops.W.tensordotDz(M, theta_k, alpha_k);
+          D = ops.W.tensordotDz_result;
+          Xk = D;
+          Xk.col(0) = M.col(0);
+          Xk.rightCols(Ny - 1) = damp.asDiagonal() * D.rightCols(Ny - 1);
+          Xk = Xk * Rpol;
+        }
+
+        if (!GRADIENT) {
+          X[j].block(0, col, nt, Ny) = (amp_k * Xk).template cast<double>();
+          continue;
+        }
+
+        // Backprop the rotation to the correct phase
+        const Matrix<Scalar> bXk = bX[j].block(0, col, nt, Ny).cast<Scalar>();
+        bamp_k += Xk.cwiseProduct(bXk).sum();
+        Matrix<Scalar> bM;
+        if (ydeg == 0) {
+          bM = amp_k * bXk;
+        } else if (alpha_k == 0) {
+          const Matrix<Scalar> bD = amp_k * bXk * Rpol.transpose();
+          ops.W.tensordotRz(M, theta_k, bD);
+          bM = ops.W.tensordotRz_bM;
+          btheta_k += ops.W.tensordotRz_btheta;
+        } else {
+          const Matrix<Scalar> bD = amp_k * bXk * Rpol.transpose();
+          const Vector<Scalar> g =
+              D.rightCols(Ny - 1)
+                  .cwiseProduct(bD.rightCols(Ny - 1))
+                  .rowwise()
+                  .sum()
+                  .cwiseProduct(damp)
+                  .cwiseProduct(q) /
+              sig;
+          const Scalar bsig = g.dot(q);
+          const Scalar btheta0 = g.sum();
+          btheta_k -= g;
+          bdelta_k += btheta0 * 2 * pi<Scalar>() / eps;
+          balpha_k -= btheta0 * theta0 / eps;
+          if (bsig != 0) {
+            // There is no damping (and no gradient) if `tau` is infinite
+            btau_k += bsig * 2 * pi<Scalar>() / eps;
+            balpha_k -= bsig * sig / eps;
+          }
+          Matrix<Scalar> bDz = Matrix<Scalar>::Zero(nt, Ny);
+          bDz.rightCols(Ny - 1) = damp.asDiagonal() * bD.rightCols(Ny - 1);
+          ops.W.tensordotDz(M, theta_k, alpha_k, bDz);
+          bM = ops.W.tensordotDz_bM;
+          bM.col(0) += bD.col(0);
+          btheta_k += ops.W.tensordotDz_btheta;
+          balpha_k += ops.W.tensordotDz_balpha;
+        }
+
+        // Backprop the assembly of the rows
+        RowVector<Scalar> bw = bM.colwise().sum();
+        Matrix<Scalar> bv(nev, Ny);
+        for (int e = 0; e < nev; ++e) {
+          bv.row(e) = bM.row(idx(start + e));
+          bw -= bv.row(e);
+        }
+        RowVector<Scalar> brTA1;
+        Matrix<Scalar> bsARA1;
+        if (ydeg > 0) {
+          bR += rTA1.transpose() * bw + sARA1.transpose() * bv;
+          brTA1 = bw * R.transpose();
+          bsARA1 = bv * R.transpose();
+        } else {
+          brTA1 = bw;
+          bsARA1 = bv;
+        }
+
+        // Backprop the filter
+        if (filtered) {
+          const Matrix<Scalar> bFA1 = bsARA1 * ops.B.A1.transpose();
+          bsAR += bFA1 * ops.F.F.transpose() * ops.B.A1Inv.transpose();
+          const Matrix<Scalar> bF =
+              ops.B.rT.transpose() * (brTA1 * ops.B.A1.transpose()) +
+              sARA1Inv.transpose() * bFA1;
+          ops.F.computeF(u_k, f_kj, bF);
+          bu[k] += ops.F.bu;
+          bf[k].row(j) = ops.F.bf.transpose();
+        } else {
+          bsAR += bsARA1;
+        }
+      }
+
+      if (GRADIENT) {
+
+        // Backprop the occultation solutions into the positions and radii
+        ops.W.tensordotRz(sA, theta_z, bsAR);
+        const Matrix<Scalar> bs = ops.W.tensordotRz_bM * ops.B.A.transpose();
+        const Vector<Scalar> btheta_z = ops.W.tensordotRz_btheta;
+        for (int e = 0; e < nev; ++e) {
+          const int n = idx(start + e);
+          const int l = occultor(start + e);
+          const Scalar bb = dsTdb.row(e).dot(bs.row(e));
+          const Scalar bro = dsTdr.row(e).dot(bs.row(e));
+          Scalar bxo = 0.0, byo = 0.0;
+          if (b(e) > 0) {
+            bxo = (bb * xo(e) + btheta_z(e) * yo(e) / b(e)) / b(e);
+            byo = (bb * yo(e) - btheta_z(e) * xo(e) / b(e)) / b(e);
+          }
+          if (l > 0) {
+            bx(n, l - 1) += static_cast<double>(bxo / rk);
+            by(n, l - 1) += static_cast<double>(byo / rk);
+          }
+          if (k > 0) {
+            bx(n, k - 1) -= static_cast<double>(bxo / rk);
+            by(n, k - 1) -= static_cast<double>(byo / rk);
+          }
+          br(k) -= static_cast<double>(
+              (bxo * xo(e) + byo * yo(e) + bro * ro(e)) / rk);
+          br(l) += static_cast<double>(bro / rk);
+        }
+
+        // Backprop the rotation to the sky frame
+        if (ydeg > 0) {
+          ops.W.dotR(R1, one, zero, zero, -halfpi, bR);
+          const Matrix<Scalar> bR1 = ops.W.dotR_bM;
+          ops.W.dotR(R0, zero, zero, one, obl_k, bR1);
+          const Matrix<Scalar> bR0 = ops.W.dotR_bM;
+          Scalar bobl_k = ops.W.dotR_btheta;
+          ops.W.dotR(I, -cos(obl_k), -sin(obl_k), zero, inc_k - halfpi, bR0);
+          bobl_k += ops.W.dotR_bx * sin(obl_k) - ops.W.dotR_by * cos(obl_k);
+          binc(k) = static_cast<double>(ops.W.dotR_btheta);
+          bobl(k) = static_cast<double>(bobl_k);
+        }
+
+        btheta.row(k) = btheta_k.transpose().template cast<double>();
+        balpha(k) = static_cast<double>(balpha_k);
+        btau(k) = static_cast<double>(btau_k);
+        bdelta(k) = static_cast<double>(bdelta_k);
+        bamp(k) = static_cast<double>(bamp_k);
+      }
+
+      col += Ny;
+    }
+  }
+
+public:
+  std::vector<Matrix<double>> X;
+  Matrix<double> btheta, bx, by;
+  Vector<double> br, binc, bobl, balpha, btau, bdelta, bamp;
+  std::vector<Vector<double>> bu;
+  std::vector<Matrix<double>> bf;
+
+  explicit DesignMatrix(const std::vector<Ops<Scalar> *> &bodies)
+      : bodies(bodies), nbodies(bodies.size()) {}
+
+  /**
+  Compute the design matrices.
+
+  */
+  inline void compute(const MatrixRef<double> &theta,
+                      const MatrixRef<double> &x, const MatrixRef<double> &y,
+                      const MatrixRef<double> &z, const VectorRef<double> &r,
+                      const VectorRef<double> &inc,
+                      const VectorRef<double> &obl,
+                      const std::vector<Vector<double>> &u,
+                      const std::vector<Matrix<double>> &f,
+                      const VectorRef<double> &alpha,
+                      const VectorRef<double> &tau,
+                      const VectorRef<double> &delta,
+                      const VectorRef<double> &amp) {
+    compute<false>(theta, x, y, z, r, inc, obl, u, f, alpha, tau, delta, amp,
+                   {});
+  }
+
+  /**
+  Backpropagate the adjoints `bX` of the design matrices.
+
+  */
+  inline void compute(const MatrixRef<double> &theta,
+                      const MatrixRef<double> &x, const MatrixRef<double> &y,
+                      const MatrixRef<double> &z, const VectorRef<double> &r,
+                      const VectorRef<double> &inc,
+                      const VectorRef<double> &obl,
+                      const std::vector<Vector<double>> &u,
+                      const std::vector<Matrix<double>> &f,
+                      const VectorRef<double> &alpha,
+                      const VectorRef<double> &tau,
+                      const VectorRef<double> &delta,
+                      const VectorRef<double> &amp,
+                      const std::vector<Matrix<double>> &bX) {
+    compute<true>(theta, x, y, z, r, inc, obl, u, f, alpha, tau, delta, amp,
+                  bX);
+  }
+};
+
+} // namespace system
+} // namespace starry
+#endif
@@ -7,18 +7,61 @@
 #ifndef _STARRY_UTILS_H_
 #define _STARRY_UTILS_H_
 
+// Count heap allocations? (debug builds only)
+// We intercept Eigen's runtime malloc check, which is the only
+// assertion whose condition starts with `is_malloc_allowed()`,
+// and count its failures instead of aborting. All other Eigen
+// assertions behave as usual.
+#ifdef STARRY_COUNT_ALLOCATIONS
+#include <atomic>
+#include <cassert>
+#define EIGEN_RUNTIME_NO_MALLOC
+#define eigen_assert(x)                                                        \
+  (starry::utils::allocations::starts_with(#x, "is_malloc_allowed()")         \
+       ? starry::utils::allocations::check(x)                                  \
+       : assert(x))
+namespace starry {
+namespace utils {
+namespace allocations {
+
+constexpr bool starts_with(const char *str, const char *prefix) {
+  return (*prefix == 0) ||
+         ((*str == *prefix) && starts_with(str + 1, prefix + 1));
+}
+
+inline std::atomic<long> &counter() {
+  static std::atomic<long> count(0);
+  return count;
+}
+
+inline void check(bool allowed) {
+  if (!allowed)
+    ++counter();
+}
+
+} // namespace allocations
+} // namespace utils
+} // namespace starry
+#endif
+
 // Includes
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <Eigen/SparseLU>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <exception>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <random>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <thread>
 #include <unsupported/Eigen/AutoDiff>
 #include <vector>
 
@@ -54,6 +97,21 @@ typedef void Multi;
 #define STARRY_QUAD_POINTS 100
 #endif
 
+//! Relative tolerance of the tanh-sinh quadrature
+#ifndef STARRY_QUAD_TOL
+#define STARRY_QUAD_TOL 1e-10
+#endif
+
+//! Maximum number of step halvings in the tanh-sinh quadrature
+#ifndef STARRY_QUAD_MAX_LEVEL
+#define STARRY_QUAD_MAX_LEVEL 8
+#endif
+
+//! Truncation of the tanh-sinh quadrature in the transformed variable
+#ifndef STARRY_QUAD_TMAX
+#define STARRY_QUAD_TMAX 3.5
+#endif
+
 //! Max iterations in elliptic integrals
 #ifndef STARRY_ELLIP_MAX_ITER
 #define STARRY_ELLIP_MAX_ITER 200
@@ -69,6 +127,11 @@ typedef void Multi;
 #define STARRY_IJ_MAX_ITER 200
 #endif
 
+//! Max iterations in the Kepler solver
+#ifndef STARRY_KEPLER_MAX_ITER
+#define STARRY_KEPLER_MAX_ITER 100
+#endif
+
 //! Refine the downward recursion in the J integral at this index
 #ifndef STARRY_REFINE_J_AT
 #define STARRY_REFINE_J_AT 25
@@ -161,6 +224,23 @@ using Matrix = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, StorageOrder>;
 template <typename T, int N>
 using ADScalar = Eigen::AutoDiffScalar<Eigen::Matrix<T, N, 1>>;
 
+//! Values at the (at most four) limits of the reflected light integrals,
+//! stored on the stack
+template <typename T>
+using Limits = Eigen::Matrix<T, Eigen::Dynamic, 1, 0, 4, 1>;
+
+//! Read-only views of existing storage (such as numpy buffers), so that
+//! arrays can be passed in without a copy. `MatrixRef` accepts any
+//! strides, so both C- and Fortran-ordered arrays map onto it directly.
+template <typename T> using VectorRef = Ref<const Vector<T>>;
+template <typename T> using RowVectorRef = Ref<const RowVector<T>>;
+template <typename T>
+using MatrixRef = Ref<const Matrix<T>, 0,
+                      Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>;
+
+//! Writable view of a caller-provided (C-ordered) output array
+template <typename T> using OutMatrix = Ref<Matrix<T, RowMajor>>;
+
 // --------------------------
 // -------- Constants -------
 // --------------------------
@@ -275,6 +355,29 @@ template <class T> inline void print_scalar(const Eigen::AutoDiffScalar<T> &x) {
   std::cout << x << ", " << x.derivatives().transpose() << std::endl;
 }
 
+#ifdef STARRY_COUNT_ALLOCATIONS
+namespace allocations {
+
+/**
+  Reset the heap allocation counter. From now on, every heap
+  allocation made by Eigen (on any thread) is counted.
+
+*/
+inline void reset() {
+  Eigen::internal::set_is_malloc_allowed(false);
+  counter() = 0;
+}
+
+/**
+  The number of heap allocations made by Eigen since the last
+  call to `reset()`.
+
+*/
+inline long count() { return counter(); }
+
+} // namespace allocations
+#endif
+
 class StarryException : public std::exception {
 
   std::string m_msg;
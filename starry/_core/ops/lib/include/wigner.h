@@ -240,6 +240,96 @@ inline void axisAngleToEuler(const Scalar &axis_x, const Scalar &axis_y,
   }
 }
 
+/**
+Rotation of zonal (`m = 0`) harmonics.
+
+By the addition theorem, rotating the unit zonal harmonic of degree `l`
+so that its axis points along the unit vector `(x, y, z)` yields the
+coefficients
+
+        Z_lm = Q_l^|m|(z) Re[(x + i y)^m]         (m >= 0)
+        Z_lm = Q_l^|m|(z) Im[(x + i y)^|m|]       (m < 0)
+
+where `Q_l^m (1 - z^2)^(m/2)` are the Schmidt semi-normalized associated
+Legendre functions (no Condon-Shortley phase). This is `O(N)` per
+rotation, as opposed to `O(l^3)` for the full Wigner matrices, and is
+smooth everywhere on the sphere. Writing the azimuthal terms as powers
+of `x + i y` avoids dividing by `sin(theta)` at the poles.
+
+*/
+template <class Scalar> class ZonalRotation {
+protected:
+  const int ydeg;       /**< */
+  const int Ny;         /**< */
+  Vector<Scalar> Q, dQ; /**< The Legendre terms & their z derivs */
+
+public:
+  RowVector<Scalar> Z;    /**< The rotated zonal coefficients */
+  RowVector<Scalar> dZdx; /**< Derivative of `Z` w/ respect to `x` */
+  RowVector<Scalar> dZdy; /**< Derivative of `Z` w/ respect to `y` */
+  RowVector<Scalar> dZdz; /**< Derivative of `Z` w/ respect to `z` */
+
+  explicit ZonalRotation(int ydeg)
+      : ydeg(ydeg), Ny((ydeg + 1) * (ydeg + 1)), Q(ydeg + 1), dQ(ydeg + 1),
+        Z(Ny), dZdx(Ny), dZdy(Ny), dZdz(Ny) {}
+
+  /**
+  Compute the rotated zonal coefficients for the axis `(x, y, z)`,
+  and optionally their derivatives.
+
+  */
+  inline void compute(const Scalar &x, const Scalar &y, const Scalar &z,
+                      bool gradient = false) {
+    // Re & Im parts of (x + i y)^m, and the same for m - 1
+    Scalar cm = 1.0, sm = 0.0, cm1 = 0.0, sm1 = 0.0;
+    Scalar Qmm = 1.0;
+    for (int m = 0; m < ydeg + 1; ++m) {
+      if (m > 0) {
+        cm1 = cm;
+        sm1 = sm;
+        cm = x * cm1 - y * sm1;
+        sm = x * sm1 + y * cm1;
+        if (m > 1)
+          Qmm *= sqrt((2.0 * m - 1.0) / (2.0 * m));
+      }
+
+      // Upward recursion in `l`
+      Q(m) = Qmm;
+      dQ(m) = 0.0;
+      if (m < ydeg) {
+        Q(m + 1) = sqrt(2.0 * m + 1.0) * z * Qmm;
+        dQ(m + 1) = sqrt(2.0 * m + 1.0) * Qmm;
+      }
+      for (int l = m + 2; l < ydeg + 1; ++l) {
+        Scalar a = 1.0 / sqrt(Scalar(l * l - m * m));
+        Scalar b = sqrt(Scalar((l - 1) * (l - 1) - m * m));
+        Q(l) = a * ((2.0 * l - 1.0) * z * Q(l - 1) - b * Q(l - 2));
+        dQ(l) = a * ((2.0 * l - 1.0) * (Q(l - 1) + z * dQ(l - 1)) -
+                     b * dQ(l - 2));
+      }
+
+      // Assemble the coefficients
+      for (int l = m; l < ydeg + 1; ++l) {
+        int np = l * l + l + m;
+        int nm = l * l + l - m;
+        Z(np) = Q(l) * cm;
+        if (m > 0)
+          Z(nm) = Q(l) * sm;
+        if (gradient) {
+          dZdx(np) = m * Q(l) * cm1;
+          dZdy(np) = -m * Q(l) * sm1;
+          dZdz(np) = dQ(l) * cm;
+          if (m > 0) {
+            dZdx(nm) = m * Q(l) * sm1;
+            dZdy(nm) = m * Q(l) * cm1;
+            dZdz(nm) = dQ(l) * sm;
+          }
+        }
+      }
+    }
+  }
+};
+
 /**
 Rotation matrix class for the spherical harmonics.
 
@@ -431,7 +521,7 @@ public:
   Compute the ``Rz`` (tensor) rotation matrix.
 
   */
-  inline void computeRz(const Vector<Scalar> &theta) {
+  inline void computeRz(const VectorRef<Scalar> &theta) {
     // Length of timeseries
     size_t npts = theta.size();
 
@@ -508,10 +598,11 @@ public:
   Computes the gradient of the dot product M . R([x, y, z], theta).
 
   */
-  template <typename T1, bool M_IS_ROW_VECTOR = (T1::RowsAtCompileTime == 1)>
+  template <typename T1, typename T2,
+            bool M_IS_ROW_VECTOR = (T1::RowsAtCompileTime == 1)>
   inline void dotR(const MatrixBase<T1> &M, const Scalar &x, const Scalar &y,
                    const Scalar &z, const Scalar &theta,
-                   const Matrix<Scalar> &bMR) {
+                   const MatrixBase<T2> &bMR) {
     // Shape checks
     size_t npts = M.rows();
 
@@ -556,7 +647,7 @@ public:
   */
   template <typename T1, bool M_IS_ROW_VECTOR = (T1::RowsAtCompileTime == 1)>
   inline void tensordotRz(const MatrixBase<T1> &M,
-                          const Vector<Scalar> &theta) {
+                          const VectorRef<Scalar> &theta) {
     // Shape checks
     size_t npts = theta.size();
     size_t Nr = M.cols();
@@ -575,8 +666,8 @@ public:
       for (int j = 0; j < 2 * l + 1; ++j) {
         if (M_IS_ROW_VECTOR) {
           tensordotRz_result.col(l * l + j) =
-              M(l * l + j) * cosmt.col(l * l + j) +
-              M(l * l + 2 * l - j) * sinmt.col(l * l + j);
+              M(0, l * l + j) * cosmt.col(l * l + j) +
+              M(0, l * l + 2 * l - j) * sinmt.col(l * l + j);
         } else {
           tensordotRz_result.col(l * l + j) =
               M.col(l * l + j).cwiseProduct(cosmt.col(l * l + j)) +
@@ -590,9 +681,11 @@ public:
   Computes the gradient of the tensor dot product M . Rz(theta).
 
   */
-  template <typename T1, bool M_IS_ROW_VECTOR = (T1::RowsAtCompileTime == 1)>
-  inline void tensordotRz(const MatrixBase<T1> &M, const Vector<Scalar> &theta,
-                          const Matrix<Scalar> &bMRz) {
+  template <typename T1, typename T2,
+            bool M_IS_ROW_VECTOR = (T1::RowsAtCompileTime == 1)>
+  inline void tensordotRz(const MatrixBase<T1> &M,
+                          const VectorRef<Scalar> &theta,
+                          const MatrixBase<T2> &bMRz) {
     // Shape checks
     size_t npts = theta.size();
     size_t Nr = M.cols();
@@ -616,8 +709,8 @@ public:
 
         // d / dtheta
         if (M_IS_ROW_VECTOR) {
-          tensordotRz_btheta +=
-              (j - l) * (M(l * l + 2 * l - j) * tmp_c - M(l * l + j) * tmp_s);
+          tensordotRz_btheta += (j - l) * (M(0, l * l + 2 * l - j) * tmp_c -
+                                           M(0, l * l + j) * tmp_s);
         } else {
           tensordotRz_btheta +=
               (j - l) * (M.col(l * l + 2 * l - j).cwiseProduct(tmp_c) -
@@ -754,7 +847,8 @@ public:
 
   */
   template <typename T1, bool M_IS_ROW_VECTOR = (T1::RowsAtCompileTime == 1)>
-  inline void tensordotDz(const MatrixBase<T1> &M, const Vector<Scalar> &theta_,
+  inline void tensordotDz(const MatrixBase<T1> &M,
+                          const VectorRef<Scalar> &theta_,
                           const Scalar &alpha) {
 
     size_t npts = theta_.size();
@@ -787,9 +881,11 @@ public:
   Computes the gradient of the tensor dot product M . Dz(theta).
 
   */
-  template <typename T1, bool M_IS_ROW_VECTOR = (T1::RowsAtCompileTime == 1)>
-  inline void tensordotDz(const MatrixBase<T1> &M, const Vector<Scalar> &theta,
-                          const Scalar &alpha, const Matrix<Scalar> &bMDz) {
+  template <typename T1, typename T2,
+            bool M_IS_ROW_VECTOR = (T1::RowsAtCompileTime == 1)>
+  inline void tensordotDz(const MatrixBase<T1> &M,
+                          const VectorRef<Scalar> &theta, const Scalar &alpha,
+                          const MatrixBase<T2> &bMDz) {
 
     // Initialize
     tensordotDz_bM.setZero(theta.size(), Ny);
@@ -802,7 +898,7 @@ public:
 
       // Backprop through the rotation operator to get `tensordotRz_bM`
       fac = (1 - alpha * mag(i));
-      tensordotRz(M, theta * fac, bMDz * T[i].transpose());
+      tensordotRz(M, theta * fac, (bMDz * T[i].transpose()).eval());
 
       // Apply the differential transform
       tensordotDz_bM += tensordotRz_bM;
@@ -1,18 +1,12 @@
 # -*- coding: utf-8 -*-
 import numpy as np
-from scipy.optimize import minimize
-import theano
+from scipy.optimize import OptimizeResult
 from theano import gof
 import theano.tensor as tt
-from theano.configparser import change_flags
+from ... import config
 
-try:
-    import healpy as hp
-except ImportError:
-    hp = None
 
-
-__all__ = ["minimizeOp", "LDPhysicalOp"]
+__all__ = ["minimizeOp", "positivityOp", "LDPhysicalOp"]
 
 
 class minimizeOp(tt.Op):
@@ -21,101 +15,24 @@ class minimizeOp(tt.Op):
     Returns the tuple `(lat, lon, I)`.
 
     .. note::
-        This op is not very optimized. The idea here is to
-        do a coarse grid search, find the minimum, then run
-        a quick gradient descent to refine the result.
+        The search is done entirely in C++: the map is evaluated on
+        a quasi-uniform grid, and the lowest `ntries` (non-adjacent)
+        grid points are refined with Newton's method on the sphere
+        using the analytic gradient and Hessian of the intensity.
+        The refinements are spread over `config.nthreads` threads.
     """
 
-    def __init__(self, intensity, P, ydeg, udeg, fdeg):
-        self.intensity = intensity
-        self.P = P
-        self.ydeg = ydeg
-        self.udeg = udeg
-        self.fdeg = fdeg
-        self._do_setup = True
+    def __init__(self, func, norm=1.0):
+        self.func = func
+        self.norm = norm
         self.oversample = 1
         self.ntries = 1
         self.result = None
 
     def setup(self, oversample=1, ntries=1):
+        self.oversample = oversample
         self.ntries = ntries
 
-        # Don't setup unless the user actually calls this function,
-        # since there's quite a bit of overhead
-        if self._do_setup or (oversample != self.oversample):
-
-            self.oversample = oversample
-
-            # Create the grid using healpy if available
-            # Require at least `oversample * l ** 2 points`
-            s = np.random.RandomState(0)
-            if hp is None:
-                npts = oversample * self.ydeg ** 2
-                self.lat_grid = (
-                    np.arccos(2 * s.rand(npts) - 1) * 180.0 / np.pi - 90.0
-                )
-                self.lon_grid = (s.rand(npts) - 0.5) * 360
-            else:
-                nside = 1
-                while hp.nside2npix(nside) < oversample * self.ydeg ** 2:
-                    nside += 1
-                theta, phi = hp.pix2ang(
-                    nside=nside, ipix=range(hp.nside2npix(nside))
-                )
-                self.lat_grid = 0.5 * np.pi - theta
-                self.lon_grid = phi - np.pi
-                # Add a little noise for stability
-                self.lat_grid += 1e-4 * s.randn(len(self.lat_grid))
-                self.lon_grid += 1e-4 * s.randn(len(self.lon_grid))
-            self.P_grid = self.P(
-                tt.as_tensor_variable(self.lat_grid),
-                tt.as_tensor_variable(self.lon_grid),
-            ).eval()
-
-            # Set up the cost & grad function for the nonlinear solver
-            u0 = np.zeros(self.udeg + 1)
-            u0[0] = -1.0
-            u0 = tt.as_tensor_variable(u0)
-            f0 = np.zeros((self.fdeg + 1) ** 2)
-            f0[0] = np.pi
-            f0 = tt.as_tensor_variable(f0)
-            latlon = tt.dvector()
-            y = tt.dvector()
-            with change_flags(compute_test_value="off"):
-                self.I = theano.function(
-                    [latlon, y],
-                    [
-                        self.intensity(
-                            latlon[0],
-                            latlon[1],
-                            y,
-                            u0,
-                            f0,
-                            0.0,
-                            0.0,
-                            np.inf,
-                            0.0,
-                            0.0,
-                        )[0],
-                        *theano.grad(
-                            self.intensity(
-                                latlon[0],
-                                latlon[1],
-                                y,
-                                u0,
-                                f0,
-                                0.0,
-                                0.0,
-                                np.inf,
-                                0.0,
-                                0.0,
-                            )[0],
-                            [latlon],
-                        ),
-                    ],
-                )
-            self._do_setup = False
-
     def make_node(self, *inputs):
         inputs = [tt.as_tensor_variable(i) for i in inputs]
         outputs = [
@@ -129,69 +46,99 @@ class minimizeOp(tt.Op):
         return [(), (), ()]
 
     def perform(self, node, inputs, outputs):
+        lat, lon, I, nit, success = self.func(
+            inputs[0], self.oversample, self.ntries, config.nthreads
+        )
+        outputs[0][0] = np.array(lat)
+        outputs[1][0] = np.array(lon)
+        outputs[2][0] = np.array(self.norm * I)
 
-        assert self._do_setup is False, "Must run `setup()` first."
+        # Save
+        self.result = OptimizeResult(
+            x=np.array([lat, lon]),
+            fun=self.norm * I,
+            nit=nit,
+            success=success,
+        )
 
-        y = inputs[0]
 
-        # Initial guess
-        I_grid = np.dot(self.P_grid, y)
-        outputs[2][0] = np.inf
+class positivityOp(tt.Op):
+    """Check whether the map intensity is positive everywhere.
 
-        for n in range(self.ntries):
+    Returns the tuple `(status, lat, lon, I)`, where `status` is 1 if the
+    intensity is provably positive, -1 if a point of negative intensity
+    was found, and 0 if the result is inconclusive. The remaining
+    outputs are the location and intensity of the point of negative
+    intensity, or of the lowest point found.
 
-            ind = np.argmin(I_grid)
-            x0 = np.array([self.lat_grid[ind], self.lon_grid[ind]])
+    """
 
-            # Minimize
-            result = minimize(self.I, x0, args=(y,), jac=True)
+    def __init__(self, func, norm=1.0):
+        self.func = func
+        self.norm = norm
+        self.maxdepth = 20
+        self.nthreads = 1
+        self.ncells = None
 
-            if result.fun < outputs[2][0]:
-                outputs[0][0] = result.x[0]
-                outputs[1][0] = result.x[1]
-                outputs[2][0] = result.fun
+    def setup(self, maxdepth=20, nthreads=1):
+        self.maxdepth = maxdepth
+        self.nthreads = nthreads
 
-            # Prepare for next iteration
-            I_grid[ind] = np.inf
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [
+            tt.bscalar(),
+            tt.TensorType(inputs[0].dtype, ())(),
+            tt.TensorType(inputs[0].dtype, ())(),
+            tt.TensorType(inputs[0].dtype, ())(),
+        ]
+        return gof.Apply(self, inputs, outputs)
 
-        # Save
-        self.result = result
+    def infer_shape(self, node, shapes):
+        return [(), (), (), ()]
+
+    def perform(self, node, inputs, outputs):
+        status, lat, lon, I, self.ncells = self.func(
+            inputs[0], self.maxdepth, self.nthreads
+        )
+        outputs[0][0] = np.array(status, dtype="int8")
+        outputs[1][0] = np.array(lat)
+        outputs[2][0] = np.array(lon)
+        outputs[3][0] = np.array(self.norm * I)
 
 
 class LDPhysicalOp(tt.Op):
     """
     Check whether a limb darkening profile is physical using Sturm's theorem.
 
+    The input may be a single vector of limb darkening coefficients or a
+    matrix of shape `(nsamples, udeg + 1)`, in which case the output is a
+    mask with one entry per row. The check itself is done in C++, with
+    the rows spread over `config.nthreads` threads.
+
     """
 
-    def __init__(self, nroots):
-        self.nroots = nroots
+    def __init__(self, limbdark_is_physical):
+        self.limbdark_is_physical = limbdark_is_physical
 
     def make_node(self, *inputs):
         inputs = [tt.as_tensor_variable(i) for i in inputs]
-        outputs = [tt.bscalar()]
+        if inputs[0].ndim == 1:
+            outputs = [tt.bscalar()]
+        else:
+            outputs = [tt.bvector()]
         return gof.Apply(self, inputs, outputs)
 
     def infer_shape(self, node, shapes):
-        return [()]
+        if node.inputs[0].ndim == 1:
+            return [()]
+        else:
+            return [shapes[0][:1]]
 
     def perform(self, node, inputs, outputs):
-        u = inputs[0]
-        outputs[0][0] = 1
-
-        # Ensure the function is *decreasing* toward the limb
-        if u.sum() < -1:
-            outputs[0][0] = 0
-            return
-
-        # Sturm's theorem on the intensity to ensure positivity
-        p = u[::-1]
-        if self.nroots(p, 0, 1) > 0:
-            outputs[0][0] = 0
-            return
-
-        # Sturm's theorem on the derivative to ensure monotonicity
-        p = (u[1:] * np.arange(1, len(u)))[::-1]
-        if self.nroots(p, 0, 1) > 0:
-            outputs[0][0] = 0
-            return
+        u = np.array(inputs[0], dtype="float64", ndmin=2)
+        physical = self.limbdark_is_physical(u, config.nthreads)
+        if node.inputs[0].ndim == 1:
+            outputs[0][0] = np.array(physical[0], dtype="int8")
+        else:
+            outputs[0][0] = np.array(physical, dtype="int8")
@@ -3,6 +3,7 @@ import numpy as np
 import theano
 from theano import gof
 import theano.tensor as tt
+from ..utils import reuse_output
 
 __all__ = ["pTOp"]
 
@@ -23,7 +24,9 @@ class pTOp(tt.Op):
         return [[shapes[0][0], self.N]]
 
     def perform(self, node, inputs, outputs):
-        outputs[0][0] = self.func(self.deg, *inputs)
+        out = reuse_output(outputs[0], (len(inputs[0]), self.N))
+        self.func(self.deg, *inputs, out=out)
+        outputs[0][0] = out
 
     def grad(self, inputs, gradients):
         return self._grad_op(*(inputs + gradients))
@@ -4,6 +4,7 @@ import numpy as np
 from theano import gof
 import theano.tensor as tt
 import theano.sparse as ts
+from ..utils import reuse_output
 
 __all__ = ["dotROp", "tensordotRzOp", "tensordotDzOp"]
 
@@ -27,7 +28,13 @@ class dotROp(tt.Op):
         return self.grad(inputs, eval_points)
 
     def perform(self, node, inputs, outputs):
-        outputs[0][0] = self.func(*inputs)
+        M = inputs[0]
+        if np.ndim(M) == 2:
+            out = reuse_output(outputs[0], np.shape(M))
+            self.func(*inputs, out=out)
+            outputs[0][0] = out
+        else:
+            outputs[0][0] = self.func(*inputs)
 
     def grad(self, inputs, gradients):
         return self._grad_op(*(inputs + gradients))
@@ -73,7 +80,13 @@ class tensordotRzOp(tt.Op):
         return self.grad(inputs, eval_points)
 
     def perform(self, node, inputs, outputs):
-        outputs[0][0] = self.func(*inputs)
+        M, theta = inputs[:2]
+        if np.ndim(M) == 2:
+            out = reuse_output(outputs[0], (len(theta), np.shape(M)[-1]))
+            self.func(*inputs, out=out)
+            outputs[0][0] = out
+        else:
+            outputs[0][0] = self.func(*inputs)
 
     def grad(self, inputs, gradients):
         return self._grad_op(*(inputs + gradients))
@@ -116,7 +129,13 @@ class tensordotDzOp(tt.Op):
         return self.grad(inputs, eval_points)
 
     def perform(self, node, inputs, outputs):
-        outputs[0][0] = self.func(*inputs)
+        M, theta = inputs[:2]
+        if np.ndim(M) == 2:
+            out = reuse_output(outputs[0], (len(theta), np.shape(M)[-1]))
+            self.func(*inputs, out=out)
+            outputs[0][0] = out
+        else:
+            outputs[0][0] = self.func(*inputs)
 
     def grad(self, inputs, gradients):
         return self._grad_op(*(inputs + gradients))
@@ -7,6 +7,21 @@ import theano.tensor as tt
 __all__ = ["spotYlmOp"]
 
 
+def _batch(amp, sigma, lat, lon):
+    """
+    Cast the spot parameters to the shapes expected by the batched C++
+    routine: ``sigma``, ``lat``, and ``lon`` are vectors with one entry
+    per spot, and ``amp`` has one row per spot and one column per
+    wavelength bin.
+
+    """
+    sigma = np.atleast_1d(sigma)
+    lat = np.atleast_1d(lat)
+    lon = np.atleast_1d(lon)
+    amp = np.reshape(amp, (len(sigma), -1))
+    return amp, sigma, lat, lon
+
+
 class spotYlmOp(tt.Op):
     def __init__(self, func, ydeg, nw):
         self.func = func
@@ -29,7 +44,7 @@ class spotYlmOp(tt.Op):
             return [(self.Ny, self.nw)]
 
     def perform(self, node, inputs, outputs):
-        outputs[0][0] = self.func(*inputs)
+        outputs[0][0] = self.func(*_batch(*inputs))
         if self.nw is None:
             outputs[0][0] = np.reshape(outputs[0][0], -1)
 
@@ -50,7 +65,9 @@ class spotYlmGradientOp(tt.Op):
         return shapes[:-1]
 
     def perform(self, node, inputs, outputs):
-        bamp, bsigma, blat, blon = self.base_op.func(*inputs)
+        bamp, bsigma, blat, blon = self.base_op.func(
+            *_batch(*inputs[:-1]), inputs[-1]
+        )
         outputs[0][0] = np.reshape(bamp, np.shape(inputs[0]))
         outputs[1][0] = np.reshape(bsigma, np.shape(inputs[1]))
         outputs[2][0] = np.reshape(blat, np.shape(inputs[2]))
@@ -0,0 +1,155 @@
+# -*- coding: utf-8 -*-
+import numpy as np
+from theano import gof
+import theano.tensor as tt
+from theano.gradient import DisconnectedType
+
+__all__ = ["OccultationsOp", "KeplerOp", "SystemXOp"]
+
+
+class OccultationsOp(tt.Op):
+    """Find the time indices of all pairwise occultations in a system.
+
+    Returns the tuple `(offsets, idx, occultor)`: the indices at which
+    body `k` is occulted by body `l` are `idx[offsets[p]:offsets[p + 1]]`,
+    where `p = k * nbodies + l` and the primary is body `0`, and `occultor`
+    is the index `l` of the occultor for each entry of `idx`.
+    """
+
+    def __init__(self, func):
+        self.func = func
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.ivector(), tt.ivector(), tt.ivector()]
+        return gof.Apply(self, inputs, outputs)
+
+    def perform(self, node, inputs, outputs):
+        for k, result in enumerate(self.func(*inputs)):
+            outputs[k][0] = np.array(result, dtype="int32").reshape(-1)
+
+    def grad(self, inputs, gradients):
+        # The indices are piecewise constant in the positions
+        return [tt.zeros_like(i) for i in inputs]
+
+
+class KeplerOp(tt.Op):
+    """Compute the sky positions of bodies on Keplerian orbits.
+
+    Returns the tuple `(x, y, z)`, each with one row per time and one
+    column per body.
+    """
+
+    def __init__(self, func):
+        self.func = func
+        self._grad_op = KeplerGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [
+            tt.TensorType(inputs[0].dtype, (False, False))() for i in range(3)
+        ]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return [(shapes[0][0], shapes[1][0]) for i in range(3)]
+
+    def perform(self, node, inputs, outputs):
+        x, y, z = self.func(*inputs)
+        outputs[0][0] = x
+        outputs[1][0] = y
+        outputs[2][0] = z
+
+    def grad(self, inputs, gradients):
+        results = self(*inputs)
+        gradients = [
+            tt.zeros_like(r) if isinstance(g.type, DisconnectedType) else g
+            for r, g in zip(results, gradients)
+        ]
+        return list(self._grad_op(*(inputs + gradients))) + [
+            tt.zeros_like(inputs[-1])
+        ]
+
+
+class KeplerGradientOp(tt.Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:8]]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return shapes[:8]
+
+    def perform(self, node, inputs, outputs):
+        grads = self.base_op.func(*inputs)
+        for k in range(8):
+            outputs[k][0] = np.reshape(grads[k], np.shape(inputs[k]))
+
+
+class SystemXOp(tt.Op):
+    """Compute the flux design matrices of a system in emitted light.
+
+    The inputs are the rotational phases `theta` (one row per body,
+    primary first), the positions `x`, `y`, `z` of the secondaries
+    (one column per secondary), the radii `r`, inclinations `inc` and
+    obliquities `obl` of all bodies, the limb darkening coefficients of
+    the primary (`pri_u`) and of the secondaries (`sec_u`, one row per
+    secondary), the filters of the primary (`pri_f`, one row per filter)
+    and of the secondaries (`sec_f`, one matrix per filter), and the
+    parameters `alpha`, `tau`, `delta` and `amp` of all bodies. The
+    output is the stack of the design matrices for each filter.
+    """
+
+    def __init__(self, func, ncols):
+        self.func = func
+        self.ncols = ncols
+        self._grad_op = SystemXGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.TensorType(inputs[0].dtype, (False, False, False))()]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return [(shapes[9][0], shapes[0][1], self.ncols)]
+
+    def perform(self, node, inputs, outputs):
+        outputs[0][0] = np.array(self.func(*self._unpack(inputs)))
+
+    def _unpack(self, inputs):
+        # The C++ engine takes lists with the coefficients of each body
+        theta, x, y, z, r, inc, obl, pri_u, sec_u, pri_f, sec_f = inputs[:11]
+        u = [pri_u] + list(sec_u)
+        f = [pri_f] + [sec_f[:, i] for i in range(sec_f.shape[1])]
+        return [theta, x, y, z, r, inc, obl, u, f] + list(inputs[11:])
+
+    def grad(self, inputs, gradients):
+        return self._grad_op(*(inputs + gradients))
+
+
+class SystemXGradientOp(tt.Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:-1]]
+        return gof.Apply(self, inputs, outputs)
+
+    def infer_shape(self, node, shapes):
+        return shapes[:-1]
+
+    def perform(self, node, inputs, outputs):
+        bX = list(inputs[-1])
+        args = self.base_op._unpack(inputs[:-1])
+        btheta, bx, by, br, binc, bobl, bu, bf, *bparams = self.base_op.func(
+            *(args + [bX])
+        )
+        grads = [btheta, bx, by, np.zeros_like(inputs[3]), br, binc, bobl]
+        grads += [bu[0], np.array(bu[1:]), bf[0], np.stack(bf[1:], axis=1)]
+        grads += bparams
+        for k, g in enumerate(grads):
+            outputs[k][0] = np.reshape(g, np.shape(inputs[k]))
@@ -6,14 +6,19 @@ import numpy as np
 from theano.configparser import change_flags
 from inspect import getmro
 from functools import wraps
+from contextlib import contextmanager
+from itertools import count
+import hashlib
 import logging
 
 logger = logging.getLogger("starry.ops")
 
-__all__ = ["logger", "autocompile"]
+__all__ = ["logger", "autocompile", "memoize", "no_memoize", "reuse_output"]
 
 
 integers = (int, np.int, np.int16, np.int32, np.int64)
+_memo_ids = count()
+_memo_bypass = [0]
 
 
 def is_theano(*objs):
@@ -132,3 +137,91 @@ def autocompile(func):
             return getattr(instance, cname)(*args)
 
     return wrapper
+
+
+def reuse_output(storage, shape):
+    """
+    Return the array held in the theano output `storage` if the C++ ops
+    can overwrite it in place with a float64 array of shape `shape`;
+    otherwise, return a new (uninitialized) array. Theano allows ops to
+    reuse their output storage from one call to the next, so this spares
+    us allocating (and faulting in) a fresh array every time.
+
+    """
+    out = storage[0]
+    if (
+        isinstance(out, np.ndarray)
+        and out.shape == tuple(shape)
+        and out.dtype == np.float64
+        and out.flags.c_contiguous
+        and out.flags.writeable
+    ):
+        return out
+    return np.empty(shape)
+
+
+def _hash_args(*args):
+    """Return a digest of the numerical arguments `args`."""
+    h = hashlib.blake2b(digest_size=16)
+    for arg in args:
+        if isinstance(arg, np.ndarray):
+            h.update(arg.dtype.str.encode())
+            h.update(str(arg.shape).encode())
+            h.update(np.ascontiguousarray(arg).tobytes())
+        else:
+            h.update(repr(arg).encode())
+    return h.digest()
+
+
+def memoize(func):
+    """
+    Wrap the method `func` (typically a design matrix) and cache its
+    numerical return value, keyed on a hash of its arguments, in the
+    global least-recently-used cache whose memory budget is set
+    by `config.cache_size`. Theano arguments are passed straight through.
+
+    Callers get a copy of the cached value unless they pass ``copy=False``,
+    in which case they get the (read-only) cached array itself. Callers
+    that pass ``compute=False`` only look the value up: on a cache miss
+    they get ``None`` and `func` is not called.
+
+    """
+
+    @wraps(func)
+    def wrapper(instance, *args, copy=True, compute=True):
+
+        if config.cache_size <= 0 or _memo_bypass[0] or is_theano(*args):
+            return func(instance, *args) if compute else None
+
+        # Key on this instance, this method, and the argument values
+        if "_memo_id" not in instance.__dict__:
+            instance._memo_id = next(_memo_ids)
+        key = (instance._memo_id, func.__name__, _hash_args(*args))
+        value = config._memo.get(key)
+        if value is None:
+            if not compute:
+                return None
+            value = func(instance, *args)
+            if isinstance(value, np.ndarray):
+                value.setflags(write=False)
+            config._memo[key] = value
+
+        if copy and isinstance(value, np.ndarray):
+            return np.array(value)
+        return value
+
+    return wrapper
+
+
+@contextmanager
+def no_memoize():
+    """
+    Context manager that bypasses (but does not clear) the design matrix
+    cache, for matrices that will be used once and discarded.
+
+    """
+    _memo_bypass[0] += 1
+    try:
+        yield
+    finally:
+        _memo_bypass[0] -= 1
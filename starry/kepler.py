@@ -1134,12 +1134,14 @@ class System(object):
 
         Args:
             flux (vector): The observed system light curve.
-            C (scalar, vector, or matrix): The data covariance. This may be
-                a scalar, in which case the noise is assumed to be
-                homoscedastic, a vector, in which case the covariance
-                is assumed to be diagonal, or a matrix specifying the full
-                covariance of the dataset. Default is None. Either `C` or
-                `cho_C` must be provided.
+            C (scalar, vector, matrix, or CeleriteCovariance): The data
+                covariance. This may be a scalar, in which case the noise
+                is assumed to be homoscedastic, a vector, in which case the
+                covariance is assumed to be diagonal, a matrix specifying
+                the full covariance of the dataset, or a
+                :py:class:`starry.linalg.CeleriteCovariance` describing a
+                quasiseparable Gaussian process covariance. Default is
+                None. Either `C` or `cho_C` must be provided.
             cho_C (matrix): The lower Cholesky factorization of the data
                 covariance matrix. Defaults to None. Either `C` or
                 `cho_C` must be provided.
@@ -1149,7 +1151,7 @@ class System(object):
             C=C, cho_C=cho_C, N=self._flux.shape[0]
         )
 
-    def solve(self, *, design_matrix=None, t=None):
+    def solve(self, *, design_matrix=None, t=None, chunk_size=None):
         """Solve the least-squares problem for the posterior over maps for all bodies.
 
         This method solves the generalized least squares problem given a system
@@ -1166,6 +1168,12 @@ class System(object):
             t (vector, optional): The vector of times at which to evaluate
                 :py:meth:`design_matrix`, if a design matrix is not provided.
                 Default is None.
+            chunk_size (int, optional): If provided, the design matrix is
+                computed in chunks of this many points in ``t`` and only the
+                normal equations are accumulated, so the memory footprint
+                is independent of the length of the light curve. This
+                requires a scalar or vector data covariance and is only
+                available in greedy mode. Default is None.
 
         Returns:
             The posterior mean for the spherical harmonic \
@@ -1185,28 +1193,18 @@ class System(object):
         if self._flux is None or self._C is None:
             raise ValueError("Please provide a dataset with `set_data()`.")
 
-        # Get the full design matrix
-        if design_matrix is None:
-            assert t is not None, "Please provide a time vector `t`."
-            design_matrix = self.design_matrix(t)
-        X = self._math.cast(design_matrix)
-
-        # Get the data vector
-        f = self._math.cast(self._flux)
-
         # Check for bodies whose priors are set
         self._solved_bodies = []
         inds = []
+        fixed = []
         dense_L = False
         for k, body in enumerate(self._bodies):
 
             if body.map._mu is None or body.map._L is None:
 
-                # Subtract out this term from the data vector,
+                # We'll subtract out this term from the data vector,
                 # since it is fixed
-                f -= body.map.amp * self._math.dot(
-                    X[:, self._inds[k]], body.map.y
-                )
+                fixed.append(k)
 
             else:
 
@@ -1220,9 +1218,6 @@ class System(object):
         if len(self._solved_bodies) == 0:
             raise ValueError("Please provide a prior for at least one body.")
 
-        # Keep only the terms we'll solve for
-        X = X[:, inds]
-
         # Stack our priors
         mu = self._math.concatenate(
             [body.map._mu for body in self._solved_bodies]
@@ -1246,8 +1241,48 @@ class System(object):
                 ]
             )
 
+        def get_terms(X, f):
+            # Subtract the fixed bodies & keep only the terms we'll solve for
+            for k in fixed:
+                f = f - self._bodies[k].map.amp * self._math.dot(
+                    X[:, self._inds[k]], self._bodies[k].map.y
+                )
+            return X[:, inds], f
+
         # Compute the MAP solution
-        self._solution = self._linalg.solve(X, f, self._C.cholesky, mu, LInv)
+        if chunk_size is not None:
+            if self._C.kind not in ["scalar", "vector"]:
+                raise ValueError(
+                    "Chunked solves require a scalar "
+                    "or vector data covariance."
+                )
+            assert t is not None, "Please provide a time vector `t`."
+            t = np.atleast_1d(t)
+            XTCInvX, XTCInvf = self._linalg.normal_equations(
+                lambda n: get_terms(self.design_matrix(t[n]), self._flux[n]),
+                self._C.inverse,
+                len(t),
+                chunk_size,
+            )
+            self._solution = self._linalg.solve_normal(
+                XTCInvX, XTCInvf, mu, LInv
+            )
+        else:
+            # Get the full design matrix
+            if design_matrix is None:
+                assert t is not None, "Please provide a time vector `t`."
+                design_matrix = self.design_matrix(t)
+            X, f = get_terms(
+                self._math.cast(design_matrix), self._math.cast(self._flux)
+            )
+            if self._C.kind == "celerite":
+                self._solution = self._linalg.solve_celerite(
+                    X, f, *self._C.value, mu, LInv
+                )
+            else:
+                self._solution = self._linalg.solve(
+                    X, f, self._C.cholesky, mu, LInv
+                )
 
         # Set all the map vectors
         x, cho_cov = self._solution
@@ -1336,6 +1371,8 @@ class System(object):
                 is not great, so if you're getting strange results try
                 disabling this. It's also a good idea to disable this in the
                 limit of few data points and large spherical harmonic degree.
+                This is ignored for a :py:class:`CeleriteCovariance`, which
+                always uses the Woodbury identity.
 
         Returns:
             lnlike: The log marginal likelihood.
@@ -1391,7 +1428,7 @@ class System(object):
         )
 
         # Compute the likelihood
-        if woodbury:
+        if woodbury or self._C.kind == "celerite":
             if not dense_L:
                 # We can just concatenate vectors
                 LInv = self._math.concatenate(
@@ -1410,6 +1447,10 @@ class System(object):
             lndetL = self._math.cast(
                 [body.map._L.lndet for body in self._solved_bodies]
             )
+            if self._C.kind == "celerite":
+                return self._linalg.lnlike_celerite(
+                    X, f, *self._C.value, mu, LInv, lndetL
+                )
             return self._linalg.lnlike_woodbury(
                 X, f, self._C.inverse, mu, LInv, self._C.lndet, lndetL
             )
@@ -1,9 +1,150 @@
 # -*- coding: utf-8 -*-
 from ._core import math
+from ._core.utils import is_theano
 from . import config
 import numpy as np
 
 
+class CeleriteCovariance(object):
+    r"""A quasiseparable (celerite) data covariance.
+
+    This represents the covariance of a timeseries whose correlated
+    component is described by the celerite kernel
+
+    .. math::
+
+        k(\tau) = \sum_j a_j e^{-c_j \tau} +
+            \sum_k e^{-c_k \tau} \left[
+                a_k \cos(d_k \tau) + b_k \sin(d_k \tau)
+            \right]
+
+    plus a diagonal (white noise) term. Instances of this class may be
+    passed as the ``C`` argument to :py:meth:`starry.Map.set_data`,
+    :py:meth:`starry.System.set_data`, :py:func:`solve`, and
+    :py:func:`lnlike`, in which case the factorization, log determinant
+    and solves involving the data covariance are all computed in
+    :math:`O(N J^2)`, where :math:`J` is the number of (real-valued)
+    terms, instead of :math:`O(N^3)`. The kernel parameters may be
+    ``theano`` tensors, in which case gradients are propagated through
+    the likelihood.
+
+    See `Foreman-Mackey et al. (2017) <https://arxiv.org/abs/1703.09710>`_
+    for details on the kernel and the algorithm.
+
+    Args:
+        t (vector): The times of the observations, in increasing order.
+        a_real (scalar or vector, optional): Amplitudes of the real terms.
+        c_real (scalar or vector, optional): Decay rates of the real terms.
+        a_complex (scalar or vector, optional): Cosine amplitudes of the
+            complex terms.
+        b_complex (scalar or vector, optional): Sine amplitudes of the
+            complex terms. Defaults to zero.
+        c_complex (scalar or vector, optional): Decay rates of the
+            complex terms.
+        d_complex (scalar or vector, optional): Frequencies of the
+            complex terms.
+        diag (scalar or vector, optional): The white noise variance.
+            Defaults to zero.
+    """
+
+    def __init__(
+        self,
+        t,
+        *,
+        a_real=None,
+        c_real=None,
+        a_complex=None,
+        b_complex=None,
+        c_complex=None,
+        d_complex=None,
+        diag=0.0,
+    ):
+        self._real = (a_real is not None) or (c_real is not None)
+        self._complex = (
+            (a_complex is not None)
+            or (b_complex is not None)
+            or (c_complex is not None)
+            or (d_complex is not None)
+        )
+        if self._real and ((a_real is None) or (c_real is None)):
+            raise ValueError(
+                "Both `a_real` and `c_real` must be provided for real terms."
+            )
+        if self._complex and (
+            (a_complex is None) or (c_complex is None) or (d_complex is None)
+        ):
+            raise ValueError(
+                "All of `a_complex`, `c_complex` and `d_complex` "
+                "must be provided for complex terms."
+            )
+        if not (self._real or self._complex):
+            raise ValueError("Please provide at least one celerite term.")
+        if not is_theano(t):
+            t = np.atleast_1d(t)
+            if np.any(np.diff(t) < 0):
+                raise ValueError("The times `t` must be sorted.")
+        self.t = t
+        self.N = t.shape[0]
+        self.a_real = a_real
+        self.c_real = c_real
+        self.a_complex = a_complex
+        self.b_complex = b_complex
+        self.c_complex = c_complex
+        self.d_complex = d_complex
+        self.diag = diag
+
+    def get_celerite_matrices(self, math):
+        """Return the celerite representation ``(a, U, V, P)``.
+
+        The covariance is ``diag(a) + tril(U . V^T) + triu(V . U^T)``,
+        where the off-diagonal terms are damped by the factors ``P``
+        between consecutive observations.
+        """
+        t = math.reshape(math.cast(self.t), [-1])
+        dt = t[1:] - t[:-1]
+        ones = math.ones_like(t)
+        a = math.cast(self.diag) * ones
+        U = []
+        V = []
+        P = []
+
+        # Real terms
+        if self._real:
+            ar = math.reshape(math.cast(self.a_real), [-1])
+            cr = math.reshape(math.cast(self.c_real), [-1])
+            a = a + math.sum(ar)
+            U.append(ones[:, None] * ar[None, :])
+            V.append(ones[:, None] * math.ones_like(ar)[None, :])
+            P.append(math.exp(-cr[None, :] * dt[:, None]))
+
+        # Complex terms
+        if self._complex:
+            ac = math.reshape(math.cast(self.a_complex), [-1])
+            cc = math.reshape(math.cast(self.c_complex), [-1])
+            dc = math.reshape(math.cast(self.d_complex), [-1])
+            if self.b_complex is None:
+                bc = math.zeros_like(ac)
+            else:
+                bc = math.reshape(math.cast(self.b_complex), [-1])
+            a = a + math.sum(ac)
+            cos = math.cos(dc[None, :] * t[:, None])
+            sin = math.sin(dc[None, :] * t[:, None])
+            U.append(ac[None, :] * cos + bc[None, :] * sin)
+            U.append(ac[None, :] * sin - bc[None, :] * cos)
+            V.append(cos)
+            V.append(sin)
+            pc = math.exp(-cc[None, :] * dt[:, None])
+            P.append(pc)
+            P.append(pc)
+
+        return (
+            a,
+            math.concatenate(U, axis=1),
+            math.concatenate(V, axis=1),
+            math.concatenate(P, axis=1),
+        )
+
+
 def solve(
     design_matrix,
     data,
@@ -23,11 +164,13 @@ def solve(
         design_matrix (matrix): The design matrix that transforms a vector
             from coefficient space to data space.
         data (vector): The observed dataset.
-        C (scalar, vector, or matrix): The data covariance. This may be
-            a scalar, in which case the noise is assumed to be
-            homoscedastic, a vector, in which case the covariance
-            is assumed to be diagonal, or a matrix specifying the full
-            covariance of the dataset. Default is None. Either `C` or
+        C (scalar, vector, matrix, or CeleriteCovariance): The data
+            covariance. This may be a scalar, in which case the noise is
+            assumed to be homoscedastic, a vector, in which case the
+            covariance is assumed to be diagonal, a matrix specifying the
+            full covariance of the dataset, or a
+            :py:class:`CeleriteCovariance` describing a quasiseparable
+            Gaussian process covariance. Default is None. Either `C` or
             `cho_C` must be provided.
         cho_C (matrix): The lower Cholesky factorization of the data
             covariance matrix. Defaults to None. Either `C` or
@@ -85,6 +228,10 @@ def solve(
     if mu.ndim == 0:
         mu = mu * _math.ones(N)
     L = _linalg.Covariance(L, cho_L, N=N)
+    if C.kind == "celerite":
+        return _linalg.solve_celerite(
+            design_matrix, data, *C.value, mu, L.inverse
+        )
     return _linalg.solve(design_matrix, data, C.cholesky, mu, L.inverse)
 
 
@@ -108,11 +255,13 @@ def lnlike(
         design_matrix (matrix): The design matrix that transforms a vector
             from coefficient space to data space.
         data (vector): The observed dataset.
-        C (scalar, vector, or matrix): The data covariance. This may be
-            a scalar, in which case the noise is assumed to be
-            homoscedastic, a vector, in which case the covariance
-            is assumed to be diagonal, or a matrix specifying the full
-            covariance of the dataset. Default is None. Either `C` or
+        C (scalar, vector, matrix, or CeleriteCovariance): The data
+            covariance. This may be a scalar, in which case the noise is
+            assumed to be homoscedastic, a vector, in which case the
+            covariance is assumed to be diagonal, a matrix specifying the
+            full covariance of the dataset, or a
+            :py:class:`CeleriteCovariance` describing a quasiseparable
+            Gaussian process covariance. Default is None. Either `C` or
             `cho_C` must be provided.
         cho_C (matrix): The lower Cholesky factorization of the data
             covariance matrix. Defaults to None. Either `C` or
@@ -141,6 +290,8 @@ def lnlike(
             is not great, so if you're getting strange results try
             disabling this. It's also a good idea to disable this in the
             limit of few data points and large number of regressors.
+            This is ignored for a :py:class:`CeleriteCovariance`, which
+            always uses the Woodbury identity.
 
     Returns:
         The log marginal likelihood, a scalar.
@@ -179,7 +330,11 @@ def lnlike(
     if mu.ndim == 0:
         mu = mu * _math.ones(N)
     L = _linalg.Covariance(L, cho_L, N=N)
-    if woodbury:
+    if C.kind == "celerite":
+        return _linalg.lnlike_celerite(
+            design_matrix, data, *C.value, mu, L.inverse, L.lndet
+        )
+    elif woodbury:
         return _linalg.lnlike_woodbury(
             design_matrix, data, C.inverse, mu, L.inverse, C.lndet, L.lndet
         )
@@ -50,6 +50,9 @@ class MapBase(object):
     # The map amplitude (just an attribute)
     amp = Amplitude()
 
+    # Keyword arguments of `design_matrix` that may be vectors over time
+    _time_like_kwargs = ("theta", "xo", "yo", "zo")
+
     def _no_spectral(self):
         if self.nw is not None:  # pragma: no cover
             raise NotImplementedError(
@@ -779,21 +782,38 @@ class MapBase(object):
             kwargs.pop("zs", None)
         self._check_kwargs("show", kwargs)
 
-    def limbdark_is_physical(self):
+    def limbdark_is_physical(self, u=None):
         """Check whether the limb darkening profile (if any) is physical.
 
         This method uses Sturm's theorem to ensure that the limb darkening
         intensity is positive everywhere and decreases monotonically toward
         the limb.
 
+        Args:
+            u (matrix, optional): An array of shape ``(nsamples, udeg + 1)``
+                of limb darkening coefficient vectors laid out like
+                :py:attr:`u` (e.g., posterior samples) to check instead
+                of the map's own coefficients. Default is None.
+
         Returns:
             bool: Whether or not the limb darkening profile is physical.
+            If ``u`` is provided, this is a boolean mask with one entry
+            per sample.
         """
-        result = self.ops.limbdark_is_physical(self.u)
-        if self.lazy:
-            return result
+        if u is None:
+            result = self.ops.limbdark_is_physical(self.u)
+            if self.lazy:
+                return result
+            else:
+                return bool(result)
         else:
-            return bool(result)
+            if not self.lazy:
+                u = np.atleast_2d(np.array(u, dtype="float64"))
+            result = self.ops.limbdark_is_physical(u)
+            if self.lazy:
+                return result
+            else:
+                return np.array(result, dtype=bool)
 
     def set_data(self, flux, C=None, cho_C=None):
         """Set the data vector and covariance matrix.
@@ -805,12 +825,16 @@ class MapBase(object):
 
         Args:
             flux (vector): The observed light curve.
-            C (scalar, vector, or matrix): The data covariance. This may be
-                a scalar, in which case the noise is assumed to be
-                homoscedastic, a vector, in which case the covariance
-                is assumed to be diagonal, or a matrix specifying the full
-                covariance of the dataset. Default is None. Either `C` or
-                `cho_C` must be provided.
+            C (scalar, vector, matrix, or CeleriteCovariance): The data
+                covariance. This may be a scalar, in which case the noise
+                is assumed to be homoscedastic, a vector, in which case the
+                covariance is assumed to be diagonal, a matrix specifying
+                the full covariance of the dataset, or a
+                :py:class:`starry.linalg.CeleriteCovariance` describing a
+                quasiseparable Gaussian process covariance, in which case
+                all operations involving it are linear in the number of
+                data points. Default is None. Either `C` or `cho_C` must
+                be provided.
             cho_C (matrix): The lower Cholesky factorization of the data
                 covariance matrix. Defaults to None. Either `C` or
                 `cho_C` must be provided.
@@ -865,7 +889,7 @@ class MapBase(object):
         self._mu = None
         self._L = None
 
-    def solve(self, *, design_matrix=None, **kwargs):
+    def solve(self, *, design_matrix=None, chunk_size=None, **kwargs):
         """Solve the linear least-squares problem for the posterior over maps.
 
         This method solves the generalized least squares problem given a
@@ -878,6 +902,12 @@ class MapBase(object):
             design_matrix (matrix, optional): The flux design matrix, the
                 quantity returned by :py:meth:`design_matrix`. Default is
                 None, in which case this is computed based on ``kwargs``.
+            chunk_size (int, optional): If provided, the design matrix is
+                computed in chunks of this many data points and only the
+                normal equations are accumulated, so the memory footprint
+                is independent of the length of the light curve. This
+                requires a scalar or vector data covariance and is only
+                available in greedy mode. Default is None.
             kwargs (optional): Keyword arguments to be passed directly to
                 :py:meth:`design_matrix`, if a design matrix is not provided.
 
@@ -899,15 +929,15 @@ class MapBase(object):
         elif self._mu is None or self._L is None:
             raise ValueError("Please provide a prior with `set_prior()`.")
 
-        # Get the design matrix & remove any amplitude weighting
-        if design_matrix is None:
-            design_matrix = self.design_matrix(**kwargs)
-        X = self._math.cast(design_matrix)
-
         # Compute the MAP solution
-        self._solution = self._linalg.solve(
-            X, self._flux, self._C.cholesky, self._mu, self._L.inverse
-        )
+        if chunk_size is not None:
+            self._solution = self._solve_chunked(chunk_size, kwargs)
+        else:
+            # Get the design matrix & remove any amplitude weighting
+            if design_matrix is None:
+                design_matrix = self.design_matrix(**kwargs)
+            X = self._math.cast(design_matrix)
+            self._solution = self._solve(X)
 
         # Set the amplitude and coefficients
         x, _ = self._solution
@@ -917,6 +947,53 @@ class MapBase(object):
         # Return the mean and covariance
         return self._solution
 
+    def _solve(self, X):
+        """Compute the MAP solution given the full design matrix."""
+        if self._C.kind == "celerite":
+            return self._linalg.solve_celerite(
+                X, self._flux, *self._C.value, self._mu, self._L.inverse
+            )
+        else:
+            return self._linalg.solve(
+                X, self._flux, self._C.cholesky, self._mu, self._L.inverse
+            )
+
+    def _solve_chunked(self, chunk_size, kwargs):
+        """Compute the MAP solution by accumulating the normal equations."""
+        if self._C.kind not in ["scalar", "vector"]:
+            raise ValueError(
+                "Chunked solves require a scalar or vector data covariance."
+            )
+        N = self._flux.shape[0]
+
+        # Only these arguments may vary from one data point to the next;
+        # all others (the radii of the occultor and the source) are scalars
+        kwargs = dict(kwargs)
+        for key in self._time_like_kwargs:
+            if np.ndim(kwargs.get(key, 0.0)) > 0:
+                if np.shape(kwargs[key]) != (N,):
+                    raise ValueError(
+                        "Argument `{}` must be a scalar or a vector with "
+                        "one entry per data point.".format(key)
+                    )
+                kwargs[key] = np.asarray(kwargs[key])
+
+        def get_chunk(inds):
+            chunk_kwargs = {
+                key: value[inds]
+                if (key in self._time_like_kwargs and np.ndim(value) > 0)
+                else value
+                for key, value in kwargs.items()
+            }
+            return self.design_matrix(**chunk_kwargs), self._flux[inds]
+
+        XTCInvX, XTCInvf = self._linalg.normal_equations(
+            get_chunk, self._C.inverse, N, chunk_size
+        )
+        return self._linalg.solve_normal(
+            XTCInvX, XTCInvf, self._mu, self._L.inverse
+        )
+
     def lnlike(self, *, design_matrix=None, woodbury=True, **kwargs):
         """Returns the log marginal likelihood of the data given a design matrix.
 
@@ -941,6 +1018,8 @@ class MapBase(object):
                 is not great, so if you're getting strange results try
                 disabling this. It's also a good idea to disable this in the
                 limit of few data points and large spherical harmonic degree.
+                This is ignored for a :py:class:`CeleriteCovariance`, which
+                always uses the Woodbury identity.
             kwargs (optional): Keyword arguments to be passed directly to
                 :py:meth:`design_matrix`, if a design matrix is not provided.
 
@@ -961,7 +1040,16 @@ class MapBase(object):
         X = self._math.cast(design_matrix)
 
         # Compute the likelihood
-        if woodbury:
+        if self._C.kind == "celerite":
+            return self._linalg.lnlike_celerite(
+                X,
+                self._flux,
+                *self._C.value,
+                self._mu,
+                self._L.inverse,
+                self._L.lndet,
+            )
+        elif woodbury:
             return self._linalg.lnlike_woodbury(
                 X,
                 self._flux,
@@ -1655,6 +1743,44 @@ class YlmBase(object):
                 self._amp * I,
             )
 
+    def is_positive(self, maxdepth=20, nthreads=1):
+        """Check whether the map intensity is positive everywhere.
+
+        Unlike :py:meth:`minimize`, which refines the lowest points of a
+        finite grid and can miss narrow regions of negative intensity,
+        this method is rigorous. It recursively subdivides the sphere
+        into spherical triangles, discarding those on which a lower
+        bound on the intensity is positive, until either none are left
+        or it finds a point where the intensity is negative.
+
+        Args:
+            maxdepth (int): Maximum number of times each cell is
+                subdivided. Default 20.
+            nthreads (int): Number of threads to distribute the cells
+                among (all available threads if nonpositive). Default 1.
+
+        Returns:
+            A tuple of the status and the latitude, longitude, and \
+            intensity at a point of negative intensity (or at the lowest \
+            point found, if none). The status is ``1`` if the intensity \
+            is provably positive everywhere, ``-1`` if it is not, and \
+            ``0`` if the result is inconclusive, which happens only if \
+            the minimum intensity is zero or very close to it.
+        """
+        # Not implemented for spectral
+        self._no_spectral()
+
+        self.ops._positivity.setup(maxdepth=maxdepth, nthreads=nthreads)
+        status, lat, lon, I = self.ops.get_positivity(self.y)
+        if not self.lazy:
+            status = int(status)
+        return (
+            status,
+            lat / self._angle_factor,
+            lon / self._angle_factor,
+            self._amp * I,
+        )
+
     def get_pixel_transforms(self, oversample=2, lam=1e-6, eps=1e-6):
         """
         Return several linear operators for pixel transformations.
@@ -2158,6 +2284,7 @@ class ReflectedBase(object):
     """
 
     _ops_class_ = OpsReflected
+    _time_like_kwargs = ("theta", "xs", "ys", "zs", "xo", "yo", "zo")
 
     def reset(self, **kwargs):
         self.roughness = kwargs.pop("roughness", self._math.cast(0.0))
@@ -0,0 +1,94 @@
+# -*- coding: utf-8 -*-
+"""
+Test that the C++ hot paths don't allocate once per timestep.
+
+NOTE: These tests are skipped unless the extension was built with
+``STARRY_COUNT_ALLOCATIONS=1``, which is not the case in a default build.
+The counter is hooked into ``eigen_assert``, so it only sees the
+allocations made by Eigen (dynamic matrices and vectors); allocations by
+the standard library (e.g., ``std::vector``) or by pybind11 are not
+counted. A passing test therefore means that the number of *Eigen*
+allocations does not grow with the length of the timeseries, not that
+there are no allocations at all.
+
+"""
+import numpy as np
+import pytest
+import starry
+from starry import _c_ops
+
+
+pytestmark = pytest.mark.skipif(
+    not hasattr(_c_ops, "allocations"),
+    reason="heap allocations are only counted in builds with "
+    "STARRY_COUNT_ALLOCATIONS=1",
+)
+
+
+def count(func, *args):
+    """Return the number of heap allocations in a call to `func`."""
+    _c_ops.reset_allocations()
+    func(*args)
+    return _c_ops.allocations()
+
+
+@pytest.mark.parametrize("occulted", [False, True])
+@pytest.mark.parametrize("sigr", [0.0, 0.5])
+def test_reflected_allocations(sigr, occulted):
+    """
+    Ensure the reflected light solvers don't allocate once per timestep:
+    the number of allocations in a call must not depend on the
+    length of the timeseries. When `occulted` is set, the occultor
+    overlaps the terminator, so the general occultation path (roots,
+    primitive integrals) is exercised.
+
+    """
+    map = starry.Map(ydeg=3, reflected=True)
+    ops = map.ops._c_ops
+
+    counts = {"rT": [], "sT": [], "bsT": []}
+    for K in [10, 100]:
+        b = np.linspace(-0.9, 0.9, K)
+        theta = np.linspace(0, np.pi, K)
+        if occulted:
+            bo = np.linspace(0.2, 1.0, K)
+            ro = 0.3 * np.ones(K)
+        else:
+            bo = 2.0 * np.ones(K)
+            ro = 0.1 * np.ones(K)
+        bsT = np.ones((K, map.ops._sT.N))
+
+        # Warm up the caches
+        ops.rTReflected(b, sigr)
+        ops.sTReflected(b, theta, bo, ro, sigr, 1)
+        ops.sTReflected(b, theta, bo, ro, sigr, bsT, 1)
+
+        counts["rT"].append(count(ops.rTReflected, b, sigr))
+        counts["sT"].append(count(ops.sTReflected, b, theta, bo, ro, sigr, 1))
+        counts["bsT"].append(
+            count(ops.sTReflected, b, theta, bo, ro, sigr, bsT, 1)
+        )
+
+    assert counts["rT"][0] == counts["rT"][1]
+    assert counts["sT"][0] == counts["sT"][1]
+    assert counts["bsT"][0] == counts["bsT"][1]
+
+
+def test_poly_basis_allocations():
+    """
+    Ensure the polynomial basis doesn't allocate once its scratch space
+    has been sized: a call with new points of the same length, written
+    into a preallocated output, must not touch the heap.
+
+    """
+    map = starry.Map(ydeg=3)
+    ops = map.ops._c_ops
+    npts = 100
+    out = np.empty((npts, (map.deg + 1) ** 2))
+    for k in range(3):
+        x = np.linspace(-0.5, 0.5, npts) * (1 - 0.1 * k)
+        y = np.linspace(-0.4, 0.6, npts) * (1 - 0.2 * k)
+        z = np.sqrt(1 - x ** 2 - y ** 2)
+        n = count(ops.pT, map.deg, x, y, z, out)
+        if k > 0:
+            assert n == 0
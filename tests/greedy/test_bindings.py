@@ -0,0 +1,145 @@
+# -*- coding: utf-8 -*-
+"""
+Tests for the array handling in the C++ bindings.
+
+"""
+import numpy as np
+import pytest
+import starry
+
+
+@pytest.fixture(scope="module")
+def ops():
+    return starry.Map(ydeg=3).ops._c_ops
+
+
+def test_out(ops):
+    """Results written into `out` should match the returned ones."""
+    np.random.seed(0)
+    npts = 50
+    M = np.random.randn(npts, ops.Ny)
+    theta = np.linspace(0, np.pi, npts)
+    x = np.linspace(-0.5, 0.5, npts)
+    y = np.linspace(-0.3, 0.3, npts)
+    z = np.sqrt(1 - x ** 2 - y ** 2)
+    b = np.linspace(-1.5, 1.5, npts)
+    r = np.array([0.1])
+    args = {
+        "dotR": (M, 0.3, 0.4, 0.5, 0.7),
+        "tensordotRz": (M, theta),
+        "pT": (ops.ydeg, x, y, z),
+        "sT": (b, r),
+    }
+    for name, arg in args.items():
+        func = getattr(ops, name)
+        expected = func(*arg)
+        out = np.empty_like(expected, order="C")
+        assert func(*arg, out=out) is None
+        assert np.allclose(out, expected)
+
+    # The wrong output shape is an error, not a reallocation
+    with pytest.raises(ValueError):
+        ops.tensordotRz(M, theta, out=np.empty((npts + 1, ops.Ny)))
+
+
+def test_layouts(ops):
+    """Inputs of any memory layout should give the same results."""
+    np.random.seed(1)
+    npts = 20
+    M = np.random.randn(npts, ops.Ny)
+    theta = np.linspace(0, np.pi, npts)
+    bMRz = np.random.randn(npts, ops.Ny)
+    expected = ops.tensordotRz(M, theta)
+    expected_grad = ops.tensordotRz(M, theta, bMRz)
+    for M_ in [np.asfortranarray(M), np.repeat(M, 2, axis=0)[::2]]:
+        assert np.allclose(ops.tensordotRz(M_, theta), expected)
+        for g, g0 in zip(ops.tensordotRz(M_, theta, bMRz), expected_grad):
+            assert np.allclose(g, g0)
+
+
+def test_incomplete_elliptic_integrals():
+    """The batched elliptic integrals should match the scalar kernels."""
+    from scipy.special import ellipkinc, ellipeinc
+
+    np.random.seed(2)
+    npts = 500
+    tanphi = np.random.uniform(-5, 5, npts)
+    m = np.random.uniform(-3, 0.99, npts)
+
+    # This one makes the Landen sequence in `el2` hit zero
+    tanphi[0] = 2.0
+    m[0] = 0.9375
+
+    # F and E, in one go
+    F, E, dFdt, dFdm, dEdt, dEdm = starry._c_ops.el2(tanphi, m)
+    for i in range(npts):
+        kc = np.sqrt(1 - m[i])
+        F0 = starry._c_ops.el2([tanphi[i]], kc, 1.0, 1.0)[0]
+        E0 = starry._c_ops.el2([tanphi[i]], kc, 1.0, kc ** 2)[0]
+        assert np.allclose([F[i], E[i]], [F0, E0], rtol=0, atol=1e-14)
+    phi = np.arctan(tanphi)
+    assert np.allclose(F, ellipkinc(phi, m))
+    assert np.allclose(E, ellipeinc(phi, m))
+
+    # Their derivatives
+    eps = 1e-7
+    Fp, Ep = starry._c_ops.el2(tanphi + eps, m)[:2]
+    Fm, Em = starry._c_ops.el2(tanphi - eps, m)[:2]
+    assert np.allclose(dFdt, (Fp - Fm) / (2 * eps))
+    assert np.allclose(dEdt, (Ep - Em) / (2 * eps))
+    Fp, Ep = starry._c_ops.el2(tanphi, m + eps)[:2]
+    Fm, Em = starry._c_ops.el2(tanphi, m - eps)[:2]
+    assert np.allclose(dFdm, (Fp - Fm) / (2 * eps))
+    assert np.allclose(dEdm, (Ep - Em) / (2 * eps))
+
+    # Carlson's RJ and its derivatives
+    x, y, z, p = np.random.uniform(0.1, 2.0, (4, npts))
+    RJ, dRJ = starry._c_ops.rj(x, y, z, p)
+    RJ0 = [starry._c_ops.rj(*args) for args in zip(x, y, z, p)]
+    assert np.allclose(RJ, RJ0, rtol=1e-14, atol=0)
+    args = np.array([x, y, z, p])
+    for j in range(4):
+        argsp = np.array(args)
+        argsm = np.array(args)
+        argsp[j] += eps
+        argsm[j] -= eps
+        RJp = starry._c_ops.rj(*argsp)[0]
+        RJm = starry._c_ops.rj(*argsm)[0]
+        assert np.allclose(dRJ[:, j], (RJp - RJm) / (2 * eps))
+
+
+def test_quartic_roots():
+    """The quartic solver should match the companion matrix roots."""
+
+    def check(coeffs, rtol):
+        roots = starry._c_ops.quartic_roots(coeffs)
+        expected = np.roots(coeffs)
+        assert len(roots) == len(expected) == 4
+        for root in expected:
+            dist = np.abs(roots - root)
+            assert np.min(dist) <= rtol * max(1.0, np.abs(root))
+
+    # Generic quartics
+    np.random.seed(3)
+    for coeffs in np.random.randn(100, 5):
+        check(coeffs, 1e-10)
+
+    # A repeated root is only determined to about sqrt(eps)
+    check(np.poly([0.3, 0.3, -0.5, 0.7]), 1e-7)
+
+    # A near-zero leading coefficient (one root near infinity)
+    for eps in [1e-4, 1e-8, 1e-12]:
+        check([eps, 1.0, -0.6, -0.13, 0.042], 1e-10)
+
+    # A near-zero constant term (one root near zero)
+    for eps in [1e-4, 1e-8, 1e-12]:
+        check([1.0, 0.3, -0.6, -0.13, eps], 1e-10)
+
+    # All-complex roots
+    check(np.polymul([1, 0, 1], [1, 2, 5]), 1e-10)
+
+    # A biquadratic
+    check(np.poly([1.0, -1.0, 2.0, -2.0]), 1e-10)
+
+    with pytest.raises(ValueError):
+        starry._c_ops.quartic_roots([1.0, 2.0, 3.0])
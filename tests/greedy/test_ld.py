@@ -36,3 +36,21 @@ def test_quadratic():
     flux2 *= np.sqrt(np.pi) / 2  # add in the starry normalization
 
     assert np.allclose(flux1, flux2)
+
+
+def test_filtered_flux():
+    """Test the matrix-free filtered flux against the design matrix."""
+    np.random.seed(0)
+    map = starry.Map(ydeg=3, udeg=2, inc=75.0, obl=20.0)
+    map[1:, :] = 0.1 * np.random.randn(map.Ny - 1)
+    map[1] = 0.5
+    map[2] = 0.25
+    kwargs = dict(
+        theta=np.linspace(0, 360, 100),
+        xo=np.linspace(-1.5, 1.5, 100),
+        yo=0.3,
+        ro=0.1,
+    )
+    flux1 = map.flux(**kwargs)
+    flux2 = map.design_matrix(**kwargs).dot(map.y) * map.amp
+    assert np.allclose(flux1, flux2)
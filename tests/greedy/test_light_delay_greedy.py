@@ -1,6 +1,7 @@
 # -*- coding: utf-8 -*-
 """Test light travel time delay"""
 import starry
+from starry._constants import c_light
 import numpy as np
 
 
@@ -10,4 +11,24 @@ def test_light_delay():
     sys = starry.System(pri, sec, light_delay=True)
     assert sys.light_delay is True
 
-    # TODO: Add tests here.
+
+def test_retarded_time():
+    """Each body should be seen where it was a light travel time ago."""
+    t = np.linspace(-1.0, 1.0, 100)
+    elements = (
+        np.array([0.1, -0.3]),  # t0
+        np.array([1.0, 3.0]),  # porb
+        np.array([0.2, 0.5]),  # ecc
+        np.array([0.3, 2.0]),  # w
+        np.array([0.5, 0.0]),  # Omega
+        np.array([1.4, 1.5]),  # inc
+        np.array([-500.0, -1500.0]),  # a
+    )
+    x, y, z = starry._c_ops.kepler_position(t, *elements, 1.0 / c_light)
+    for k in range(2):
+        xr, yr, zr = starry._c_ops.kepler_position(
+            t + z[:, k] / c_light, *elements, 0.0
+        )
+        assert np.allclose(x[:, k], xr[:, k])
+        assert np.allclose(y[:, k], yr[:, k])
+        assert np.allclose(z[:, k], zr[:, k])
@@ -27,6 +27,49 @@ def test_minimize():
     assert val_m <= val
 
 
+def test_minimize_threads():
+    # The searches from the starting points are run in parallel,
+    # but the result shouldn't depend on the number of threads
+    map = starry.Map(ydeg=10)
+    map.load("earth")
+    serial = map.ops._c_ops.minimize(map.y, 2, 8, 1)
+    parallel = map.ops._c_ops.minimize(map.y, 2, 8, 4)
+    assert serial == parallel
+
+
+def test_minimize_pole():
+    # The minimum of a dipole map is at the south pole,
+    # where the intensity is a coordinate singularity in lat-lon
+    map = starry.Map(ydeg=3)
+    map[1, -1] = 0.5
+    lat_m, lon_m, val_m = map.minimize()
+    assert np.allclose(lat_m, -90.0)
+    assert np.allclose(val_m, map.intensity(lat=-90.0))
+
+
+def test_positivity():
+    # A map that's positive everywhere
+    np.random.seed(0)
+    map = starry.Map(ydeg=10)
+    map[1:, :] = 0.01 * np.random.randn(map.Ny - 1)
+    status, _, _, _ = map.is_positive()
+    assert status == 1
+
+    # A map with a narrow dark spot that goes negative
+    map = starry.Map(ydeg=15)
+    map.add_spot(intensity=-1.5, sigma=0.05, lat=30, lon=30)
+    status, lat, lon, I = map.is_positive(nthreads=2)
+    assert status == -1
+    assert I < 0
+    assert np.allclose(I, map.intensity(lat=lat, lon=lon))
+
+    # A map whose minimum is exactly zero
+    map = starry.Map(ydeg=1)
+    map[1, 0] = 1 / np.sqrt(3)
+    status, _, _, _ = map.is_positive(maxdepth=10)
+    assert status == 0
+
+
 def test_sturm():
     # Check that we can count the real
     # roots of a polynomial in the range [0, 1]
@@ -56,3 +99,22 @@ def test_limbdark_physical():
     for i in range(500):
         map[1:] = np.random.randn(2)
         assert map.limbdark_is_physical() == is_physical(map.u)
+
+
+def test_limbdark_physical_batched():
+    # The batched check should agree with the single-vector one
+    np.random.seed(1)
+    map = starry.Map(udeg=3)
+    u = np.hstack((-np.ones((1000, 1)), np.random.randn(1000, 3)))
+    mask = map.limbdark_is_physical(u)
+    assert mask.shape == (1000,)
+    assert mask.dtype == bool
+    assert np.any(mask) and not np.all(mask)
+    for i in range(0, 1000, 50):
+        map[1:] = u[i, 1:]
+        assert mask[i] == map.limbdark_is_physical()
+
+    # Multi-threaded evaluation shouldn't change the result
+    assert np.array_equal(
+        starry._c_ops.limbdark_is_physical(u, 4).astype(bool), mask
+    )
@@ -4,6 +4,8 @@ Miscellaneous tests.
 
 """
 import starry
+import pytest
+import numpy as np
 import io
 import logging
 import warnings
@@ -86,3 +88,61 @@ def test_coefficient_numbers():
     assert map.Ny == 9
     assert map.Nu == 4
     assert map.Nf == 1
+
+
+@pytest.mark.parametrize("udeg", [0, 2])
+def test_design_matrix_cache(udeg):
+    """Test the memoization of the design matrix."""
+    memo = starry.config._memo
+    map = starry.Map(ydeg=2, udeg=udeg)
+    map[1, :] = [0.1, 0.2, 0.3]
+    if udeg:
+        map[1:] = [0.4, 0.2]
+    kwargs = dict(theta=np.linspace(0, 90, 50), xo=np.linspace(-1, 1, 50))
+
+    # The first call should miss the cache. Unfiltered maps populate
+    # it; filtered maps take the matrix-free path instead, so we
+    # populate it by computing the design matrix explicitly
+    entries = len(memo)
+    hits, misses = memo.hits, memo.misses
+    flux1 = map.flux(**kwargs)
+    assert memo.misses == misses + 1
+    assert memo.hits == hits
+    if udeg:
+        assert len(memo) == entries
+        assert np.allclose(flux1, map.design_matrix(**kwargs).dot(map.y))
+    assert len(memo) == entries + 1
+    nbytes = memo.nbytes
+    assert nbytes > 0
+
+    # Changing only `y` should hit the cache
+    hits, misses = memo.hits, memo.misses
+    map[2, :] = [0.1, 0.2, 0.3, 0.4, 0.5]
+    flux2 = map.flux(**kwargs)
+    assert memo.hits == hits + 1
+    assert memo.misses == misses
+    assert (len(memo), memo.nbytes) == (entries + 1, nbytes)
+    assert not np.allclose(flux1, flux2)
+    assert np.allclose(flux2, map.design_matrix(**kwargs).dot(map.y))
+
+    # Changing a non-linear parameter should not
+    hits, misses = memo.hits, memo.misses
+    map.obl = 30.0
+    flux3 = map.flux(**kwargs)
+    assert memo.hits == hits
+    assert memo.misses == misses + 1
+    assert len(memo) == entries + (1 if udeg else 2)
+    assert not np.allclose(flux2, flux3)
+
+    # The design matrix we return should be ours to modify
+    X = map.design_matrix(**kwargs)
+    X[:] = 0
+    assert np.allclose(flux3, map.flux(**kwargs))
+
+    # Disabling the cache should clear it
+    cache_size = starry.config.cache_size
+    starry.config.cache_size = 0
+    assert len(memo) == 0
+    assert memo.nbytes == 0
+    assert np.allclose(flux3, map.flux(**kwargs))
+    starry.config.cache_size = cache_size
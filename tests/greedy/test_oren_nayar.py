@@ -135,8 +135,77 @@ def test_approximation(plot=False):
     assert maxabs < 1e-2, maxabs
 
 
+@pytest.mark.parametrize("roughness", [0, 30])
+def test_phase_curve_interpolation(roughness):
+    """
+    Ensure the interpolated phase curve integrals do not depend on
+    the order of the calls or on the roughnesses seen before.
+
+    """
+    np.random.seed(0)
+    y = 0.1 * np.random.randn(35)
+    theta = np.linspace(0, 360, 500)
+    xs = np.cos(np.linspace(0, 2 * np.pi, 500))
+    zs = np.sin(np.linspace(0, 2 * np.pi, 500))
+
+    # In order, on a fresh map
+    map = starry.Map(ydeg=5, reflected=True)
+    map[1:, :] = y
+    map.roughness = roughness
+    flux1 = map.flux(theta=theta, xs=xs, ys=0.1, zs=zs)
+
+    # Reversed, after a single point at a different roughness
+    map = starry.Map(ydeg=5, reflected=True)
+    map[1:, :] = y
+    map.roughness = roughness + 10
+    map.flux(theta=theta[0], xs=xs[0], ys=0.1, zs=zs[0])
+    map.roughness = roughness
+    flux2 = map.flux(theta=theta[::-1], xs=xs[::-1], ys=0.1, zs=zs[::-1])
+    assert np.allclose(flux1, flux2[::-1], rtol=0, atol=1e-14)
+
+
+@pytest.mark.parametrize("roughness", [0, 15, 45, 70])
+def test_phase_curve_interpolation_accuracy(roughness):
+    """
+    Ensure the interpolated phase curve integrals and their derivatives
+    agree with the exact computation.
+
+    """
+    map = starry.Map(ydeg=5, reflected=True)
+    b = np.linspace(-1, 1, 1001)[1:-1]
+    sigr = roughness * np.pi / 180
+    interp = map.ops._c_ops.rTReflected(b, sigr)
+    exact = map.ops._c_ops.rTReflectedExact(b, sigr)
+    for f1, f2 in zip(interp, exact):
+        assert np.allclose(f1, f2, rtol=0, atol=1e-10)
+
+
+def test_phase_curve_short_batch():
+    """
+    Ensure short time series are always evaluated exactly, both before
+    and after a long time series has built the interpolant at the same
+    roughness, so the result does not depend on the order of the calls.
+
+    """
+    map = starry.Map(ydeg=5, reflected=True)
+    b = np.linspace(-1, 1, 12)[1:-1]
+    b_long = np.linspace(-1, 1, 1001)[1:-1]
+    for roughness in [0, 15, 45, 70]:
+        sigr = roughness * np.pi / 180
+        exact = map.ops._c_ops.rTReflectedExact(b, sigr)
+        before = map.ops._c_ops.rTReflected(b, sigr)
+        map.ops._c_ops.rTReflected(b_long, sigr)
+        after = map.ops._c_ops.rTReflected(b, sigr)
+        for f1, f2, f3 in zip(before, after, exact):
+            assert np.array_equal(f1, f3)
+            assert np.array_equal(f2, f3)
+
+
 if __name__ == "__main__":
     starry.config.lazy = False
     test_terminator_continuity()
     test_half_phase_discontinuity()
     test_approximation()
+    test_phase_curve_interpolation(30)
+    test_phase_curve_interpolation_accuracy(30)
+    test_phase_curve_short_batch()
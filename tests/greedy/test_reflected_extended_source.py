@@ -0,0 +1,57 @@
+"""Test the finite size of the illumination source in reflected light."""
+import numpy as np
+import starry
+
+
+def test_extended_source():
+    """
+    Test that the design matrix for an extended source is the average
+    of the point source design matrices over the points on its disk.
+
+    """
+    map = starry.Map(ydeg=2, reflected=True, source_npts=30)
+    np.random.seed(0)
+    map[1:, :] = 0.1 * np.random.randn(map.Ny - 1)
+
+    # A phase curve with a transit in the middle
+    npts = 50
+    phase = np.linspace(0, 2 * np.pi, npts)
+    xs = 20 * np.sin(phase)
+    ys = 5 * np.ones(npts)
+    zs = -20 * np.cos(phase)
+    rs = 3.0
+    xo = np.linspace(-1.5, 1.5, npts)
+    yo = 0.2 * np.ones(npts)
+    zo = np.ones(npts)
+    ro = 0.3
+    flux = map.flux(xs=xs, ys=ys, zs=zs, rs=rs, xo=xo, yo=yo, zo=zo, ro=ro)
+
+    # Brute force: evaluate the point source flux at each point
+    rsrc = np.sqrt(xs ** 2 + ys ** 2 + zs ** 2)
+    Reff = rs * np.sqrt(1 - ((rs - 1) / rsrc) ** 2)
+    dx = Reff[:, None] * map.ops.source_dx.eval()
+    dy = Reff[:, None] * map.ops.source_dy.eval()
+    dz = -np.sqrt(rs ** 2 - dx ** 2 - dy ** 2)
+    npts_src = dx.shape[1]
+    ones = np.ones((1, npts_src))
+    flux_point = map.ops.flux_point_source(
+        np.zeros(npts * npts_src),
+        (xs[:, None] + dx).flatten(),
+        (ys[:, None] + dy).flatten(),
+        (zs[:, None] + dz).flatten(),
+        (xo[:, None] * ones).flatten(),
+        (yo[:, None] * ones).flatten(),
+        (zo[:, None] * ones).flatten(),
+        ro,
+        map._inc,
+        map._obl,
+        map._y,
+        map._u,
+        map._f,
+        map._alpha,
+        map._tau,
+        map._delta,
+        map._sigr,
+    )
+    flux_point = np.mean(flux_point.reshape(npts, npts_src), axis=1)
+    assert np.allclose(flux, map.amp * flux_point)
@@ -390,6 +390,84 @@ def test_theta_poles(res=500, tol=1e-3):
     assert np.all(err < tol)
 
 
+def test_threads():
+    """
+    Test that the multithreaded occultation solution is identical
+    to the serial one.
+
+    """
+    map = starry.Map(ydeg=2, reflected=True)
+    npts = 500
+    b = np.linspace(-1.5, 1.5, npts)
+    theta = np.linspace(-np.pi, np.pi, npts)
+    bo = np.linspace(0.0, 1.5, npts)
+    ro = np.where(np.arange(npts) % 3, 0.1, 2.0)
+    assert np.array_equal(
+        map.ops._sT.func(b, theta, bo, ro, 0.0, 1),
+        map.ops._sT.func(b, theta, bo, ro, 0.0, 4),
+    )
+    bsT = np.random.randn(npts, map.ops._sT.N)
+    serial = map.ops._sT.func(b, theta, bo, ro, 0.0, bsT, 1)
+    parallel = map.ops._sT.func(b, theta, bo, ro, 0.0, bsT, 4)
+    for x, y in zip(serial, parallel):
+        assert np.array_equal(x, y)
+
+
+def test_forward_derivatives():
+    """
+    Test that a scalar occultor radius gives the solution and its forward
+    derivatives, and that they agree with the value-only solution and
+    with finite differences.
+
+    """
+    map = starry.Map(ydeg=2, reflected=True)
+    npts = 100
+    b = np.linspace(-0.9, 0.9, npts)
+    theta = np.linspace(0.1, 1.0, npts)
+    bo = np.linspace(0.3, 1.2, npts)
+    sT, ddb, ddtheta, ddbo, ddro, ddsigr = map.ops._sT.func(
+        b, theta, bo, 0.4, 0.5
+    )
+    assert np.array_equal(sT, map.ops._sT.func(b, theta, bo, [0.4], 0.5))
+    eps = 1e-7
+    sT1, *_ = map.ops._sT.func(b, theta, bo + eps, 0.4, 0.5)
+    assert np.allclose((sT1 - sT) / eps, ddbo, atol=1e-5)
+    sT1, *_ = map.ops._sT.func(b, theta, bo, 0.4 + eps, 0.5)
+    assert np.allclose((sT1 - sT) / eps, ddro, atol=1e-5)
+
+
+@pytest.mark.parametrize("sigr", [0.0, 0.5])
+def test_adaptive_quadrature(sigr):
+    """
+    Test that the tanh-sinh quadrature of the primitive integrals agrees
+    with the fixed Gauss-Legendre rule, and that it is counted.
+
+    """
+    np.random.seed(0)
+    ops = starry.Map(ydeg=3, reflected=True).ops._c_ops
+    npts = 200
+    b = np.random.uniform(-1, 1, npts)
+    theta = np.random.uniform(0, 2 * np.pi, npts)
+    bo = np.random.uniform(0.5, 1.1, npts)
+    ro = np.array([0.4])
+
+    # Tanh-sinh quadrature
+    assert ops.adaptive_quad
+    ops.reset_quad_counters()
+    sT = ops.sTReflected(b, theta, bo, ro, sigr, 1)
+    nevals, nintegrals = ops.quad_counters()
+    assert nintegrals > 0
+    assert nevals > nintegrals
+
+    # Fixed rule
+    ops.adaptive_quad = False
+    ops.reset_quad_counters()
+    sT0 = ops.sTReflected(b, theta, bo, ro, sigr, 1)
+    assert ops.quad_counters()[1] == nintegrals
+    ops.adaptive_quad = True
+    assert np.allclose(sT, sT0, rtol=0, atol=1e-8)
+
+
 # BROKEN: Figure out why the root finder fails here.
 @pytest.mark.xfail
 def test_root_finder():
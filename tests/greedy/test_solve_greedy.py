@@ -108,3 +108,90 @@ def test_lnlike(L, C, woodbury):
     # Verify that we get the correct inclination
     assert incs[np.argmax(ll)] == 60
     assert np.allclose(ll[np.argmax(ll)], 974.221605)  # benchmarked
+
+
+def test_celerite():
+    """Test solve and lnlike with a celerite covariance."""
+    map.set_prior(L=1)
+    map.inc = inc_true
+
+    # A correlated noise model: one real and one complex term
+    t = np.linspace(0, 10, len(flux))
+    kernel = dict(
+        a_real=1e-10,
+        c_real=0.5,
+        a_complex=2e-10,
+        b_complex=1e-11,
+        c_complex=0.3,
+        d_complex=2.0,
+    )
+    tau = np.abs(t[:, None] - t[None, :])
+    C = (
+        kernel["a_real"] * np.exp(-kernel["c_real"] * tau)
+        + np.exp(-kernel["c_complex"] * tau)
+        * (
+            kernel["a_complex"] * np.cos(kernel["d_complex"] * tau)
+            + kernel["b_complex"] * np.sin(kernel["d_complex"] * tau)
+        )
+        + sigma ** 2 * np.eye(len(t))
+    )
+
+    # Dense benchmark
+    map.set_data(flux, C=C)
+    mu0, cho_cov0 = map.solve(**kwargs)
+    ll0 = map.lnlike(woodbury=False, **kwargs)
+
+    # Quasiseparable version
+    map.set_data(
+        flux,
+        C=starry.linalg.CeleriteCovariance(t, diag=sigma ** 2, **kernel),
+    )
+    mu, cho_cov = map.solve(**kwargs)
+    ll = map.lnlike(**kwargs)
+    assert np.allclose(mu, mu0)
+    assert np.allclose(cho_cov, cho_cov0)
+    assert np.allclose(ll, ll0)
+
+
+@pytest.mark.parametrize("C", ["scalar", "vector"])
+def test_solve_chunked(C):
+    """Test that accumulating the normal equations in chunks is exact."""
+    map.set_prior(L=np.ones(map.Ny))
+    map.inc = inc_true
+    if C == "scalar":
+        map.set_data(flux, C=sigma ** 2)
+    else:
+        map.set_data(flux, C=np.linspace(0.5, 2.0, len(flux)) * sigma ** 2)
+    mu0, cho_cov0 = map.solve(**kwargs)
+
+    # The chunks should not end up in the design matrix cache. The
+    # chunk size does not divide the number of points, so the last
+    # chunk is shorter than the others.
+    assert len(flux) % 7 != 0
+    entries = len(starry.config._memo)
+    mu, cho_cov = map.solve(chunk_size=7, **kwargs)
+    assert len(starry.config._memo) == entries
+    assert np.allclose(mu, mu0)
+    assert np.allclose(cho_cov, cho_cov0)
+
+    # Only the time-like arguments are sliced
+    with pytest.raises(ValueError):
+        map.solve(chunk_size=7, **dict(kwargs, xs=xs[:-1]))
+
+
+@pytest.mark.parametrize("chunk_size", [1, 7, 100, 150])
+def test_normal_equations(chunk_size):
+    """Test the chunked normal equations against the unchunked products."""
+    from starry._core.math import greedy_linalg
+
+    np.random.seed(3)
+    N = 100
+    X = np.random.randn(N, 5)
+    f = np.random.randn(N)
+    for CInv in [2.0, np.random.uniform(0.5, 2.0, N)]:
+        XTCInvX, XTCInvf = greedy_linalg.normal_equations(
+            lambda inds: (X[inds], f[inds]), CInv, N, chunk_size
+        )
+        CInvX = X * np.reshape(CInv, (-1, 1))
+        assert np.allclose(XTCInvX, np.dot(X.T, CInvX))
+        assert np.allclose(XTCInvf, np.dot(CInvX.T, f))
@@ -78,3 +78,21 @@ def test_two_spots():
 
     assert not same_intensity(amp=-0.01, relative=True)
     assert not same_intensity(intensity=-0.1, relative=True)
+
+
+def test_batched_spots():
+    """Test that a batch of spots expands to the sum of the individual spots."""
+    map = starry.Map(ydeg=10, nw=2)
+    amp = np.array([[-0.01, -0.02], [0.03, 0.01], [-0.02, 0.02]])
+    sigma = np.array([0.1, 0.15, 0.08])
+    lat = np.array([30.0, -20.0, 0.0]) * np.pi / 180
+    lon = np.array([45.0, 120.0, 0.0]) * np.pi / 180
+    y = map.ops.expand_spot(amp, sigma, lat, lon)
+    y_sum = np.sum(
+        [
+            map.ops.expand_spot(amp[i], sigma[i], lat[i], lon[i])
+            for i in range(len(sigma))
+        ],
+        axis=0,
+    )
+    assert np.allclose(y, y_sum)
@@ -85,3 +85,90 @@ def test_reflected_light():
     flux = sys.flux(t)
 
     # TODO: Add an analytic validation here
+
+
+def test_occultation_indices():
+    """Compare the pruned occultation indices to a brute force search."""
+    np.random.seed(3)
+    nt, nsec = 500, 4
+    t = np.linspace(0, 20, nt)
+    a = 2.0 + np.arange(nsec)
+    phase = 2 * np.pi * np.random.random(nsec)
+    angle = 2 * np.pi * t[:, None] / a ** 1.5 + phase
+    x = a * np.cos(angle)
+    y = 0.05 * a * np.sin(angle)
+    z = a * np.sin(angle)
+    r = np.append(1.0, 0.1 + 0.3 * np.random.random(nsec))
+    offsets, idx, occultor = starry._c_ops.occultations(x, y, z, r)
+
+    # Prepend the primary, which sits at the origin
+    x, y, z = [np.hstack((np.zeros((nt, 1)), q)) for q in (x, y, z)]
+    nbodies = nsec + 1
+    for k in range(nbodies):
+        for l in range(nbodies):
+            p = k * nbodies + l
+            expected = []
+            if k != l:
+                xo = (x[:, l] - x[:, k]) / r[k]
+                yo = (y[:, l] - y[:, k]) / r[k]
+                zo = (z[:, l] - z[:, k]) / r[k]
+                b = np.sqrt(xo ** 2 + yo ** 2)
+                expected = np.where((b < 1.0 + r[l] / r[k]) & (zo > 0))[0]
+            assert np.array_equal(idx[offsets[p] : offsets[p + 1]], expected)
+            assert np.all(occultor[offsets[p] : offsets[p + 1]] == l)
+
+
+@pytest.mark.parametrize("udeg", [0, 2])
+def test_vector_occultor_radius(udeg):
+    """The map ops should accept one occultor radius per cadence."""
+    map = starry.Map(ydeg=2, udeg=udeg)
+    map[1:, :] = 0.1
+    if udeg:
+        map[1:] = [0.4, 0.2]
+    npts = 50
+    xo = np.linspace(-1.5, 1.5, npts)
+    yo = 0.2 * np.ones(npts)
+    zo = np.ones(npts)
+    ro = np.where(np.arange(npts) % 2, 0.1, 0.3)
+    args = (
+        map._inc,
+        map._obl,
+        map._u,
+        map._f,
+        map._alpha,
+        map._tau,
+        map._delta,
+    )
+    X = map.ops.X(np.zeros(npts), xo, yo, zo, ro, *args)
+    for r in [0.1, 0.3]:
+        X0 = map.ops.X(np.zeros(npts), xo, yo, zo, r, *args)
+        assert np.allclose(X[ro == r], X0[ro == r])
+
+
+def test_system_engine():
+    """Compare the C++ system engine to the body-by-body design matrix."""
+    np.random.seed(4)
+    pri = starry.Primary(
+        starry.Map(ydeg=2, udeg=2, inc=80.0, obl=10.0), r=1.0, m=1.0, prot=1.3
+    )
+    pri.map[1:, :] = 0.1 * np.random.randn(pri.map.Ny - 1)
+    pri.map[1:] = [0.4, 0.2]
+    sec1 = starry.Secondary(
+        starry.Map(ydeg=1, udeg=1, inc=60.0), porb=1.0, r=0.2, m=0, prot=0.7
+    )
+    sec1.map[1:, :] = [0.1, 0.2, -0.1]
+    sec1.map[1] = 0.3
+    sec1.map.alpha = 0.2
+    sec2 = starry.Secondary(starry.Map(udeg=1), porb=1.7, r=0.3, m=0)
+    sec2.map[1] = 0.5
+    t = np.linspace(-1.0, 3.0, 1000)
+
+    # The bodies transit, are occulted, and occult each other
+    sys = starry.System(pri, sec1, sec2)
+    assert sys.ops._system_X is not None
+    X = sys.design_matrix(t)
+
+    # Force the body-by-body path
+    sys0 = starry.System(pri, sec1, sec2)
+    sys0.ops._system_X = None
+    assert np.allclose(X, sys0.design_matrix(t))
@@ -5,7 +5,7 @@ import pytest
 import theano
 import numpy as np
 import astropy.units as u
-import exoplanet
+import astropy.constants as c
 
 
 def test_compare_to_map_rv():
@@ -57,8 +57,37 @@ def test_compare_to_map_rv():
     assert np.allclose(rv1, rv2)
 
 
-def test_compare_to_exoplanet():
-    """Ensure we get the same result with `starry` and `exoplanet`.
+def keplerian_rv(t, period, t0, ecc, w, incl, m_planet, m_star):
+    """Reference RV of the star on a Keplerian orbit, in m/s."""
+    # Time of periastron, given that the transit is at `w + f = pi / 2`
+    f0 = np.pi / 2 - w
+    E0 = 2 * np.arctan(np.sqrt((1 - ecc) / (1 + ecc)) * np.tan(f0 / 2))
+    tp = t0 - (E0 - ecc * np.sin(E0)) * period / (2 * np.pi)
+
+    # Solve Kepler's equation by Newton iteration
+    M = 2 * np.pi * (t - tp) / period
+    E = np.array(M)
+    for _ in range(50):
+        E -= (E - ecc * np.sin(E) - M) / (1 - ecc * np.cos(E))
+    f = 2 * np.arctan2(
+        np.sqrt(1 + ecc) * np.sin(E / 2), np.sqrt(1 - ecc) * np.cos(E / 2)
+    )
+
+    # Semi-amplitude
+    m_planet = m_planet * u.Msun
+    m_star = m_star * u.Msun
+    K = (
+        (2 * np.pi * c.G / (period * u.day)) ** (1 / 3)
+        * m_planet
+        * np.sin(incl)
+        / ((m_star + m_planet) ** (2 / 3) * np.sqrt(1 - ecc ** 2))
+    )
+    K = K.to(u.m / u.s).value
+    return K * (np.cos(w + f) + ecc * np.cos(w))
+
+
+def test_compare_to_keplerian():
+    """Ensure the Keplerian RV matches an independent calculation.
     """
     # Define the star
     A = starry.Primary(
@@ -93,17 +122,44 @@ def test_compare_to_exoplanet():
     time = np.linspace(-0.5, 0.5, 1000)
     rv1 = sys.rv(time, keplerian=True)
 
-    # Compute with exoplanet
-    orbit = exoplanet.orbits.KeplerianOrbit(
+    # Compute the reference
+    rv2 = keplerian_rv(
+        time,
         period=1.0,
         t0=0.0,
-        incl=86.0 * np.pi / 180,
         ecc=0.3,
-        omega=60 * np.pi / 180,
+        w=60 * np.pi / 180,
+        incl=86.0 * np.pi / 180,
         m_planet=0.01,
         m_star=1.0,
-        r_star=1.0,
     )
-    rv2 = orbit.get_radial_velocity(time).eval()
 
     assert np.allclose(rv1, rv2)
+
+
+def test_rv_single_pass():
+    """Ensure the single-pass RV matches the ratio of the two fluxes.
+    """
+    map = starry.Map(ydeg=2, udeg=2, rv=True, veq=1e4, alpha=0.3, inc=60)
+    map[1, 0] = 0.5
+    map[2, 1] = 0.1
+    map[1:] = [0.4, 0.2]
+
+    # A transit, with some cadences out of transit
+    npts = 50
+    theta = np.zeros(npts)
+    xo = np.linspace(-1.5, 1.5, npts)
+    yo = 0.3 * np.ones(npts)
+    zo = np.ones(npts)
+    ro = 0.1
+
+    # Compute the two fluxes separately
+    args = (theta, xo, yo, zo, ro, map._inc, map._obl, map._y, map._u)
+    params = (map._alpha, map._tau, map._delta)
+    map._set_RV_filter()
+    Iv = map.ops.flux(*args, map._f, *params)
+    map._unset_RV_filter()
+    I = map.ops.flux(*args, map._f, *params)
+
+    rv = map.rv(xo=xo, yo=yo, zo=zo, ro=ro)
+    assert np.allclose(rv, Iv / I)
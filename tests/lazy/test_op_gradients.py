@@ -7,6 +7,7 @@ import theano
 from theano.tests.unittest_tools import verify_grad
 from theano.configparser import change_flags
 import theano.tensor as tt
+import theano.sparse as ts
 import numpy as np
 import pytest
 import starry
@@ -124,7 +125,7 @@ def test_F(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
         u[0] = -1
         f = np.random.randn(16)
         verify_grad(
-            map.ops.F,
+            lambda u, f: ts.dense_from_sparse(map.ops.F(u, f)),
             (u, f),
             abs_tol=abs_tol,
             rel_tol=rel_tol,
@@ -133,6 +134,148 @@ def test_F(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
         )
 
 
+def test_Fdot(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    with change_flags(compute_test_value="off"):
+        map = starry.Map(ydeg=2, udeg=2, rv=True)
+        np.random.seed(11)
+        u = np.random.randn(3)
+        u[0] = -1
+        f = np.random.randn(16)
+        M = np.random.randn(9, 3)
+        verify_grad(
+            map.ops.Fdot,
+            (u, f, M),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+        )
+
+
+def test_celerite(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    from starry._core.math import _celerite_factor, _celerite_solve
+
+    with change_flags(compute_test_value="off"):
+        np.random.seed(3)
+        N, J = 10, 3
+        a = 10 + np.random.rand(N)
+        U = np.random.randn(N, J)
+        V = np.random.randn(N, J)
+        P = 0.5 + 0.3 * np.random.rand(N - 1, J)
+        Y = np.random.randn(N, 2)
+        verify_grad(
+            lambda *args: tt.concatenate(
+                (
+                    tt.shape_padright(_celerite_factor(*args)[0]),
+                    _celerite_factor(*args)[1],
+                ),
+                axis=1,
+            ),
+            (a, U, V, P),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+        )
+        verify_grad(
+            lambda a, U, V, P, Y: _celerite_solve(
+                U, P, *_celerite_factor(a, U, V, P)[:2], Y
+            ),
+            (a, U, V, P, Y),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+        )
+
+
+def test_kepler(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    from starry._core.ops import KeplerOp
+
+    kepler = KeplerOp(starry._c_ops.kepler_position)
+    with change_flags(compute_test_value="off"):
+        t = np.linspace(-1.0, 1.0, 10)
+        t0 = np.array([0.1, -0.2])
+        porb = np.array([1.0, 2.7])
+        ecc = np.array([0.05, 0.6])
+        w = np.array([0.3, -2.0])
+        Omega = np.array([0.2, 1.0])
+        inc = np.array([1.5, 1.2])
+        a = np.array([-3.0, 5.0])
+        for invc in [0.0, 0.03]:
+            verify_grad(
+                lambda *args: tt.concatenate(kepler(*args, invc), axis=1),
+                (t, t0, porb, ecc, w, Omega, inc, a),
+                abs_tol=abs_tol,
+                rel_tol=rel_tol,
+                eps=eps,
+                n_tests=1,
+            )
+
+
+def test_system_X(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    pri = starry.Primary(starry.Map(ydeg=2, udeg=2))
+    sec = starry.Secondary(starry.Map(ydeg=1, udeg=1), porb=1.0, r=0.3)
+    op = starry.System(pri, sec).ops._system_X
+    with change_flags(compute_test_value="off"):
+        nt = 30
+        x = np.linspace(-1.5, 1.5, nt).reshape(-1, 1)
+        y = 0.2 * np.ones((nt, 1))
+        z = np.where(np.arange(nt) < nt // 2, 1.0, -1.0).reshape(-1, 1)
+        theta = np.vstack((np.linspace(0, 1, nt), np.linspace(0, 2, nt)))
+        r = np.array([1.0, 0.3])
+        inc = np.array([1.2, 1.4])
+        obl = np.array([0.3, -0.2])
+        pri_u = np.array([-1.0, 0.4, 0.2])
+        sec_u = np.array([[-1.0, 0.3]])
+        pri_f = np.array([[np.pi]])
+        sec_f = np.array([[[np.pi]]])
+        tau = np.array([0.5, 0.3])
+        delta = np.array([0.1, 0.0])
+        amp = np.array([1.0, 0.7])
+        for alpha in [0.0, 0.2]:
+
+            def X(theta, x, y, r, inc, obl, pri_u, sec_u, pri_f, sec_f, *args):
+                return op(
+                    theta,
+                    x,
+                    y,
+                    z,
+                    r,
+                    inc,
+                    obl,
+                    pri_u,
+                    sec_u,
+                    pri_f,
+                    sec_f,
+                    np.array([alpha, alpha]),
+                    *args,
+                )
+
+            verify_grad(
+                X,
+                (
+                    theta,
+                    x,
+                    y,
+                    r,
+                    inc,
+                    obl,
+                    pri_u,
+                    sec_u,
+                    pri_f,
+                    sec_f,
+                    tau,
+                    delta,
+                    amp,
+                ),
+                abs_tol=abs_tol,
+                rel_tol=rel_tol,
+                eps=eps,
+                n_tests=1,
+            )
+
+
 def test_pT(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
     with change_flags(compute_test_value="off"):
         map = starry.Map(ydeg=2)
@@ -511,6 +654,23 @@ def test_spot_spectral(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
         )
 
 
+def test_spot_batched(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    with change_flags(compute_test_value="off"):
+        map = starry.Map(ydeg=5, nw=2)
+        amp = [[-0.01, -0.02], [0.03, 0.01], [-0.02, 0.02]]
+        sigma = [0.1, 0.15, 0.08]
+        lat = np.array([30, -20, 0]) * np.pi / 180
+        lon = np.array([45, 120, 0]) * np.pi / 180
+        verify_grad(
+            map.ops.spotYlm,
+            (amp, sigma, lat, lon),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+        )
+
+
 def test_sT_reflected(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
     with change_flags(compute_test_value="off"):
         map = starry.Map(ydeg=2, reflected=True)
@@ -527,3 +687,22 @@ def test_sT_reflected(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
             eps=eps,
             n_tests=1,
         )
+
+
+def test_sT_reflected_extended(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    with change_flags(compute_test_value="off"):
+        map = starry.Map(ydeg=2, reflected=True, source_npts=3)
+        b = np.array([[0.5, 0.4, 0.6], [-0.3, -0.2, -0.25]])
+        theta = np.array([[0.5, 0.45, 0.55], [1.2, 1.1, 1.3]])
+        bo = np.array([0.75, 0.5])
+        ro = np.array([0.5, 0.3])
+        sigr = 30 * np.pi / 180
+        w = np.array([[0.3, 0.25, 0.45], [0.2, 0.5, 0.3]])
+        verify_grad(
+            map.ops._sTExtended,
+            (b, theta, bo, ro, sigr, w),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+        )